@@ -13,8 +13,11 @@ kiavcRequire('game/resources')
 -- animations, etc.), while scaling how much this should be scaled
 -- when presented as an actual window: for instance, we can choose to
 -- work on a 320x200 canvas, but then scale that three times larger.
--- The fps determines how often we draw, so the frames per second: note
--- this only impacts the rendering frequency, NOT the engine speed
+-- The fps determines how often the world is updated, since the engine
+-- advances in fixed steps of 1000/fps milliseconds: drawing follows the
+-- refresh rate of the display when vsync is available (interpolating
+-- what's moving), and the fps value otherwise. Notice this does NOT
+-- impact the engine speed, as movement is in pixels per second.
 setResolution({ width = 320, height = 180, fps = 60, scale = 4 })
 
 -- We can also specify the title of the window
@@ -81,6 +84,14 @@ end)
 onUserInput('F11', function()
 	debugWalkboxes(not isDebuggingWalkboxes())
 end)
+-- Pressing P enables or disables the frame profiler overlay
+onUserInput('P', function()
+	debugProfiler(not isDebuggingProfiler())
+end)
+-- Pressing O enables or disables the overdraw heatmap
+onUserInput('O', function()
+	debugOverdraw(not isDebuggingOverdraw())
+end)
 -- Pressing F12 saves a screenshot
 onUserInput('F12', function()
 	saveScreenshot('screenshot-' .. currentTicks .. '.png')
@@ -165,10 +165,10 @@ Actor = {
 			moveActorTo(self.id, roomId, x, y)
 		end,
 	scale =
-		function(self, scale)
+		function(self, scale, ms)
 			self.scaleFactor = scale
-			-- Tell the engine to use the provided z-plane for the actor
-			scaleActor(self.id, scale)
+			-- Tell the engine to scale the actor, possibly over some time
+			scaleActor(self.id, scale, ms)
 		end,
 	setAlpha =
 		function(self, alpha)
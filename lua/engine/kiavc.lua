@@ -118,6 +118,34 @@ function updateWorld(ticks)
 		cutscene = nil
 		cutsceneEscape = nil
 	end
+	-- Let the engine know when we'll need to awaken a coroutine next,
+	-- so that it can sleep in the meanwhile if nothing else is going on
+	return nextScheduled()
+end
+
+-- Helper function to print the frame timing statistics from the engine
+-- profiler, e.g., from the debugging console
+function printFrameStats()
+	local stats = getFrameStats()
+	local phases = { 'frame', 'input', 'update', 'scripts', 'plugins_update', 'render', 'plugins_render', 'present' }
+	for _, phase in ipairs(phases) do
+		local s = stats[phase]
+		if s ~= nil and s.samples > 0 then
+			kiavcLog(string.format('%-15s p50 %6.2fms, p95 %6.2fms, p99 %6.2fms, max %6.2fms (%d samples)',
+				phase, s.p50, s.p95, s.p99, s.max, s.samples))
+		end
+	end
+end
+
+-- Helper function to print what was drawn in the last frame, e.g.,
+-- from the debugging console, to find out which rooms are too heavy
+function printRenderStats()
+	local s = getRenderStats()
+	if s == false then return end
+	kiavcLog(string.format('%d draw calls, %d sprites, %d texture switches, %d fill rects, %d plugin renders',
+		s.drawCalls, s.sprites, s.textureSwitches, s.fillRects, s.pluginRenders))
+	kiavcLog(string.format('%d drawn, %d culled, %d occluded, %d/%d state changes applied/avoided, %.2fx overdraw',
+		s.drawn, s.culled, s.occluded, s.stateChanges, s.stateChangesAvoided, s.overdraw))
 end
 
 -- Helper function to run a command from the core as a coroutine
@@ -175,6 +203,18 @@ function checkScheduled()
 	end
 end
 
+-- Helper function to find out when the next timed coroutine will be
+-- awakened, if there's any: coroutines are awakened after their time
+function nextScheduled()
+	local nextTicks = nil
+	for _, wakeUp in pairs(scheduled) do
+		if nextTicks == nil or wakeUp + 1 < nextTicks then
+			nextTicks = wakeUp + 1
+		end
+	end
+	return nextTicks
+end
+
 -- Helper function to wait for a specific event
 function waitFor(event)
 	local co = coroutine.running()
@@ -303,10 +303,10 @@ Object = {
 			setObjectUiPosition(self.id, x, y)
 		end,
 	scale =
-		function(self, scale)
+		function(self, scale, ms)
 			self.scaleFactor = scale
-			-- Tell the engine to use the provided z-plane for the object
-			scaleObject(self.id, scale)
+			-- Tell the engine to scale the object, possibly over some time
+			scaleObject(self.id, scale, ms)
 		end,
 	setAlpha =
 		function(self, alpha)
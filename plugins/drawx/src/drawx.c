@@ -198,14 +198,10 @@ static void kiavc_drawx_render(kiavc_plugin_resource *resource, SDL_Renderer *re
 	 * turn to render something as previously requested: this is where
 	 * we can draw stuff, for instance the our simple diagonal lines */
 	if(draw) {
-		/* Take note of the current draw color */
-		Uint8 r = 0, g = 0, b = 0, a = 0;
-		SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
-		/* Draw the two diagonals using the specified color */
-		SDL_SetRenderDrawColor(renderer, 0, color, 255, SDL_ALPHA_OPAQUE);
+		/* Draw the two diagonals using the specified color: we change
+		 * the color via the core, so that it keeps track of the state */
+		kc->set_draw_color(0, color, 255, SDL_ALPHA_OPAQUE);
 		SDL_RenderDrawLine(renderer, 0, 0, width, height);
 		SDL_RenderDrawLine(renderer, width, 0, 0, height);
-		/* We're done, restore the original draw color */
-		SDL_SetRenderDrawColor(renderer, r, g, b, a);
 	}
 }
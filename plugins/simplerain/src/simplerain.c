@@ -269,14 +269,11 @@ static void kiavc_simplerain_render(kiavc_plugin_resource *resource, SDL_Rendere
 	 * turn to render something as previously requested: this is where
 	 * we can draw stuff, for instance the our simple rain cycle */
 	if(raining) {
-		/* Take note of the current draw color */
-		Uint8 r = 0, g = 0, b = 0, a = 0;
-		SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
-		/* Draw rain particles */
+		/* Draw rain particles: we change the color via the core, which
+		 * keeps track of the state and skips redundant changes */
 		int i = 0;
 		for(i=0; i<particles_num; i++) {
-			SDL_SetRenderDrawColor(renderer,
-				(particles + i)->color,
+			kc->set_draw_color((particles + i)->color,
 				(particles + i)->color,
 				(particles + i)->color, 128);
 			if((particles + i)->x >= width)
@@ -290,7 +287,5 @@ static void kiavc_simplerain_render(kiavc_plugin_resource *resource, SDL_Rendere
 			SDL_RenderDrawLine(renderer, (particles + i)->x, (particles + i)->y,
 				(particles + i)->x, (particles + i)->y + 2);
 		}
-		/* We're done, restore the original draw color */
-		SDL_SetRenderDrawColor(renderer, r, g, b, a);
 	}
 }
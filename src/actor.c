@@ -16,12 +16,22 @@
 #include <SDL2/SDL_image.h>
 
 #include "actor.h"
+#include "pool.h"
+
+/* Pool all actors are allocated from */
+static kiavc_pool *actors_pool = NULL;
 
 /* Actor constructor */
 kiavc_actor *kiavc_actor_create(const char *id) {
 	if(!id)
 		return NULL;
-	kiavc_actor *actor = SDL_calloc(1, sizeof(kiavc_actor));
+	if(!actors_pool)
+		actors_pool = kiavc_pool_create(sizeof(kiavc_actor));
+	Uint32 handle = 0;
+	kiavc_actor *actor = kiavc_pool_alloc(actors_pool, &handle);
+	if(!actor)
+		return NULL;
+	actor->handle = handle;
 	actor->res.type = KIAVC_ACTOR;
 	actor->res.fade_alpha = 255;
 	actor->id = SDL_strdup(id);
@@ -33,13 +43,32 @@ kiavc_actor *kiavc_actor_create(const char *id) {
 	return actor;
 }
 
+/* Iterate on all actors, in the order they're stored in memory */
+kiavc_actor *kiavc_actor_next(Uint32 *handle) {
+	return kiavc_pool_next(actors_pool, handle);
+}
+
+/* Update the costume set and animation the actor uses */
+void kiavc_actor_update_animation(kiavc_actor *actor) {
+	if(!actor)
+		return;
+	actor->set = kiavc_costume_get_set(actor->costume, actor->state, false);
+	actor->animation = NULL;
+	if(actor->set && actor->direction >= KIAVC_UP && actor->direction <= KIAVC_RIGHT)
+		actor->animation = actor->set->animations[actor->direction];
+}
+
 /* Actor destructor */
 void kiavc_actor_destroy(kiavc_actor *actor) {
 	if(actor) {
 		SDL_free(actor->id);
 		if(actor->line)
 			kiavc_font_text_destroy(actor->line);
-		SDL_free(actor);
+		kiavc_pool_release(actors_pool, actor->handle);
+		if(actors_pool->items == 0) {
+			kiavc_pool_destroy(actors_pool);
+			actors_pool = NULL;
+		}
 	}
 }
 
@@ -37,36 +37,49 @@ int kiavc_actor_state(const char *state_str);
 /* Helper to stringify an actor state */
 const char *kiavc_actor_state_str(int state);
 
-/* Abstraction of an actor in the KIAVC engine */
+/* Abstraction of an actor in the KIAVC engine: actors are allocated
+ * from a pool, and what the update and render passes need comes first,
+ * while what's only looked at once in a while is at the end */
 typedef struct kiavc_actor {
 	/* Common resource info */
 	kiavc_resource res;
-	/* Unique ID of the actor */
-	char *id;
-	/* Current costume of the actor */
-	kiavc_costume *costume;
-	/* Room this actor is in */
-	kiavc_room *room;
-	/* Walkbox this actor is in */
-	kiavc_pathfinding_walkbox *walkbox;
 	/* Whether the actor is visible */
 	bool visible;
-	/* Walking path for an actor */
-	kiavc_list *path, *step;
 	/* Current state of the actor */
 	int state;
 	/* Current direction of the actor */
 	int direction;
-	/* Scaling of the actor, if needed */
-	float scale;
 	/* Current frame in an actor animation */
 	int frame;
+	/* Scaling of the actor, if needed */
+	float scale;
+	/* Costume set and animation for the current state and direction, which
+	 * are updated any time state, direction or costume change */
+	kiavc_costume_set *set;
+	kiavc_animation *animation;
+	/* Current costume of the actor */
+	kiavc_costume *costume;
+	/* Room this actor is in */
+	kiavc_room *room;
+	/* Walkbox this actor is in */
+	kiavc_pathfinding_walkbox *walkbox;
 	/* Line this actor is saying, if any */
 	kiavc_font_text *line;
+	/* Unique ID of the actor */
+	char *id;
+	/* Walking path for an actor */
+	kiavc_list *path, *step;
+	/* Handle of the actor in the pool */
+	Uint32 handle;
 } kiavc_actor;
 
 /* Actor constructor */
 kiavc_actor *kiavc_actor_create(const char *id);
+/* Iterate on all actors, in the order they're stored in memory: start
+ * with a handle set to 0, and stop when NULL is returned */
+kiavc_actor *kiavc_actor_next(Uint32 *handle);
+/* Update the costume set and animation the actor uses, after a change of state, direction or costume */
+void kiavc_actor_update_animation(kiavc_actor *actor);
 /* Actor destructor */
 void kiavc_actor_destroy(kiavc_actor *actor);
 
@@ -22,6 +22,10 @@
 
 #include "engine.h"
 #include "animation.h"
+#include "atlas.h"
+#include "opaque.h"
+#include "utils.h"
+#include "trace.h"
 
 /* Animation constructor */
 kiavc_animation *kiavc_animation_create(const char *id, const char *path,
@@ -33,6 +37,7 @@ kiavc_animation *kiavc_animation_create(const char *id, const char *path,
 	anim->path = SDL_strdup(path);
 	anim->frames = frames;
 	anim->ms = ms;
+	anim->atlas_page = -1;
 	if(transparency) {
 		anim->transparency = 1;
 		anim->t_r = transparency->r;
@@ -51,9 +56,33 @@ int kiavc_animation_load(kiavc_animation *anim, void *resource, SDL_Renderer *re
 	/* If we have a texture already, do nothing */
 	if(anim->texture)
 		return 0;
+	/* Check if we know which part of the image is opaque: we ignore that
+	 * for color keyed images, since transparency is applied when loading */
+	SDL_Rect *opaque = anim->transparency ? NULL :
+		kiavc_opaque_lookup(kiavc_engine_get_opaque_regions(), anim->path);
+	if(opaque)
+		anim->opaque = *opaque;
+	/* Check if the image is in the texture atlas: color keyed images
+	 * can't use it, though, since transparency is applied when loading */
+	kiavc_atlas_image *image = anim->transparency ? NULL :
+		kiavc_atlas_lookup(kiavc_engine_get_atlas(), anim->path);
+	if(image) {
+		anim->texture = kiavc_atlas_page_load(kiavc_engine_get_atlas(), image->page, renderer);
+		if(anim->texture) {
+			anim->atlas_page = image->page;
+			anim->area = image->rect;
+			anim->w = image->rect.w/anim->frames;
+			anim->h = image->rect.h;
+			SDL_Log("Loaded image: %s (atlas page %d)\n", anim->path, image->page);
+			return 0;
+		}
+		/* Something went wrong, try loading the image on its own */
+	}
 	/* Load the image */
+	kiavc_trace_begin("load_image", anim->path);
 	SDL_Surface *loaded = IMG_Load_RW(kiavc_engine_open_file(anim->path), 1);
 	if(!loaded) {
+		kiavc_trace_end();
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error loading image: %s\n", IMG_GetError());
 		kiavc_animation_unload(anim, resource);
 		return -2;
@@ -61,9 +90,16 @@ int kiavc_animation_load(kiavc_animation *anim, void *resource, SDL_Renderer *re
 	if(anim->transparency)
 		SDL_SetColorKey(loaded, SDL_TRUE, SDL_MapRGB(loaded->format, anim->t_r, anim->t_g, anim->t_b));
 	anim->texture = SDL_CreateTextureFromSurface(renderer, loaded);
+	if(anim->texture)
+		kiavc_engine_texture_created(anim->texture, loaded);
 	anim->w = loaded->w/anim->frames;
 	anim->h = loaded->h;
+	anim->area.x = 0;
+	anim->area.y = 0;
+	anim->area.w = loaded->w;
+	anim->area.h = loaded->h;
 	SDL_FreeSurface(loaded);
+	kiavc_trace_end();
 	if(!anim->texture) {
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error creating texture: %s\n", SDL_GetError());
 		kiavc_animation_unload(anim, resource);
@@ -73,6 +109,46 @@ int kiavc_animation_load(kiavc_animation *anim, void *resource, SDL_Renderer *re
 	return 0;
 }
 
+/* Helper to map a clip rect in the animation to the actual area in
+ * the texture, adjusting the target rect if the clip had to be cut */
+bool kiavc_animation_clip(kiavc_animation *anim, SDL_Rect *clip, SDL_Rect *rect) {
+	if(!anim || !anim->texture)
+		return false;
+	/* Make sure we don't go beyond the image, since in an atlas page
+	 * that would mean drawing parts of other images */
+	if(!kiavc_clip_rect(anim->area.w, anim->area.h, clip, rect))
+		return false;
+	clip->x += anim->area.x;
+	clip->y += anim->area.y;
+	return true;
+}
+
+/* Helper to find out which part of the target rect will be fully opaque */
+bool kiavc_animation_opaque(kiavc_animation *anim, const SDL_Rect *clip, const SDL_Rect *rect, SDL_Rect *opaque) {
+	if(!anim || !anim->texture || !clip || !rect || !opaque || anim->opaque.w <= 0 || anim->opaque.h <= 0 ||
+			clip->w <= 0 || clip->h <= 0)
+		return false;
+	SDL_Rect area = anim->opaque, covered = { 0 };
+	area.x += anim->area.x;
+	area.y += anim->area.y;
+	if(!SDL_IntersectRect(&area, clip, &covered))
+		return false;
+	/* Map the opaque area to the target rect, rounding inwards */
+	float sx = (float)rect->w / (float)clip->w;
+	float sy = (float)rect->h / (float)clip->h;
+	int x1 = rect->x + (int)SDL_ceilf((covered.x - clip->x) * sx);
+	int y1 = rect->y + (int)SDL_ceilf((covered.y - clip->y) * sy);
+	int x2 = rect->x + (int)SDL_floorf((covered.x + covered.w - clip->x) * sx);
+	int y2 = rect->y + (int)SDL_floorf((covered.y + covered.h - clip->y) * sy);
+	if(x2 <= x1 || y2 <= y1)
+		return false;
+	opaque->x = x1;
+	opaque->y = y1;
+	opaque->w = x2 - x1;
+	opaque->h = y2 - y1;
+	return true;
+}
+
 /* Animation image de-initialization */
 void kiavc_animation_unload(kiavc_animation *anim, void *resource) {
 	if(!anim)
@@ -83,11 +159,19 @@ void kiavc_animation_unload(kiavc_animation *anim, void *resource) {
 		/* This animation is still needed */
 		return;
 	}
-	if(anim->texture) {
+	if(anim->texture && anim->atlas_page >= 0) {
+		/* The texture belongs to the atlas page */
+		kiavc_atlas_page_unload(kiavc_engine_get_atlas(), anim->atlas_page);
+		SDL_Log("Unloaded image: %s\n", anim->path);
+	} else if(anim->texture) {
+		kiavc_engine_texture_destroyed(anim->texture);
 		SDL_DestroyTexture(anim->texture);
 		SDL_Log("Unloaded image: %s\n", anim->path);
 	}
 	anim->texture = NULL;
+	anim->atlas_page = -1;
+	SDL_zero(anim->area);
+	SDL_zero(anim->opaque);
 	anim->w = 0;
 	anim->h = 0;
 }
@@ -21,6 +21,8 @@
 #ifndef __KIAVC_ANIMATION_H
 #define __KIAVC_ANIMATION_H
 
+#include <stdbool.h>
+
 #include <SDL2/SDL.h>
 
 #include "map.h"
@@ -33,8 +35,14 @@ typedef struct kiavc_animation {
 	char *path;
 	/* Color keying, if required */
 	Uint8 transparency, t_r, t_g, t_b;
-	/* Texture of the animation */
+	/* Texture of the animation (may be an atlas page) */
 	SDL_Texture *texture;
+	/* Atlas page the animation is in, or -1 if it has its own texture */
+	int atlas_page;
+	/* Where the frames are in the texture */
+	SDL_Rect area;
+	/* Opaque part of the image, if any (zero size if not known) */
+	SDL_Rect opaque;
 	/* Size of each frame */
 	int w, h;
 	/* Number of frames in the animation */
@@ -50,6 +58,12 @@ kiavc_animation *kiavc_animation_create(const char *id, const char *path,
 	int frames, int ms, SDL_Color *transparency);
 /* Animation image initialization */
 int kiavc_animation_load(kiavc_animation *anim, void *resource, SDL_Renderer *renderer);
+/* Helper to map a clip rect in the animation to the actual area in
+ * the texture, adjusting the target rect if the clip had to be cut */
+bool kiavc_animation_clip(kiavc_animation *anim, SDL_Rect *clip, SDL_Rect *rect);
+/* Helper to find out which part of the target rect will be fully opaque,
+ * when drawing an area of the texture (as returned by the clip helper) */
+bool kiavc_animation_opaque(kiavc_animation *anim, const SDL_Rect *clip, const SDL_Rect *rect, SDL_Rect *opaque);
 /* Animation image de-initialization */
 void kiavc_animation_unload(kiavc_animation *anim, void *resource);
 /* Animation destructor */
@@ -0,0 +1,161 @@
+/*
+ *
+ * KIAVC texture atlas. When creating a BAG archive, kiavc-bag can pack
+ * most images in a few large pages, and save a table telling where each
+ * image ended up: at runtime, animations that are in the atlas share
+ * the texture of their page, rather than each loading their own file,
+ * which means fewer files to open and decode, and fewer texture changes
+ * when rendering. Pages are only loaded when an animation needs them,
+ * and unloaded when no animation is using them anymore.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include <SDL2/SDL_image.h>
+
+#include "engine.h"
+#include "atlas.h"
+#include "trace.h"
+
+/* Image destruction */
+static void kiavc_atlas_image_destroy(kiavc_atlas_image *image) {
+	if(image) {
+		SDL_free(image->path);
+		SDL_free(image);
+	}
+}
+
+/* Import an atlas table */
+kiavc_atlas *kiavc_atlas_import(SDL_RWops *rwops) {
+	if(!rwops)
+		return NULL;
+	Sint64 size = SDL_RWsize(rwops);
+	if(size <= 0) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Invalid atlas table\n");
+		SDL_RWclose(rwops);
+		return NULL;
+	}
+	char *table = SDL_malloc(size + 1);
+	if(SDL_RWread(rwops, table, 1, size) != (size_t)size) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error reading atlas table\n");
+		SDL_free(table);
+		SDL_RWclose(rwops);
+		return NULL;
+	}
+	SDL_RWclose(rwops);
+	table[size] = '\0';
+	kiavc_atlas *atlas = SDL_calloc(1, sizeof(kiavc_atlas));
+	atlas->images = kiavc_map_create((kiavc_map_value_destroy)&kiavc_atlas_image_destroy);
+	/* Parse the table line by line */
+	char *line = table, *next = NULL;
+	int page = 0, x = 0, y = 0, w = 0, h = 0, offset = 0;
+	while(line && *line) {
+		next = SDL_strchr(line, '\n');
+		if(next)
+			*next++ = '\0';
+		offset = 0;
+		if(SDL_sscanf(line, "page %d %n", &page, &offset) == 1 && offset > 0) {
+			if(page != atlas->count) {
+				SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Invalid atlas page %d\n", page);
+				goto error;
+			}
+			kiavc_atlas_page *pages = SDL_realloc(atlas->pages, (atlas->count + 1) * sizeof(kiavc_atlas_page));
+			if(!pages)
+				goto error;
+			atlas->pages = pages;
+			SDL_zerop(&atlas->pages[atlas->count]);
+			atlas->pages[atlas->count].path = SDL_strdup(line + offset);
+			atlas->count++;
+		} else if(SDL_sscanf(line, "image %d %d %d %d %d %n", &page, &x, &y, &w, &h, &offset) == 5 && offset > 0) {
+			if(page < 0 || page >= atlas->count || w <= 0 || h <= 0) {
+				SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Invalid atlas image '%s'\n", line + offset);
+				goto error;
+			}
+			kiavc_atlas_image *image = SDL_calloc(1, sizeof(kiavc_atlas_image));
+			image->path = SDL_strdup(line + offset);
+			image->page = page;
+			image->rect.x = x;
+			image->rect.y = y;
+			image->rect.w = w;
+			image->rect.h = h;
+			kiavc_map_insert(atlas->images, image->path, image);
+		}
+		line = next;
+	}
+	SDL_free(table);
+	SDL_Log("Imported texture atlas (%d pages)\n", atlas->count);
+	return atlas;
+
+error:
+	SDL_free(table);
+	kiavc_atlas_destroy(atlas);
+	return NULL;
+}
+
+/* Find out if and where an image is in the atlas */
+kiavc_atlas_image *kiavc_atlas_lookup(kiavc_atlas *atlas, const char *path) {
+	if(!atlas || !path)
+		return NULL;
+	return kiavc_map_lookup(atlas->images, path);
+}
+
+/* Get the texture of a page, loading it if needed */
+SDL_Texture *kiavc_atlas_page_load(kiavc_atlas *atlas, int page, SDL_Renderer *renderer) {
+	if(!atlas || page < 0 || page >= atlas->count || !renderer)
+		return NULL;
+	kiavc_atlas_page *p = &atlas->pages[page];
+	if(!p->texture) {
+		kiavc_trace_begin("load_image", p->path);
+		SDL_Surface *loaded = IMG_Load_RW(kiavc_engine_open_file(p->path), 1);
+		if(!loaded) {
+			kiavc_trace_end();
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error loading atlas page: %s\n", IMG_GetError());
+			return NULL;
+		}
+		p->texture = SDL_CreateTextureFromSurface(renderer, loaded);
+		if(p->texture)
+			kiavc_engine_texture_created(p->texture, loaded);
+		SDL_FreeSurface(loaded);
+		kiavc_trace_end();
+		if(!p->texture) {
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error creating texture: %s\n", SDL_GetError());
+			return NULL;
+		}
+		SDL_Log("Loaded atlas page: %s\n", p->path);
+	}
+	p->refs++;
+	return p->texture;
+}
+
+/* Release a page, unloading its texture if no one is using it anymore */
+void kiavc_atlas_page_unload(kiavc_atlas *atlas, int page) {
+	if(!atlas || page < 0 || page >= atlas->count)
+		return;
+	kiavc_atlas_page *p = &atlas->pages[page];
+	if(p->refs > 0)
+		p->refs--;
+	if(p->refs == 0 && p->texture) {
+		kiavc_engine_texture_destroyed(p->texture);
+		SDL_DestroyTexture(p->texture);
+		p->texture = NULL;
+		SDL_Log("Unloaded atlas page: %s\n", p->path);
+	}
+}
+
+/* Destroy an atlas */
+void kiavc_atlas_destroy(kiavc_atlas *atlas) {
+	if(!atlas)
+		return;
+	int i = 0;
+	for(i=0; i<atlas->count; i++) {
+		if(atlas->pages[i].texture) {
+			kiavc_engine_texture_destroyed(atlas->pages[i].texture);
+			SDL_DestroyTexture(atlas->pages[i].texture);
+		}
+		SDL_free(atlas->pages[i].path);
+	}
+	SDL_free(atlas->pages);
+	kiavc_map_destroy(atlas->images);
+	SDL_free(atlas);
+}
@@ -0,0 +1,78 @@
+/*
+ *
+ * KIAVC texture atlas. When creating a BAG archive, kiavc-bag can pack
+ * most images in a few large pages, and save a table telling where each
+ * image ended up: at runtime, animations that are in the atlas share
+ * the texture of their page, rather than each loading their own file,
+ * which means fewer files to open and decode, and fewer texture changes
+ * when rendering. The table is a text file in the BAG, with lines that
+ * either describe a page or an image in a page, e.g.:
+ *
+ *	page 0 atlas/page0.png
+ *	image 0 0 0 256 64 ./assets/images/dvwalkd.png
+ *
+ * where an image line contains the page, the position and the size of
+ * the image in the page, and the path of the original image.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_ATLAS_H
+#define __KIAVC_ATLAS_H
+
+#include <SDL2/SDL.h>
+
+#include "map.h"
+
+/* Key of the atlas table in a BAG archive */
+#define KIAVC_ATLAS_TABLE	"atlas/atlas.txt"
+/* Prefix of the keys of atlas pages in a BAG archive */
+#define KIAVC_ATLAS_PAGE	"atlas/page"
+/* Default (and maximum) size of atlas pages */
+#define KIAVC_ATLAS_PAGE_SIZE	2048
+#define KIAVC_ATLAS_PAGE_SIZE_MAX	8192
+/* Empty space to leave around each image in a page */
+#define KIAVC_ATLAS_PADDING	2
+
+/* Atlas page */
+typedef struct kiavc_atlas_page {
+	/* Path to the page image */
+	char *path;
+	/* Texture of the page, if loaded */
+	SDL_Texture *texture;
+	/* How many animations are using this page */
+	int refs;
+} kiavc_atlas_page;
+
+/* Image in the atlas */
+typedef struct kiavc_atlas_image {
+	/* Path of the original image */
+	char *path;
+	/* Page the image is in */
+	int page;
+	/* Where the image is in the page */
+	SDL_Rect rect;
+} kiavc_atlas_image;
+
+/* Texture atlas */
+typedef struct kiavc_atlas {
+	/* Pages */
+	kiavc_atlas_page *pages;
+	int count;
+	/* Images, indexed by their original path */
+	kiavc_map *images;
+} kiavc_atlas;
+
+/* Import an atlas table */
+kiavc_atlas *kiavc_atlas_import(SDL_RWops *rwops);
+/* Find out if and where an image is in the atlas */
+kiavc_atlas_image *kiavc_atlas_lookup(kiavc_atlas *atlas, const char *path);
+/* Get the texture of a page, loading it if needed */
+SDL_Texture *kiavc_atlas_page_load(kiavc_atlas *atlas, int page, SDL_Renderer *renderer);
+/* Release a page, unloading its texture if no one is using it anymore */
+void kiavc_atlas_page_unload(kiavc_atlas *atlas, int page);
+/* Destroy an atlas */
+void kiavc_atlas_destroy(kiavc_atlas *atlas);
+
+#endif
@@ -19,6 +19,7 @@
 #include "engine.h"
 #include "audio.h"
 #include "map.h"
+#include "trace.h"
 
 /* Callback to be notified when playback of a track finishes */
 static SDL_mutex *mutex = NULL;
@@ -75,7 +76,9 @@ int kiavc_audio_load(kiavc_audio *track) {
 		SDL_UnlockMutex(mutex);
 		return 0;
 	}
+	kiavc_trace_begin("load_audio", track->path);
 	track->chunk = Mix_LoadWAV_RW(kiavc_engine_open_file(track->path), 1);
+	kiavc_trace_end();
 	if(track->chunk == NULL) {
 		SDL_UnlockMutex(mutex);
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error loading track track: %s\n", Mix_GetError());
@@ -0,0 +1,157 @@
+/*
+ *
+ * KIAVC sprite batcher. Rather than issuing a separate draw call for
+ * each sprite, sprites are collected as quads in a vertex array and
+ * drawn all at once with SDL_RenderGeometry: since sprites have to be
+ * drawn in z-order, a batch is flushed as soon as a sprite with a
+ * different texture is added, or when something needs to be drawn
+ * outside of the batcher. Alpha is applied per vertex, so sprites of
+ * the same texture with different alpha still end up in the same batch.
+ * With versions of SDL older than 2.0.18, where SDL_RenderGeometry is
+ * not available, sprites are drawn one by one with SDL_RenderCopy.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include "batch.h"
+#include "capture.h"
+
+/* Initial number of quads we can fit in a batch */
+#define KIAVC_BATCH_SIZE	128
+
+/* Helper to make sure we can fit more quads */
+static int kiavc_batch_grow(kiavc_batch *batch, int size) {
+	SDL_Vertex *vertices = SDL_realloc(batch->vertices, size * 4 * sizeof(SDL_Vertex));
+	if(!vertices)
+		return -1;
+	batch->vertices = vertices;
+	int *indices = SDL_realloc(batch->indices, size * 6 * sizeof(int));
+	if(!indices)
+		return -1;
+	batch->indices = indices;
+	/* Indices never change, so we can prepare them in advance */
+	int i = 0;
+	for(i=batch->size; i<size; i++) {
+		batch->indices[i*6] = i*4;
+		batch->indices[i*6 + 1] = i*4 + 1;
+		batch->indices[i*6 + 2] = i*4 + 2;
+		batch->indices[i*6 + 3] = i*4 + 2;
+		batch->indices[i*6 + 4] = i*4 + 1;
+		batch->indices[i*6 + 5] = i*4 + 3;
+	}
+	batch->size = size;
+	return 0;
+}
+
+/* Create a new sprite batcher */
+kiavc_batch *kiavc_batch_create(SDL_Renderer *renderer) {
+	if(!renderer)
+		return NULL;
+	kiavc_batch *batch = SDL_calloc(1, sizeof(kiavc_batch));
+	batch->renderer = renderer;
+	if(kiavc_batch_grow(batch, KIAVC_BATCH_SIZE) < 0) {
+		kiavc_batch_destroy(batch);
+		return NULL;
+	}
+	return batch;
+}
+
+/* Add a sprite to the batch: if the source rect is NULL, the whole texture is used */
+void kiavc_batch_add(kiavc_batch *batch, SDL_Texture *texture, const SDL_Rect *src, const SDL_Rect *dst, Uint8 alpha) {
+	if(!batch || !texture || !dst)
+		return;
+	kiavc_capture_sprite(texture, src, dst, alpha);
+	batch->sprites++;
+	kiavc_batch_bind(batch, texture);
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	if(texture != batch->texture) {
+		/* Different texture, draw what we have so far and start a new batch */
+		kiavc_batch_flush(batch);
+		kiavc_batch_prepare_texture(batch, texture);
+		batch->texture = texture;
+		SDL_QueryTexture(texture, NULL, NULL, &batch->texture_w, &batch->texture_h);
+	}
+	if(batch->count == batch->size && kiavc_batch_grow(batch, batch->size * 2) < 0) {
+		kiavc_batch_flush(batch);
+		batch->texture = texture;
+	}
+	if(batch->texture_w == 0 || batch->texture_h == 0)
+		return;
+	float u1 = 0, v1 = 0, u2 = 1, v2 = 1;
+	if(src) {
+		u1 = (float)src->x / (float)batch->texture_w;
+		v1 = (float)src->y / (float)batch->texture_h;
+		u2 = (float)(src->x + src->w) / (float)batch->texture_w;
+		v2 = (float)(src->y + src->h) / (float)batch->texture_h;
+	}
+	float x1 = dst->x, y1 = dst->y, x2 = dst->x + dst->w, y2 = dst->y + dst->h;
+	SDL_Color color = { .r = 255, .g = 255, .b = 255, .a = alpha };
+	SDL_Vertex *v = &batch->vertices[batch->count * 4];
+	v[0].position.x = x1; v[0].position.y = y1; v[0].tex_coord.x = u1; v[0].tex_coord.y = v1; v[0].color = color;
+	v[1].position.x = x2; v[1].position.y = y1; v[1].tex_coord.x = u2; v[1].tex_coord.y = v1; v[1].color = color;
+	v[2].position.x = x1; v[2].position.y = y2; v[2].tex_coord.x = u1; v[2].tex_coord.y = v2; v[2].color = color;
+	v[3].position.x = x2; v[3].position.y = y2; v[3].tex_coord.x = u2; v[3].tex_coord.y = v2; v[3].color = color;
+	batch->count++;
+#else
+	/* No SDL_RenderGeometry, draw the sprite right away */
+	kiavc_batch_prepare_texture(batch, texture);
+	SDL_SetTextureAlphaMod(texture, alpha);
+	SDL_RenderCopy(batch->renderer, texture, src, dst);
+	batch->draws++;
+#endif
+}
+
+/* Draw all the sprites in the current batch */
+void kiavc_batch_flush(kiavc_batch *batch) {
+	if(!batch)
+		return;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	if(batch->count > 0 && batch->texture) {
+		SDL_RenderGeometry(batch->renderer, batch->texture,
+			batch->vertices, batch->count * 4, batch->indices, batch->count * 6);
+		batch->draws++;
+	}
+#endif
+	batch->count = 0;
+	batch->texture = NULL;
+}
+
+/* Keep track of the texture we're about to draw with: this is also used
+ * for textures drawn outside of the batch, so that switches are only
+ * counted when the texture actually changes, no matter who draws it */
+void kiavc_batch_bind(kiavc_batch *batch, SDL_Texture *texture) {
+	if(!batch || !texture || texture == batch->bound)
+		return;
+	batch->bound = texture;
+	batch->switches++;
+}
+
+/* Make sure a texture is scaled the way the batch draws sprites */
+void kiavc_batch_prepare_texture(kiavc_batch *batch, SDL_Texture *texture) {
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+	if(!batch || !texture)
+		return;
+	SDL_ScaleMode mode = batch->nearest ? SDL_ScaleModeNearest : SDL_ScaleModeLinear, current = mode;
+	if(SDL_GetTextureScaleMode(texture, &current) == 0 && current != mode)
+		SDL_SetTextureScaleMode(texture, mode);
+#endif
+}
+
+/* Reset the batch statistics */
+void kiavc_batch_reset_stats(kiavc_batch *batch) {
+	if(!batch)
+		return;
+	batch->sprites = 0;
+	batch->draws = 0;
+	batch->switches = 0;
+}
+
+/* Destroy a sprite batcher */
+void kiavc_batch_destroy(kiavc_batch *batch) {
+	if(!batch)
+		return;
+	SDL_free(batch->vertices);
+	SDL_free(batch->indices);
+	SDL_free(batch);
+}
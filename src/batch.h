@@ -0,0 +1,59 @@
+/*
+ *
+ * KIAVC sprite batcher. Rather than issuing a separate draw call for
+ * each sprite, sprites are collected as quads in a vertex array and
+ * drawn all at once with SDL_RenderGeometry: since sprites have to be
+ * drawn in z-order, a batch is flushed as soon as a sprite with a
+ * different texture is added, or when something needs to be drawn
+ * outside of the batcher. Alpha is applied per vertex, so sprites of
+ * the same texture with different alpha still end up in the same batch.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_BATCH_H
+#define __KIAVC_BATCH_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+/* Sprite batch */
+typedef struct kiavc_batch {
+	/* Renderer to draw on */
+	SDL_Renderer *renderer;
+	/* Texture of the current batch, and its size */
+	SDL_Texture *texture;
+	int texture_w, texture_h;
+	/* Vertices and indices of the quads in the current batch */
+	SDL_Vertex *vertices;
+	int *indices;
+	/* Number of quads in the current batch, and how many we can fit */
+	int count, size;
+	/* Texture we drew with last */
+	SDL_Texture *bound;
+	/* Whether sprites are scaled with nearest pixel sampling (e.g., because
+	 * the renderer scales everything), rather than with linear filtering */
+	bool nearest;
+	/* How many sprites were added, how many draw calls we made,
+	 * and how many times we had to switch texture */
+	Uint32 sprites, draws, switches;
+} kiavc_batch;
+
+/* Create a new sprite batcher */
+kiavc_batch *kiavc_batch_create(SDL_Renderer *renderer);
+/* Add a sprite to the batch: if the source rect is NULL, the whole texture is used */
+void kiavc_batch_add(kiavc_batch *batch, SDL_Texture *texture, const SDL_Rect *src, const SDL_Rect *dst, Uint8 alpha);
+/* Draw all the sprites in the current batch */
+void kiavc_batch_flush(kiavc_batch *batch);
+/* Keep track of the texture we're about to draw with, counting a switch if it's not the last one */
+void kiavc_batch_bind(kiavc_batch *batch, SDL_Texture *texture);
+/* Make sure a texture is scaled the way the batch draws sprites, before drawing it */
+void kiavc_batch_prepare_texture(kiavc_batch *batch, SDL_Texture *texture);
+/* Reset the batch statistics */
+void kiavc_batch_reset_stats(kiavc_batch *batch);
+/* Destroy a sprite batcher */
+void kiavc_batch_destroy(kiavc_batch *batch);
+
+#endif
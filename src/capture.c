@@ -0,0 +1,447 @@
+/*
+ *
+ * KIAVC render capture. When enabled, everything the engine asks the
+ * renderer to do in a frame is saved as a sequence of commands to a
+ * binary file, which the kiavc-replay tool can play back in a loop.
+ * The file format is very simple: a "KIAVCCAP" header, a version, and
+ * the width and height of the game (16 bits each), followed by a list
+ * of commands, each made of its type (8 bits) and a type specific
+ * payload, all in network byte order. Rects are stored as a flag
+ * (8 bits) telling whether they're set, followed by x, y, w and h
+ * (32 bits each) when they are:
+ *
+ * - texture: id (32 bits), format (32 bits), access (8 bits),
+ *   w (32 bits), h (32 bits), blend mode (32 bits), alpha mod (8 bits);
+ * - forget, target, update: id (32 bits);
+ * - draw color: r, g, b, a (8 bits each);
+ * - blend mode: mode (32 bits);
+ * - viewport, clip, fill: rect;
+ * - scale: scale, in thousandths (32 bits);
+ * - alpha mod: id (32 bits), alpha (8 bits);
+ * - sprite: id (32 bits), src rect, dst rect, alpha (8 bits);
+ * - copy: id (32 bits), src rect, dst rect;
+ * - line: x1, y1, x2, y2 (32 bits each);
+ * - plugin: length (8 bits), name;
+ * - clear, frame: no payload.
+ *
+ * Textures get an ID the first time they're used in a capture, at
+ * which point a texture command is saved to describe them.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include "capture.h"
+
+/* Capture header and version */
+#define KIAVC_CAPTURE_HEADER	"KIAVCCAP"
+#define KIAVC_CAPTURE_VERSION	1
+
+/* Texture we've seen in the current capture */
+typedef struct kiavc_capture_texture {
+	SDL_Texture *texture;
+	Uint32 id;
+} kiavc_capture_texture;
+
+/* Capture state */
+static SDL_RWops *capture_file = NULL;
+static int capture_frames = 0, capture_count = 0;
+static kiavc_capture_texture *textures = NULL;
+static int textures_count = 0, textures_size = 0;
+static Uint32 textures_id = 0;
+
+/* Helpers to write to the file */
+static void kiavc_capture_write_u8(Uint8 value) {
+	SDL_RWwrite(capture_file, &value, sizeof(Uint8), 1);
+}
+static void kiavc_capture_write_u16(Uint16 value) {
+	value = SDL_SwapBE16(value);
+	SDL_RWwrite(capture_file, &value, sizeof(Uint16), 1);
+}
+static void kiavc_capture_write_u32(Uint32 value) {
+	value = SDL_SwapBE32(value);
+	SDL_RWwrite(capture_file, &value, sizeof(Uint32), 1);
+}
+static void kiavc_capture_write_rect(const SDL_Rect *rect) {
+	kiavc_capture_write_u8(rect ? 1 : 0);
+	if(!rect)
+		return;
+	kiavc_capture_write_u32((Uint32)rect->x);
+	kiavc_capture_write_u32((Uint32)rect->y);
+	kiavc_capture_write_u32((Uint32)rect->w);
+	kiavc_capture_write_u32((Uint32)rect->h);
+}
+
+/* Helper to get the ID of a texture, describing it if it's the first time we see it */
+static Uint32 kiavc_capture_texture_id(SDL_Texture *texture) {
+	if(!texture)
+		return 0;
+	int i = 0;
+	for(i=0; i<textures_count; i++) {
+		if(textures[i].texture == texture)
+			return textures[i].id;
+	}
+	if(textures_count == textures_size) {
+		int size = textures_size ? textures_size*2 : 64;
+		kiavc_capture_texture *list = SDL_realloc(textures, size * sizeof(kiavc_capture_texture));
+		if(!list)
+			return 0;
+		textures = list;
+		textures_size = size;
+	}
+	Uint32 format = 0;
+	int access = 0, w = 0, h = 0;
+	SDL_BlendMode blend = SDL_BLENDMODE_NONE;
+	Uint8 alpha = SDL_ALPHA_OPAQUE;
+	SDL_QueryTexture(texture, &format, &access, &w, &h);
+	SDL_GetTextureBlendMode(texture, &blend);
+	SDL_GetTextureAlphaMod(texture, &alpha);
+	textures_id++;
+	textures[textures_count].texture = texture;
+	textures[textures_count].id = textures_id;
+	textures_count++;
+	kiavc_capture_write_u8(KIAVC_CAPTURE_TEXTURE);
+	kiavc_capture_write_u32(textures_id);
+	kiavc_capture_write_u32(format);
+	kiavc_capture_write_u8((Uint8)access);
+	kiavc_capture_write_u32((Uint32)w);
+	kiavc_capture_write_u32((Uint32)h);
+	kiavc_capture_write_u32((Uint32)blend);
+	kiavc_capture_write_u8(alpha);
+	return textures_id;
+}
+
+/* Start capturing */
+int kiavc_capture_start(const char *path, int frames, int w, int h) {
+	if(!path || w < 1 || h < 1)
+		return -1;
+	if(capture_file) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Already capturing\n");
+		return -1;
+	}
+	capture_file = SDL_RWFromFile(path, "wb");
+	if(!capture_file) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error creating capture file '%s': %s\n", path, SDL_GetError());
+		return -1;
+	}
+	SDL_RWwrite(capture_file, KIAVC_CAPTURE_HEADER, 1, SDL_strlen(KIAVC_CAPTURE_HEADER));
+	kiavc_capture_write_u8(KIAVC_CAPTURE_VERSION);
+	kiavc_capture_write_u16((Uint16)w);
+	kiavc_capture_write_u16((Uint16)h);
+	capture_frames = frames > 0 ? frames : KIAVC_CAPTURE_FRAMES;
+	capture_count = 0;
+	textures_count = 0;
+	textures_id = 0;
+	SDL_Log("Capturing %d frames to '%s'\n", capture_frames, path);
+	return 0;
+}
+
+/* Check whether capturing is active */
+bool kiavc_capture_is_enabled(void) {
+	return capture_file != NULL;
+}
+
+/* Take note of render state changes */
+void kiavc_capture_target(SDL_Texture *target) {
+	if(!capture_file)
+		return;
+	Uint32 id = kiavc_capture_texture_id(target);
+	kiavc_capture_write_u8(KIAVC_CAPTURE_TARGET);
+	kiavc_capture_write_u32(id);
+}
+void kiavc_capture_draw_color(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+	if(!capture_file)
+		return;
+	kiavc_capture_write_u8(KIAVC_CAPTURE_DRAW_COLOR);
+	kiavc_capture_write_u8(r);
+	kiavc_capture_write_u8(g);
+	kiavc_capture_write_u8(b);
+	kiavc_capture_write_u8(a);
+}
+void kiavc_capture_blend_mode(SDL_BlendMode blend) {
+	if(!capture_file)
+		return;
+	kiavc_capture_write_u8(KIAVC_CAPTURE_BLEND_MODE);
+	kiavc_capture_write_u32((Uint32)blend);
+}
+void kiavc_capture_viewport(const SDL_Rect *viewport) {
+	if(!capture_file)
+		return;
+	kiavc_capture_write_u8(KIAVC_CAPTURE_VIEWPORT);
+	kiavc_capture_write_rect(viewport);
+}
+void kiavc_capture_clip(const SDL_Rect *clip) {
+	if(!capture_file)
+		return;
+	kiavc_capture_write_u8(KIAVC_CAPTURE_CLIP);
+	kiavc_capture_write_rect(clip);
+}
+void kiavc_capture_scale(float scale) {
+	if(!capture_file)
+		return;
+	kiavc_capture_write_u8(KIAVC_CAPTURE_SCALE);
+	kiavc_capture_write_u32((Uint32)(scale * 1000));
+}
+void kiavc_capture_alpha_mod(SDL_Texture *texture, Uint8 alpha) {
+	if(!capture_file || !texture)
+		return;
+	Uint32 id = kiavc_capture_texture_id(texture);
+	kiavc_capture_write_u8(KIAVC_CAPTURE_ALPHA_MOD);
+	kiavc_capture_write_u32(id);
+	kiavc_capture_write_u8(alpha);
+}
+
+/* Take note of things being drawn */
+void kiavc_capture_sprite(SDL_Texture *texture, const SDL_Rect *src, const SDL_Rect *dst, Uint8 alpha) {
+	if(!capture_file || !texture || !dst)
+		return;
+	Uint32 id = kiavc_capture_texture_id(texture);
+	kiavc_capture_write_u8(KIAVC_CAPTURE_SPRITE);
+	kiavc_capture_write_u32(id);
+	kiavc_capture_write_rect(src);
+	kiavc_capture_write_rect(dst);
+	kiavc_capture_write_u8(alpha);
+}
+void kiavc_capture_copy(SDL_Texture *texture, const SDL_Rect *src, const SDL_Rect *dst) {
+	if(!capture_file || !texture)
+		return;
+	Uint32 id = kiavc_capture_texture_id(texture);
+	kiavc_capture_write_u8(KIAVC_CAPTURE_COPY);
+	kiavc_capture_write_u32(id);
+	kiavc_capture_write_rect(src);
+	kiavc_capture_write_rect(dst);
+}
+void kiavc_capture_fill(const SDL_Rect *rect) {
+	if(!capture_file)
+		return;
+	kiavc_capture_write_u8(KIAVC_CAPTURE_FILL);
+	kiavc_capture_write_rect(rect);
+}
+void kiavc_capture_line(int x1, int y1, int x2, int y2) {
+	if(!capture_file)
+		return;
+	kiavc_capture_write_u8(KIAVC_CAPTURE_LINE);
+	kiavc_capture_write_u32((Uint32)x1);
+	kiavc_capture_write_u32((Uint32)y1);
+	kiavc_capture_write_u32((Uint32)x2);
+	kiavc_capture_write_u32((Uint32)y2);
+}
+void kiavc_capture_clear(void) {
+	if(!capture_file)
+		return;
+	kiavc_capture_write_u8(KIAVC_CAPTURE_CLEAR);
+}
+void kiavc_capture_update(SDL_Texture *texture) {
+	if(!capture_file || !texture)
+		return;
+	Uint32 id = kiavc_capture_texture_id(texture);
+	kiavc_capture_write_u8(KIAVC_CAPTURE_UPDATE);
+	kiavc_capture_write_u32(id);
+}
+void kiavc_capture_plugin(const char *name) {
+	if(!capture_file)
+		return;
+	size_t len = name ? SDL_strlen(name) : 0;
+	if(len > 31)
+		len = 31;
+	kiavc_capture_write_u8(KIAVC_CAPTURE_PLUGIN);
+	kiavc_capture_write_u8((Uint8)len);
+	if(len > 0)
+		SDL_RWwrite(capture_file, name, 1, len);
+}
+
+/* Take note of a texture being destroyed */
+void kiavc_capture_forget(SDL_Texture *texture) {
+	if(!capture_file || !texture)
+		return;
+	int i = 0;
+	for(i=0; i<textures_count; i++) {
+		if(textures[i].texture == texture) {
+			kiavc_capture_write_u8(KIAVC_CAPTURE_FORGET);
+			kiavc_capture_write_u32(textures[i].id);
+			textures[i] = textures[textures_count-1];
+			textures_count--;
+			return;
+		}
+	}
+}
+
+/* Take note of the end of a frame */
+bool kiavc_capture_frame(void) {
+	if(!capture_file)
+		return false;
+	kiavc_capture_write_u8(KIAVC_CAPTURE_FRAME);
+	capture_count++;
+	if(capture_count < capture_frames)
+		return false;
+	kiavc_capture_stop();
+	return true;
+}
+
+/* Stop capturing */
+int kiavc_capture_stop(void) {
+	if(!capture_file)
+		return -1;
+	SDL_RWclose(capture_file);
+	capture_file = NULL;
+	SDL_free(textures);
+	textures = NULL;
+	textures_count = 0;
+	textures_size = 0;
+	SDL_Log("Captured %d frames (%"SCNu32" textures)\n", capture_count, textures_id);
+	return 0;
+}
+
+/* Helpers to read from a file */
+static bool kiavc_capture_read_u8(SDL_RWops *file, Uint8 *value) {
+	return SDL_RWread(file, value, sizeof(Uint8), 1) == 1;
+}
+static bool kiavc_capture_read_u16(SDL_RWops *file, Uint16 *value) {
+	if(SDL_RWread(file, value, sizeof(Uint16), 1) != 1)
+		return false;
+	*value = SDL_SwapBE16(*value);
+	return true;
+}
+static bool kiavc_capture_read_u32(SDL_RWops *file, Uint32 *value) {
+	if(SDL_RWread(file, value, sizeof(Uint32), 1) != 1)
+		return false;
+	*value = SDL_SwapBE32(*value);
+	return true;
+}
+static bool kiavc_capture_read_int(SDL_RWops *file, int *value) {
+	Uint32 v = 0;
+	if(!kiavc_capture_read_u32(file, &v))
+		return false;
+	*value = (int)(Sint32)v;
+	return true;
+}
+static bool kiavc_capture_read_rect(SDL_RWops *file, SDL_Rect *rect, bool *set) {
+	Uint8 flag = 0;
+	if(!kiavc_capture_read_u8(file, &flag))
+		return false;
+	*set = (flag != 0);
+	if(!*set)
+		return true;
+	return kiavc_capture_read_int(file, &rect->x) && kiavc_capture_read_int(file, &rect->y) &&
+		kiavc_capture_read_int(file, &rect->w) && kiavc_capture_read_int(file, &rect->h);
+}
+
+/* Read all the commands in a capture file */
+kiavc_capture_file *kiavc_capture_load(const char *path) {
+	if(!path)
+		return NULL;
+	SDL_RWops *file = SDL_RWFromFile(path, "rb");
+	if(!file) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error opening capture file '%s': %s\n", path, SDL_GetError());
+		return NULL;
+	}
+	char header[8];
+	Uint8 version = 0;
+	Uint16 w = 0, h = 0;
+	if(SDL_RWread(file, header, 1, sizeof(header)) != sizeof(header) ||
+			SDL_memcmp(header, KIAVC_CAPTURE_HEADER, sizeof(header)) ||
+			!kiavc_capture_read_u8(file, &version) || version != KIAVC_CAPTURE_VERSION ||
+			!kiavc_capture_read_u16(file, &w) || !kiavc_capture_read_u16(file, &h) || w == 0 || h == 0) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Invalid capture file '%s'\n", path);
+		SDL_RWclose(file);
+		return NULL;
+	}
+	kiavc_capture_file *capture = SDL_calloc(1, sizeof(kiavc_capture_file));
+	capture->w = w;
+	capture->h = h;
+	int size = 0;
+	Uint8 type = 0, u8 = 0;
+	Uint32 u32 = 0;
+	bool ok = false;
+	while(kiavc_capture_read_u8(file, &type)) {
+		if(capture->count == size) {
+			size = size ? size*2 : 1024;
+			kiavc_capture_command *commands = SDL_realloc(capture->commands, size * sizeof(kiavc_capture_command));
+			if(!commands)
+				break;
+			capture->commands = commands;
+		}
+		kiavc_capture_command *cmd = &capture->commands[capture->count];
+		SDL_zerop(cmd);
+		cmd->type = type;
+		ok = false;
+		switch(type) {
+			case KIAVC_CAPTURE_TEXTURE:
+				ok = kiavc_capture_read_u32(file, &cmd->id) && kiavc_capture_read_u32(file, &cmd->format) &&
+					kiavc_capture_read_u8(file, &u8) && kiavc_capture_read_int(file, &cmd->w) &&
+					kiavc_capture_read_int(file, &cmd->h) && kiavc_capture_read_u32(file, &u32) &&
+					kiavc_capture_read_u8(file, &cmd->alpha);
+				cmd->access = u8;
+				cmd->blend = (SDL_BlendMode)u32;
+				if(cmd->id > capture->max_id)
+					capture->max_id = cmd->id;
+				break;
+			case KIAVC_CAPTURE_FORGET:
+			case KIAVC_CAPTURE_TARGET:
+			case KIAVC_CAPTURE_UPDATE:
+				ok = kiavc_capture_read_u32(file, &cmd->id);
+				break;
+			case KIAVC_CAPTURE_DRAW_COLOR:
+				ok = kiavc_capture_read_u8(file, &cmd->color.r) && kiavc_capture_read_u8(file, &cmd->color.g) &&
+					kiavc_capture_read_u8(file, &cmd->color.b) && kiavc_capture_read_u8(file, &cmd->color.a);
+				break;
+			case KIAVC_CAPTURE_BLEND_MODE:
+				ok = kiavc_capture_read_u32(file, &u32);
+				cmd->blend = (SDL_BlendMode)u32;
+				break;
+			case KIAVC_CAPTURE_VIEWPORT:
+			case KIAVC_CAPTURE_CLIP:
+			case KIAVC_CAPTURE_FILL:
+				ok = kiavc_capture_read_rect(file, &cmd->dst, &cmd->has_dst);
+				break;
+			case KIAVC_CAPTURE_SCALE:
+				ok = kiavc_capture_read_u32(file, &u32);
+				cmd->scale = (float)u32 / 1000.0f;
+				break;
+			case KIAVC_CAPTURE_ALPHA_MOD:
+				ok = kiavc_capture_read_u32(file, &cmd->id) && kiavc_capture_read_u8(file, &cmd->alpha);
+				break;
+			case KIAVC_CAPTURE_SPRITE:
+				ok = kiavc_capture_read_u32(file, &cmd->id) && kiavc_capture_read_rect(file, &cmd->src, &cmd->has_src) &&
+					kiavc_capture_read_rect(file, &cmd->dst, &cmd->has_dst) && kiavc_capture_read_u8(file, &cmd->alpha);
+				break;
+			case KIAVC_CAPTURE_COPY:
+				ok = kiavc_capture_read_u32(file, &cmd->id) && kiavc_capture_read_rect(file, &cmd->src, &cmd->has_src) &&
+					kiavc_capture_read_rect(file, &cmd->dst, &cmd->has_dst);
+				break;
+			case KIAVC_CAPTURE_LINE:
+				/* We store the coordinates of the line as a rect */
+				ok = kiavc_capture_read_int(file, &cmd->dst.x) && kiavc_capture_read_int(file, &cmd->dst.y) &&
+					kiavc_capture_read_int(file, &cmd->dst.w) && kiavc_capture_read_int(file, &cmd->dst.h);
+				break;
+			case KIAVC_CAPTURE_PLUGIN:
+				ok = kiavc_capture_read_u8(file, &u8) && u8 < sizeof(cmd->name) &&
+					(u8 == 0 || SDL_RWread(file, cmd->name, 1, u8) == u8);
+				break;
+			case KIAVC_CAPTURE_CLEAR:
+				ok = true;
+				break;
+			case KIAVC_CAPTURE_FRAME:
+				ok = true;
+				capture->frames++;
+				break;
+			default:
+				break;
+		}
+		if(!ok) {
+			SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Invalid command %d in capture file, ignoring the rest\n", type);
+			break;
+		}
+		capture->count++;
+	}
+	SDL_RWclose(file);
+	return capture;
+}
+
+/* Destroy the commands read from a capture file */
+void kiavc_capture_file_destroy(kiavc_capture_file *file) {
+	if(!file)
+		return;
+	SDL_free(file->commands);
+	SDL_free(file);
+}
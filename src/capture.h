@@ -0,0 +1,132 @@
+/*
+ *
+ * KIAVC render capture. When enabled, everything the engine asks the
+ * renderer to do in a frame (render targets, state changes, sprites,
+ * copies, fills, texture uploads, plugin render callbacks) is saved as
+ * a sequence of commands to a binary file, for a specific number of
+ * frames. The kiavc-replay tool can then play those commands back in a
+ * loop on any SDL render driver, without any game logic or Lua script
+ * involved, which makes it easy to compare backends and batching on
+ * exactly the same workload. Textures are only saved as their size,
+ * format and blend mode, since what matters is how they're drawn: the
+ * replay tool fills them with a pattern of its own.
+ *
+ * The file starts with a "KIAVCCAP" header, a version and the size of
+ * the game, followed by commands, each made of its type (8 bits) and a
+ * type specific payload, all in network byte order.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_CAPTURE_H
+#define __KIAVC_CAPTURE_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+/* Default number of frames to capture */
+#define KIAVC_CAPTURE_FRAMES	300
+
+/* Capture commands */
+typedef enum kiavc_capture_type {
+	KIAVC_CAPTURE_TEXTURE = 1,	/* A new texture was used: id, format, access, w, h, blend mode, alpha */
+	KIAVC_CAPTURE_FORGET,		/* A texture was destroyed: id */
+	KIAVC_CAPTURE_TARGET,		/* Render target change: id (0 is the window) */
+	KIAVC_CAPTURE_DRAW_COLOR,	/* Draw color change: r, g, b, a */
+	KIAVC_CAPTURE_BLEND_MODE,	/* Draw blend mode change: mode */
+	KIAVC_CAPTURE_VIEWPORT,		/* Viewport change: rect (optional) */
+	KIAVC_CAPTURE_CLIP,			/* Clip rect change: rect (optional) */
+	KIAVC_CAPTURE_SCALE,		/* Scale change: scale */
+	KIAVC_CAPTURE_ALPHA_MOD,	/* Texture alpha modulation change: id, alpha */
+	KIAVC_CAPTURE_SPRITE,		/* Sprite (may be batched): id, src (optional), dst, alpha */
+	KIAVC_CAPTURE_COPY,			/* Texture copy: id, src (optional), dst (optional) */
+	KIAVC_CAPTURE_FILL,			/* Filled rectangle: rect (optional) */
+	KIAVC_CAPTURE_LINE,			/* Line: x1, y1, x2, y2 */
+	KIAVC_CAPTURE_CLEAR,		/* Clear of the render target */
+	KIAVC_CAPTURE_UPDATE,		/* Upload of the whole content of a texture: id */
+	KIAVC_CAPTURE_PLUGIN,		/* Render callback of a plugin: name */
+	KIAVC_CAPTURE_FRAME			/* End of the frame (present) */
+} kiavc_capture_type;
+
+/* Captured command, as read from a file */
+typedef struct kiavc_capture_command {
+	/* Type of command */
+	kiavc_capture_type type;
+	/* Texture the command refers to, if any */
+	Uint32 id;
+	/* Texture properties (when defined), and alpha */
+	Uint32 format;
+	int access, w, h;
+	SDL_BlendMode blend;
+	Uint8 alpha;
+	/* Color, for draw colors */
+	SDL_Color color;
+	/* Source and destination rects, whether they're set, and line coordinates */
+	SDL_Rect src, dst;
+	bool has_src, has_dst;
+	/* Scale */
+	float scale;
+	/* Plugin name */
+	char name[32];
+} kiavc_capture_command;
+
+/* Captured frames, as read from a file */
+typedef struct kiavc_capture_file {
+	/* Size of the game */
+	int w, h;
+	/* Commands */
+	kiavc_capture_command *commands;
+	int count;
+	/* Number of frames, and the highest texture ID */
+	int frames;
+	Uint32 max_id;
+} kiavc_capture_file;
+
+/* Start capturing a number of frames of a game of the provided size to a file */
+int kiavc_capture_start(const char *path, int frames, int w, int h);
+/* Check whether capturing is active */
+bool kiavc_capture_is_enabled(void);
+/* Take note of a change of render target (NULL for the window) */
+void kiavc_capture_target(SDL_Texture *target);
+/* Take note of a change of draw color */
+void kiavc_capture_draw_color(Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+/* Take note of a change of draw blend mode */
+void kiavc_capture_blend_mode(SDL_BlendMode blend);
+/* Take note of a change of viewport (NULL to reset it) */
+void kiavc_capture_viewport(const SDL_Rect *viewport);
+/* Take note of a change of clip rect (NULL to disable clipping) */
+void kiavc_capture_clip(const SDL_Rect *clip);
+/* Take note of a change of scale */
+void kiavc_capture_scale(float scale);
+/* Take note of a change of alpha modulation of a texture */
+void kiavc_capture_alpha_mod(SDL_Texture *texture, Uint8 alpha);
+/* Take note of a sprite being drawn (NULL source means the whole texture) */
+void kiavc_capture_sprite(SDL_Texture *texture, const SDL_Rect *src, const SDL_Rect *dst, Uint8 alpha);
+/* Take note of a texture being copied as it is */
+void kiavc_capture_copy(SDL_Texture *texture, const SDL_Rect *src, const SDL_Rect *dst);
+/* Take note of a rectangle being filled (NULL for the whole target) */
+void kiavc_capture_fill(const SDL_Rect *rect);
+/* Take note of a line being drawn */
+void kiavc_capture_line(int x1, int y1, int x2, int y2);
+/* Take note of the target being cleared */
+void kiavc_capture_clear(void);
+/* Take note of the content of a texture being uploaded */
+void kiavc_capture_update(SDL_Texture *texture);
+/* Take note of a plugin being asked to render */
+void kiavc_capture_plugin(const char *name);
+/* Take note of a texture being destroyed */
+void kiavc_capture_forget(SDL_Texture *texture);
+/* Take note of the end of a frame: capturing stops automatically after
+ * the requested number of frames, in which case true is returned */
+bool kiavc_capture_frame(void);
+/* Stop capturing and close the file */
+int kiavc_capture_stop(void);
+
+/* Read all the commands in a capture file */
+kiavc_capture_file *kiavc_capture_load(const char *path);
+/* Destroy the commands read from a capture file */
+void kiavc_capture_file_destroy(kiavc_capture_file *file);
+
+#endif
@@ -0,0 +1,411 @@
+/*
+ *
+ * KIAVC CPU compositor. On machines without a usable GPU, SDL falls
+ * back to its software renderer, which isn't particularly fast when
+ * drawing lots of alpha modulated sprites. When enabled, the compositor
+ * keeps a premultiplied copy of the pixels of each texture, blits sprites
+ * straight into a buffer as large as the canvas using SIMD kernels when
+ * available (SSE2 or AVX2), and uploads the result to a streaming texture
+ * only once per frame. Since premultiplied alpha is prepared when the
+ * texture is loaded, blending is a single multiply-add per channel, and
+ * color keyed pixels are simply fully transparent ones. The pixels are
+ * associated to textures as their user data, which needs SDL >= 2.0.18.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include "compositor.h"
+#include "capture.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define KIAVC_COMPOSITOR_X86
+#include <immintrin.h>
+#endif
+
+/* Helper to multiply all channels of a pixel by a value, divided by 255 */
+static inline Uint32 kiavc_compositor_scale(Uint32 pixel, Uint32 value) {
+	Uint32 rb = (pixel & 0x00FF00FF) * value + 0x00800080;
+	rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+	Uint32 ag = ((pixel >> 8) & 0x00FF00FF) * value + 0x00800080;
+	ag = (ag + ((ag >> 8) & 0x00FF00FF)) & 0xFF00FF00;
+	return rb | ag;
+}
+
+/* Plain C kernel: blend a row of premultiplied pixels, with an additional alpha */
+static void kiavc_compositor_blend_c(Uint32 *dst, const Uint32 *src, int count, Uint8 alpha) {
+	int i = 0;
+	Uint32 s = 0, sa = 0;
+	for(i=0; i<count; i++) {
+		s = src[i];
+		if(alpha != SDL_ALPHA_OPAQUE)
+			s = kiavc_compositor_scale(s, alpha);
+		sa = s >> 24;
+		if(sa == 0)
+			continue;
+		if(sa == 255)
+			dst[i] = s;
+		else
+			dst[i] = s + kiavc_compositor_scale(dst[i], 255 - sa);
+	}
+}
+
+#ifdef KIAVC_COMPOSITOR_X86
+/* Multiply 16-bit channels by 16-bit values, divided by 255 */
+#define KIAVC_MUL255_SSE2(x, v) \
+	(t = _mm_add_epi16(_mm_mullo_epi16(x, v), c128), \
+	_mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8))
+/* SSE2 kernel: same as the C one, four pixels at a time */
+__attribute__((target("sse2")))
+static void kiavc_compositor_blend_sse2(Uint32 *dst, const Uint32 *src, int count, Uint8 alpha) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c128 = _mm_set1_epi16(0x80);
+	const __m128i c255 = _mm_set1_epi16(0xFF);
+	const __m128i amask = _mm_set1_epi32(0xFF000000);
+	const __m128i a16 = _mm_set1_epi16(alpha);
+	__m128i s, d, slo, shi, dlo, dhi, alo, ahi, t;
+	int i = 0, mask = 0;
+	for(i=0; i+4<=count; i+=4) {
+		s = _mm_loadu_si128((const __m128i *)(src + i));
+		/* Skip fully transparent pixels, and copy fully opaque ones */
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, amask), zero));
+		if(mask == 0xFFFF)
+			continue;
+		if(alpha == SDL_ALPHA_OPAQUE &&
+				_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, amask), amask)) == 0xFFFF) {
+			_mm_storeu_si128((__m128i *)(dst + i), s);
+			continue;
+		}
+		d = _mm_loadu_si128((const __m128i *)(dst + i));
+		slo = _mm_unpacklo_epi8(s, zero);
+		shi = _mm_unpackhi_epi8(s, zero);
+		if(alpha != SDL_ALPHA_OPAQUE) {
+			slo = KIAVC_MUL255_SSE2(slo, a16);
+			shi = KIAVC_MUL255_SSE2(shi, a16);
+		}
+		/* Broadcast the source alpha, and invert it */
+		alo = _mm_sub_epi16(c255, _mm_shufflehi_epi16(_mm_shufflelo_epi16(slo, 0xFF), 0xFF));
+		ahi = _mm_sub_epi16(c255, _mm_shufflehi_epi16(_mm_shufflelo_epi16(shi, 0xFF), 0xFF));
+		dlo = _mm_unpacklo_epi8(d, zero);
+		dhi = _mm_unpackhi_epi8(d, zero);
+		dlo = _mm_add_epi16(KIAVC_MUL255_SSE2(dlo, alo), slo);
+		dhi = _mm_add_epi16(KIAVC_MUL255_SSE2(dhi, ahi), shi);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(dlo, dhi));
+	}
+	/* Take care of what's left */
+	if(i < count)
+		kiavc_compositor_blend_c(dst + i, src + i, count - i, alpha);
+}
+
+/* Multiply 16-bit channels by 16-bit values, divided by 255 */
+#define KIAVC_MUL255_AVX2(x, v) \
+	(t = _mm256_add_epi16(_mm256_mullo_epi16(x, v), c128), \
+	_mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8))
+/* AVX2 kernel: same as the C one, eight pixels at a time */
+__attribute__((target("avx2")))
+static void kiavc_compositor_blend_avx2(Uint32 *dst, const Uint32 *src, int count, Uint8 alpha) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i c128 = _mm256_set1_epi16(0x80);
+	const __m256i c255 = _mm256_set1_epi16(0xFF);
+	const __m256i amask = _mm256_set1_epi32(0xFF000000);
+	const __m256i a16 = _mm256_set1_epi16(alpha);
+	__m256i s, d, slo, shi, dlo, dhi, alo, ahi, t;
+	int i = 0, mask = 0;
+	for(i=0; i+8<=count; i+=8) {
+		s = _mm256_loadu_si256((const __m256i *)(src + i));
+		/* Skip fully transparent pixels, and copy fully opaque ones */
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(s, amask), zero));
+		if(mask == -1)
+			continue;
+		if(alpha == SDL_ALPHA_OPAQUE &&
+				_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(s, amask), amask)) == -1) {
+			_mm256_storeu_si256((__m256i *)(dst + i), s);
+			continue;
+		}
+		d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		/* Unpacking and packing work per 128-bit lane, so the order is preserved */
+		slo = _mm256_unpacklo_epi8(s, zero);
+		shi = _mm256_unpackhi_epi8(s, zero);
+		if(alpha != SDL_ALPHA_OPAQUE) {
+			slo = KIAVC_MUL255_AVX2(slo, a16);
+			shi = KIAVC_MUL255_AVX2(shi, a16);
+		}
+		/* Broadcast the source alpha, and invert it */
+		alo = _mm256_sub_epi16(c255, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(slo, 0xFF), 0xFF));
+		ahi = _mm256_sub_epi16(c255, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(shi, 0xFF), 0xFF));
+		dlo = _mm256_unpacklo_epi8(d, zero);
+		dhi = _mm256_unpackhi_epi8(d, zero);
+		dlo = _mm256_add_epi16(KIAVC_MUL255_AVX2(dlo, alo), slo);
+		dhi = _mm256_add_epi16(KIAVC_MUL255_AVX2(dhi, ahi), shi);
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(dlo, dhi));
+	}
+	/* Take care of what's left */
+	if(i < count)
+		kiavc_compositor_blend_sse2(dst + i, src + i, count - i, alpha);
+}
+#endif
+
+/* Helper to convert premultiplied pixels back to straight alpha */
+static void kiavc_compositor_unpremultiply(Uint32 *pixels, int count) {
+	int i = 0;
+	Uint32 p = 0, a = 0, r = 0, g = 0, b = 0;
+	for(i=0; i<count; i++) {
+		p = pixels[i];
+		a = p >> 24;
+		if(a == 0 || a == 255)
+			continue;
+		r = SDL_min(255, (((p >> 16) & 0xFF) * 255 + a/2) / a);
+		g = SDL_min(255, (((p >> 8) & 0xFF) * 255 + a/2) / a);
+		b = SDL_min(255, ((p & 0xFF) * 255 + a/2) / a);
+		pixels[i] = (a << 24) | (r << 16) | (g << 8) | b;
+	}
+}
+
+/* Create a new CPU compositor */
+kiavc_compositor *kiavc_compositor_create(SDL_Renderer *renderer, int w, int h) {
+	if(!renderer || w < 1 || h < 1)
+		return NULL;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	kiavc_compositor *comp = SDL_calloc(1, sizeof(kiavc_compositor));
+	comp->renderer = renderer;
+	comp->w = w;
+	comp->h = h;
+	comp->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING, w, h);
+	if(!comp->texture) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error creating compositor texture: %s\n", SDL_GetError());
+		kiavc_compositor_destroy(comp);
+		return NULL;
+	}
+	comp->pixels = SDL_calloc(w * h, sizeof(Uint32));
+	comp->row = SDL_calloc(w, sizeof(Uint32));
+	comp->columns = SDL_calloc(w, sizeof(int));
+	if(!comp->pixels || !comp->row || !comp->columns) {
+		kiavc_compositor_destroy(comp);
+		return NULL;
+	}
+	/* Pick the best kernel this CPU supports */
+	comp->blend = kiavc_compositor_blend_c;
+	comp->kernel = "C";
+#ifdef KIAVC_COMPOSITOR_X86
+	if(SDL_HasAVX2()) {
+		comp->blend = kiavc_compositor_blend_avx2;
+		comp->kernel = "AVX2";
+	} else if(SDL_HasSSE2()) {
+		comp->blend = kiavc_compositor_blend_sse2;
+		comp->kernel = "SSE2";
+	}
+#endif
+	SDL_Log("Created CPU compositor (%dx%d, %s kernel)\n", w, h, comp->kernel);
+	return comp;
+#else
+	SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "The CPU compositor needs SDL >= 2.0.18\n");
+	return NULL;
+#endif
+}
+
+/* Keep a premultiplied copy of the pixels of a texture */
+void kiavc_compositor_add_texture(kiavc_compositor *comp, SDL_Texture *texture, SDL_Surface *surface) {
+	if(!comp || !texture || !surface)
+		return;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	/* Converting the surface also turns the color key, if any, into alpha */
+	SDL_Surface *converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+	if(!converted) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error converting surface: %s\n", SDL_GetError());
+		return;
+	}
+	kiavc_compositor_image *image = SDL_calloc(1, sizeof(kiavc_compositor_image));
+	image->texture = texture;
+	image->w = converted->w;
+	image->h = converted->h;
+	image->pixels = SDL_malloc(image->w * image->h * sizeof(Uint32));
+	if(!image->pixels) {
+		SDL_FreeSurface(converted);
+		SDL_free(image);
+		return;
+	}
+	SDL_LockSurface(converted);
+	int x = 0, y = 0;
+	Uint32 p = 0, a = 0, *dst = image->pixels;
+	const Uint32 *src = NULL;
+	for(y=0; y<image->h; y++) {
+		src = (const Uint32 *)((const Uint8 *)converted->pixels + y * converted->pitch);
+		for(x=0; x<image->w; x++) {
+			p = src[x];
+			a = p >> 24;
+			if(a == 0)
+				*dst++ = 0;
+			else if(a == 255)
+				*dst++ = p;
+			else
+				*dst++ = (kiavc_compositor_scale(p, a) & 0x00FFFFFF) | (a << 24);
+		}
+	}
+	SDL_UnlockSurface(converted);
+	SDL_FreeSurface(converted);
+	/* If we had pixels for this texture already, replace them */
+	kiavc_compositor_remove_texture(comp, texture);
+	SDL_SetTextureUserData(texture, image);
+	comp->images = kiavc_list_append(comp->images, image);
+#endif
+}
+
+/* Forget about the pixels of a texture */
+void kiavc_compositor_remove_texture(kiavc_compositor *comp, SDL_Texture *texture) {
+	if(!comp || !texture)
+		return;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	kiavc_compositor_image *image = SDL_GetTextureUserData(texture);
+	if(!image)
+		return;
+	SDL_SetTextureUserData(texture, NULL);
+	comp->images = kiavc_list_remove(comp->images, image);
+	SDL_free(image->pixels);
+	SDL_free(image);
+#endif
+}
+
+/* Start a new frame */
+void kiavc_compositor_begin(kiavc_compositor *comp) {
+	if(!comp)
+		return;
+	/* We start from an opaque black background, as the renderer does */
+	SDL_memset4(comp->pixels, 0xFF000000, comp->w * comp->h);
+	comp->covered = true;
+	comp->dirty = true;
+	comp->area.x = 0;
+	comp->area.y = 0;
+	comp->area.w = comp->w;
+	comp->area.h = comp->h;
+}
+
+/* Check if we have pixels for a texture */
+bool kiavc_compositor_can_blit(kiavc_compositor *comp, SDL_Texture *texture) {
+	if(!comp || !texture)
+		return false;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	return SDL_GetTextureUserData(texture) != NULL;
+#else
+	return false;
+#endif
+}
+
+/* Blit a sprite in the buffer */
+bool kiavc_compositor_blit(kiavc_compositor *comp, SDL_Texture *texture,
+		const SDL_Rect *clip, const SDL_Rect *rect, Uint8 alpha) {
+	if(!comp || !texture || !rect)
+		return false;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	kiavc_compositor_image *image = SDL_GetTextureUserData(texture);
+	if(!image)
+		return false;
+	comp->sprites++;
+	if(alpha == 0 || rect->w < 1 || rect->h < 1)
+		return true;
+	SDL_Rect src = { 0, 0, image->w, image->h };
+	if(clip)
+		src = *clip;
+	if(src.x < 0 || src.y < 0 || src.w < 1 || src.h < 1 ||
+			src.x + src.w > image->w || src.y + src.h > image->h)
+		return true;
+	/* Only touch the part of the buffer the sprite is in */
+	int x0 = SDL_max(rect->x, 0), y0 = SDL_max(rect->y, 0);
+	int x1 = SDL_min(rect->x + rect->w, comp->w), y1 = SDL_min(rect->y + rect->h, comp->h);
+	if(x0 >= x1 || y0 >= y1)
+		return true;
+	int x = 0, y = 0, sy = 0, count = x1 - x0;
+	bool scaled = (src.w != rect->w);
+	if(scaled) {
+		/* Nearest neighbour scaling: the columns are the same for all rows */
+		for(x=x0; x<x1; x++)
+			comp->columns[x - x0] = src.x + ((x - rect->x) * src.w) / rect->w;
+	}
+	const Uint32 *line = NULL, *row = NULL;
+	for(y=y0; y<y1; y++) {
+		sy = src.y + ((y - rect->y) * src.h) / rect->h;
+		line = image->pixels + sy * image->w;
+		if(scaled) {
+			for(x=0; x<count; x++)
+				comp->row[x] = line[comp->columns[x]];
+			row = comp->row;
+		} else {
+			row = line + src.x + (x0 - rect->x);
+		}
+		comp->blend(comp->pixels + y * comp->w + x0, row, count, alpha);
+	}
+	/* Keep track of the area we'll need to upload */
+	SDL_Rect blitted = { x0, y0, x1 - x0, y1 - y0 };
+	if(comp->dirty)
+		SDL_UnionRect(&comp->area, &blitted, &comp->area);
+	else
+		comp->area = blitted;
+	comp->dirty = true;
+	return true;
+#else
+	return false;
+#endif
+}
+
+/* Upload what we blitted so far, and draw it */
+void kiavc_compositor_flush(kiavc_compositor *comp) {
+	if(!comp || !comp->dirty)
+		return;
+	/* Only upload the area we blitted to: the rest of the buffer is empty */
+	SDL_Rect *area = &comp->area;
+	Uint32 *pixels = comp->pixels + area->y * comp->w + area->x;
+	int y = 0;
+	if(comp->covered) {
+		/* The buffer is opaque, so we can just copy it */
+		SDL_SetTextureBlendMode(comp->texture, SDL_BLENDMODE_NONE);
+	} else {
+		/* Something was drawn by the renderer before this, so we need
+		 * to blend: not all renderers support premultiplied alpha as
+		 * a blend mode, so we convert the buffer to straight alpha */
+		for(y=0; y<area->h; y++)
+			kiavc_compositor_unpremultiply(pixels + y * comp->w, area->w);
+		SDL_SetTextureBlendMode(comp->texture, SDL_BLENDMODE_BLEND);
+	}
+	SDL_UpdateTexture(comp->texture, area, pixels, comp->w * sizeof(Uint32));
+	SDL_RenderCopy(comp->renderer, comp->texture, area, area);
+	kiavc_capture_update(comp->texture);
+	kiavc_capture_copy(comp->texture, area, area);
+	comp->uploads++;
+	/* Anything we blit from now on will be drawn on top */
+	for(y=0; y<area->h; y++)
+		SDL_memset(pixels + y * comp->w, 0, area->w * sizeof(Uint32));
+	comp->covered = false;
+	comp->dirty = false;
+}
+
+/* Reset the stats */
+void kiavc_compositor_reset_stats(kiavc_compositor *comp) {
+	if(!comp)
+		return;
+	comp->sprites = 0;
+	comp->uploads = 0;
+}
+
+/* Destroy a CPU compositor */
+void kiavc_compositor_destroy(kiavc_compositor *comp) {
+	if(!comp)
+		return;
+	kiavc_list *list = comp->images;
+	while(list) {
+		kiavc_compositor_image *image = (kiavc_compositor_image *)list->data;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+		/* The texture may outlive us, so don't leave it pointing to freed pixels */
+		SDL_SetTextureUserData(image->texture, NULL);
+#endif
+		SDL_free(image->pixels);
+		SDL_free(image);
+		list = list->next;
+	}
+	kiavc_list_destroy(comp->images);
+	if(comp->texture)
+		SDL_DestroyTexture(comp->texture);
+	SDL_free(comp->pixels);
+	SDL_free(comp->row);
+	SDL_free(comp->columns);
+	SDL_free(comp);
+}
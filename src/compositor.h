@@ -0,0 +1,84 @@
+/*
+ *
+ * KIAVC CPU compositor. On machines without a usable GPU, SDL falls
+ * back to its software renderer, which isn't particularly fast when
+ * drawing lots of alpha modulated sprites. When enabled, the compositor
+ * keeps a premultiplied copy of the pixels of each texture, blits sprites
+ * straight into a buffer as large as the canvas using SIMD kernels when
+ * available (SSE2 or AVX2), and uploads the result to a streaming texture
+ * only once per frame. Textures the compositor has no pixels for are
+ * still drawn by the renderer, after flushing what was blitted so far:
+ * only the area sprites were blitted to since the last flush is uploaded.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_COMPOSITOR_H
+#define __KIAVC_COMPOSITOR_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "list.h"
+
+/* Premultiplied pixels of a texture */
+typedef struct kiavc_compositor_image {
+	/* Texture these pixels belong to */
+	SDL_Texture *texture;
+	/* Pixels (ARGB8888, premultiplied alpha) and size */
+	Uint32 *pixels;
+	int w, h;
+} kiavc_compositor_image;
+
+/* CPU compositor */
+typedef struct kiavc_compositor {
+	/* Renderer to upload the result to */
+	SDL_Renderer *renderer;
+	/* Streaming texture we upload the buffer to */
+	SDL_Texture *texture;
+	/* Buffer we blit sprites to (ARGB8888, premultiplied alpha), and its size */
+	Uint32 *pixels;
+	int w, h;
+	/* Scratch row and column map, used when scaling sprites */
+	Uint32 *row;
+	int *columns;
+	/* Images we have pixels for */
+	kiavc_list *images;
+	/* Whether the buffer covers the whole target (opaque background), and
+	 * whether something was blitted since the last time we flushed */
+	bool covered, dirty;
+	/* Area of the buffer we blitted to since the last time we flushed */
+	SDL_Rect area;
+	/* Kernel used to blend rows of pixels, and its name */
+	void (*blend)(Uint32 *dst, const Uint32 *src, int count, Uint8 alpha);
+	const char *kernel;
+	/* Stats on the current frame */
+	Uint32 sprites, uploads;
+} kiavc_compositor;
+
+/* Create a new CPU compositor as large as the canvas: returns NULL if the
+ * compositor isn't available (e.g., because SDL is too old) */
+kiavc_compositor *kiavc_compositor_create(SDL_Renderer *renderer, int w, int h);
+/* Keep a premultiplied copy of the pixels of a texture, from the surface it was created from */
+void kiavc_compositor_add_texture(kiavc_compositor *comp, SDL_Texture *texture, SDL_Surface *surface);
+/* Forget about the pixels of a texture, e.g., because it's being destroyed */
+void kiavc_compositor_remove_texture(kiavc_compositor *comp, SDL_Texture *texture);
+/* Start a new frame, clearing the buffer */
+void kiavc_compositor_begin(kiavc_compositor *comp);
+/* Check if we have pixels for a texture, and so if we can blit its sprites */
+bool kiavc_compositor_can_blit(kiavc_compositor *comp, SDL_Texture *texture);
+/* Blit a sprite in the buffer (NULL clip means the whole texture): returns
+ * false if we have no pixels for the texture, in which case the caller must
+ * flush the compositor and draw the sprite with the renderer instead */
+bool kiavc_compositor_blit(kiavc_compositor *comp, SDL_Texture *texture,
+	const SDL_Rect *clip, const SDL_Rect *rect, Uint8 alpha);
+/* Upload what we blitted so far, and draw it on the current render target */
+void kiavc_compositor_flush(kiavc_compositor *comp);
+/* Reset the stats before a new frame */
+void kiavc_compositor_reset_stats(kiavc_compositor *comp);
+/* Destroy a CPU compositor */
+void kiavc_compositor_destroy(kiavc_compositor *comp);
+
+#endif
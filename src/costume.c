@@ -15,6 +15,40 @@
 #include <SDL2/SDL_image.h>
 
 #include "costume.h"
+#include "actor.h"
+
+/* Custom sets we've seen so far, and how many */
+static kiavc_map *custom_sets = NULL;
+static int custom_sets_count = 0;
+
+/* Helper to convert the name of a set to its index */
+int kiavc_costume_set_index(const char *name, bool add) {
+	if(!name)
+		return -1;
+	/* Check if this is one of the actor states first */
+	int state = kiavc_actor_state(name);
+	const char *state_str = kiavc_actor_state_str(state);
+	if(state_str && !SDL_strcasecmp(name, state_str))
+		return state;
+	/* It's not, check if it's a custom set we know about */
+	if(custom_sets) {
+		void *index = kiavc_map_lookup(custom_sets, name);
+		if(index)
+			return (int)(intptr_t)index;
+	}
+	if(!add)
+		return -1;
+	int index = KIAVC_ACTOR_USING_L + 1 + custom_sets_count;
+	if(index >= KIAVC_COSTUME_MAX_SETS) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't add costume set '%s', too many custom sets\n", name);
+		return -1;
+	}
+	if(!custom_sets)
+		custom_sets = kiavc_map_create(NULL);
+	kiavc_map_insert(custom_sets, name, (void *)(intptr_t)index);
+	custom_sets_count++;
+	return index;
+}
 
 /* Private method to destroy a set */
 static void kiavc_costume_set_destroy(kiavc_costume_set *set) {
@@ -30,20 +64,16 @@ kiavc_costume *kiavc_costume_create(const char *id) {
 		return NULL;
 	kiavc_costume *costume = SDL_calloc(1, sizeof(kiavc_costume));
 	costume->id = SDL_strdup(id);
-	costume->sets = kiavc_map_create((kiavc_map_value_destroy)kiavc_costume_set_destroy);
 	return costume;
 }
 
-/* Get or add a costume set */
-kiavc_costume_set *kiavc_costume_get_set(kiavc_costume *costume, const char *name) {
-	if(!costume || !name)
+/* Get a costume set by index, optionally adding it */
+kiavc_costume_set *kiavc_costume_get_set(kiavc_costume *costume, int index, bool add) {
+	if(!costume || index < 0 || index >= KIAVC_COSTUME_MAX_SETS)
 		return NULL;
-	kiavc_costume_set *set = kiavc_map_lookup(costume->sets, name);
-	if(set)
-		return set;
-	set = SDL_calloc(1, sizeof(kiavc_costume_set));
-	kiavc_map_insert(costume->sets, name, set);
-	return set;
+	if(!costume->sets[index] && add)
+		costume->sets[index] = SDL_calloc(1, sizeof(kiavc_costume_set));
+	return costume->sets[index];
 }
 
 /* Helper to load textures for a specific set */
@@ -72,26 +102,18 @@ void kiavc_costume_unload_set(kiavc_costume_set *set, void *resource) {
 void kiavc_costume_unload_sets(kiavc_costume *costume, void *resource) {
 	if(!costume)
 		return;
-	kiavc_list *sets = kiavc_map_get_values(costume->sets), *tmp = sets;
-	kiavc_costume_set *set = NULL;
 	int i = 0;
-	while(tmp) {
-		set = (kiavc_costume_set *)tmp->data;
-		i = 0;
-		for(i = KIAVC_UP; i<= KIAVC_RIGHT; i++) {
-			if(set && set->animations[i])
-				kiavc_animation_unload(set->animations[i], resource);
-		}
-		tmp = tmp->next;
-	}
-	kiavc_list_destroy(sets);
+	for(i=0; i<KIAVC_COSTUME_MAX_SETS; i++)
+		kiavc_costume_unload_set(costume->sets[i], resource);
 }
 
 /* Costume destructor */
 void kiavc_costume_destroy(kiavc_costume *costume) {
 	if(costume) {
 		SDL_free(costume->id);
-		kiavc_map_destroy(costume->sets);
+		int i = 0;
+		for(i=0; i<KIAVC_COSTUME_MAX_SETS; i++)
+			kiavc_costume_set_destroy(costume->sets[i]);
 		SDL_free(costume);
 	}
 }
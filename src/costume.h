@@ -15,6 +15,8 @@
 #ifndef __KIAVC_COSTUME_H
 #define __KIAVC_COSTUME_H
 
+#include <stdbool.h>
+
 #include <SDL2/SDL.h>
 
 #include "animation.h"
@@ -28,13 +30,13 @@
 /* Helper to convert a string direction to one of the above defines */
 int kiavc_costume_direction(const char *direction);
 
-/* Abstraction of an costume in the KIAVC engine */
-typedef struct kiavc_costume {
-	/* Unique ID of the costume */
-	char *id;
-	/* Set of costumes, indexed by type (e.g., still, talking, walking) */
-	kiavc_map *sets;
-} kiavc_costume;
+/* Maximum number of sets in a costume: the first ones are indexed by
+ * actor state (e.g., KIAVC_ACTOR_WALKING), while custom sets are given
+ * an index of their own the first time a costume uses their name */
+#define KIAVC_COSTUME_MAX_SETS	32
+/* Helper to convert the name of a set to its index, optionally adding it
+ * if it's a custom set we haven't seen before: returns -1 if unknown */
+int kiavc_costume_set_index(const char *name, bool add);
 
 /* Set of animations for a specific activity */
 typedef struct kiavc_costume_set {
@@ -42,10 +44,18 @@ typedef struct kiavc_costume_set {
 	kiavc_animation *animations[4];
 } kiavc_costume_set;
 
+/* Abstraction of an costume in the KIAVC engine */
+typedef struct kiavc_costume {
+	/* Unique ID of the costume */
+	char *id;
+	/* Sets of animations, indexed by actor state or custom set index */
+	kiavc_costume_set *sets[KIAVC_COSTUME_MAX_SETS];
+} kiavc_costume;
+
 /* Costume constructor */
 kiavc_costume *kiavc_costume_create(const char *id);
-/* Get or add a costume set */
-kiavc_costume_set *kiavc_costume_get_set(kiavc_costume *costume, const char *name);
+/* Get a costume set by index, optionally adding it if it doesn't exist yet */
+kiavc_costume_set *kiavc_costume_get_set(kiavc_costume *costume, int index, bool add);
 /* Helper to load textures for a specific set */
 void kiavc_costume_load_set(kiavc_costume_set *set, void *resource, SDL_Renderer *renderer);
 /* Helper to unload textures for a specific set */
@@ -0,0 +1,166 @@
+/*
+ *
+ * KIAVC dirty rectangles tracking. Since most of the time only a small
+ * part of an adventure game scene changes from one frame to the next
+ * (e.g., an actor walking, or the cursor moving), there's no need to
+ * redraw the whole canvas every time. This keeps track of the sprites
+ * that were drawn in the previous frame, and compares them with the
+ * ones that need to be drawn now: the sprites that appeared, moved,
+ * disappeared or changed frame or alpha are where the canvas is dirty,
+ * and so the only area that needs to be redrawn. Sprites are compared
+ * by their position in the draw order, so that a change in the order
+ * itself marks the affected sprites as dirty too.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include "dirtyrects.h"
+
+/* Initial number of sprites we can track per frame */
+#define KIAVC_DIRTY_RECTS_SIZE	64
+
+/* Create a new dirty rectangles tracker */
+kiavc_dirty_rects *kiavc_dirty_rects_create(int width, int height) {
+	if(width < 1 || height < 1)
+		return NULL;
+	kiavc_dirty_rects *dr = SDL_calloc(1, sizeof(kiavc_dirty_rects));
+	dr->width = width;
+	dr->height = height;
+	dr->size = KIAVC_DIRTY_RECTS_SIZE;
+	dr->previous = SDL_calloc(dr->size, sizeof(kiavc_dirty_sprite));
+	dr->current = SDL_calloc(dr->size, sizeof(kiavc_dirty_sprite));
+	dr->invalid = true;
+	return dr;
+}
+
+/* Start tracking a new frame */
+bool kiavc_dirty_rects_begin(kiavc_dirty_rects *dr, int view_x, int view_y) {
+	if(!dr)
+		return true;
+	/* What we drew last time becomes the previous frame */
+	kiavc_dirty_sprite *tmp = dr->previous;
+	dr->previous = dr->current;
+	dr->previous_count = dr->count;
+	dr->current = tmp;
+	dr->count = 0;
+	/* If the camera moved, everything moved */
+	if(view_x != dr->view_x || view_y != dr->view_y)
+		dr->invalid = true;
+	dr->view_x = view_x;
+	dr->view_y = view_y;
+	return dr->invalid;
+}
+
+/* Keep track of a sprite that is part of the current frame */
+void kiavc_dirty_rects_add(kiavc_dirty_rects *dr, SDL_Texture *texture,
+		const SDL_Rect *src, const SDL_Rect *dst, Uint8 alpha) {
+	if(!dr || !texture || !dst)
+		return;
+	if(dr->count == dr->size) {
+		/* Make room for more sprites */
+		int size = dr->size * 2;
+		kiavc_dirty_sprite *previous = SDL_realloc(dr->previous, size * sizeof(kiavc_dirty_sprite));
+		if(!previous) {
+			dr->invalid = true;
+			return;
+		}
+		dr->previous = previous;
+		kiavc_dirty_sprite *current = SDL_realloc(dr->current, size * sizeof(kiavc_dirty_sprite));
+		if(!current) {
+			dr->invalid = true;
+			return;
+		}
+		dr->current = current;
+		dr->size = size;
+	}
+	kiavc_dirty_sprite *sprite = &dr->current[dr->count];
+	sprite->texture = texture;
+	if(src) {
+		sprite->src = *src;
+	} else {
+		SDL_zero(sprite->src);
+	}
+	sprite->dst = *dst;
+	sprite->alpha = alpha;
+	dr->count++;
+}
+
+/* Helper to compare two sprites */
+static bool kiavc_dirty_sprite_equal(kiavc_dirty_sprite *s1, kiavc_dirty_sprite *s2) {
+	return s1->texture == s2->texture && s1->alpha == s2->alpha &&
+		s1->src.x == s2->src.x && s1->src.y == s2->src.y &&
+		s1->src.w == s2->src.w && s1->src.h == s2->src.h &&
+		s1->dst.x == s2->dst.x && s1->dst.y == s2->dst.y &&
+		s1->dst.w == s2->dst.w && s1->dst.h == s2->dst.h;
+}
+
+/* Helper to add a rectangle to the dirty area */
+static void kiavc_dirty_rects_merge(SDL_Rect *area, bool *dirty, const SDL_Rect *rect) {
+	if(rect->w <= 0 || rect->h <= 0)
+		return;
+	if(!*dirty) {
+		*area = *rect;
+		*dirty = true;
+		return;
+	}
+	SDL_UnionRect(area, rect, area);
+}
+
+/* Compare the current frame with the previous one, and return the area that needs to be redrawn */
+bool kiavc_dirty_rects_end(kiavc_dirty_rects *dr, SDL_Rect *area) {
+	if(!dr || !area)
+		return false;
+	if(dr->invalid) {
+		/* Everything needs to be redrawn */
+		dr->invalid = false;
+		area->x = 0;
+		area->y = 0;
+		area->w = dr->width;
+		area->h = dr->height;
+		return true;
+	}
+	/* If a sprite changed in any way, both where it was and where it
+	 * is now are dirty: if a sprite was added or removed, all the ones
+	 * that follow it are considered changed too, which is conservative
+	 * but guarantees the draw order is respected in the dirty area */
+	bool dirty = false;
+	int i = 0, count = SDL_max(dr->count, dr->previous_count);
+	for(i=0; i<count; i++) {
+		if(i < dr->count && i < dr->previous_count &&
+				kiavc_dirty_sprite_equal(&dr->current[i], &dr->previous[i]))
+			continue;
+		if(i < dr->previous_count)
+			kiavc_dirty_rects_merge(area, &dirty, &dr->previous[i].dst);
+		if(i < dr->count)
+			kiavc_dirty_rects_merge(area, &dirty, &dr->current[i].dst);
+	}
+	if(!dirty)
+		return false;
+	/* Make sure we stay within the canvas */
+	int x1 = SDL_max(area->x, 0), y1 = SDL_max(area->y, 0);
+	int x2 = SDL_min(area->x + area->w, dr->width);
+	int y2 = SDL_min(area->y + area->h, dr->height);
+	if(x2 <= x1 || y2 <= y1)
+		return false;
+	area->x = x1;
+	area->y = y1;
+	area->w = x2 - x1;
+	area->h = y2 - y1;
+	return true;
+}
+
+/* Force the whole canvas to be redrawn in the next frame */
+void kiavc_dirty_rects_invalidate(kiavc_dirty_rects *dr) {
+	if(dr)
+		dr->invalid = true;
+}
+
+/* Destroy a dirty rectangles tracker */
+void kiavc_dirty_rects_destroy(kiavc_dirty_rects *dr) {
+	if(!dr)
+		return;
+	SDL_free(dr->previous);
+	SDL_free(dr->current);
+	SDL_free(dr);
+}
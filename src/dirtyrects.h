@@ -0,0 +1,64 @@
+/*
+ *
+ * KIAVC dirty rectangles tracking. Since most of the time only a small
+ * part of an adventure game scene changes from one frame to the next
+ * (e.g., an actor walking, or the cursor moving), there's no need to
+ * redraw the whole canvas every time. This keeps track of the sprites
+ * that were drawn in the previous frame, and compares them with the
+ * ones that need to be drawn now: the sprites that appeared, moved,
+ * disappeared or changed frame or alpha are where the canvas is dirty,
+ * and so the only area that needs to be redrawn. The area is the union
+ * of all the dirty rectangles, which means a single redraw per frame.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_DIRTYRECTS_H
+#define __KIAVC_DIRTYRECTS_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+/* Sprite drawn on the canvas */
+typedef struct kiavc_dirty_sprite {
+	/* Texture the sprite comes from */
+	SDL_Texture *texture;
+	/* Where the sprite is in the texture, and where it's drawn */
+	SDL_Rect src, dst;
+	/* Alpha the sprite is drawn with */
+	Uint8 alpha;
+} kiavc_dirty_sprite;
+
+/* Dirty rectangles tracker */
+typedef struct kiavc_dirty_rects {
+	/* Size of the canvas */
+	int width, height;
+	/* Sprites of the previous frame and of the current one */
+	kiavc_dirty_sprite *previous, *current;
+	int previous_count, count, size;
+	/* Camera position in the previous frame */
+	int view_x, view_y;
+	/* Whether the whole canvas must be redrawn */
+	bool invalid;
+} kiavc_dirty_rects;
+
+/* Create a new dirty rectangles tracker */
+kiavc_dirty_rects *kiavc_dirty_rects_create(int width, int height);
+/* Start tracking a new frame: if the camera moved, the whole canvas
+ * needs to be redrawn; returns true if the whole canvas is dirty */
+bool kiavc_dirty_rects_begin(kiavc_dirty_rects *dr, int view_x, int view_y);
+/* Keep track of a sprite that is part of the current frame */
+void kiavc_dirty_rects_add(kiavc_dirty_rects *dr, SDL_Texture *texture,
+	const SDL_Rect *src, const SDL_Rect *dst, Uint8 alpha);
+/* Compare the current frame with the previous one, and return the
+ * area that needs to be redrawn: returns false if nothing changed */
+bool kiavc_dirty_rects_end(kiavc_dirty_rects *dr, SDL_Rect *area);
+/* Force the whole canvas to be redrawn in the next frame (e.g., because
+ * a texture was destroyed, or because the canvas itself was lost) */
+void kiavc_dirty_rects_invalidate(kiavc_dirty_rects *dr);
+/* Destroy a dirty rectangles tracker */
+void kiavc_dirty_rects_destroy(kiavc_dirty_rects *dr);
+
+#endif
@@ -34,11 +34,40 @@
 #include "object.h"
 #include "dialog.h"
 #include "plugin.h"
+#include "recording.h"
+#include "profiler.h"
+#include "trace.h"
+#include "capture.h"
+#include "pipeline.h"
+#include "renderqueue.h"
+#include "tween.h"
+#include "schedule.h"
+#include "jobs.h"
+#include "batch.h"
+#include "dirtyrects.h"
+#include "layercache.h"
+#include "renderstate.h"
+#include "compositor.h"
+#include "overdraw.h"
 
 /* Global SDL resources */
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
 static SDL_Texture *canvas = NULL;
+static kiavc_batch *batch = NULL;
+static kiavc_dirty_rects *dirty_rects = NULL;
+static kiavc_layer_cache *layer_cache = NULL;
+static kiavc_render_state *render_state = NULL;
+static kiavc_compositor *compositor = NULL;
+static kiavc_overdraw *overdraw = NULL;
+/* Opaque areas of the things that will be drawn in the current frame, and
+ * the position in the render queue they'll be drawn at */
+typedef struct kiavc_occluder {
+	int index;
+	SDL_Rect rect;
+} kiavc_occluder;
+static kiavc_occluder *occluders = NULL;
+static int occluders_count = 0, occluders_size = 0;
 static char *app_path = NULL;
 static bool quit = false;
 static SDL_threadID thread = 0;
@@ -53,6 +82,12 @@ static int kiavc_screen_fps = -1;
 static bool kiavc_screen_grab_mouse = false;
 static bool kiavc_screen_fullscreen = false, kiavc_screen_fullscreen_desktop = false;
 static int kiavc_screen_scanlines = 0;
+static bool kiavc_screen_dirty_rects = true, kiavc_screen_deferred = false;
+static bool kiavc_screen_cpu_compositor = false;
+/* Whether we're drawing the game straight to the window in this frame */
+static bool kiavc_screen_direct = false;
+/* Whether the window is hidden or minimized, in which case we don't draw at all */
+static bool kiavc_screen_hidden = false;
 static SDL_Texture *kiavc_screen_scanlines_texture = NULL;
 
 /* Test console */
@@ -64,10 +99,69 @@ static kiavc_list *console_history = NULL, *console_current = NULL;
 static FILE *console_file = NULL;
 
 /* Visual debugging */
-static bool kiavc_debug_objects = false, kiavc_debug_walkboxes = false;
+static bool kiavc_debug_objects = false, kiavc_debug_walkboxes = false, kiavc_debug_profiler = false,
+	kiavc_debug_overdraw = false;
+
+/* Profiling: we keep track of when the last frame started, and of how
+ * much time plugins spent rendering in the current frame */
+static Uint64 kiavc_profiler_last_frame = 0, kiavc_profiler_plugins_render = 0;
+/* Render statistics: the frame being drawn, the last complete frame, and
+ * the totals since we last logged them (if we're asked to periodically) */
+static kiavc_render_stats render_stats = { 0 }, render_stats_last = { 0 }, render_stats_total = { 0 };
+static Uint32 render_stats_frames = 0, render_stats_interval = 0, render_stats_logged = 0;
+
+/* Trace to start as soon as the engine is initialized, if any */
+static char *kiavc_trace_filename = NULL;
+/* Render capture to start at the beginning of the next frame, if any */
+static char *kiavc_capture_filename = NULL;
+static int kiavc_capture_frames = 0;
+
+/* Frame scheduling: the world is updated in fixed steps of 1000/fps
+ * milliseconds, driven by the high resolution counter, while rendering
+ * interpolates positions within a step and is paced by vsync, or by a
+ * precise sleep in case vsync is not available */
+#define KIAVC_MAX_CATCHUP_STEPS	5
+static bool kiavc_screen_vsync = false;
+static Uint64 kiavc_clock_frequency = 0, kiavc_clock_last = 0;
+static Uint64 kiavc_clock_accumulator = 0, kiavc_clock_next_frame = 0;
+static double kiavc_clock_ms = 0;
+static float kiavc_clock_alpha = 0;
+static Uint32 kiavc_clock_steps = 0;
+/* Update pipeline: if enabled, the world for the next frame is updated on
+ * a worker while we present the current one, and the result is kept here */
+static bool kiavc_screen_pipelining = false;
+static bool kiavc_pipeline_ahead = false;
+static int kiavc_pipeline_result = 0;
+static Uint64 kiavc_pipeline_done = 0;
+/* Idle detection: when nothing is moving, fading or being animated, we
+ * don't draw frames that would look the same as the last one, and we
+ * wait for events (or for the next time something will change, e.g., a
+ * Lua timer or a new animation frame) rather than polling for them */
+#define KIAVC_IDLE_MAX_WAIT	250
+static bool kiavc_idle = false, kiavc_idle_rendered = false;
+static Uint32 kiavc_idle_wakeup = 0;
+
+/* How many actors that moved to look walkboxes up for in each parallel job */
+#define KIAVC_WALKBOXES_CHUNK	64
+
+/* Headless mode, where the clock is virtual and the world is updated
+ * as fast as possible, optionally stopping after a specific time */
+static int kiavc_headless = KIAVC_HEADLESS_NONE;
+static uint32_t kiavc_headless_run_ms = 0;
+static Uint64 kiavc_headless_start = 0;
+
+/* Input recording and replaying: when replaying, the clock is virtual
+ * too, and recorded events are fed back at the same simulation step */
+static kiavc_recording *recording = NULL, *replay = NULL;
+static bool replay_fast = false;
+static Uint32 replay_mismatches = 0;
+static Uint64 replay_start = 0;
 
 /* Assets connection */
 static kiavc_bag *bag = NULL;
+static kiavc_atlas *atlas = NULL;
+/* Opaque regions of images, if the BAG archive has them */
+static kiavc_map *opaque_regions = NULL;
 
 /* Object maps */
 static kiavc_map *animations = NULL;
@@ -101,8 +195,15 @@ typedef struct kiavc_engine {
 	Uint8 fade_alpha;
 	/* Fade in/out ticks */
 	uint32_t fade_ticks;
-	/* Other fading resources, if any */
-	kiavc_list *fading;
+	/* Resources moving, fading or being scaled */
+	kiavc_tweens *tweens;
+	/* Resources that will need to be updated at some point (animations, text lines) */
+	kiavc_schedule *schedule;
+	/* Actors that moved in the last simulation step, and the walkboxes
+	 * they're in now (which we look up in parallel) */
+	kiavc_actor **moved;
+	kiavc_pathfinding_walkbox **moved_walkboxes;
+	int moved_count, moved_size;
 	/* Current mouse coordinates */
 	int mouse_x, mouse_y;
 	/* Current cursors (main and/or hotspot) */
@@ -121,14 +222,12 @@ typedef struct kiavc_engine {
 	kiavc_actor *actor;
 	/* Actor we're following with the camera */
 	kiavc_actor *following;
-	/* List of resources to render */
-	kiavc_list *render_list;
+	/* Queue of resources to render, sorted by z-plane */
+	kiavc_render_queue *render_queue;
 	/* Resource we're currently hovering on */
 	kiavc_resource *hovering;
 	/* Dialog we're running, if any */
 	kiavc_dialog *dialog;
-	/* Rendering ticks */
-	uint32_t render_ticks;
 } kiavc_engine;
 static kiavc_engine engine = { 0 };
 
@@ -142,11 +241,30 @@ static bool kiavc_engine_set_fullscreen(bool fullscreen, bool desktop);
 static bool kiavc_engine_get_fullscreen(void);
 static bool kiavc_engine_set_scanlines(int alpha);
 static int kiavc_engine_get_scanlines(void);
+static bool kiavc_engine_set_dirty_rects(bool enabled);
+static bool kiavc_engine_get_dirty_rects(void);
+static bool kiavc_engine_set_compositor(const char *name);
+static const char *kiavc_engine_get_compositor(void);
+static bool kiavc_engine_set_pipelining(bool enabled);
+static bool kiavc_engine_get_pipelining(void);
 static bool kiavc_engine_debug_objects(bool debug);
 static bool kiavc_engine_is_debugging_objects(void);
 static bool kiavc_engine_debug_walkboxes(bool debug);
 static bool kiavc_engine_is_debugging_walkboxes(void);
+static bool kiavc_engine_debug_overdraw(bool debug);
+static bool kiavc_engine_is_debugging_overdraw(void);
+static bool kiavc_engine_debug_profiler(bool debug);
+static bool kiavc_engine_is_debugging_profiler(void);
+static bool kiavc_engine_get_frame_stats(int phase, kiavc_profiler_stats *stats);
+static bool kiavc_engine_get_render_stats(kiavc_render_stats *stats);
+static bool kiavc_engine_log_render_stats(int seconds);
 static bool kiavc_engine_save_screenshot(const char *path);
+static bool kiavc_engine_start_trace(const char *path);
+static bool kiavc_engine_stop_trace(void);
+static bool kiavc_engine_start_capture(const char *path, int frames);
+static bool kiavc_engine_stop_capture(void);
+static bool kiavc_engine_trace_begin(const char *name, const char *detail);
+static bool kiavc_engine_trace_end(void);
 static bool kiavc_engine_enable_console(const char *font);
 static bool kiavc_engine_show_console(void);
 static bool kiavc_engine_hide_console(void);
@@ -198,7 +316,7 @@ static bool kiavc_engine_fade_actor_to(const char *id, int alpha, int ms);
 static bool kiavc_engine_set_actor_alpha(const char *id, int alpha);
 static bool kiavc_engine_set_actor_plane(const char *id, int zplane);
 static bool kiavc_engine_set_actor_speed(const char *id, int speed);
-static bool kiavc_engine_scale_actor(const char *id, float scale);
+static bool kiavc_engine_scale_actor(const char *id, float scale, int ms);
 static bool kiavc_engine_walk_actor_to(const char *id, int x, int y);
 static bool kiavc_engine_say_actor(const char *id, const char *text, const char *font, SDL_Color *color, SDL_Color *outline);
 static bool kiavc_engine_set_actor_direction(const char *id, const char *direction);
@@ -224,7 +342,7 @@ static bool kiavc_engine_fade_object_to(const char *id, int alpha, int ms);
 static bool kiavc_engine_set_object_alpha(const char *id, int alpha);
 static bool kiavc_engine_set_object_plane(const char *id, int zplane);
 static bool kiavc_engine_set_object_state(const char *id, const char *state);
-static bool kiavc_engine_scale_object(const char *id, float scale);
+static bool kiavc_engine_scale_object(const char *id, float scale, int ms);
 static bool kiavc_engine_add_object_to_inventory(const char *id, const char *owner);
 static bool kiavc_engine_remove_object_from_inventory(const char *id, const char *owner);
 static bool kiavc_engine_show_text(const char *id, const char *text, const char *font,
@@ -247,11 +365,30 @@ static kiavc_scripts_callbacks scripts_callbacks =
 		.get_fullscreen = kiavc_engine_get_fullscreen,
 		.set_scanlines = kiavc_engine_set_scanlines,
 		.get_scanlines = kiavc_engine_get_scanlines,
+		.set_dirty_rects = kiavc_engine_set_dirty_rects,
+		.get_dirty_rects = kiavc_engine_get_dirty_rects,
+		.set_compositor = kiavc_engine_set_compositor,
+		.get_compositor = kiavc_engine_get_compositor,
+		.set_pipelining = kiavc_engine_set_pipelining,
+		.get_pipelining = kiavc_engine_get_pipelining,
 		.debug_objects = kiavc_engine_debug_objects,
 		.is_debugging_objects = kiavc_engine_is_debugging_objects,
 		.debug_walkboxes = kiavc_engine_debug_walkboxes,
 		.is_debugging_walkboxes = kiavc_engine_is_debugging_walkboxes,
+		.debug_overdraw = kiavc_engine_debug_overdraw,
+		.is_debugging_overdraw = kiavc_engine_is_debugging_overdraw,
+		.debug_profiler = kiavc_engine_debug_profiler,
+		.is_debugging_profiler = kiavc_engine_is_debugging_profiler,
+		.get_frame_stats = kiavc_engine_get_frame_stats,
+		.get_render_stats = kiavc_engine_get_render_stats,
+		.log_render_stats = kiavc_engine_log_render_stats,
 		.save_screenshot = kiavc_engine_save_screenshot,
+		.start_trace = kiavc_engine_start_trace,
+		.stop_trace = kiavc_engine_stop_trace,
+		.start_capture = kiavc_engine_start_capture,
+		.stop_capture = kiavc_engine_stop_capture,
+		.trace_begin = kiavc_engine_trace_begin,
+		.trace_end = kiavc_engine_trace_end,
 		.enable_console = kiavc_engine_enable_console,
 		.show_console = kiavc_engine_show_console,
 		.hide_console = kiavc_engine_hide_console,
@@ -345,6 +482,9 @@ static kiavc_scripts_callbacks scripts_callbacks =
 static void kiavc_plugins_add_resource(kiavc_plugin_resource *resource);
 static void kiavc_plugins_remove_resource(kiavc_plugin_resource *resource);
 static void kiavc_plugins_run_command(const char *fmt, ...);
+static void kiavc_plugins_set_draw_color(Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+static void kiavc_plugins_set_draw_blend_mode(SDL_BlendMode blend);
+static void kiavc_plugins_set_viewport(const SDL_Rect *viewport);
 static kiavc_plugin_callbacks plugin_callbacks =
 	{
 		.register_function = kiavc_scripts_register_function,
@@ -352,14 +492,21 @@ static kiavc_plugin_callbacks plugin_callbacks =
 		.run_command = kiavc_plugins_run_command,
 		.add_resource = kiavc_plugins_add_resource,
 		.remove_resource = kiavc_plugins_remove_resource,
+		.trace_begin = kiavc_trace_begin,
+		.trace_end = kiavc_trace_end,
+		.set_draw_color = kiavc_plugins_set_draw_color,
+		.set_draw_blend_mode = kiavc_plugins_set_draw_blend_mode,
+		.set_viewport = kiavc_plugins_set_viewport,
 	};
 
 /* Helper to renegerate the scanlines texture (if scanlines are enabled) */
 static void kiavc_engine_regenerate_scanlines(void) {
 	if(kiavc_screen_width == 0 || kiavc_screen_height == 0 || !renderer)
 		return;
-	if(kiavc_screen_scanlines_texture)
+	if(kiavc_screen_scanlines_texture) {
+		kiavc_capture_forget(kiavc_screen_scanlines_texture);
 		SDL_DestroyTexture(kiavc_screen_scanlines_texture);
+	}
 	kiavc_screen_scanlines_texture = NULL;
 	if(kiavc_screen_scanlines) {
 		int w = kiavc_screen_width * kiavc_screen_scale;
@@ -377,7 +524,7 @@ static void kiavc_engine_regenerate_scanlines(void) {
 		kiavc_screen_scanlines_texture = SDL_CreateTextureFromSurface(renderer, scanlines);
 		SDL_FreeSurface(scanlines);
 		SDL_SetTextureBlendMode(kiavc_screen_scanlines_texture, SDL_BLENDMODE_BLEND);
-		SDL_SetTextureAlphaMod(kiavc_screen_scanlines_texture, kiavc_screen_scanlines);
+		kiavc_render_state_set_alpha_mod(render_state, kiavc_screen_scanlines_texture, kiavc_screen_scanlines);
 	}
 }
 
@@ -391,6 +538,7 @@ static void kiavc_engine_regenerate_fade(void) {
 	Uint32 color = SDL_MapRGB(surface->format, 0, 0, 0);
 	SDL_FillRect(surface, NULL, color);
 	engine.fade_texture = SDL_CreateTextureFromSurface(renderer, surface);
+	kiavc_engine_texture_created(engine.fade_texture, surface);
 	SDL_FreeSurface(surface);
 }
 
@@ -463,11 +611,66 @@ static int kiavc_engine_sort_resources(const kiavc_resource *r1, const kiavc_res
 	return r1->y - r2->y;
 }
 
+/* Enable the headless mode */
+void kiavc_engine_set_headless(int mode, uint32_t run_ms) {
+	if(mode != KIAVC_HEADLESS_NORENDER && mode != KIAVC_HEADLESS_SOFTWARE)
+		mode = KIAVC_HEADLESS_NONE;
+	kiavc_headless = mode;
+	kiavc_headless_run_ms = run_ms;
+	if(kiavc_headless == KIAVC_HEADLESS_NONE)
+		return;
+	/* We don't want to need a display or a sound card */
+	SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+	SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+	SDL_Log("Headless mode (%s)\n", kiavc_headless == KIAVC_HEADLESS_SOFTWARE ? "software rendering" : "no rendering");
+	if(kiavc_headless_run_ms > 0)
+		SDL_Log("  -- Will stop after %"SCNu32" ms\n", kiavc_headless_run_ms);
+}
+
+/* Start recording user input */
+int kiavc_engine_record_input(const char *path, bool checksums) {
+	if(recording || replay) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Already recording or replaying input\n");
+		return -1;
+	}
+	recording = kiavc_recording_create(path, checksums);
+	return recording ? 0 : -1;
+}
+
+/* Replay previously recorded user input */
+int kiavc_engine_replay_input(const char *path, bool fast) {
+	if(recording || replay) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Already recording or replaying input\n");
+		return -1;
+	}
+	replay = kiavc_recording_open(path);
+	if(!replay)
+		return -1;
+	replay_fast = fast || kiavc_headless;
+	replay_start = SDL_GetPerformanceCounter();
+	return 0;
+}
+
+/* Start tracing as soon as the engine is initialized */
+void kiavc_engine_set_trace(const char *filename) {
+	SDL_free(kiavc_trace_filename);
+	kiavc_trace_filename = filename ? SDL_strdup(filename) : NULL;
+}
+
+/* Capture what's rendered as soon as the engine starts drawing */
+void kiavc_engine_set_capture(const char *filename, int frames) {
+	SDL_free(kiavc_capture_filename);
+	kiavc_capture_filename = filename ? SDL_strdup(filename) : NULL;
+	kiavc_capture_frames = frames;
+}
+
 /* Initialize the engine */
 int kiavc_engine_init(const char *app, kiavc_bag *bagfile) {
 	bag = bagfile;
 	thread = SDL_ThreadID();
 	SDL_Log("Thread ID: %lu\n", thread);
+	kiavc_clock_frequency = SDL_GetPerformanceFrequency();
+	kiavc_profiler_init();
 
 	/* Create maps */
 	animations = kiavc_map_create((kiavc_map_value_destroy)&kiavc_animation_destroy);
@@ -481,11 +684,26 @@ int kiavc_engine_init(const char *app, kiavc_bag *bagfile) {
 	texts = kiavc_map_create((kiavc_map_value_destroy)&kiavc_font_text_destroy);
 	dialogs = kiavc_map_create((kiavc_map_value_destroy)&kiavc_dialog_destroy);
 	plugins = kiavc_map_create((kiavc_map_value_destroy)&kiavc_plugin_destroy);
+	engine.render_queue = kiavc_render_queue_create();
+	engine.tweens = kiavc_tweens_create();
+	engine.schedule = kiavc_schedule_create();
+	/* If the BAG archive has a texture atlas, import it */
+	if(bag && kiavc_map_lookup(bag->map, KIAVC_ATLAS_TABLE))
+		atlas = kiavc_atlas_import(kiavc_bag_asset_export_rw(bag, KIAVC_ATLAS_TABLE));
+	/* If the BAG archive knows where images are opaque, import that too */
+	if(bag && kiavc_map_lookup(bag->map, KIAVC_OPAQUE_TABLE))
+		opaque_regions = kiavc_opaque_import(kiavc_bag_asset_export_rw(bag, KIAVC_OPAQUE_TABLE));
 
 	/* FIXME As in the logger, we get the path where we can save files, which
 	 * we'll used for saved screenshots. And as in the logger, we're currently
 	 * hardcoding "KIAVC" as both org and app, which needs to be changed. */
 	app_path = SDL_GetPrefPath("KIAVC", app);
+	/* If we were asked to trace from the start, do it now */
+	if(kiavc_trace_filename) {
+		kiavc_engine_start_trace(kiavc_trace_filename);
+		SDL_free(kiavc_trace_filename);
+		kiavc_trace_filename = NULL;
+	}
 
 	/* Initialize the scripting engine */
 	if(kiavc_scripts_load("./lua/main.lua", &scripts_callbacks) < 0) {
@@ -521,7 +739,8 @@ int kiavc_engine_init(const char *app, kiavc_bag *bagfile) {
 	}
 	/* Initialize SDL rendering and create the main window */
 	window = SDL_CreateWindow(kiavc_screen_title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-		kiavc_screen_width * kiavc_screen_scale, kiavc_screen_height * kiavc_screen_scale, SDL_WINDOW_SHOWN);
+		kiavc_screen_width * kiavc_screen_scale, kiavc_screen_height * kiavc_screen_scale,
+		kiavc_headless ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN);
 	if(window == NULL) {
 		SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Error creating window: %s\n", SDL_GetError());
 		return -1;
@@ -551,13 +770,37 @@ int kiavc_engine_init(const char *app, kiavc_bag *bagfile) {
 		SDL_FreeSurface(icon);
 	}
 	/* Finally, create a renderer */
-	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+	if(kiavc_headless) {
+		/* In headless mode we only draw to the offscreen framebuffer of the dummy driver */
+		renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+	} else {
+		renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	}
 	if(renderer == NULL) {
 		SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Error creating renderer: %s\n", SDL_GetError());
 		return -1;
 	}
+	/* Check if we got vsync, or if we'll need to pace frames ourselves */
+	SDL_RendererInfo info = { 0 };
+	if(SDL_GetRendererInfo(renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC))
+		kiavc_screen_vsync = true;
+	SDL_Log("Frame pacing: %s\n", kiavc_headless ? "none (headless)" : (kiavc_screen_vsync ? "vsync" : "timer"));
 	canvas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
 		SDL_TEXTUREACCESS_TARGET, kiavc_screen_width, kiavc_screen_height);
+	/* Keep track of the renderer state, to avoid redundant changes */
+	render_state = kiavc_render_state_create(renderer);
+	/* Sprites are drawn in batches, to reduce the number of draw calls */
+	batch = kiavc_batch_create(renderer);
+	/* Keep track of what changes from one frame to the next */
+	dirty_rects = kiavc_dirty_rects_create(kiavc_screen_width, kiavc_screen_height);
+	/* Static room layers are flattened in a single texture */
+	layer_cache = kiavc_layer_cache_create(render_state);
+	/* Check if we've been asked to composite sprites on the CPU */
+	if(kiavc_screen_cpu_compositor) {
+		compositor = kiavc_compositor_create(renderer, kiavc_screen_width, kiavc_screen_height);
+		if(!compositor)
+			SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create CPU compositor, drawing sprites with the renderer\n");
+	}
 	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
 	/* Check if we need to confine the mouse to the window */
 	if(kiavc_screen_grab_mouse)
@@ -573,6 +816,9 @@ int kiavc_engine_init(const char *app, kiavc_bag *bagfile) {
 	/* Check if we need to enable scanlines */
 	if(kiavc_screen_scanlines)
 		kiavc_engine_regenerate_scanlines();
+	/* If we're headless, take note of when we started */
+	if(kiavc_headless)
+		kiavc_headless_start = SDL_GetPerformanceCounter();
 
 	/* Done */
 	return 0;
@@ -594,6 +840,33 @@ SDL_RWops *kiavc_engine_open_file(const char *path) {
 	return rwops;
 }
 
+/* Return the texture atlas from the BAG archive, if any */
+kiavc_atlas *kiavc_engine_get_atlas(void) {
+	return atlas;
+}
+
+/* Return the opaque regions of images from the BAG archive, if any */
+kiavc_map *kiavc_engine_get_opaque_regions(void) {
+	return opaque_regions;
+}
+
+/* Force the whole canvas to be redrawn in the next frame */
+void kiavc_engine_invalidate_canvas(void) {
+	kiavc_dirty_rects_invalidate(dirty_rects);
+}
+
+/* Take note of a new texture, and the surface it was created from */
+void kiavc_engine_texture_created(SDL_Texture *texture, SDL_Surface *surface) {
+	kiavc_compositor_add_texture(compositor, texture, surface);
+}
+
+/* Take note of a texture that's about to be destroyed */
+void kiavc_engine_texture_destroyed(SDL_Texture *texture) {
+	kiavc_capture_forget(texture);
+	kiavc_compositor_remove_texture(compositor, texture);
+	kiavc_dirty_rects_invalidate(dirty_rects);
+}
+
 /* Helper method to check if we're hovering on something */
 static void kiavc_engine_check_hovering(void) {
 	if(engine.main_cursor && engine.main_cursor->animation) {
@@ -609,18 +882,18 @@ static void kiavc_engine_check_hovering(void) {
 		int x = engine.mouse_x + (int)engine.room->res.x;
 		int y = engine.mouse_y + (int)engine.room->res.y;
 		kiavc_resource *resource, *hovering = NULL;
-		kiavc_list *item = engine.render_list;
-		while(item) {
-			resource = (kiavc_resource *)item->data;
+		int qi = 0;
+		for(qi=0; qi<engine.render_queue->count; qi++) {
+			resource = engine.render_queue->items[qi].resource;
+			if(!resource)
+				continue;
 			if(resource->type == KIAVC_OBJECT) {
 				/* FIXME Check if we're in the box */
 				kiavc_object *object = (kiavc_object *)resource;
 				if(!object->interactable) {
-					item = item->next;
 					continue;
 				}
 				if(!object->ui && object->room != engine.room) {
-					item = item->next;
 					continue;
 				}
 				if(object->hover.from_x >= 0 || object->hover.from_y >= 0 ||
@@ -666,10 +939,9 @@ static void kiavc_engine_check_hovering(void) {
 				kiavc_actor *actor = (kiavc_actor *)resource;
 				if(actor != engine.actor && actor->costume && actor->room && actor->room == engine.room) {
 					int w = 0, h = 0;
-					kiavc_costume_set *set = kiavc_costume_get_set(actor->costume, kiavc_actor_state_str(actor->state));
-					if(set && set->animations[actor->direction]) {
-						w = set->animations[actor->direction]->w;
-						h = set->animations[actor->direction]->h;
+					if(actor->animation) {
+						w = actor->animation->w;
+						h = actor->animation->h;
 					}
 					if(actor->scale != 1.0 || (actor->walkbox && actor->walkbox->scale != 1.0)) {
 						float ws = actor->walkbox ? actor->walkbox->scale : 1.0;
@@ -682,7 +954,6 @@ static void kiavc_engine_check_hovering(void) {
 					}
 				}
 			}
-			item = item->next;
 		}
 		if(hovering != engine.hovering) {
 			if(engine.hovering) {
@@ -746,146 +1017,626 @@ static void kiavc_engine_check_hovering(void) {
 			}
 		}
 		if(engine.dialog->selected) {
-			engine.render_list = kiavc_list_remove(engine.render_list, engine.dialog->selected->selected);
-			engine.render_list = kiavc_list_remove(engine.render_list, engine.dialog->selected->text);
-			engine.render_list = kiavc_list_append(engine.render_list, engine.dialog->selected->text);
+			kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)engine.dialog->selected->selected);
+			kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)engine.dialog->selected->text);
+			kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)engine.dialog->selected->text);
 		}
 		engine.dialog->selected = selected;
 		if(selected)
-			engine.render_list = kiavc_list_append(engine.render_list, selected->selected);
+			kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)selected->selected);
 	}
 }
 
-/* Handle input from the user */
-int kiavc_engine_handle_input(void) {
-	if(quit)
+/* Helper to convert the mouse coordinates of an event from the window to the canvas */
+static void kiavc_engine_canvas_event(SDL_Event *e) {
+	if(e->type == SDL_MOUSEMOTION) {
+		e->motion.x /= kiavc_screen_scale;
+		e->motion.y /= kiavc_screen_scale;
+	} else if(e->type == SDL_MOUSEBUTTONUP) {
+		e->button.x /= kiavc_screen_scale;
+		e->button.y /= kiavc_screen_scale;
+	}
+}
+
+/* Helper to process a single input event, whether it's live or recorded:
+ * mouse coordinates are in canvas coordinates, and mod is the state of
+ * the modifier keys when the event was received */
+static int kiavc_engine_process_event(SDL_Event *e, Uint16 mod) {
+	if(e->type == SDL_QUIT) {
+		/* No need to go on */
 		return -1;
-	/* Poll for events */
-	SDL_Event e = { 0 };
-	while(SDL_PollEvent(&e) != 0) {
-		if(e.type == SDL_QUIT) {
-			/* No need to go on */
-			return -1;
-		} else if(e.type == SDL_MOUSEMOTION) {
-			engine.mouse_x = e.motion.x / kiavc_screen_scale;
-			engine.mouse_y = e.motion.y / kiavc_screen_scale;
-			kiavc_engine_check_hovering();
-		} else if(e.type == SDL_MOUSEBUTTONUP) {
-			int x, y;
-			SDL_GetMouseState(&x, &y);
-			x = x/kiavc_screen_scale;
-			y = y/kiavc_screen_scale;
-			if(engine.room) {
-				x += (int)engine.room->res.x;
-				y += (int)engine.room->res.y;
-			}
-			if(engine.dialog) {
-				if(engine.dialog->active && engine.dialog->selected) {
-					char *id = SDL_strdup(engine.dialog->id);
-					char *name = SDL_strdup(engine.dialog->selected->name);
-					/* Get rid of the dialog lines, waiting for the next round */
-					engine.dialog->active = false;
-					kiavc_list *temp = engine.dialog->lines;
-					kiavc_dialog_line *line = NULL;
-					while(temp) {
-						line = (kiavc_dialog_line *)temp->data;
-						if(line->text)
-							engine.render_list = kiavc_list_remove(engine.render_list, line->text);
-						if(line->selected)
-							engine.render_list = kiavc_list_remove(engine.render_list, line->selected);
-						temp = temp->next;
-					}
-					kiavc_dialog_clear(engine.dialog);
-					/* Notify the script about the choice */
-					kiavc_scripts_run_command("dialogSelected('%s', '%s')", id, name);
-					SDL_free(id);
-					SDL_free(name);
-				}
-			} else if(!engine.cutscene && !engine.input_disabled) {
-				if(e.button.button == SDL_BUTTON_LEFT) {
-					kiavc_scripts_run_command("leftClick(%d, %d)", x, y);
-				} else if(e.button.button == SDL_BUTTON_RIGHT) {
-					kiavc_scripts_run_command("rightClick(%d, %d)", x, y);
+	} else if(e->type == SDL_MOUSEMOTION) {
+		engine.mouse_x = e->motion.x;
+		engine.mouse_y = e->motion.y;
+		kiavc_engine_check_hovering();
+	} else if(e->type == SDL_MOUSEBUTTONUP) {
+		int x = e->button.x;
+		int y = e->button.y;
+		if(engine.room) {
+			x += (int)engine.room->res.x;
+			y += (int)engine.room->res.y;
+		}
+		if(engine.dialog) {
+			if(engine.dialog->active && engine.dialog->selected) {
+				char *id = SDL_strdup(engine.dialog->id);
+				char *name = SDL_strdup(engine.dialog->selected->name);
+				/* Get rid of the dialog lines, waiting for the next round */
+				engine.dialog->active = false;
+				kiavc_list *temp = engine.dialog->lines;
+				kiavc_dialog_line *line = NULL;
+				while(temp) {
+					line = (kiavc_dialog_line *)temp->data;
+					if(line->text)
+						kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)line->text);
+					if(line->selected)
+						kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)line->selected);
+					temp = temp->next;
 				}
+				kiavc_dialog_clear(engine.dialog);
+				/* Notify the script about the choice */
+				kiavc_scripts_run_command("dialogSelected('%s', '%s')", id, name);
+				SDL_free(id);
+				SDL_free(name);
 			}
-		} else if(e.type == SDL_TEXTINPUT) {
-			if(console_active) {
-				if(!(SDL_GetModState() & KMOD_CTRL && (e.text.text[0] == 'c' || e.text.text[0] == 'C' ||
-						e.text.text[0] == 'v' || e.text.text[0] == 'V'))) {
-					size_t len = SDL_strlen(console_text);
-					if(len < (sizeof(console_text)-1)) {
-						SDL_snprintf(console_text+len, sizeof(console_text)-len-1, "%s", e.text.text);
-						kiavc_font_text_destroy(console_rendered);
-						SDL_Color color = { .r = 128, .g = 128, .b = 128, 0 };
-						console_rendered = kiavc_font_render_text(console_font, renderer, console_text, &color,
-							NULL, kiavc_screen_width * kiavc_screen_scale);
-					}
+		} else if(!engine.cutscene && !engine.input_disabled) {
+			if(e->button.button == SDL_BUTTON_LEFT) {
+				kiavc_scripts_run_command("leftClick(%d, %d)", x, y);
+			} else if(e->button.button == SDL_BUTTON_RIGHT) {
+				kiavc_scripts_run_command("rightClick(%d, %d)", x, y);
+			}
+		}
+	} else if(e->type == SDL_TEXTINPUT) {
+		if(console_active) {
+			if(!(mod & KMOD_CTRL && (e->text.text[0] == 'c' || e->text.text[0] == 'C' ||
+					e->text.text[0] == 'v' || e->text.text[0] == 'V'))) {
+				size_t len = SDL_strlen(console_text);
+				if(len < (sizeof(console_text)-1)) {
+					SDL_snprintf(console_text+len, sizeof(console_text)-len-1, "%s", e->text.text);
+					kiavc_font_text_destroy(console_rendered);
+					SDL_Color color = { .r = 128, .g = 128, .b = 128, 0 };
+					console_rendered = kiavc_font_render_text(console_font, renderer, console_text, &color,
+						NULL, kiavc_screen_width * kiavc_screen_scale);
 				}
 			}
-		} else if(e.type == SDL_KEYDOWN) {
-			/* We handle text input different depending on whether the
-			 * debugging console is active or not */
-			if(console_active) {
-				if(e.key.keysym.sym == SDLK_ESCAPE) {
-					kiavc_engine_hide_console();
-					continue;
-				} else if(e.key.keysym.sym == SDLK_RETURN) {
-					kiavc_scripts_run_command("%s", console_text + 2);
-					char *line = SDL_strdup(console_text + 2);
-					console_history = kiavc_list_prepend(console_history, line);
-					if(console_file) {
-						/* Also append to the debug history */
-						size_t len = strlen(line), written = fwrite(line, 1, strlen(line), console_file);
-						if(written != len) {
-							SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't write the debug line to history: %s\n",
-								strerror(errno));
-						} else {
-							(void)fwrite("\n", 1, 1, console_file);
-						}
-					}
-					console_current = NULL;
-					*(console_text + 2) = '\0';
-				} else if(e.key.keysym.sym == SDLK_UP) {
-					if(console_current == NULL)
-						console_current = console_history;
-					else
-						console_current = console_current->next ? console_current->next : console_current;
-					SDL_snprintf(console_text, sizeof(console_text)-1, "> %s", console_current ? (char *)console_current->data : "");
-				} else if(e.key.keysym.sym == SDLK_DOWN) {
-					console_current = console_current ? console_current->prev : NULL;
-					SDL_snprintf(console_text, sizeof(console_text)-1, "> %s", console_current ? (char *)console_current->data : "");
-				} else if(e.key.keysym.sym == SDLK_BACKSPACE && SDL_strlen(console_text) > 2) {
-					console_text[SDL_strlen(console_text)-1] = '\0';
-				} else if(e.key.keysym.sym == SDLK_v && SDL_GetModState() & KMOD_CTRL) {
-					char *clipboard = SDL_GetClipboardText();
-					size_t len = SDL_strlen(console_text);
-					if(clipboard && SDL_strlen(clipboard) > 0 && len < (sizeof(console_text)-1)) {
-						SDL_snprintf(console_text+len, sizeof(console_text)-len-1, "%s", clipboard);
+		}
+	} else if(e->type == SDL_KEYDOWN) {
+		/* We handle text input different depending on whether the
+		 * debugging console is active or not */
+		if(console_active) {
+			if(e->key.keysym.sym == SDLK_ESCAPE) {
+				kiavc_engine_hide_console();
+				return 0;
+			} else if(e->key.keysym.sym == SDLK_RETURN) {
+				kiavc_scripts_run_command("%s", console_text + 2);
+				char *line = SDL_strdup(console_text + 2);
+				console_history = kiavc_list_prepend(console_history, line);
+				if(console_file) {
+					/* Also append to the debug history */
+					size_t len = strlen(line), written = fwrite(line, 1, strlen(line), console_file);
+					if(written != len) {
+						SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't write the debug line to history: %s\n",
+							strerror(errno));
+					} else {
+						(void)fwrite("\n", 1, 1, console_file);
 					}
 				}
-				kiavc_font_text_destroy(console_rendered);
-				SDL_Color color = { .r = 128, .g = 128, .b = 128 };
-				console_rendered = kiavc_font_render_text(console_font, renderer, console_text, &color,
-					NULL, kiavc_screen_width * kiavc_screen_scale);
-				continue;
+				console_current = NULL;
+				*(console_text + 2) = '\0';
+			} else if(e->key.keysym.sym == SDLK_UP) {
+				if(console_current == NULL)
+					console_current = console_history;
+				else
+					console_current = console_current->next ? console_current->next : console_current;
+				SDL_snprintf(console_text, sizeof(console_text)-1, "> %s", console_current ? (char *)console_current->data : "");
+			} else if(e->key.keysym.sym == SDLK_DOWN) {
+				console_current = console_current ? console_current->prev : NULL;
+				SDL_snprintf(console_text, sizeof(console_text)-1, "> %s", console_current ? (char *)console_current->data : "");
+			} else if(e->key.keysym.sym == SDLK_BACKSPACE && SDL_strlen(console_text) > 2) {
+				console_text[SDL_strlen(console_text)-1] = '\0';
+			} else if(e->key.keysym.sym == SDLK_v && e->key.keysym.mod & KMOD_CTRL) {
+				char *clipboard = SDL_GetClipboardText();
+				size_t len = SDL_strlen(console_text);
+				if(clipboard && SDL_strlen(clipboard) > 0 && len < (sizeof(console_text)-1)) {
+					SDL_snprintf(console_text+len, sizeof(console_text)-len-1, "%s", clipboard);
+				}
 			}
-			/* If we got here, the console is not active: pass the key to the script */
-			const char *key = SDL_GetKeyName(e.key.keysym.sym);
-			kiavc_scripts_run_command("userInput('%s')", key);
+			kiavc_font_text_destroy(console_rendered);
+			SDL_Color color = { .r = 128, .g = 128, .b = 128 };
+			console_rendered = kiavc_font_render_text(console_font, renderer, console_text, &color,
+				NULL, kiavc_screen_width * kiavc_screen_scale);
+			return 0;
 		}
+		/* If we got here, the console is not active: pass the key to the script */
+		const char *key = SDL_GetKeyName(e->key.keysym.sym);
+		kiavc_scripts_run_command("userInput('%s')", key);
 	}
 	/* Done */
 	return 0;
 }
 
-/* Update the "world" */
-int kiavc_engine_update_world(void) {
+/* Helper to get the animation of an actor or object whose frames we
+ * need to update, and how many ms each of those frames lasts */
+static kiavc_animation *kiavc_engine_animation(kiavc_resource *resource, int *ms) {
+	kiavc_animation *anim = NULL;
+	*ms = 100;
+	if(resource->type == KIAVC_ACTOR) {
+		kiavc_actor *actor = (kiavc_actor *)resource;
+		anim = actor->animation;
+		if(anim)
+			*ms = anim->ms;
+	} else if(resource->type == KIAVC_OBJECT) {
+		kiavc_object *object = (kiavc_object *)resource;
+		anim = object->state ? object->state->animation : NULL;
+		if(anim)
+			*ms = anim->ms;
+		if(object->ui)
+			anim = object->ui_animation;
+	}
+	if(*ms < 1)
+		*ms = 1;
+	return anim;
+}
+
+/* Helper to schedule the next update of a resource in the render queue:
+ * animations are due when the next frame is, and text lines when they'll
+ * need to be removed, while resources that never change are left alone */
+static void kiavc_engine_schedule(kiavc_resource *resource) {
+	if(!resource || resource->queue_index == 0) {
+		kiavc_schedule_remove(engine.schedule, resource);
+		return;
+	}
+	if(resource->type == KIAVC_FONT_TEXT) {
+		/* Only cursor text and dialog lines remain there until we manually remove it */
+		kiavc_font_text *line = (kiavc_font_text *)resource;
+		if(line->owner_type == KIAVC_CURSOR || line->owner_type == KIAVC_DIALOG || line->duration == 0)
+			kiavc_schedule_remove(engine.schedule, resource);
+		else
+			kiavc_schedule_set(engine.schedule, resource, line->started ? line->started + line->duration : 0);
+		return;
+	}
+	int ms = 0;
+	kiavc_animation *anim = kiavc_engine_animation(resource, &ms);
+	if(!anim || anim->frames < 2)
+		kiavc_schedule_remove(engine.schedule, resource);
+	else
+		kiavc_schedule_set(engine.schedule, resource, resource->ticks ? resource->ticks + ms : 0);
+}
+
+/* Helper to move the animation of an actor or object to the frame it
+ * should be at now: since the frame is computed from the time that
+ * elapsed, animations that weren't updated for a while catch up */
+static void kiavc_engine_advance_animation(kiavc_resource *resource, Uint32 ticks) {
+	if(resource->ticks == 0) {
+		resource->ticks = ticks;
+		return;
+	}
+	int ms = 0;
+	kiavc_animation *anim = kiavc_engine_animation(resource, &ms);
+	if(!anim || anim->frames < 2 || ticks < resource->ticks + ms)
+		return;
+	int frames = (ticks - resource->ticks) / ms;
+	resource->ticks += frames * ms;
+	if(resource->type == KIAVC_ACTOR) {
+		kiavc_actor *actor = (kiavc_actor *)resource;
+		actor->frame = (actor->frame + frames) % anim->frames;
+	} else if(resource->type == KIAVC_OBJECT) {
+		kiavc_object *object = (kiavc_object *)resource;
+		object->frame = (object->frame + frames) % anim->frames;
+	}
+}
+
+/* Helper to update the animation an actor uses, and when it will change next */
+static void kiavc_engine_update_actor_animation(kiavc_actor *actor) {
+	kiavc_actor_update_animation(actor);
+	kiavc_engine_schedule(&actor->res);
+}
+
+/* Helper to check whether we can wait for events when the world is idle:
+ * we can't when the clock is virtual, or when something we draw changes
+ * all the time (e.g., the profiler overlay, or render captures) */
+static bool kiavc_engine_can_idle(void) {
+	return !kiavc_headless && !recording && !replay && !kiavc_debug_profiler &&
+		!kiavc_capture_filename && !kiavc_capture_is_enabled();
+}
+
+/* Helper to check, at the end of a simulation step, if the world is idle,
+ * i.e., if nothing is moving, fading or being animated: in that case, we
+ * also take note of the next time something will change, if we know */
+static void kiavc_engine_check_idle(Uint32 ticks, Uint32 wakeup) {
+	kiavc_idle = false;
+	kiavc_idle_wakeup = 0;
+	if(!kiavc_engine_can_idle() || plugins_list || console_active || engine.fade_ticks > 0 ||
+			kiavc_tweens_motions_active(engine.tweens) || kiavc_tweens_values_active(engine.tweens) ||
+			engine.render_queue->added || engine.room_direction_x != 0 || engine.room_direction_y != 0)
+		return;
+	/* The schedule tells us when the next animation frame or text line is due */
+	Uint32 next = wakeup, deadline = 0;
+	if(kiavc_schedule_peek(engine.schedule, &deadline)) {
+		if(deadline <= ticks)
+			return;
+		if(next == 0 || deadline < next)
+			next = deadline;
+	}
+	kiavc_cursor *cursors[2] = { engine.main_cursor, engine.hotspot_cursor };
+	int i = 0;
+	for(i=0; i<2; i++) {
+		if(cursors[i] && cursors[i]->animation && cursors[i]->animation->frames > 1 &&
+				(next == 0 || cursors[i]->res.ticks + cursors[i]->animation->ms < next))
+			next = cursors[i]->res.ticks + cursors[i]->animation->ms;
+	}
+	kiavc_idle = true;
+	kiavc_idle_wakeup = next;
+}
+
+/* Helper to move the clock ahead after we waited while the world was idle:
+ * since nothing changed, we don't simulate all the steps we slept through.
+ * Actors and objects catch up with their animations on their own, while
+ * for cursors we move animation timers ahead, as if those steps happened */
+static void kiavc_engine_skip_idle_steps(Uint64 skipped) {
+	kiavc_clock_ms += (double)skipped * 1000.0 / (double)kiavc_screen_fps;
+	Uint32 ticks = (Uint32)kiavc_clock_ms;
+	kiavc_cursor *cursors[2] = { engine.main_cursor, engine.hotspot_cursor };
+	int i = 0, ms = 0;
+	for(i=0; i<2; i++) {
+		if(!cursors[i] || cursors[i]->res.ticks == 0 || cursors[i]->res.ticks >= ticks)
+			continue;
+		ms = cursors[i]->animation ? cursors[i]->animation->ms : 100;
+		cursors[i]->res.ticks = ticks - ((ticks - cursors[i]->res.ticks) % ms);
+	}
+	if(engine.room_ticks > 0 && engine.room_ticks < ticks)
+		engine.room_ticks = ticks - ((ticks - engine.room_ticks) % 15);
+}
+
+/* Helper to figure out how long we can wait for events before handling
+ * input: we only wait if the window is hidden, or if the world is idle
+ * and we already drew how it looks, in which case it's until the next
+ * time something will change, or at most KIAVC_IDLE_MAX_WAIT */
+static Uint32 kiavc_engine_idle_timeout(void) {
+	if(kiavc_headless || recording || replay)
+		return 0;
+	Uint32 frame = 1000 / kiavc_screen_fps;
+	if(!kiavc_idle || (!kiavc_idle_rendered && !kiavc_screen_hidden))
+		return kiavc_screen_hidden ? frame : 0;
+	Uint32 now = (Uint32)kiavc_clock_ms, timeout = KIAVC_IDLE_MAX_WAIT;
+	if(kiavc_idle_wakeup > 0) {
+		if(kiavc_idle_wakeup <= now) {
+			/* Something's about to change, so we'll need to draw it */
+			kiavc_idle_rendered = false;
+			return 0;
+		}
+		if(kiavc_idle_wakeup - now < timeout)
+			timeout = kiavc_idle_wakeup - now;
+	}
+	return timeout;
+}
+
+/* Handle input from the user */
+int kiavc_engine_handle_input(void) {
 	if(quit)
 		return -1;
-	/* Update the world in the script first */
-	uint32_t ticks = SDL_GetTicks();
-	if(kiavc_scripts_update_world(ticks) < 0)
+	/* If there's nothing new to draw, wait for something to happen rather than polling */
+	Uint32 timeout = kiavc_engine_idle_timeout();
+	if(timeout > 0) {
+		kiavc_trace_begin("idle", NULL);
+		SDL_WaitEventTimeout(NULL, timeout);
+		kiavc_trace_end();
+		kiavc_idle_rendered = false;
+	}
+	Uint64 start = kiavc_profiler_now();
+	/* Poll for events */
+	SDL_Event e = { 0 };
+	while(SDL_PollEvent(&e) != 0) {
+		/* Anything may change what's on screen */
+		kiavc_idle_rendered = false;
+		if(e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET) {
+			/* The content of the canvas may have been lost */
+			kiavc_dirty_rects_invalidate(dirty_rects);
+		} else if(e.type == SDL_WINDOWEVENT) {
+			/* Keep track of whether the window can be seen at all */
+			if(e.window.event == SDL_WINDOWEVENT_HIDDEN || e.window.event == SDL_WINDOWEVENT_MINIMIZED) {
+				kiavc_screen_hidden = true;
+			} else if(e.window.event == SDL_WINDOWEVENT_SHOWN || e.window.event == SDL_WINDOWEVENT_RESTORED ||
+					e.window.event == SDL_WINDOWEVENT_MAXIMIZED || e.window.event == SDL_WINDOWEVENT_EXPOSED) {
+				kiavc_screen_hidden = false;
+				kiavc_dirty_rects_invalidate(dirty_rects);
+			}
+		}
+		if(replay) {
+			/* When replaying we ignore the user, unless they want to quit */
+			if(e.type == SDL_QUIT)
+				return -1;
+			continue;
+		}
+		/* Recordings are in canvas coordinates, to work with any window size */
+		kiavc_engine_canvas_event(&e);
+		Uint16 mod = (Uint16)SDL_GetModState();
+		if(recording && kiavc_recording_is_supported(&e))
+			kiavc_recording_add_event(recording, kiavc_clock_steps, &e, mod);
+		if(kiavc_engine_process_event(&e, mod) < 0)
+			return -1;
+	}
+	if(replay) {
+		/* Feed the recorded events meant for the current step */
+		kiavc_recording_item *ri = NULL;
+		while((ri = kiavc_recording_peek(replay)) != NULL && ri->step <= kiavc_clock_steps) {
+			if(ri->type == KIAVC_RECORDING_CHECKSUM) {
+				/* Checksum we couldn't verify, skip it */
+				kiavc_recording_next(replay);
+				continue;
+			}
+			e = ri->event;
+			Uint16 mod = ri->mod;
+			kiavc_recording_next(replay);
+			if(kiavc_engine_process_event(&e, mod) < 0)
+				return -1;
+		}
+		if(ri == NULL) {
+			SDL_Log("Replay completed\n");
+			quit = true;
+			return -1;
+		}
+	}
+	kiavc_profiler_add(KIAVC_PROFILER_INPUT, start);
+	/* Done */
+	return 0;
+}
+
+/* Helper to get the position of a resource when rendering: if the
+ * resource moved in the last simulation step, and wasn't moved after it,
+ * we interpolate between where it was at the beginning and at the end */
+static void kiavc_engine_render_position(kiavc_resource *resource, int *x, int *y) {
+	if(resource->moved == kiavc_clock_steps && resource->x == resource->last_x && resource->y == resource->last_y) {
+		*x = (int)(resource->prev_x + (resource->x - resource->prev_x) * kiavc_clock_alpha);
+		*y = (int)(resource->prev_y + (resource->y - resource->prev_y) * kiavc_clock_alpha);
+	} else {
+		*x = (int)resource->x;
+		*y = (int)resource->y;
+	}
+}
+
+/* Generation of the images resources draw, increased any time a costume
+ * changes what it contains, so that cached bounding boxes are updated */
+static Uint32 kiavc_bounds_generation = 0;
+
+/* Helper to check if the cached bounding box of a resource is up to date */
+static bool kiavc_engine_bounds_match(kiavc_bounds *bounds, int x, int y, float scale, const void *image, int variant) {
+	return bounds->valid && bounds->x == x && bounds->y == y && bounds->scale == scale &&
+		bounds->image == image && bounds->variant == variant && bounds->generation == kiavc_bounds_generation;
+}
+
+/* Helper to update the cached bounding box of a resource */
+static void kiavc_engine_bounds_update(kiavc_bounds *bounds, int x, int y, float scale, const void *image, int variant, SDL_Rect *rect) {
+	bounds->x = x;
+	bounds->y = y;
+	bounds->scale = scale;
+	bounds->image = image;
+	bounds->variant = variant;
+	bounds->generation = kiavc_bounds_generation;
+	bounds->rect = *rect;
+	bounds->valid = true;
+}
+
+/* Helper to check if a bounding box is within the camera */
+static bool kiavc_engine_bounds_visible(SDL_Rect *rect, int view_x, int view_y) {
+	return rect->x - view_x < kiavc_screen_width && rect->y - view_y < kiavc_screen_height &&
+		rect->x + rect->w - view_x > 0 && rect->y + rect->h - view_y > 0;
+}
+
+/* Helper to wait for the next frame when we can't rely on vsync: we sleep
+ * for the whole milliseconds left, and then in steps of a millisecond for
+ * what remains, rather than busy waiting, which would keep a core busy
+ * for nothing: frames may be up to a millisecond late as a consequence */
+static void kiavc_engine_wait_frame(void) {
+	Uint64 frame = kiavc_clock_frequency / kiavc_screen_fps;
+	Uint64 now = SDL_GetPerformanceCounter();
+	if(kiavc_clock_next_frame == 0 || now > kiavc_clock_next_frame + frame) {
+		/* First frame, or we're way too late: start over from now */
+		kiavc_clock_next_frame = now + frame;
+		return;
+	}
+	Uint32 ms = 0;
+	while(now < kiavc_clock_next_frame) {
+		ms = (Uint32)(((kiavc_clock_next_frame - now) * 1000) / kiavc_clock_frequency);
+		kiavc_pipeline_sleep(ms > 0 ? ms : 1);
+		now = SDL_GetPerformanceCounter();
+	}
+	kiavc_clock_next_frame += frame;
+}
+
+/* Helper to compute a checksum of the state of the world (FNV-1a), so
+ * that we can check if a replay diverged from the original session */
+static void kiavc_engine_checksum_add(Uint32 *hash, Sint32 value) {
+	int i = 0;
+	for(i=0; i<4; i++) {
+		*hash ^= (Uint32)((value >> (i*8)) & 0xFF);
+		*hash *= 16777619;
+	}
+}
+static Uint32 kiavc_engine_checksum(void) {
+	Uint32 hash = 2166136261u;
+	if(engine.room) {
+		kiavc_engine_checksum_add(&hash, (Sint32)(engine.room->res.x * 16));
+		kiavc_engine_checksum_add(&hash, (Sint32)(engine.room->res.y * 16));
+	}
+	kiavc_engine_checksum_add(&hash, engine.fade_alpha);
+	kiavc_resource *resource = NULL;
+	int qi = 0;
+	for(qi=0; qi<engine.render_queue->count; qi++) {
+		resource = engine.render_queue->items[qi].resource;
+		if(!resource)
+			continue;
+		kiavc_engine_checksum_add(&hash, resource->type);
+		kiavc_engine_checksum_add(&hash, (Sint32)(resource->x * 16));
+		kiavc_engine_checksum_add(&hash, (Sint32)(resource->y * 16));
+		kiavc_engine_checksum_add(&hash, resource->zplane);
+		kiavc_engine_checksum_add(&hash, resource->fade_alpha);
+		if(resource->type == KIAVC_ACTOR) {
+			kiavc_actor *actor = (kiavc_actor *)resource;
+			kiavc_engine_checksum_add(&hash, actor->state);
+			kiavc_engine_checksum_add(&hash, actor->direction);
+			kiavc_engine_checksum_add(&hash, actor->frame);
+		} else if(resource->type == KIAVC_OBJECT) {
+			kiavc_object *object = (kiavc_object *)resource;
+			kiavc_engine_checksum_add(&hash, object->frame);
+		}
+	}
+	return hash;
+}
+
+/* Helpers for what the world update does with SDL, which must happen on
+ * the main thread in case we're updating the world on the pipeline worker */
+static void kiavc_engine_main_regenerate_fade(void *data) {
+	kiavc_engine_regenerate_fade();
+}
+static void kiavc_engine_main_destroy_fade(void *data) {
+	kiavc_engine_texture_destroyed(engine.fade_texture);
+	SDL_DestroyTexture(engine.fade_texture);
+	engine.fade_texture = NULL;
+}
+static void kiavc_engine_main_destroy_line(void *data) {
+	kiavc_font_text *line = (kiavc_font_text *)data;
+	if(line->id)
+		kiavc_map_remove(texts, line->id);
+	else
+		kiavc_font_text_destroy(line);
+}
+
+/* Helper to find which walkbox a chunk of the actors that moved is in:
+ * this may run in parallel on different chunks, since it only looks */
+static void kiavc_engine_find_walkboxes(int from, int to, void *data) {
+	int i = 0;
+	for(i=from; i<to; i++) {
+		kiavc_actor *actor = engine.moved[i];
+		kiavc_pathfinding_point point = { .x = (int)actor->res.x, .y = (int)actor->res.y };
+		engine.moved_walkboxes[i] = kiavc_pathfinding_context_find_walkbox(engine.room->pathfinding, &point);
+	}
+}
+
+/* Helper to update the walkbox an actor is in, after it moved */
+static void kiavc_engine_set_walkbox(kiavc_actor *actor, kiavc_pathfinding_walkbox *walkbox) {
+	if(walkbox != actor->walkbox) {
+		if(walkbox) {
+			SDL_Log("Actor '%s' now in walkbox (%dx%d -> %dx%d)", actor->id,
+				walkbox->p1.x, walkbox->p1.y, walkbox->p2.x, walkbox->p2.y);
+			if(walkbox->name) {
+				/* Signal script */
+				SDL_Log("Actor '%s' triggered walkbox '%s'\n", actor->id, walkbox->name);
+				kiavc_scripts_run_command("triggerWalkbox('%s', '%s', '%s')",
+					engine.room->id, walkbox->name, actor->id);
+			}
+		}
+		actor->walkbox = walkbox;
+	}
+}
+
+/* Helper to check if the camera needs to scroll to follow an actor */
+static void kiavc_engine_scroll_to_actor(kiavc_actor *actor) {
+	int width = kiavc_screen_width;
+	int height = kiavc_screen_height;
+	if(engine.room_direction_x == 0) {
+		/* FIXME */
+		int portion = width/3;
+		if((int)actor->res.x - (int)engine.room->res.x < portion)
+			engine.room_direction_x = -1;
+		else if((int)actor->res.x - (int)engine.room->res.x > (width - portion))
+			engine.room_direction_x = 1;
+	} else {
+		/* FIXME */
+		int portion = width/2;
+		if((int)actor->res.x - (int)engine.room->res.x > (portion-5) && (int)actor->res.x - (int)engine.room->res.x < (portion+5)) {
+			engine.room_direction_x = 0;
+		}
+	}
+	if(engine.room_direction_y == 0) {
+		/* FIXME */
+		int portion = height/2;
+		if((int)actor->res.y - (int)engine.room->res.y < portion)
+			engine.room_direction_y = -1;
+		else if((int)actor->res.y - (int)engine.room->res.y > (height - portion))
+			engine.room_direction_y = 1;
+	} else {
+		/* FIXME */
+		int portion = height/2;
+		if((int)actor->res.y - (int)engine.room->res.y > (portion-5) && (int)actor->res.y - (int)engine.room->res.y < (portion+5)) {
+			engine.room_direction_y = 0;
+		}
+	}
+}
+
+/* Helper to notify the scripts about the tweens that were completed in the last update */
+static void kiavc_engine_tweens_completed(void) {
+	kiavc_tween_event *event = NULL;
+	kiavc_resource *resource = NULL;
+	int i = 0;
+	for(i=0; i<engine.tweens->events_count; i++) {
+		event = &engine.tweens->events[i];
+		resource = event->resource;
+		if(!resource)
+			continue;
+		const char *id = NULL;
+		if(resource->type == KIAVC_ACTOR)
+			id = ((kiavc_actor *)resource)->id;
+		else if(resource->type == KIAVC_OBJECT)
+			id = ((kiavc_object *)resource)->id;
+		else if(resource->type == KIAVC_FONT_TEXT)
+			id = ((kiavc_font_text *)resource)->id;
+		if(event->type == KIAVC_TWEEN_MOTION && resource->type == KIAVC_ACTOR) {
+			/* Arrived, is it over? */
+			kiavc_actor *actor = (kiavc_actor *)resource;
+			if(actor->step) {
+				/* We have to walk more */
+				kiavc_pathfinding_point *p = (kiavc_pathfinding_point *)actor->step->data;
+				actor->res.target_x = p->x;
+				actor->res.target_y = p->y;
+				actor->step = actor->step->next;
+				kiavc_tweens_move(engine.tweens, &actor->res, p->x, p->y, actor->res.speed);
+			} else {
+				/* We're done */
+				g_list_free_full(actor->path, (GDestroyNotify)kiavc_pathfinding_point_destroy);
+				actor->path = NULL;
+				actor->step = NULL;
+				actor->state = KIAVC_ACTOR_STILL;
+				kiavc_engine_update_actor_animation(actor);
+				actor->res.target_x = -1;
+				actor->res.target_y = -1;
+				/* FIXME */
+				kiavc_scripts_run_command("signal('%s')", actor->id);
+			}
+		} else if(event->type == KIAVC_TWEEN_MOTION) {
+			/* We're done: signal the script that the object or text has finished moving */
+			resource->speed = 0;
+			if(id)
+				kiavc_scripts_run_command("signal('%s')", id);
+		} else if(event->type == KIAVC_TWEEN_ALPHA) {
+			/* Signal the script that the fade is over */
+			if(id)
+				kiavc_scripts_run_command("signal('fade-%s')", id);
+		} else if(event->type == KIAVC_TWEEN_SCALE) {
+			/* Signal the script that the scaling is over */
+			if(id)
+				kiavc_scripts_run_command("signal('scale-%s')", id);
+		}
+	}
+}
+
+/* Helper to take note of where a resource is at the end of a simulation step, if it moved */
+static void kiavc_engine_track_motion(kiavc_resource *resource, Uint32 step) {
+	if(!resource || (resource->x == resource->prev_x && resource->y == resource->prev_y))
+		return;
+	resource->last_x = resource->x;
+	resource->last_y = resource->y;
+	resource->moved = step;
+}
+
+/* Update the "world" by a single simulation step */
+static int kiavc_engine_update_step(uint32_t ticks) {
+	/* Update the world in the script first: the script also tells us when
+	 * the next coroutine waiting on a timer will need to be awakened */
+	Uint64 start = kiavc_profiler_now();
+	Uint32 wakeup = 0;
+	if(kiavc_scripts_update_world(ticks, &wakeup) < 0)
 		return -1;
+	kiavc_profiler_add(KIAVC_PROFILER_SCRIPTS, start);
 	/* Now update the world in the engine: initialize ticks, if needed */
 	if(engine.room_ticks == 0)
 		engine.room_ticks = ticks;
@@ -893,262 +1644,162 @@ int kiavc_engine_update_world(void) {
 	if((engine.fade_in > 0 || engine.fade_out > 0) && engine.fade_ticks == 0) {
 		engine.fade_ticks = ticks;
 		engine.fade_alpha = 255;
-		kiavc_engine_regenerate_fade();
+		kiavc_pipeline_call(kiavc_engine_main_regenerate_fade, NULL);
 	}
-	/* Check if we're fading in/out individual resources */
+	/* If resources were added to the render queue, check if and when they'll need updating */
 	kiavc_resource *resource = NULL;
-	kiavc_list *fading = engine.fading;
-	while(fading) {
-		resource = (kiavc_resource *)fading->data;
-		if(resource->fade_ms > 0 && resource->fade_ticks == 0)
-			resource->fade_ticks = ticks;
-		fading = fading->next;
-	}
-	/* Loop on all resources to render, which are already ordered by z-plane */
-	kiavc_list *item = engine.render_list, *to_remove = NULL;
+	int qi = 0;
+	if(engine.render_queue->added) {
+		engine.render_queue->added = false;
+		for(qi=0; qi<engine.render_queue->count; qi++) {
+			resource = engine.render_queue->items[qi].resource;
+			if(resource && !kiavc_schedule_contains(engine.schedule, resource))
+				kiavc_engine_schedule(resource);
+		}
+	}
+	/* Get the actors that are walking ready for the next step: movement
+	 * happens once per simulation step, and we only look at what's moving */
+	kiavc_list *to_remove = NULL;
 	bool sort = false;
-	while(item) {
-		resource = (kiavc_resource *)item->data;
-		if(resource->ticks == 0)
-			resource->ticks = ticks;
-		if(resource->type == KIAVC_ACTOR) {
-			/* This is an actor */
-			kiavc_actor *actor = (kiavc_actor *)resource;
-			if(actor->line && actor->line->started == 0)
-				actor->line->started = ticks;
-			if(actor->res.move_ticks == 0)
-				actor->res.move_ticks = ticks;
-			if(ticks - actor->res.move_ticks >= (1000/kiavc_screen_fps)) {
-				actor->res.move_ticks += (1000/kiavc_screen_fps);
-				if(actor->res.target_x != -1 && actor->res.target_y != -1) {
-					if(actor->state != KIAVC_ACTOR_WALKING)
-						actor->frame = 0;
-					actor->state = KIAVC_ACTOR_WALKING;
-					if(actor->line) {
-						to_remove = kiavc_list_append(to_remove, actor->line);
-						actor->line = NULL;
-					}
-					int diff_x = (int)actor->res.x - actor->res.target_x;
-					int diff_y = (int)actor->res.y - actor->res.target_y;
-					if(abs(diff_x) > abs(diff_y)) {
-						/* Left/right */
-						if(diff_x > 0)
-							actor->direction = KIAVC_LEFT;
-						else if(diff_x < 0)
-							actor->direction = KIAVC_RIGHT;
-					} else {
-						/* Up/down */
-						if(diff_y > 0)
-							actor->direction = KIAVC_UP;
-						else if(diff_y < 0)
-							actor->direction = KIAVC_DOWN;
-					}
-					float speed = (float)actor->res.speed;
-					if(actor->walkbox && actor->walkbox->speed != 1.0) {
-						speed = (float)(speed) * actor->walkbox->speed;
-						if(speed < 1.0)
-							speed = 1.0;
-					}
-					if((int)actor->res.x != actor->res.target_x || (int)actor->res.y != actor->res.target_y) {
-						float movement = speed/kiavc_screen_fps;
-						float d = sqrt(((actor->res.target_x - actor->res.x)*(actor->res.target_x - actor->res.x)) +
-							((actor->res.target_y - actor->res.y)*(actor->res.target_y - actor->res.y)));
-						float p = d/movement;
-						float mx = actor->res.x + ((float)actor->res.target_x - actor->res.x) / p;
-						float my = actor->res.y + ((float)actor->res.target_y - actor->res.y) / p;
-						if((actor->res.x > (float)actor->res.target_x && mx < (float)actor->res.target_x)
-								|| (actor->res.x < (float)actor->res.target_x && mx > (float)actor->res.target_x))
-							mx = (float)actor->res.target_x;
-						if((actor->res.y > (float)actor->res.target_y && my < (float)actor->res.target_y)
-								|| (actor->res.y < (float)actor->res.target_y && my > (float)actor->res.target_y))
-							my = (float)actor->res.target_y;
-						if((int)my != (int)actor->res.y)
-							sort = true;
-						actor->res.x = mx;
-						actor->res.y = my;
-					}
-					if((int)actor->res.x == actor->res.target_x && (int)actor->res.y == actor->res.target_y) {
-						/* Arrived, is it over? */
-						if(actor->step) {
-							/* We have to walk more */
-							kiavc_pathfinding_point *p = (kiavc_pathfinding_point *)actor->step->data;
-							actor->res.target_x = p->x;
-							actor->res.target_y = p->y;
-							actor->step = actor->step->next;
-						} else {
-							/* We're done */
-							g_list_free_full(actor->path, (GDestroyNotify)kiavc_pathfinding_point_destroy);
-							actor->path = NULL;
-							actor->step = NULL;
-							actor->state = KIAVC_ACTOR_STILL;
-							actor->res.target_x = -1;
-							actor->res.target_y = -1;
-							/* FIXME */
-							kiavc_scripts_run_command("signal('%s')", actor->id);
-						}
-					}
-					/* FIXME Check which walkbox we're in */
-					if(engine.room && engine.room->pathfinding && engine.room->pathfinding->walkboxes) {
-						int x = (int)actor->res.x;
-						int y = (int)actor->res.y;
-						kiavc_pathfinding_point point = { .x = x, .y = y };
-						kiavc_pathfinding_walkbox *walkbox = kiavc_pathfinding_context_find_walkbox(engine.room->pathfinding, &point);
-						if(walkbox != actor->walkbox) {
-							if(walkbox) {
-								SDL_Log("Actor '%s' now in walkbox (%dx%d -> %dx%d)", actor->id,
-									walkbox->p1.x, walkbox->p1.y, walkbox->p2.x, walkbox->p2.y);
-								if(walkbox->name) {
-									/* Signal script */
-									SDL_Log("Actor '%s' triggered walkbox '%s'\n", actor->id, walkbox->name);
-									kiavc_scripts_run_command("triggerWalkbox('%s', '%s', '%s')",
-										engine.room->id, walkbox->name, actor->id);
-								}
-							}
-							actor->walkbox = walkbox;
-						}
-					}
-				}
-				if(actor->room == engine.room && engine.following == actor) {
-					int width = kiavc_screen_width;
-					int height = kiavc_screen_height;
-					if(engine.room_direction_x == 0) {
-						/* FIXME */
-						int portion = width/3;
-						if((int)actor->res.x - (int)engine.room->res.x < portion)
-							engine.room_direction_x = -1;
-						else if((int)actor->res.x - (int)engine.room->res.x > (width - portion))
-							engine.room_direction_x = 1;
-					} else {
-						/* FIXME */
-						int portion = width/2;
-						if((int)actor->res.x - (int)engine.room->res.x > (portion-5) && (int)actor->res.x - (int)engine.room->res.x < (portion+5)) {
-							engine.room_direction_x = 0;
-						}
-					}
-					if(engine.room_direction_y == 0) {
-						/* FIXME */
-						int portion = height/2;
-						if((int)actor->res.y - (int)engine.room->res.y < portion)
-							engine.room_direction_y = -1;
-						else if((int)actor->res.y - (int)engine.room->res.y > (height - portion))
-							engine.room_direction_y = 1;
-					} else {
-						/* FIXME */
-						int portion = height/2;
-						if((int)actor->res.y - (int)engine.room->res.y > (portion-5) && (int)actor->res.y - (int)engine.room->res.y < (portion+5)) {
-							engine.room_direction_y = 0;
-						}
-					}
-				}
-			}
-			kiavc_costume_set *set = kiavc_costume_get_set(actor->costume, kiavc_actor_state_str(actor->state));
-			int ms = (set && set->animations[actor->direction]) ? set->animations[actor->direction]->ms : 100;
-			if(ticks - actor->res.ticks >= ms) {
-				actor->res.ticks += ms;
-				actor->frame++;
-			}
-		} else if(resource->type == KIAVC_OBJECT) {
-			/* This is an object */
-			kiavc_object *object = (kiavc_object *)resource;
-			kiavc_object_state *state = object ? object->state : NULL;
-			int ms = (state && state->animation ? state->animation->ms : 100);
-			if(ticks - object->res.ticks >= ms) {
-				object->res.ticks += ms;
-				if(state && state->animation) {
-					object->frame++;
-				} else {
-					object->frame = 0;
-				}
-			}
-			if(object->res.speed > 0) {
-				/* We're moving this object around */
-				if(object->res.move_ticks == 0)
-					object->res.move_ticks = ticks;
-				if(((int)object->res.x != object->res.target_x || (int)object->res.y != object->res.target_y) &&
-						ticks - object->res.move_ticks >= (1000/kiavc_screen_fps)) {
-					object->res.move_ticks += (1000/kiavc_screen_fps);
-					float movement = (float)(object->res.speed)/(kiavc_screen_fps);
-					float d = sqrt(((object->res.target_x - object->res.x)*(object->res.target_x - object->res.x)) +
-						((object->res.target_y - object->res.y)*(object->res.target_y - object->res.y)));
-					float p = d/movement;
-					float mx = object->res.x + ((float)object->res.target_x - object->res.x) / p;
-					float my = object->res.y + ((float)object->res.target_y - object->res.y) / p;
-					if((object->res.x > (float)object->res.target_x && mx < (float)object->res.target_x)
-							|| (object->res.x < (float)object->res.target_x && mx > (float)object->res.target_x))
-						mx = (float)object->res.target_x;
-					if((object->res.y > (float)object->res.target_y && my < (float)object->res.target_y)
-							|| (object->res.y < (float)object->res.target_y && my > (float)object->res.target_y))
-						my = (float)object->res.target_y;
-					if((int)my != (int)object->res.y)
-						sort = true;
-					object->res.x = mx;
-					object->res.y = my;
-				}
-				if((int)object->res.x == object->res.target_x && (int)object->res.y == object->res.target_y) {
-					/* We're done */
-					object->res.speed = 0;
-					/* Signal the script that the object has finished moving */
-					kiavc_scripts_run_command("signal('%s')", object->id);
-				}
-			}
-		} else if(resource->type == KIAVC_FONT_TEXT) {
-			/* This is a font text line (not belonging to an actor) */
+	int mi = 0;
+	for(mi=0; mi<engine.tweens->motions.count; mi++) {
+		resource = engine.tweens->motions.resources[mi];
+		if(resource->type != KIAVC_ACTOR || resource->queue_index == 0 ||
+				resource->target_x == -1 || resource->target_y == -1)
+			continue;
+		kiavc_actor *actor = (kiavc_actor *)resource;
+		int state = actor->state, direction = actor->direction;
+		if(actor->state != KIAVC_ACTOR_WALKING)
+			actor->frame = 0;
+		actor->state = KIAVC_ACTOR_WALKING;
+		if(actor->line) {
+			kiavc_schedule_remove(engine.schedule, (kiavc_resource *)actor->line);
+			to_remove = kiavc_list_append(to_remove, actor->line);
+			actor->line = NULL;
+		}
+		int diff_x = (int)actor->res.x - actor->res.target_x;
+		int diff_y = (int)actor->res.y - actor->res.target_y;
+		if(abs(diff_x) > abs(diff_y)) {
+			/* Left/right */
+			if(diff_x > 0)
+				actor->direction = KIAVC_LEFT;
+			else if(diff_x < 0)
+				actor->direction = KIAVC_RIGHT;
+		} else {
+			/* Up/down */
+			if(diff_y > 0)
+				actor->direction = KIAVC_UP;
+			else if(diff_y < 0)
+				actor->direction = KIAVC_DOWN;
+		}
+		if(actor->state != state || actor->direction != direction)
+			kiavc_engine_update_actor_animation(actor);
+		float speed = (float)actor->res.speed;
+		if(actor->walkbox && actor->walkbox->speed != 1.0) {
+			speed = (float)(speed) * actor->walkbox->speed;
+			if(speed < 1.0)
+				speed = 1.0;
+		}
+		/* The actual movement is done later, together with everything else that's moving */
+		kiavc_tweens_move(engine.tweens, &actor->res, actor->res.target_x, actor->res.target_y, speed);
+	}
+	/* Update the resources that are due (a new animation frame, or a text
+	 * line to remove), rather than looping on the whole render queue */
+	Uint32 deadline = 0;
+	while((resource = kiavc_schedule_peek(engine.schedule, &deadline)) != NULL && deadline <= ticks) {
+		if(resource->queue_index == 0) {
+			/* Not in the render queue anymore */
+			kiavc_schedule_remove(engine.schedule, resource);
+			continue;
+		}
+		if(resource->type == KIAVC_FONT_TEXT) {
+			/* This is a font text line */
 			kiavc_font_text *line = (kiavc_font_text *)resource;
-			if(line->owner_type != KIAVC_CURSOR && line->owner_type != KIAVC_DIALOG) {
-				/* Only cursor text and dialog lines remain there until we manually remove it */
-				if(line->started == 0)
-					line->started = ticks;
-			}
-			if(line->res.speed > 0) {
-				/* We're moving this text around */
-				if(line->res.move_ticks == 0)
-					line->res.move_ticks = ticks;
-				if(((int)line->res.x != line->res.target_x || (int)line->res.y != line->res.target_y) &&
-						ticks - line->res.move_ticks >= (1000/kiavc_screen_fps)) {
-					line->res.move_ticks += (1000/kiavc_screen_fps);
-					float movement = (float)(line->res.speed)/(kiavc_screen_fps);
-					float d = sqrt(((line->res.target_x - line->res.x)*(line->res.target_x - line->res.x)) +
-						((line->res.target_y - line->res.y)*(line->res.target_y - line->res.y)));
-					float p = d/movement;
-					float mx = line->res.x + ((float)line->res.target_x - line->res.x) / p;
-					float my = line->res.y + ((float)line->res.target_y - line->res.y) / p;
-					if((line->res.x > (float)line->res.target_x && mx < (float)line->res.target_x)
-							|| (line->res.x < (float)line->res.target_x && mx > (float)line->res.target_x))
-						mx = (float)line->res.target_x;
-					if((line->res.y > (float)line->res.target_y && my < (float)line->res.target_y)
-							|| (line->res.y < (float)line->res.target_y && my > (float)line->res.target_y))
-						my = (float)line->res.target_y;
-					line->res.x = mx;
-					line->res.y = my;
-				}
-				if((int)line->res.x == line->res.target_x && (int)line->res.y == line->res.target_y) {
-					/* We're done */
-					line->res.speed = 0;
-					/* Signal the script that the text has finished moving */
-					kiavc_scripts_run_command("signal('%s')", line->id);
-				}
-			}
-			if(line->started && line->duration && (ticks - line->started >= line->duration)) {
+			if(line->started > 0) {
 				/* We've displayed this text line long enough */
+				kiavc_schedule_remove(engine.schedule, resource);
 				to_remove = kiavc_list_append(to_remove, line);
 				/* If this is owned by an actor, handle it */
 				if(line->owner_type == KIAVC_ACTOR) {
 					kiavc_actor *actor = (kiavc_actor *)line->owner;
 					actor->state = KIAVC_ACTOR_STILL;
+					kiavc_engine_update_actor_animation(actor);
 					actor->line = NULL;
 					/* FIXME */
 					kiavc_scripts_run_command("signal('%s')", actor->id);
 				}
+				continue;
 			}
+			line->started = ticks;
+		} else {
+			/* This is an actor or object */
+			kiavc_engine_advance_animation(resource, ticks);
 		}
-		item = item->next;
+		kiavc_engine_schedule(resource);
+	}
+	/* Move, fade and scale everything that needs it in a single pass, and
+	 * take note of where what moved was before and after that */
+	Uint32 step = kiavc_clock_steps + 1;
+	for(mi=0; mi<engine.tweens->motions.count; mi++) {
+		resource = engine.tweens->motions.resources[mi];
+		resource->prev_x = resource->x;
+		resource->prev_y = resource->y;
+	}
+	if(kiavc_tweens_update(engine.tweens, ticks, kiavc_screen_fps))
+		sort = true;
+	for(mi=0; mi<engine.tweens->motions.count; mi++)
+		kiavc_engine_track_motion(engine.tweens->motions.resources[mi], step);
+	for(mi=0; mi<engine.tweens->events_count; mi++) {
+		if(engine.tweens->events[mi].type == KIAVC_TWEEN_MOTION)
+			kiavc_engine_track_motion(engine.tweens->events[mi].resource, step);
+	}
+	/* Notify the scripts about what's completed all at once */
+	kiavc_engine_tweens_completed();
+	/* Check if the actors that moved are in a different walkbox now: we
+	 * look walkboxes up in parallel, but notify the scripts in order */
+	engine.moved_count = 0;
+	for(mi=0; mi<engine.tweens->motions.count + engine.tweens->events_count; mi++) {
+		if(mi < engine.tweens->motions.count) {
+			resource = engine.tweens->motions.resources[mi];
+		} else {
+			kiavc_tween_event *event = &engine.tweens->events[mi - engine.tweens->motions.count];
+			resource = event->type == KIAVC_TWEEN_MOTION ? event->resource : NULL;
+			if(resource && resource->motion_index > 0)
+				continue;
+		}
+		if(!resource || resource->type != KIAVC_ACTOR || resource->moved != step)
+			continue;
+		if(engine.moved_count == engine.moved_size) {
+			int size = engine.moved_size ? engine.moved_size * 2 : 16;
+			kiavc_actor **moved = SDL_realloc(engine.moved, size * sizeof(kiavc_actor *));
+			if(!moved)
+				break;
+			engine.moved = moved;
+			kiavc_pathfinding_walkbox **walkboxes = SDL_realloc(engine.moved_walkboxes, size * sizeof(kiavc_pathfinding_walkbox *));
+			if(!walkboxes)
+				break;
+			engine.moved_walkboxes = walkboxes;
+			engine.moved_size = size;
+		}
+		engine.moved[engine.moved_count] = (kiavc_actor *)resource;
+		engine.moved_count++;
 	}
+	if(engine.moved_count > 0 && engine.room && engine.room->pathfinding && engine.room->pathfinding->walkboxes) {
+		kiavc_jobs_run(kiavc_engine_find_walkboxes, NULL, engine.moved_count, KIAVC_WALKBOXES_CHUNK);
+		for(mi=0; mi<engine.moved_count; mi++)
+			kiavc_engine_set_walkbox(engine.moved[mi], engine.moved_walkboxes[mi]);
+	}
+	if(engine.following && engine.following->room == engine.room &&
+			kiavc_render_queue_contains(engine.render_queue, (kiavc_resource *)engine.following))
+		kiavc_engine_scroll_to_actor(engine.following);
 	while(to_remove) {
 		resource = (kiavc_resource *)to_remove->data;
 		if(resource->type == KIAVC_FONT_TEXT) {
 			/* This is a font text line */
 			kiavc_font_text *line = (kiavc_font_text *)resource;
-			engine.render_list = kiavc_list_remove(engine.render_list, line);
+			kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)line);
+			kiavc_tweens_remove(engine.tweens, (kiavc_resource *)line);
+			kiavc_schedule_remove(engine.schedule, (kiavc_resource *)line);
 			/* Destroy the text line */
 			if(line->owner_type == KIAVC_ACTOR) {
 				kiavc_actor *actor = (kiavc_actor *)line->owner;
@@ -1156,17 +1807,20 @@ int kiavc_engine_update_world(void) {
 			} else if(line->owner_type == KIAVC_CURSOR) {
 				engine.cursor_text = NULL;
 			}
-			if(line->owner_type != KIAVC_DIALOG) {
-				if(line->id)
-					kiavc_map_remove(texts, line->id);
-				else
-					kiavc_font_text_destroy(line);
-			}
+			if(line->owner_type != KIAVC_DIALOG)
+				kiavc_pipeline_call(kiavc_engine_main_destroy_line, line);
 		}
 		to_remove = kiavc_list_remove(to_remove, resource);
 	}
+	/* Sort the render queue again, if needed (e.g., because something moved) */
 	if(sort)
-		engine.render_list = kiavc_list_sort(engine.render_list, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+		kiavc_render_queue_invalidate(engine.render_queue);
+	kiavc_render_queue_sort(engine.render_queue);
+	/* Scroll the room, if needed */
+	if(engine.room) {
+		engine.room->res.prev_x = engine.room->res.x;
+		engine.room->res.prev_y = engine.room->res.y;
+	}
 	if(ticks - engine.room_ticks >= 15) {
 		engine.room_ticks += 15;
 		if(engine.room && engine.room->background) {
@@ -1192,6 +1846,8 @@ int kiavc_engine_update_world(void) {
 			}
 		}
 	}
+	if(engine.room)
+		kiavc_engine_track_motion(&engine.room->res, step);
 	if(engine.main_cursor) {
 		if(engine.main_cursor->res.ticks == 0)
 			engine.main_cursor->res.ticks = ticks;
@@ -1218,500 +1874,1238 @@ int kiavc_engine_update_world(void) {
 			}
 		}
 	}
-	if(engine.fade_ticks > 0) {
-		if(ticks >= (engine.fade_ticks + (engine.fade_in > 0 ? engine.fade_in : engine.fade_out))) {
-			/* We're done */
-			engine.fade_ticks = 0;
-			engine.fade_alpha = engine.fade_in > 0 ? 0 : 255;
-			engine.fade_in = 0;
-			engine.fade_out = 0;
-			if(engine.fade_alpha == 0) {
-				SDL_DestroyTexture(engine.fade_texture);
-				engine.fade_texture = NULL;
-			}
-			kiavc_scripts_run_command("signal('fade')");
+	if(engine.fade_ticks > 0) {
+		if(ticks >= (engine.fade_ticks + (engine.fade_in > 0 ? engine.fade_in : engine.fade_out))) {
+			/* We're done */
+			engine.fade_ticks = 0;
+			engine.fade_alpha = engine.fade_in > 0 ? 0 : 255;
+			engine.fade_in = 0;
+			engine.fade_out = 0;
+			if(engine.fade_alpha == 0)
+				kiavc_pipeline_call(kiavc_engine_main_destroy_fade, NULL);
+			kiavc_scripts_run_command("signal('fade')");
+		} else {
+			/* Calculate the alpha to use for the black texture */
+			int diff = ticks - engine.fade_ticks;
+			float percent = (float)diff/(float)(engine.fade_in > 0 ? engine.fade_in : engine.fade_out);
+			float update = 255 * percent;
+			engine.fade_alpha = engine.fade_out > 0 ? (int)update : (255 - (int)update);
+		}
+	}
+	/* To conclude, we tell all plugins that want to know it about the new tick */
+	start = kiavc_profiler_now();
+	kiavc_list *pl = plugins_list;
+	while(pl) {
+		kiavc_plugin *plugin = (kiavc_plugin *)pl->data;
+		if(plugin && plugin->update_world)
+			plugin->update_world(ticks);
+		pl = pl->next;
+	}
+	if(plugins_list)
+		kiavc_profiler_add(KIAVC_PROFILER_PLUGINS_UPDATE, start);
+	/* Check if nothing's happening, in which case we can take it easy */
+	kiavc_engine_check_idle(ticks, wakeup);
+	kiavc_clock_steps++;
+	/* If we're recording or replaying with checksums, take care of them */
+	if(recording && recording->checksums) {
+		kiavc_recording_add_checksum(recording, kiavc_clock_steps, kiavc_engine_checksum());
+	} else if(replay && replay->checksums) {
+		kiavc_recording_item *ri = NULL;
+		while((ri = kiavc_recording_peek(replay)) != NULL && ri->type == KIAVC_RECORDING_CHECKSUM &&
+				ri->step <= kiavc_clock_steps) {
+			if(ri->step == kiavc_clock_steps) {
+				Uint32 checksum = kiavc_engine_checksum();
+				if(checksum != ri->checksum) {
+					if(replay_mismatches == 0) {
+						SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Replay diverged at step %"SCNu32" (checksum %08"SCNx32", expected %08"SCNx32")\n",
+							kiavc_clock_steps, checksum, ri->checksum);
+					}
+					replay_mismatches++;
+				}
+			}
+			kiavc_recording_next(replay);
+		}
+	}
+	/* Done */
+	return 0;
+}
+
+/* Update the "world" */
+static int kiavc_engine_advance_world(void) {
+	Uint64 start = kiavc_profiler_now();
+	if(kiavc_headless || replay) {
+		/* The clock is virtual, so we just do a single step every time,
+		 * unless we're replaying at normal speed and need to wait */
+		if(replay && !replay_fast && !kiavc_headless)
+			kiavc_engine_wait_frame();
+		kiavc_clock_ms += 1000.0 / (double)kiavc_screen_fps;
+		kiavc_clock_alpha = 1.0;
+		if(kiavc_engine_update_step((uint32_t)kiavc_clock_ms) < 0)
+			return -1;
+		kiavc_profiler_add(KIAVC_PROFILER_UPDATE, start);
+		if(kiavc_headless && kiavc_headless_run_ms > 0 && kiavc_clock_ms >= kiavc_headless_run_ms) {
+			SDL_Log("Headless run completed\n");
+			quit = true;
+			return -1;
+		}
+		return 0;
+	}
+	/* Check how much time passed since the last time we were here */
+	Uint64 step = kiavc_clock_frequency / kiavc_screen_fps;
+	Uint64 now = SDL_GetPerformanceCounter();
+	if(kiavc_clock_last == 0) {
+		/* First time we get here, make sure we do a step right away */
+		kiavc_clock_last = now;
+		kiavc_clock_accumulator = step;
+	}
+	kiavc_clock_accumulator += (now - kiavc_clock_last);
+	kiavc_clock_last = now;
+	/* If the world was idle, we may have been waiting for a while */
+	if(kiavc_idle && kiavc_clock_accumulator >= 2*step) {
+		Uint64 skipped = kiavc_clock_accumulator / step - 1;
+		kiavc_clock_accumulator -= skipped * step;
+		kiavc_engine_skip_idle_steps(skipped);
+	}
+	/* Advance the simulation in fixed steps, catching up if we're late */
+	int steps = 0;
+	while(kiavc_clock_accumulator >= step) {
+		if(steps == KIAVC_MAX_CATCHUP_STEPS) {
+			/* We're too far behind, drop the time we couldn't simulate */
+			kiavc_clock_accumulator %= step;
+			break;
+		}
+		kiavc_clock_accumulator -= step;
+		kiavc_clock_ms += 1000.0 / (double)kiavc_screen_fps;
+		if(kiavc_engine_update_step((uint32_t)kiavc_clock_ms) < 0)
+			return -1;
+		steps++;
+	}
+	/* Take note of how far we are in the next step, for interpolation */
+	kiavc_clock_alpha = (float)kiavc_clock_accumulator / (float)step;
+	if(steps > 0)
+		kiavc_profiler_add(KIAVC_PROFILER_UPDATE, start);
+	/* Done */
+	return 0;
+}
+int kiavc_engine_update_world(void) {
+	if(quit)
+		return -1;
+	/* If we updated the world while presenting the previous frame, we're done */
+	if(kiavc_pipeline_ahead) {
+		kiavc_pipeline_ahead = false;
+		return kiavc_pipeline_result;
+	}
+	return kiavc_engine_advance_world();
+}
+
+/* Helper to check if we can update the world on the pipeline worker: we
+ * can't when the clock is virtual, since input must be handled at exactly
+ * the same step it was recorded at, nor when plugins are involved, since
+ * they may use SDL when notified about updates */
+static bool kiavc_engine_can_pipeline(void) {
+	return kiavc_screen_pipelining && !quit && !kiavc_headless && !recording && !replay && !plugins_list;
+}
+static int kiavc_engine_pipeline_job(void *data) {
+	int res = kiavc_engine_advance_world();
+	kiavc_pipeline_done = kiavc_profiler_now();
+	return res;
+}
+
+/* Helper to keep track of an area of the canvas being written to, when
+ * debugging overdraw: a NULL rect means the current viewport, if any */
+static void kiavc_engine_count_overdraw(const SDL_Rect *rect) {
+	if(!overdraw || render_state->target != (kiavc_screen_direct ? NULL : canvas))
+		return;
+	if(!rect && render_state->known_viewport && render_state->viewport.w > 0)
+		rect = &render_state->viewport;
+	kiavc_overdraw_add(overdraw, rect);
+}
+
+/* Helpers to draw with the renderer directly, keeping track of the draw calls */
+static void kiavc_engine_render_copy(SDL_Texture *texture, const SDL_Rect *src, const SDL_Rect *dst) {
+	/* The canvas is always scaled with nearest pixel sampling */
+	if(texture != canvas)
+		kiavc_batch_prepare_texture(batch, texture);
+	SDL_RenderCopy(renderer, texture, src, dst);
+	kiavc_capture_copy(texture, src, dst);
+	render_stats.draw_calls++;
+	kiavc_batch_bind(batch, texture);
+	kiavc_engine_count_overdraw(dst);
+}
+static void kiavc_engine_fill_rect(const SDL_Rect *rect) {
+	SDL_RenderFillRect(renderer, rect);
+	kiavc_capture_fill(rect);
+	render_stats.draw_calls++;
+	render_stats.fill_rects++;
+	kiavc_engine_count_overdraw(rect);
+}
+static void kiavc_engine_draw_line(int x1, int y1, int x2, int y2) {
+	SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
+	kiavc_capture_line(x1, y1, x2, y2);
+	render_stats.draw_calls++;
+}
+static void kiavc_engine_clear(void) {
+	SDL_RenderClear(renderer);
+	kiavc_capture_clear();
+	render_stats.draw_calls++;
+	render_stats.fill_rects++;
+	kiavc_engine_count_overdraw(NULL);
+}
+
+/* Helper to keep track of how many pixels of the canvas (or of an area of it) a sprite covers */
+static void kiavc_engine_count_pixels(const SDL_Rect *rect, const SDL_Rect *area) {
+	SDL_Rect canvas_area = { 0, 0, kiavc_screen_width, kiavc_screen_height }, covered = { 0 };
+	if(SDL_IntersectRect(rect, area ? area : &canvas_area, &covered))
+		render_stats.pixels += (Uint64)covered.w * (Uint64)covered.h;
+}
+
+/* Helper to complete the statistics on the frame we just rendered, and log them if needed */
+static void kiavc_engine_update_render_stats(void) {
+	/* Add what was counted by the batcher, the compositor and the state tracker */
+	render_stats.draw_calls += batch ? batch->draws : 0;
+	render_stats.sprites += batch ? batch->sprites : 0;
+	/* Texture switches are all counted by the batcher, even for textures drawn outside of it */
+	render_stats.texture_switches += batch ? batch->switches : 0;
+	if(compositor) {
+		render_stats.draw_calls += compositor->uploads;
+		render_stats.sprites += compositor->sprites;
+	}
+	render_stats.state_changes = render_state ? render_state->applied : 0;
+	render_stats.state_changes_avoided = render_state ? render_state->avoided : 0;
+	Uint64 area = (Uint64)kiavc_screen_width * (Uint64)kiavc_screen_height;
+	render_stats.overdraw = area > 0 ? (double)render_stats.pixels / (double)area : 0.0;
+	render_stats_last = render_stats;
+	SDL_zero(render_stats);
+	if(render_stats_interval == 0)
+		return;
+	/* Keep track of the totals, and log the averages per frame every now and then */
+	render_stats_total.draw_calls += render_stats_last.draw_calls;
+	render_stats_total.sprites += render_stats_last.sprites;
+	render_stats_total.texture_switches += render_stats_last.texture_switches;
+	render_stats_total.fill_rects += render_stats_last.fill_rects;
+	render_stats_total.plugin_renders += render_stats_last.plugin_renders;
+	render_stats_total.resources_drawn += render_stats_last.resources_drawn;
+	render_stats_total.resources_culled += render_stats_last.resources_culled;
+	render_stats_total.resources_occluded += render_stats_last.resources_occluded;
+	render_stats_total.state_changes += render_stats_last.state_changes;
+	render_stats_total.state_changes_avoided += render_stats_last.state_changes_avoided;
+	render_stats_total.pixels += render_stats_last.pixels;
+	if(render_stats_last.overdraw > render_stats_total.overdraw)
+		render_stats_total.overdraw = render_stats_last.overdraw;
+	render_stats_frames++;
+	Uint32 now = SDL_GetTicks();
+	if(render_stats_logged == 0)
+		render_stats_logged = now;
+	if(now - render_stats_logged < render_stats_interval)
+		return;
+	double frames = (double)render_stats_frames;
+	SDL_Log("Render stats (%"SCNu32" frames, avg per frame): %.1f draw calls, %.1f sprites, %.1f texture switches, "
+		"%.1f fill rects, %.1f plugin renders, %.1f drawn / %.1f culled / %.1f occluded, "
+		"%.1f / %.1f state changes applied / avoided, "
+		"%.2fx overdraw (max %.2fx)\n", render_stats_frames,
+		render_stats_total.draw_calls / frames, render_stats_total.sprites / frames,
+		render_stats_total.texture_switches / frames, render_stats_total.fill_rects / frames,
+		render_stats_total.plugin_renders / frames, render_stats_total.resources_drawn / frames,
+		render_stats_total.resources_culled / frames, render_stats_total.resources_occluded / frames,
+		render_stats_total.state_changes / frames,
+		render_stats_total.state_changes_avoided / frames,
+		area > 0 ? ((double)render_stats_total.pixels / frames) / (double)area : 0.0,
+		render_stats_total.overdraw);
+	SDL_zero(render_stats_total);
+	render_stats_frames = 0;
+	render_stats_logged = now;
+}
+
+/* Helper to draw the profiler overlay: for each phase we draw a bar,
+ * where the full width is the frame budget, showing the median (green),
+ * the 95th percentile (yellow) and the max (red) of the recent samples */
+static void kiavc_engine_render_profiler(void) {
+	int scale = kiavc_screen_scale > 0 ? kiavc_screen_scale : 1;
+	int width = 100 * scale, height = 3 * scale, margin = 2 * scale;
+	double budget = 1000.0 / (double)kiavc_screen_fps;
+	kiavc_profiler_stats stats = { 0 };
+	SDL_Rect rect = { 0 };
+	kiavc_render_state_set_blend_mode(render_state, SDL_BLENDMODE_BLEND);
+	kiavc_render_state_set_draw_color(render_state, 0, 0, 0, 160);
+	rect.x = margin;
+	rect.y = margin;
+	rect.w = width + 2*margin;
+	rect.h = KIAVC_PROFILER_PHASES * (height + margin) + margin;
+	kiavc_engine_fill_rect(&rect);
+	int phase = 0;
+	for(phase=0; phase<KIAVC_PROFILER_PHASES; phase++) {
+		if(kiavc_profiler_get_stats(phase, &stats) < 0 || stats.samples == 0)
+			continue;
+		rect.x = 2*margin;
+		rect.y = 2*margin + phase * (height + margin);
+		rect.h = height;
+		/* Max */
+		rect.w = (int)(SDL_min(stats.max / budget, 1.0) * width);
+		kiavc_render_state_set_draw_color(render_state, 255, 0, 0, SDL_ALPHA_OPAQUE);
+		kiavc_engine_fill_rect(&rect);
+		/* 95th percentile */
+		rect.w = (int)(SDL_min(stats.p95 / budget, 1.0) * width);
+		kiavc_render_state_set_draw_color(render_state, 255, 255, 0, SDL_ALPHA_OPAQUE);
+		kiavc_engine_fill_rect(&rect);
+		/* Median */
+		rect.w = (int)(SDL_min(stats.p50 / budget, 1.0) * width);
+		kiavc_render_state_set_draw_color(render_state, 0, 255, 0, SDL_ALPHA_OPAQUE);
+		kiavc_engine_fill_rect(&rect);
+	}
+	kiavc_render_state_set_blend_mode(render_state, SDL_BLENDMODE_NONE);
+}
+
+/* Helper to check if any plugin is going to draw on the canvas */
+static bool kiavc_engine_plugins_rendering(void) {
+	kiavc_list *pl = plugin_resources;
+	while(pl) {
+		kiavc_plugin_resource *pr = (kiavc_plugin_resource *)pl->data;
+		if(pr && pr->plugin && pr->plugin->render)
+			return true;
+		pl = pl->next;
+	}
+	return false;
+}
+
+/* Helper to check how many resources at the beginning of the render
+ * queue are the room background or static layers that scroll along with
+ * it: if there's more than one, they're flattened in the layer cache, and
+ * we return the texture to draw instead, plus how many items it covers */
+static SDL_Texture *kiavc_engine_get_cached_layers(int *cached) {
+	*cached = 0;
+	if(!layer_cache || compositor || !engine.room || !engine.room->background)
+		return NULL;
+	kiavc_animation_load(engine.room->background, engine.room, renderer);
+	kiavc_animation *background = engine.room->background, *layers[KIAVC_LAYER_CACHE_MAX];
+	kiavc_resource *resource = NULL;
+	kiavc_animation *anim = NULL;
+	int count = 0, qi = 0;
+	for(qi=0; qi<engine.render_queue->count && count < KIAVC_LAYER_CACHE_MAX; qi++) {
+		resource = engine.render_queue->items[qi].resource;
+		if(!resource)
+			continue;
+		if(resource->type == KIAVC_ROOM) {
+			anim = background;
+		} else if(resource->type == KIAVC_ROOM_LAYER) {
+			anim = ((kiavc_room_layer *)resource)->background;
+			kiavc_animation_load(anim, resource, renderer);
 		} else {
-			/* Calculate the alpha to use for the black texture */
-			int diff = ticks - engine.fade_ticks;
-			float percent = (float)diff/(float)(engine.fade_in > 0 ? engine.fade_in : engine.fade_out);
-			float update = 255 * percent;
-			engine.fade_alpha = engine.fade_out > 0 ? (int)update : (255 - (int)update);
+			/* Dynamic resource, we're done */
+			break;
 		}
+		/* Only static layers as large as the room scroll the same way */
+		if(!anim || !anim->texture || anim->frames != 1 || anim->w != background->w || anim->h != background->h)
+			break;
+		layers[count] = anim;
+		count++;
 	}
-	/* Check if we're fading in/out individual resources, and update the state in case */
-	kiavc_list *faded = NULL;
-	fading = engine.fading;
-	while(fading) {
-		resource = (kiavc_resource *)fading->data;
-		if(resource->fade_alpha == resource->fade_target || ticks >= (resource->fade_ticks + resource->fade_ms)) {
-			/* We're done */
-			resource->fade_ticks = 0;
-			resource->fade_ms = 0;
-			faded = kiavc_list_append(faded, resource);
-			/* Signal the script */
-			if(resource->type == KIAVC_OBJECT) {
-				kiavc_object *object = (kiavc_object *)resource;
-				kiavc_scripts_run_command("signal('fade-%s')", object->id);
-			} else if(resource->type == KIAVC_ACTOR) {
-				kiavc_actor *actor = (kiavc_actor *)resource;
-				kiavc_scripts_run_command("signal('fade-%s')", actor->id);
-			} else if(resource->type == KIAVC_FONT_TEXT) {
-				kiavc_font_text *line = (kiavc_font_text *)resource;
-				if(line->id)
-					kiavc_scripts_run_command("signal('fade-%s')", line->id);
+	if(count < 2)
+		return NULL;
+	SDL_Texture *texture = kiavc_layer_cache_get(layer_cache, layers, count, kiavc_screen_direct ? NULL : canvas);
+	if(texture)
+		*cached = qi;
+	return texture;
+}
+
+/* Helper to figure out which part of a room layer should be drawn where:
+ * since parallax may be involved, we check how much the width of the
+ * room background and the layer differ, to scroll the layer accordingly */
+static bool kiavc_engine_layer_position(kiavc_room_layer *layer, int view_x, int view_y, SDL_Rect *clip, SDL_Rect *rect) {
+	/* FIXME */
+	if(!layer || !layer->background || !engine.room || !engine.room->background)
+		return false;
+	int room_range_w = engine.room->background->w - kiavc_screen_width;
+	int layer_range_w = layer->background->w - kiavc_screen_width;
+	float layer_x = 0;
+	if(room_range_w > 0 && layer_range_w > 0)
+		layer_x = ((float)view_x / (float)room_range_w) * (float)layer_range_w;
+	int room_range_h = engine.room->background->h - kiavc_screen_height;
+	int layer_range_h = layer->background->h - kiavc_screen_height;
+	float layer_y = 0;
+	if(room_range_h > 0 && layer_range_h > 0)
+		layer_y = ((float)view_y / (float)room_range_h) * (float)layer_range_h;
+	clip->x = (int)layer_x;
+	clip->y = (int)layer_y;
+	clip->w = kiavc_screen_width;
+	clip->h = kiavc_screen_height;
+	rect->x = 0;
+	rect->y = 0;
+	rect->w = kiavc_screen_width;
+	rect->h = kiavc_screen_height;
+	return kiavc_animation_clip(layer->background, clip, rect);
+}
+
+/* Helper to take note of the opaque part of something we'll draw later */
+static void kiavc_engine_add_occluder(int index, kiavc_animation *anim, SDL_Rect *clip, SDL_Rect *rect) {
+	SDL_Rect opaque = { 0 };
+	if(!kiavc_animation_opaque(anim, clip, rect, &opaque))
+		return;
+	if(occluders_count == occluders_size) {
+		int size = occluders_size ? occluders_size*2 : 16;
+		kiavc_occluder *list = SDL_realloc(occluders, size * sizeof(kiavc_occluder));
+		if(!list)
+			return;
+		occluders = list;
+		occluders_size = size;
+	}
+	occluders[occluders_count].index = index;
+	occluders[occluders_count].rect = opaque;
+	occluders_count++;
+}
+
+/* Helper to find the opaque room layers and UI panels in the render queue
+ * before we start drawing, since anything they completely hide can be skipped */
+static void kiavc_engine_find_occluders(int start, int view_x, int view_y) {
+	occluders_count = 0;
+	if(!opaque_regions)
+		return;
+	SDL_Rect clip = { 0 }, rect = { 0 };
+	kiavc_resource *resource = NULL;
+	int qi = 0;
+	for(qi=start; qi<engine.render_queue->count; qi++) {
+		resource = engine.render_queue->items[qi].resource;
+		if(!resource)
+			continue;
+		if(resource->type == KIAVC_ROOM_LAYER) {
+			kiavc_room_layer *layer = (kiavc_room_layer *)resource;
+			if(!layer->background || layer->background->transparency)
+				continue;
+			kiavc_animation_load(layer->background, layer, renderer);
+			if(kiavc_engine_layer_position(layer, view_x, view_y, &clip, &rect))
+				kiavc_engine_add_occluder(qi, layer->background, &clip, &rect);
+		} else if(resource->type == KIAVC_OBJECT) {
+			/* We only care about UI objects, which are drawn where they are */
+			kiavc_object *object = (kiavc_object *)resource;
+			kiavc_animation *animation = object->ui_animation;
+			if(!object->ui || engine.cutscene || engine.dialog || !animation || animation->transparency ||
+					object->res.fade_alpha != SDL_ALPHA_OPAQUE)
+				continue;
+			kiavc_animation_load(animation, object, renderer);
+			if(object->frame < 0 || object->frame >= animation->frames)
+				continue;
+			int object_x = 0, object_y = 0, parent_x = 0, parent_y = 0;
+			kiavc_engine_render_position(&object->res, &object_x, &object_y);
+			if(object->parent) {
+				kiavc_engine_render_position(&object->parent->res, &parent_x, &parent_y);
+				object_x += parent_x;
+				object_y += parent_y;
 			}
-		} else {
-			/* Calculate the alpha to use for the resource texture */
-			int diff = ticks - resource->fade_ticks;
-			float percent = (float)diff/(float)(resource->fade_ms);
-			float update = (resource->fade_target - resource->fade_start) * percent;
-			resource->fade_alpha = resource->fade_start + (int)update;
+			clip.x = object->frame*animation->w;
+			clip.y = 0;
+			clip.w = animation->w;
+			clip.h = animation->h;
+			rect.x = object_x;
+			rect.y = object_y;
+			rect.w = animation->w * object->scale;
+			rect.h = animation->h * object->scale;
+			if(rect.w > 0 && rect.h > 0 && kiavc_animation_clip(animation, &clip, &rect))
+				kiavc_engine_add_occluder(qi, animation, &clip, &rect);
 		}
-		fading = fading->next;
 	}
-	fading = faded;
-	while(fading) {
-		engine.fading = kiavc_list_remove(engine.fading, fading->data);
-		fading = fading->next;
+}
+
+/* Helper to check if something we're about to draw is hidden by opaque
+ * things that will be drawn after it (i.e., later in the render queue):
+ * returns false if it's completely hidden, and otherwise cuts the parts
+ * that are hidden, when possible (only when it's not scaled) */
+static bool kiavc_engine_occlude(int index, SDL_Rect *clip, SDL_Rect *rect) {
+	bool unscaled = (clip->w == rect->w && clip->h == rect->h);
+	int i = 0, cut = 0;
+	SDL_Rect *o = NULL;
+	for(i=0; i<occluders_count; i++) {
+		if(occluders[i].index <= index)
+			continue;
+		o = &occluders[i].rect;
+		if(o->x <= rect->x && o->y <= rect->y &&
+				o->x + o->w >= rect->x + rect->w && o->y + o->h >= rect->y + rect->h)
+			return false;
+		if(!unscaled)
+			continue;
+		if(o->x <= rect->x && o->x + o->w >= rect->x + rect->w) {
+			/* The occluder is as wide as what we're drawing, check top and bottom */
+			if(o->y <= rect->y && o->y + o->h > rect->y) {
+				cut = o->y + o->h - rect->y;
+				rect->y += cut;
+				clip->y += cut;
+				rect->h -= cut;
+				clip->h -= cut;
+			} else if(o->y < rect->y + rect->h && o->y + o->h >= rect->y + rect->h) {
+				cut = rect->y + rect->h - o->y;
+				rect->h -= cut;
+				clip->h -= cut;
+			}
+		} else if(o->y <= rect->y && o->y + o->h >= rect->y + rect->h) {
+			/* The occluder is as tall as what we're drawing, check left and right */
+			if(o->x <= rect->x && o->x + o->w > rect->x) {
+				cut = o->x + o->w - rect->x;
+				rect->x += cut;
+				clip->x += cut;
+				rect->w -= cut;
+				clip->w -= cut;
+			} else if(o->x < rect->x + rect->w && o->x + o->w >= rect->x + rect->w) {
+				cut = rect->x + rect->w - o->x;
+				rect->w -= cut;
+				clip->w -= cut;
+			}
+		}
 	}
-	kiavc_list_destroy(faded);
-	/* To conclude, we tell all plugins that want to know it about the new tick */
-	kiavc_list *pl = plugins_list;
+	return true;
+}
+
+/* Helper to check if we can draw the game straight to the window, scaled
+ * by the renderer, rather than drawing to the canvas and then copying the
+ * canvas to the window: we can only do that if the window is an exact
+ * integer multiple of the canvas, and if no plugin needs to draw on the
+ * scaled target after the game. Returns the scale to use, or 0 if not */
+static int kiavc_engine_direct_scale(void) {
+	if(kiavc_screen_width < 1 || kiavc_screen_height < 1)
+		return 0;
+	kiavc_list *pl = plugin_resources;
 	while(pl) {
-		kiavc_plugin *plugin = (kiavc_plugin *)pl->data;
-		if(plugin && plugin->update_world)
-			plugin->update_world(ticks);
+		kiavc_plugin_resource *pr = (kiavc_plugin_resource *)pl->data;
+		if(pr && pr->rendering == KIAVC_PLUGIN_RENDERING_LAST)
+			return 0;
 		pl = pl->next;
 	}
-	/* Done */
-	return 0;
+	int w = 0, h = 0;
+	if(SDL_GetRendererOutputSize(renderer, &w, &h) < 0)
+		return 0;
+	if(w % kiavc_screen_width || h % kiavc_screen_height || w / kiavc_screen_width != h / kiavc_screen_height)
+		return 0;
+	return w / kiavc_screen_width;
+}
+
+/* Helper to upload and draw what the CPU compositor blitted, if anything */
+static void kiavc_engine_flush_compositor(void) {
+	if(!compositor)
+		return;
+	Uint32 uploads = compositor->uploads;
+	kiavc_compositor_flush(compositor);
+	if(compositor->uploads != uploads)
+		kiavc_batch_bind(batch, compositor->texture);
+}
+
+/* Helper to draw a sprite on the canvas: we keep track of all sprites for
+ * dirty rectangles, and if only part of the canvas needs to be redrawn we
+ * don't draw them right away, since we don't know what changed yet */
+static void kiavc_engine_draw_sprite(SDL_Texture *texture, SDL_Rect *clip, SDL_Rect *rect, Uint8 alpha) {
+	kiavc_dirty_rects_add(dirty_rects, texture, clip, rect, alpha);
+	if(kiavc_screen_deferred)
+		return;
+	kiavc_engine_count_pixels(rect, NULL);
+	kiavc_engine_count_overdraw(rect);
+	if(kiavc_compositor_can_blit(compositor, texture)) {
+		/* Blit the sprite on the CPU, on top of what the renderer drew so far */
+		kiavc_batch_flush(batch);
+		kiavc_compositor_blit(compositor, texture, clip, rect, alpha);
+		return;
+	}
+	/* Sprites we have no pixels for are drawn by the renderer instead, on top
+	 * of what we blitted so far: consecutive ones end up in the same batch */
+	kiavc_engine_flush_compositor();
+	kiavc_batch_add(batch, texture, clip, rect, alpha);
+}
+
+/* Helper to draw all the sprites we haven't drawn yet, before drawing something else */
+static void kiavc_engine_flush_sprites(void) {
+	kiavc_engine_flush_compositor();
+	kiavc_batch_flush(batch);
+}
+
+/* Helper to only redraw the sprites in the area of the canvas that changed */
+static void kiavc_engine_redraw_area(SDL_Rect *area) {
+	kiavc_render_state_set_clip(render_state, area);
+	kiavc_render_state_set_draw_color(render_state, 0, 0, 0, SDL_ALPHA_OPAQUE);
+	kiavc_engine_fill_rect(area);
+	int i = 0;
+	kiavc_dirty_sprite *sprite = NULL;
+	for(i=0; i<dirty_rects->count; i++) {
+		sprite = &dirty_rects->current[i];
+		if(!SDL_HasIntersection(&sprite->dst, area))
+			continue;
+		kiavc_engine_count_pixels(&sprite->dst, area);
+		kiavc_batch_add(batch, sprite->texture, sprite->src.w > 0 ? &sprite->src : NULL, &sprite->dst, sprite->alpha);
+	}
+	kiavc_batch_flush(batch);
+	kiavc_render_state_set_clip(render_state, NULL);
 }
 
 /* Render the current frames */
 int kiavc_engine_render(void) {
 	if(quit)
 		return -1;
+	if(kiavc_headless == KIAVC_HEADLESS_NORENDER)
+		return 0;
+	/* If the window can't be seen, or if nothing changed since the last
+	 * frame we presented, there's no point in drawing anything */
+	if(kiavc_screen_hidden || (kiavc_idle && kiavc_idle_rendered && kiavc_engine_can_idle()))
+		return 0;
+	kiavc_idle_rendered = kiavc_idle;
+	/* Keep track of how long it's been since the previous frame */
+	Uint64 start = kiavc_profiler_now();
+	if(kiavc_profiler_last_frame > 0)
+		kiavc_profiler_add(KIAVC_PROFILER_FRAME, kiavc_profiler_last_frame);
+	kiavc_profiler_last_frame = start;
+	kiavc_profiler_plugins_render = 0;
+	kiavc_batch_reset_stats(batch);
+	kiavc_render_state_reset_stats(render_state);
+	kiavc_compositor_reset_stats(compositor);
+	/* If we've been asked to capture what we draw, start now: since the
+	 * capture starts from scratch, make sure all the state is applied again */
+	if(kiavc_capture_filename) {
+		char fullpath[1024];
+		g_snprintf(fullpath, sizeof(fullpath)-1, "%s%s", app_path, kiavc_capture_filename);
+		int output_w = 0, output_h = 0;
+		SDL_GetRendererOutputSize(renderer, &output_w, &output_h);
+		kiavc_capture_start(fullpath, kiavc_capture_frames, output_w, output_h);
+		SDL_free(kiavc_capture_filename);
+		kiavc_capture_filename = NULL;
+		kiavc_render_state_invalidate(render_state);
+	}
 	/* Draw the images on screen */
 	SDL_Rect rect = { 0 }, clip = { 0 };
-	uint32_t ticks = SDL_GetTicks();
-	if(engine.render_ticks == 0)
-		engine.render_ticks = ticks;
 	bool background_drawn = false;
-	if(ticks - engine.render_ticks >= (1000/kiavc_screen_fps)) {
-		engine.render_ticks += (1000/kiavc_screen_fps);
-		/* The game may need to be scaled, so let's use the texture as the render target */
-		SDL_SetRenderTarget(renderer, canvas);
-		SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
-		SDL_RenderClear(renderer);
-		/* Now we iterate on dynamic resources (rooms, layers, actors, objects, text, etc.) */
-		kiavc_resource *resource = NULL;
-		kiavc_list *item = engine.render_list;
-		while(item) {
-			resource = (kiavc_resource *)item->data;
-			if(resource->type == KIAVC_ROOM) {
-				/* This is the room background */
-				kiavc_animation_load(engine.room->background, engine.room, renderer);
-				if(engine.room->background) {
-					clip.x = (int)engine.room->res.x;
-					clip.y = (int)engine.room->res.y;
-					clip.w = kiavc_screen_width;
-					clip.h = kiavc_screen_height;
-					rect.x = 0;
-					rect.y = 0;
-					rect.w = kiavc_screen_width;
-					rect.h = kiavc_screen_height;
-					if(engine.room->background->texture)
-						SDL_RenderCopy(renderer, engine.room->background->texture, &clip, &rect);
+	/* Check where the room is, since everything is drawn relative to that */
+	int view_x = 0, view_y = 0;
+	if(engine.room)
+		kiavc_engine_render_position(&engine.room->res, &view_x, &view_y);
+	/* Check if there's something we can't keep track of with dirty rectangles,
+	 * like dialogs or plugins, in which case we'll redraw the whole canvas */
+	bool untracked = engine.dialog || kiavc_engine_plugins_rendering() || kiavc_debug_overdraw;
+	/* The game may need to be scaled: if the renderer can do that for us we
+	 * draw straight to the window, otherwise we use the canvas as the target.
+	 * When using dirty rectangles, we only do that when the whole canvas would
+	 * be redrawn anyway (the camera moved, or something untracked is drawn),
+	 * since the canvas won't be up to date for the next frame afterwards */
+	bool redraw = !kiavc_screen_dirty_rects || !dirty_rects || compositor || untracked ||
+		view_x != dirty_rects->view_x || view_y != dirty_rects->view_y;
+	int direct_scale = redraw ? kiavc_engine_direct_scale() : 0;
+	kiavc_screen_direct = (direct_scale > 0);
+	kiavc_render_state_set_target(render_state, kiavc_screen_direct ? NULL : canvas);
+	if(kiavc_screen_direct)
+		kiavc_render_state_set_scale(render_state, (float)direct_scale);
+	/* When the renderer scales everything, sprites need nearest pixel sampling
+	 * to look the same as the canvas, while on the canvas we filter them */
+	if(batch)
+		batch->nearest = kiavc_screen_direct;
+	/* If we're debugging overdraw, start counting writes from scratch */
+	if(kiavc_debug_overdraw) {
+		if(overdraw && (overdraw->w != kiavc_screen_width || overdraw->h != kiavc_screen_height)) {
+			kiavc_overdraw_destroy(overdraw);
+			overdraw = NULL;
+		}
+		if(!overdraw)
+			overdraw = kiavc_overdraw_create(renderer, kiavc_screen_width, kiavc_screen_height);
+		kiavc_overdraw_reset(overdraw);
+	}
+	/* Check if we can only redraw the parts of the canvas that changed: we can't
+	 * if there's something we can't keep track of, or if we're not using the
+	 * canvas at all in this frame, which will need a full redraw next time */
+	untracked = untracked || kiavc_screen_direct;
+	bool full = kiavc_dirty_rects_begin(dirty_rects, view_x, view_y);
+	kiavc_screen_deferred = (dirty_rects && kiavc_screen_dirty_rects && !compositor && !untracked && !full);
+	if(!kiavc_screen_deferred) {
+		kiavc_render_state_set_draw_color(render_state, 0, 0, 0, SDL_ALPHA_OPAQUE);
+		kiavc_engine_clear();
+		kiavc_compositor_begin(compositor);
+	}
+	/* Now we iterate on dynamic resources (rooms, layers, actors, objects, text, etc.) */
+	kiavc_render_queue_sort(engine.render_queue);
+	/* If the room background and static layers are in the cache, start from that */
+	int cached = 0;
+	SDL_Texture *layers = kiavc_engine_get_cached_layers(&cached);
+	/* Check which opaque layers and UI panels will hide what's behind them */
+	kiavc_engine_find_occluders(cached, view_x, view_y);
+	if(layers) {
+		clip.x = view_x;
+		clip.y = view_y;
+		clip.w = kiavc_screen_width;
+		clip.h = kiavc_screen_height;
+		rect.x = 0;
+		rect.y = 0;
+		rect.w = kiavc_screen_width;
+		rect.h = kiavc_screen_height;
+		if(kiavc_clip_rect(engine.room->background->w, engine.room->background->h, &clip, &rect)) {
+			if(kiavc_engine_occlude(-1, &clip, &rect))
+				kiavc_engine_draw_sprite(layers, &clip, &rect, SDL_ALPHA_OPAQUE);
+			else
+				render_stats.resources_occluded++;
+		}
+	}
+	kiavc_resource *resource = NULL;
+	int qi = 0;
+	for(qi=cached; qi<engine.render_queue->count; qi++) {
+		resource = engine.render_queue->items[qi].resource;
+		if(!resource)
+			continue;
+		if(resource->type == KIAVC_ROOM) {
+			/* This is the room background */
+			kiavc_animation_load(engine.room->background, engine.room, renderer);
+			if(engine.room->background) {
+				clip.x = view_x;
+				clip.y = view_y;
+				clip.w = kiavc_screen_width;
+				clip.h = kiavc_screen_height;
+				rect.x = 0;
+				rect.y = 0;
+				rect.w = kiavc_screen_width;
+				rect.h = kiavc_screen_height;
+				if(kiavc_animation_clip(engine.room->background, &clip, &rect)) {
+					if(kiavc_engine_occlude(qi, &clip, &rect))
+						kiavc_engine_draw_sprite(engine.room->background->texture, &clip, &rect, SDL_ALPHA_OPAQUE);
+					else
+						render_stats.resources_occluded++;
 				}
-			} else if(resource->type == KIAVC_ROOM_LAYER) {
-				/* This is a room layer */
-				kiavc_room_layer *layer = (kiavc_room_layer *)resource;
-				kiavc_animation_load(layer->background, layer, renderer);
-				/* FIXME */
-				if(layer && layer->background && engine.room && engine.room->background) {
-					/* Since parallax may be involved, check how much
-					 * the width of background and this layer differ */
-					int room_range_w = engine.room->background->w - kiavc_screen_width;
-					int layer_range_w = layer->background->w - kiavc_screen_width;
-					float layer_x = 0;
-					if(room_range_w > 0 && layer_range_w > 0)
-						layer_x = (engine.room->res.x / (float)room_range_w) * (float)layer_range_w;
-					int room_range_h = engine.room->background->h - kiavc_screen_height;
-					int layer_range_h = layer->background->h - kiavc_screen_height;
-					float layer_y = 0;
-					if(room_range_h > 0 && layer_range_h > 0)
-						layer_y = (engine.room->res.y / (float)room_range_h) * (float)layer_range_h;
-					clip.x = (int)layer_x;
-					clip.y = (int)layer_y;
-					clip.w = kiavc_screen_width;
-					clip.h = kiavc_screen_height;
-					rect.x = 0;
-					rect.y = 0;
-					rect.w = kiavc_screen_width;
-					rect.h = kiavc_screen_height;
-					if(layer->background->texture)
-						SDL_RenderCopy(renderer, layer->background->texture, &clip, &rect);
+			}
+		} else if(resource->type == KIAVC_ROOM_LAYER) {
+			/* This is a room layer */
+			kiavc_room_layer *layer = (kiavc_room_layer *)resource;
+			kiavc_animation_load(layer->background, layer, renderer);
+			if(kiavc_engine_layer_position(layer, view_x, view_y, &clip, &rect)) {
+				if(kiavc_engine_occlude(qi, &clip, &rect))
+					kiavc_engine_draw_sprite(layer->background->texture, &clip, &rect, SDL_ALPHA_OPAQUE);
+				else
+					render_stats.resources_occluded++;
+			}
+		} else if(resource->type == KIAVC_ACTOR) {
+			/* This is an actor */
+			kiavc_actor *actor = (kiavc_actor *)resource;
+			if(actor && actor->room == engine.room && actor->visible && actor->costume) {
+				int room_x = engine.room ? view_x : 0;
+				int room_y = engine.room ? view_y : 0;
+				int actor_x = 0, actor_y = 0;
+				kiavc_engine_render_position(&actor->res, &actor_x, &actor_y);
+				float scale = actor->scale * (actor->walkbox ? actor->walkbox->scale : 1.0);
+				int variant = actor->state*4 + actor->direction;
+				/* If we know where the actor is and it's off-screen, we're done */
+				if(kiavc_engine_bounds_match(&actor->res.bounds, actor_x, actor_y, scale, actor->costume, variant) &&
+						!kiavc_engine_bounds_visible(&actor->res.bounds.rect, room_x, room_y)) {
+					render_stats.resources_culled++;
+					continue;
 				}
-			} else if(resource->type == KIAVC_ACTOR) {
-				/* This is an actor */
-				kiavc_actor *actor = (kiavc_actor *)resource;
-				if(actor && actor->room == engine.room && actor->visible && actor->costume) {
-					int room_x = engine.room ? (int)engine.room->res.x : 0;
-					int room_y = engine.room ? (int)engine.room->res.y : 0;
-					kiavc_costume_set *set = kiavc_costume_get_set(actor->costume, kiavc_actor_state_str(actor->state));
-					if(set && set->animations[actor->direction]) {
-						kiavc_costume_load_set(set, actor, renderer);
-						clip.w = set->animations[actor->direction]->w;
-						clip.h = set->animations[actor->direction]->h;
-						if(actor->frame < 0 || actor->frame >= set->animations[actor->direction]->frames)
-							actor->frame = 0;
-						clip.x = actor->frame*(clip.w);
-						clip.y = 0;
-						int w = set->animations[actor->direction]->w;
-						int h = set->animations[actor->direction]->h;
-						if(actor->scale != 1.0 || (actor->walkbox && actor->walkbox->scale != 1.0)) {
-							float ws = actor->walkbox ? actor->walkbox->scale : 1.0;
-							w *= (actor->scale * ws);
-							h *= (actor->scale * ws);
-						}
-						rect.x = (int)actor->res.x - w/2 - room_x;
-						rect.y = (int)actor->res.y - h - room_y;
-						rect.w = w;
-						rect.h = h;
-						if(rect.x < kiavc_screen_width && rect.y < kiavc_screen_height &&
-								rect.x + rect.w > 0 && rect.y + rect.h > 0) {
-							SDL_SetTextureAlphaMod(set->animations[actor->direction]->texture, actor->res.fade_alpha);
-							SDL_RenderCopy(renderer, set->animations[actor->direction]->texture, &clip, &rect);
+				if(actor->animation) {
+					kiavc_costume_load_set(actor->set, actor, renderer);
+					clip.w = actor->animation->w;
+					clip.h = actor->animation->h;
+					if(actor->frame < 0 || actor->frame >= actor->animation->frames)
+						actor->frame = 0;
+					clip.x = actor->frame*(clip.w);
+					clip.y = 0;
+					int w = actor->animation->w;
+					int h = actor->animation->h;
+					if(actor->scale != 1.0 || (actor->walkbox && actor->walkbox->scale != 1.0)) {
+						float ws = actor->walkbox ? actor->walkbox->scale : 1.0;
+						w *= (actor->scale * ws);
+						h *= (actor->scale * ws);
+					}
+					rect.x = actor_x - w/2;
+					rect.y = actor_y - h;
+					rect.w = w;
+					rect.h = h;
+					if(w > 0 && h > 0)
+						kiavc_engine_bounds_update(&actor->res.bounds, actor_x, actor_y, scale, actor->costume, variant, &rect);
+					rect.x -= room_x;
+					rect.y -= room_y;
+					if(rect.x < kiavc_screen_width && rect.y < kiavc_screen_height &&
+							rect.x + rect.w > 0 && rect.y + rect.h > 0 &&
+							kiavc_animation_clip(actor->animation, &clip, &rect)) {
+						if(kiavc_engine_occlude(qi, &clip, &rect)) {
+							kiavc_engine_draw_sprite(actor->animation->texture,
+								&clip, &rect, actor->res.fade_alpha);
+							render_stats.resources_drawn++;
+						} else {
+							render_stats.resources_occluded++;
 						}
+					} else {
+						render_stats.resources_culled++;
 					}
 				}
-			} else if(resource->type == KIAVC_OBJECT) {
-				/* This is an object */
-				kiavc_object *object = (kiavc_object *)resource;
-				if(object && ((object->ui && !engine.cutscene && !engine.dialog) || object->room == engine.room)) {
-					int room_x = !object->ui && engine.room ? (int)engine.room->res.x : 0;
-					int room_y = !object->ui && engine.room ? (int)engine.room->res.y : 0;
-					kiavc_animation *animation = object->ui ? object->ui_animation :
-						(object->state ? object->state->animation : NULL);
-					if(animation) {
-						kiavc_animation_load(animation, object->ui ? (void *)object : (void *)object->state, renderer);
-						clip.w = animation->w;
-						clip.h = animation->h;
-						if(object->frame < 0 || object->frame >= animation->frames)
-							object->frame = 0;
-						clip.x = object->frame*(clip.w);
-						clip.y = 0;
-						int w = animation->w;
-						int h = animation->h;
-						if(object->scale != 1.0) {
-							w *= object->scale;
-							h *= object->scale;
-						}
-						int object_x = (int)object->res.x + (object->parent ? (int)object->parent->res.x : 0);
-						int object_y = (int)object->res.y + (object->parent ? (int)object->parent->res.y : 0);
-						if(object->ui) {
-							rect.x = object_x - room_x;
-							rect.y = object_y - room_y;
+			}
+		} else if(resource->type == KIAVC_OBJECT) {
+			/* This is an object */
+			kiavc_object *object = (kiavc_object *)resource;
+			if(object && ((object->ui && !engine.cutscene && !engine.dialog) || object->room == engine.room)) {
+				int room_x = !object->ui && engine.room ? view_x : 0;
+				int room_y = !object->ui && engine.room ? view_y : 0;
+				kiavc_animation *animation = object->ui ? object->ui_animation :
+					(object->state ? object->state->animation : NULL);
+				if(animation) {
+					int object_x = 0, object_y = 0, parent_x = 0, parent_y = 0;
+					kiavc_engine_render_position(&object->res, &object_x, &object_y);
+					if(object->parent) {
+						kiavc_engine_render_position(&object->parent->res, &parent_x, &parent_y);
+						object_x += parent_x;
+						object_y += parent_y;
+					}
+					/* If we know where the object is and it's off-screen, we're done */
+					if(kiavc_engine_bounds_match(&object->res.bounds, object_x, object_y, object->scale, animation, object->ui) &&
+							!kiavc_engine_bounds_visible(&object->res.bounds.rect, room_x, room_y)) {
+						render_stats.resources_culled++;
+						continue;
+					}
+					kiavc_animation_load(animation, object->ui ? (void *)object : (void *)object->state, renderer);
+					clip.w = animation->w;
+					clip.h = animation->h;
+					if(object->frame < 0 || object->frame >= animation->frames)
+						object->frame = 0;
+					clip.x = object->frame*(clip.w);
+					clip.y = 0;
+					int w = animation->w;
+					int h = animation->h;
+					if(object->scale != 1.0) {
+						w *= object->scale;
+						h *= object->scale;
+					}
+					if(object->ui) {
+						rect.x = object_x;
+						rect.y = object_y;
+					} else {
+						rect.x = object_x - w/2;
+						rect.y = object_y - h;
+					}
+					rect.w = w;
+					rect.h = h;
+					if(w > 0 && h > 0)
+						kiavc_engine_bounds_update(&object->res.bounds, object_x, object_y, object->scale, animation, object->ui, &rect);
+					rect.x -= room_x;
+					rect.y -= room_y;
+					if(rect.x < kiavc_screen_width && rect.y < kiavc_screen_height &&
+							rect.x + rect.w > 0 && rect.y + rect.h > 0 &&
+							kiavc_animation_clip(animation, &clip, &rect)) {
+						if(kiavc_engine_occlude(qi, &clip, &rect)) {
+							kiavc_engine_draw_sprite(animation->texture, &clip, &rect, object->res.fade_alpha);
+							render_stats.resources_drawn++;
 						} else {
-							rect.x = object_x - w/2 - room_x;
-							rect.y = object_y - h - room_y;
-						}
-						rect.w = w;
-						rect.h = h;
-						if(rect.x < kiavc_screen_width && rect.y < kiavc_screen_height &&
-								rect.x + rect.w > 0 && rect.y + rect.h > 0) {
-							SDL_SetTextureAlphaMod(animation->texture, object->res.fade_alpha);
-							SDL_RenderCopy(renderer, animation->texture, &clip, &rect);
+							render_stats.resources_occluded++;
 						}
+					} else {
+						render_stats.resources_culled++;
 					}
 				}
-			} else if(resource->type == KIAVC_FONT_TEXT) {
-				/* This is a text line */
-				bool draw = false;
-				kiavc_font_text *line = (kiavc_font_text *)resource;
-				int room_x = (!line->absolute && engine.room) ? (int)engine.room->res.x : 0;
-				int room_y = (!line->absolute && engine.room) ? (int)engine.room->res.y : 0;
-				rect.w = line->w;
-				rect.h = line->h;
-				if(line->owner_type == 0) {
-					/* Unowned text */
-					draw = true;
-					rect.x = (int)line->res.x - line->w/2 - room_x;
-					rect.y = (int)line->res.y - line->h/2 - room_y;
-				} else {
-					/* Check who the owner is */
-					if(line->owner_type == KIAVC_ACTOR) {
-						kiavc_actor *actor = (kiavc_actor *)line->owner;
-						if(actor && actor->room != engine.room) {
-							/* FIXME Since the actor isn't in the room, we render the text at the center */
-							draw = true;
-							line->absolute = true;
-							line->res.x = kiavc_screen_width/2;
-							line->res.y = kiavc_screen_height/2;
-							rect.x = (int)line->res.x - line->w/2 - room_x;
-							rect.y = (int)line->res.y - line->h/2 - room_y;
-						} else if(actor && actor->state == KIAVC_ACTOR_TALKING) {
-							kiavc_costume_set *set = kiavc_costume_get_set(actor->costume, "talking");
-							draw = true;
-							/* Don't draw the text if the actor isn't visible */
-							int w = (set && set->animations[actor->direction]) ?
-								set->animations[actor->direction]->w : 0;
-							int h = (set && set->animations[actor->direction]) ?
-								set->animations[actor->direction]->h : 0;
-							int ax = (int)actor->res.x - w/2 - room_x;
-							int ay = (int)actor->res.y - h - room_y;
-							int aw = w;
-							int ah = h;
-							if(w == 0 || h == 0 || ax >= kiavc_screen_width || ay >= kiavc_screen_height ||
-									ax + aw <= 0 || ay + ah <= 0)
-								draw = false;
-							rect.x = (int)actor->res.x - room_x - (line->w/2);
-							if(rect.x < 0)
-								rect.x = 0;
-							else if(rect.x + line->w > kiavc_screen_width)
-								rect.x = kiavc_screen_width - line->w;
-							int diff_y = kiavc_screen_height/20;
-							if(set && set->animations[actor->direction]) {
-								int h = set->animations[actor->direction]->h;
-								if(actor->scale != 1.0 || (actor->walkbox && actor->walkbox->scale != 1.0)) {
-									float ws = actor->walkbox ? actor->walkbox->scale : 1.0;
-									h *= (actor->scale * ws);
-								}
-								rect.y = (int)actor->res.y - h - room_y - line->h - diff_y;
-							} else {
-								rect.y = (int)actor->res.y - room_y - line->h - diff_y;
+			}
+		} else if(resource->type == KIAVC_FONT_TEXT) {
+			/* This is a text line */
+			bool draw = false;
+			kiavc_font_text *line = (kiavc_font_text *)resource;
+			int room_x = (!line->absolute && engine.room) ? view_x : 0;
+			int room_y = (!line->absolute && engine.room) ? view_y : 0;
+			int line_x = 0, line_y = 0;
+			kiavc_engine_render_position(&line->res, &line_x, &line_y);
+			rect.w = line->w;
+			rect.h = line->h;
+			if(line->owner_type == 0) {
+				/* Unowned text */
+				draw = true;
+				rect.x = line_x - line->w/2 - room_x;
+				rect.y = line_y - line->h/2 - room_y;
+			} else {
+				/* Check who the owner is */
+				if(line->owner_type == KIAVC_ACTOR) {
+					kiavc_actor *actor = (kiavc_actor *)line->owner;
+					if(actor && actor->room != engine.room) {
+						/* FIXME Since the actor isn't in the room, we render the text at the center */
+						draw = true;
+						line->absolute = true;
+						line->res.x = kiavc_screen_width/2;
+						line->res.y = kiavc_screen_height/2;
+						rect.x = (int)line->res.x - line->w/2 - room_x;
+						rect.y = (int)line->res.y - line->h/2 - room_y;
+					} else if(actor && actor->state == KIAVC_ACTOR_TALKING) {
+						draw = true;
+						int actor_x = 0, actor_y = 0;
+						kiavc_engine_render_position(&actor->res, &actor_x, &actor_y);
+						/* Don't draw the text if the actor isn't visible */
+						int w = actor->animation ? actor->animation->w : 0;
+						int h = actor->animation ? actor->animation->h : 0;
+						int ax = actor_x - w/2 - room_x;
+						int ay = actor_y - h - room_y;
+						int aw = w;
+						int ah = h;
+						if(w == 0 || h == 0 || ax >= kiavc_screen_width || ay >= kiavc_screen_height ||
+								ax + aw <= 0 || ay + ah <= 0)
+							draw = false;
+						rect.x = actor_x - room_x - (line->w/2);
+						if(rect.x < 0)
+							rect.x = 0;
+						else if(rect.x + line->w > kiavc_screen_width)
+							rect.x = kiavc_screen_width - line->w;
+						int diff_y = kiavc_screen_height/20;
+						if(actor->animation) {
+							int h = actor->animation->h;
+							if(actor->scale != 1.0 || (actor->walkbox && actor->walkbox->scale != 1.0)) {
+								float ws = actor->walkbox ? actor->walkbox->scale : 1.0;
+								h *= (actor->scale * ws);
 							}
-							if(rect.y < 0)
-								rect.y = 0;
-						}
-					} else if(line->owner_type == KIAVC_CURSOR) {
-						kiavc_cursor *cursor = (engine.hovering && engine.hotspot_cursor && engine.hotspot_cursor->animation) ?
-							engine.hotspot_cursor : engine.main_cursor;
-						if(cursor && cursor->animation) {
-							draw = true;
-							rect.x = engine.mouse_x - line->w/2;
-							rect.y = engine.mouse_y - line->h - cursor->animation->h/2;
-							if(rect.y < 0)
-								rect.y = engine.mouse_y;
+							rect.y = actor_y - h - room_y - line->h - diff_y;
+						} else {
+							rect.y = actor_y - room_y - line->h - diff_y;
 						}
-					} else if(line->owner_type == KIAVC_DIALOG) {
-						if(engine.dialog && engine.dialog == line->owner) {
-							/* FIXME We draw ourselves in a viewport */
-							clip.x = engine.dialog->area.x;
-							clip.y = engine.dialog->area.y - 4;
-							clip.w = engine.dialog->area.w;
-							clip.h = engine.dialog->area.h + 4;
-							SDL_RenderSetViewport(renderer, &clip);
-							/* If we haven't drawn the background yet, do it now */
-							if(!background_drawn) {
-								background_drawn = true;
-								SDL_SetRenderDrawColor(renderer, engine.dialog->background.r,
-									engine.dialog->background.g, engine.dialog->background.b, engine.dialog->background.a);
-								SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-								SDL_RenderFillRect(renderer, NULL);
-								SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
-							}
-							/* Draw the text */
-							rect.x = (int)line->res.x;
-							if(rect.x < 0)
-								rect.x = 0;
-							rect.y = (int)line->res.y;
-							if(rect.y < 0)
-								rect.y = 0;
-							SDL_RenderCopy(renderer, line->texture, NULL, &rect);
-							SDL_RenderSetViewport(renderer, NULL);
+						if(rect.y < 0)
+							rect.y = 0;
+					}
+				} else if(line->owner_type == KIAVC_CURSOR) {
+					kiavc_cursor *cursor = (engine.hovering && engine.hotspot_cursor && engine.hotspot_cursor->animation) ?
+						engine.hotspot_cursor : engine.main_cursor;
+					if(cursor && cursor->animation) {
+						draw = true;
+						rect.x = engine.mouse_x - line->w/2;
+						rect.y = engine.mouse_y - line->h - cursor->animation->h/2;
+						if(rect.y < 0)
+							rect.y = engine.mouse_y;
+					}
+				} else if(line->owner_type == KIAVC_DIALOG) {
+					if(engine.dialog && engine.dialog == line->owner) {
+						/* Anything we batched so far must be drawn before we change the viewport */
+						kiavc_engine_flush_sprites();
+						/* FIXME We draw ourselves in a viewport */
+						clip.x = engine.dialog->area.x;
+						clip.y = engine.dialog->area.y - 4;
+						clip.w = engine.dialog->area.w;
+						clip.h = engine.dialog->area.h + 4;
+						kiavc_render_state_set_viewport(render_state, &clip);
+						/* If we haven't drawn the background yet, do it now */
+						if(!background_drawn) {
+							background_drawn = true;
+							kiavc_render_state_set_draw_color(render_state, engine.dialog->background.r,
+								engine.dialog->background.g, engine.dialog->background.b, engine.dialog->background.a);
+							kiavc_render_state_set_blend_mode(render_state, SDL_BLENDMODE_BLEND);
+							kiavc_engine_fill_rect(NULL);
+							kiavc_render_state_set_draw_color(render_state, 0, 0, 0, SDL_ALPHA_OPAQUE);
 						}
+						/* Draw the text */
+						rect.x = (int)line->res.x;
+						if(rect.x < 0)
+							rect.x = 0;
+						rect.y = (int)line->res.y;
+						if(rect.y < 0)
+							rect.y = 0;
+						kiavc_engine_render_copy(line->texture, NULL, &rect);
+						kiavc_render_state_set_viewport(render_state, NULL);
 					}
 				}
-				if(draw && rect.x < kiavc_screen_width && rect.y < kiavc_screen_height &&
-						rect.x + rect.w > 0 && rect.y + rect.h > 0) {
-					SDL_SetTextureAlphaMod(line->texture, line->res.fade_alpha);
-					SDL_RenderCopy(renderer, line->texture, NULL, &rect);
-				}
-			} else if(resource->type == KIAVC_PLUGIN) {
-				/* This is a plugin resource, invoke its render function */
-				kiavc_plugin_resource *pr = (kiavc_plugin_resource *)resource;
-				if(pr && pr->rendering == KIAVC_PLUGIN_RENDERING_REGULAR && pr->plugin && pr->plugin->render)
-					pr->plugin->render(pr, renderer, kiavc_screen_width, kiavc_screen_height);
 			}
-			item = item->next;
-		}
-		/* If we haven't drawn the dialog background yet, do it now */
-		if(engine.dialog && !background_drawn && (engine.dialog->lines || !engine.dialog->autohide)) {
-			background_drawn = true;
-			/* We draw in a viewport */
-			clip.x = engine.dialog->area.x;
-			clip.y = engine.dialog->area.y - 4;
-			clip.w = engine.dialog->area.w * kiavc_screen_scale;
-			clip.h = engine.dialog->area.h + 4;
-			SDL_RenderSetViewport(renderer, &clip);
-			SDL_SetRenderDrawColor(renderer, engine.dialog->background.r,
-				engine.dialog->background.g, engine.dialog->background.b, engine.dialog->background.a);
-			SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-			SDL_RenderFillRect(renderer, NULL);
-			SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
-			SDL_RenderSetViewport(renderer, NULL);
-		}
-		/* If we're fading in or out, draw the black fade texture with the right alpha */
-		if(engine.fade_texture && engine.fade_alpha > 0) {
-			SDL_SetTextureAlphaMod(engine.fade_texture, engine.fade_alpha);
-			SDL_RenderCopy(renderer, engine.fade_texture, NULL, NULL);
-		}
-		/* The cursor is always the last game thing we draw */
-		kiavc_cursor *cursor = (engine.hovering && engine.hotspot_cursor && engine.hotspot_cursor->animation) ?
-			engine.hotspot_cursor : engine.main_cursor;
-		if(engine.cursor_visible && cursor && cursor->animation && cursor->animation && (!engine.cutscene || engine.dialog)) {
-			kiavc_animation_load(cursor->animation, cursor, renderer);
-			if(cursor->frame < 0 || cursor->frame >= cursor->animation->frames)
-				cursor->frame = 0;
-			clip.w = cursor->animation->w;
-			clip.h = cursor->animation->h;
-			clip.x = cursor->frame*(clip.w);
-			clip.y = 0;
-			rect.x = (int)cursor->res.x;
-			rect.y = (int)cursor->res.y;
-			rect.w = cursor->animation->w;
-			rect.h = cursor->animation->h;
-			if(cursor->animation->texture)
-				SDL_RenderCopy(renderer, cursor->animation->texture, &clip, &rect);
-		}
-		/* Check if there's any plugins that want to render stuff now */
-		kiavc_list *pl = plugin_resources;
-		while(pl) {
-			kiavc_plugin_resource *pr = (kiavc_plugin_resource *)pl->data;
-			if(pr && pr->rendering == KIAVC_PLUGIN_RENDERING_AFTER && pr->plugin && pr->plugin->render)
+			if(draw && rect.x < kiavc_screen_width && rect.y < kiavc_screen_height &&
+					rect.x + rect.w > 0 && rect.y + rect.h > 0) {
+				kiavc_engine_draw_sprite(line->texture, NULL, &rect, line->res.fade_alpha);
+				render_stats.resources_drawn++;
+			} else if(draw) {
+				render_stats.resources_culled++;
+			}
+		} else if(resource->type == KIAVC_PLUGIN) {
+			/* This is a plugin resource, invoke its render function */
+			kiavc_plugin_resource *pr = (kiavc_plugin_resource *)resource;
+			if(pr && pr->rendering == KIAVC_PLUGIN_RENDERING_REGULAR && pr->plugin && pr->plugin->render) {
+				/* Plugins draw on their own, so flush the sprites first */
+				kiavc_engine_flush_sprites();
+				kiavc_capture_plugin(pr->plugin->get_name ? pr->plugin->get_name() : NULL);
+				Uint64 pstart = kiavc_profiler_now();
 				pr->plugin->render(pr, renderer, kiavc_screen_width, kiavc_screen_height);
-			pl = pl->next;
-		}
-		/* Now that we're done with game stuff, let's pass the back texture to the renderer:
-		 * this will allow us to render debugging stuff and filters at the actual resolution */
-		SDL_SetRenderTarget(renderer, NULL);
-		SDL_RenderCopy(renderer, canvas, NULL, NULL);
-		/* Check if we're debugging objects */
-		if(kiavc_debug_objects && engine.render_list) {
-			SDL_SetRenderDrawColor(renderer, 255, 0, 255, SDL_ALPHA_OPAQUE);
-			kiavc_resource *resource = NULL;
-			kiavc_object *object = NULL;
-			kiavc_object_state *state = NULL;
-			int x = 0, y = 0, w = 0, h = 0,
-				x1 = 0, y1 = 0, x2 = 0, y2 = 0;
-			kiavc_list *temp = engine.render_list;
-			while(temp) {
-				resource = (kiavc_resource *)temp->data;
-				if(resource->type != KIAVC_OBJECT) {
-					temp = temp->next;
-					continue;
-				}
-				object = (kiavc_object *)resource;
-				state = object->state;
-				if(object->ui)
-					SDL_SetRenderDrawColor(renderer, 0, 255, 255, SDL_ALPHA_OPAQUE);
-				else
-					SDL_SetRenderDrawColor(renderer, 255, 0, 255, SDL_ALPHA_OPAQUE);
-				x = y = w = h = 0;
-				int object_x = (int)object->res.x + (object->parent ? (int)object->parent->res.x : 0);
-				int object_y = (int)object->res.y + (object->parent ? (int)object->parent->res.y : 0);
-				if(object->hover.from_x >= 0 || object->hover.from_y >= 0 ||
-						object->hover.to_x >= 0 || object->hover.to_y >= 0) {
-					x = object->hover.from_x;
-					y = object->hover.from_y;
-					w = object->hover.to_x - x;
-					h = object->hover.to_y - y;
-				} else if(!object->ui && state && state->animation) {
-					x = object_x - state->animation->w/2;
-					y = object_y - state->animation->h;
-					w = state->animation->w;
-					h = state->animation->h;
-				} else if(object->ui && object->ui_animation) {
-					x = object_x;
-					y = object_y;
-					w = object->ui_animation->w;
-					h = object->ui_animation->h;
-				}
-				x1 = (x - (object->ui ? 0 : (int)engine.room->res.x)) * kiavc_screen_scale;
-				y1 = (y - (object->ui ? 0 : (int)engine.room->res.y)) * kiavc_screen_scale;
-				x2 = (x + w - (object->ui ? 0 : (int)engine.room->res.x)) * kiavc_screen_scale;
-				y2 = (y + h - (object->ui ? 0 : (int)engine.room->res.y)) * kiavc_screen_scale;
-				SDL_RenderDrawLine(renderer, x1, y1, x2, y1);
-				SDL_RenderDrawLine(renderer, x2, y1, x2, y2);
-				SDL_RenderDrawLine(renderer, x2, y2, x1, y2);
-				SDL_RenderDrawLine(renderer, x1, y2, x1, y1);
+				kiavc_profiler_plugins_render += (kiavc_profiler_now() - pstart);
+				render_stats.plugin_renders++;
+				/* We don't know what the plugin drew, so assume the whole canvas */
+				kiavc_engine_count_overdraw(NULL);
+				/* The plugin may have changed the renderer state on its own */
+				kiavc_render_state_invalidate(render_state);
+			}
+		}
+	}
+	/* If we haven't drawn the dialog background yet, do it now */
+	if(engine.dialog && !background_drawn && (engine.dialog->lines || !engine.dialog->autohide)) {
+		background_drawn = true;
+		kiavc_engine_flush_sprites();
+		/* We draw in a viewport */
+		clip.x = engine.dialog->area.x;
+		clip.y = engine.dialog->area.y - 4;
+		clip.w = engine.dialog->area.w * kiavc_screen_scale;
+		clip.h = engine.dialog->area.h + 4;
+		kiavc_render_state_set_viewport(render_state, &clip);
+		kiavc_render_state_set_draw_color(render_state, engine.dialog->background.r,
+			engine.dialog->background.g, engine.dialog->background.b, engine.dialog->background.a);
+		kiavc_render_state_set_blend_mode(render_state, SDL_BLENDMODE_BLEND);
+		kiavc_engine_fill_rect(NULL);
+		kiavc_render_state_set_draw_color(render_state, 0, 0, 0, SDL_ALPHA_OPAQUE);
+		kiavc_render_state_set_viewport(render_state, NULL);
+	}
+	/* If we're fading in or out, draw the black fade texture with the right alpha */
+	if(engine.fade_texture && engine.fade_alpha > 0) {
+		rect.x = 0;
+		rect.y = 0;
+		rect.w = kiavc_screen_width;
+		rect.h = kiavc_screen_height;
+		kiavc_engine_draw_sprite(engine.fade_texture, NULL, &rect, engine.fade_alpha);
+	}
+	/* The cursor is always the last game thing we draw */
+	kiavc_cursor *cursor = (engine.hovering && engine.hotspot_cursor && engine.hotspot_cursor->animation) ?
+		engine.hotspot_cursor : engine.main_cursor;
+	if(engine.cursor_visible && cursor && cursor->animation && cursor->animation && (!engine.cutscene || engine.dialog)) {
+		kiavc_animation_load(cursor->animation, cursor, renderer);
+		if(cursor->frame < 0 || cursor->frame >= cursor->animation->frames)
+			cursor->frame = 0;
+		clip.w = cursor->animation->w;
+		clip.h = cursor->animation->h;
+		clip.x = cursor->frame*(clip.w);
+		clip.y = 0;
+		rect.x = (int)cursor->res.x;
+		rect.y = (int)cursor->res.y;
+		rect.w = cursor->animation->w;
+		rect.h = cursor->animation->h;
+		if(kiavc_animation_clip(cursor->animation, &clip, &rect))
+			kiavc_engine_draw_sprite(cursor->animation->texture, &clip, &rect, SDL_ALPHA_OPAQUE);
+	}
+	/* We're done with game sprites, draw what we haven't drawn yet */
+	kiavc_engine_flush_sprites();
+	/* If we only need to redraw what changed, now's the time to do it */
+	SDL_Rect area = { 0 };
+	if(kiavc_dirty_rects_end(dirty_rects, &area) && kiavc_screen_deferred)
+		kiavc_engine_redraw_area(&area);
+	kiavc_screen_deferred = false;
+	/* If we drew something we couldn't track, the next frame will need a full redraw too */
+	if(untracked || !kiavc_screen_dirty_rects)
+		kiavc_dirty_rects_invalidate(dirty_rects);
+	/* Check if there's any plugins that want to render stuff now */
+	kiavc_list *pl = plugin_resources;
+	while(pl) {
+		kiavc_plugin_resource *pr = (kiavc_plugin_resource *)pl->data;
+		if(pr && pr->rendering == KIAVC_PLUGIN_RENDERING_AFTER && pr->plugin && pr->plugin->render) {
+			kiavc_capture_plugin(pr->plugin->get_name ? pr->plugin->get_name() : NULL);
+			Uint64 pstart = kiavc_profiler_now();
+			pr->plugin->render(pr, renderer, kiavc_screen_width, kiavc_screen_height);
+			kiavc_profiler_plugins_render += (kiavc_profiler_now() - pstart);
+			render_stats.plugin_renders++;
+			kiavc_engine_count_overdraw(NULL);
+			/* The plugin may have changed the renderer state on its own */
+			kiavc_render_state_invalidate(render_state);
+		}
+		pl = pl->next;
+	}
+	/* Now that we're done with game stuff, let's pass the back texture to the renderer:
+	 * this will allow us to render debugging stuff and filters at the actual resolution.
+	 * If we drew to the window directly, we just need to get rid of the scaling instead */
+	if(kiavc_screen_direct) {
+		if(kiavc_debug_overdraw && overdraw) {
+			kiavc_overdraw_render(overdraw);
+			kiavc_batch_bind(batch, overdraw->texture);
+		}
+		kiavc_render_state_set_scale(render_state, 1.0);
+	} else {
+		kiavc_render_state_set_target(render_state, NULL);
+		kiavc_engine_render_copy(canvas, NULL, NULL);
+		/* If we're debugging overdraw, show the heatmap on top */
+		if(kiavc_debug_overdraw && overdraw) {
+			kiavc_overdraw_render(overdraw);
+			kiavc_batch_bind(batch, overdraw->texture);
+		}
+	}
+	/* Check if we're debugging objects */
+	if(kiavc_debug_objects && engine.render_queue->count > 0) {
+		kiavc_render_state_set_draw_color(render_state, 255, 0, 255, SDL_ALPHA_OPAQUE);
+		kiavc_resource *resource = NULL;
+		kiavc_object *object = NULL;
+		kiavc_object_state *state = NULL;
+		int x = 0, y = 0, w = 0, h = 0,
+			x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+		int qi = 0;
+		for(qi=0; qi<engine.render_queue->count; qi++) {
+			resource = engine.render_queue->items[qi].resource;
+			if(!resource)
+				continue;
+			if(resource->type != KIAVC_OBJECT) {
+				continue;
+			}
+			object = (kiavc_object *)resource;
+			state = object->state;
+			if(object->ui)
+				kiavc_render_state_set_draw_color(render_state, 0, 255, 255, SDL_ALPHA_OPAQUE);
+			else
+				kiavc_render_state_set_draw_color(render_state, 255, 0, 255, SDL_ALPHA_OPAQUE);
+			x = y = w = h = 0;
+			int object_x = (int)object->res.x + (object->parent ? (int)object->parent->res.x : 0);
+			int object_y = (int)object->res.y + (object->parent ? (int)object->parent->res.y : 0);
+			if(object->hover.from_x >= 0 || object->hover.from_y >= 0 ||
+					object->hover.to_x >= 0 || object->hover.to_y >= 0) {
+				x = object->hover.from_x;
+				y = object->hover.from_y;
+				w = object->hover.to_x - x;
+				h = object->hover.to_y - y;
+			} else if(!object->ui && state && state->animation) {
+				x = object_x - state->animation->w/2;
+				y = object_y - state->animation->h;
+				w = state->animation->w;
+				h = state->animation->h;
+			} else if(object->ui && object->ui_animation) {
+				x = object_x;
+				y = object_y;
+				w = object->ui_animation->w;
+				h = object->ui_animation->h;
+			}
+			x1 = (x - (object->ui ? 0 : view_x)) * kiavc_screen_scale;
+			y1 = (y - (object->ui ? 0 : view_y)) * kiavc_screen_scale;
+			x2 = (x + w - (object->ui ? 0 : view_x)) * kiavc_screen_scale;
+			y2 = (y + h - (object->ui ? 0 : view_y)) * kiavc_screen_scale;
+			kiavc_engine_draw_line(x1, y1, x2, y1);
+			kiavc_engine_draw_line(x2, y1, x2, y2);
+			kiavc_engine_draw_line(x2, y2, x1, y2);
+			kiavc_engine_draw_line(x1, y2, x1, y1);
+		}
+	}
+	/* Check if we're debugging walkboxes */
+	if(kiavc_debug_walkboxes && engine.room && engine.room->pathfinding && engine.room->pathfinding->walkboxes) {
+		kiavc_render_state_set_draw_color(render_state, 255, 255, 255, SDL_ALPHA_OPAQUE);
+		kiavc_pathfinding_walkbox *w = NULL;
+		int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+		kiavc_list *temp = engine.room->pathfinding->walkboxes;
+		while(temp) {
+			w = (kiavc_pathfinding_walkbox *)temp->data;
+			if(w->disabled) {
 				temp = temp->next;
+				continue;
 			}
+			x1 = (w->p1.x - view_x) * kiavc_screen_scale;
+			y1 = (w->p1.y - view_y) * kiavc_screen_scale;
+			x2 = (w->p2.x - view_x) * kiavc_screen_scale;
+			y2 = (w->p2.y - view_y) * kiavc_screen_scale;
+			kiavc_engine_draw_line(x1, y1, x2, y1);
+			kiavc_engine_draw_line(x2, y1, x2, y2);
+			kiavc_engine_draw_line(x2, y2, x1, y2);
+			kiavc_engine_draw_line(x1, y2, x1, y1);
+			temp = temp->next;
 		}
-		/* Check if we're debugging walkboxes */
-		if(kiavc_debug_walkboxes && engine.room && engine.room->pathfinding && engine.room->pathfinding->walkboxes) {
-			SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
-			kiavc_pathfinding_walkbox *w = NULL;
-			int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
-			kiavc_list *temp = engine.room->pathfinding->walkboxes;
+		if(engine.actor && engine.actor->path) {
+			kiavc_render_state_set_draw_color(render_state, 255, 255, 0, SDL_ALPHA_OPAQUE);
+			kiavc_pathfinding_point *p1 = NULL, *p2 = NULL;
+			temp = engine.actor->path;
 			while(temp) {
-				w = (kiavc_pathfinding_walkbox *)temp->data;
-				if(w->disabled) {
-					temp = temp->next;
-					continue;
+				p1 = (kiavc_pathfinding_point *)temp->data;
+				p2 = (kiavc_pathfinding_point *)(temp->next ? temp->next->data : NULL);
+				if(p2) {
+					x1 = (p1->x - view_x) * kiavc_screen_scale;
+					y1 = (p1->y - view_y) * kiavc_screen_scale;
+					x2 = (p2->x - view_x) * kiavc_screen_scale;
+					y2 = (p2->y - view_y) * kiavc_screen_scale;
+					kiavc_engine_draw_line(x1, y1, x2, y2);
 				}
-				x1 = (w->p1.x - (int)engine.room->res.x) * kiavc_screen_scale;
-				y1 = (w->p1.y - (int)engine.room->res.y) * kiavc_screen_scale;
-				x2 = (w->p2.x - (int)engine.room->res.x) * kiavc_screen_scale;
-				y2 = (w->p2.y - (int)engine.room->res.y) * kiavc_screen_scale;
-				SDL_RenderDrawLine(renderer, x1, y1, x2, y1);
-				SDL_RenderDrawLine(renderer, x2, y1, x2, y2);
-				SDL_RenderDrawLine(renderer, x2, y2, x1, y2);
-				SDL_RenderDrawLine(renderer, x1, y2, x1, y1);
 				temp = temp->next;
 			}
-			if(engine.actor && engine.actor->path) {
-				SDL_SetRenderDrawColor(renderer, 255, 255, 0, SDL_ALPHA_OPAQUE);
-				kiavc_pathfinding_point *p1 = NULL, *p2 = NULL;
-				temp = engine.actor->path;
-				while(temp) {
-					p1 = (kiavc_pathfinding_point *)temp->data;
-					p2 = (kiavc_pathfinding_point *)(temp->next ? temp->next->data : NULL);
-					if(p2) {
-						x1 = (p1->x - (int)engine.room->res.x) * kiavc_screen_scale;
-						y1 = (p1->y - (int)engine.room->res.y) * kiavc_screen_scale;
-						x2 = (p2->x - (int)engine.room->res.x) * kiavc_screen_scale;
-						y2 = (p2->y - (int)engine.room->res.y) * kiavc_screen_scale;
-						SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
-					}
-					temp = temp->next;
-				}
-			}
 		}
-		/* If the console's active, draw that now */
-		if(console_active && console_rendered) {
-			rect.x = 0;
-			rect.y = (kiavc_screen_height * kiavc_screen_scale) - console_rendered->h;
-			rect.w = console_rendered->w;
-			rect.h = console_rendered->h;
-			SDL_RenderCopy(renderer, console_rendered->texture, NULL, &rect);
-		}
-		/* If the scanlines filter is active, display that too */
-		if(kiavc_screen_scanlines_texture)
-			SDL_RenderCopy(renderer, kiavc_screen_scanlines_texture, NULL, NULL);
-		/* Check if there's any plugins that want to render stuff as the last thing */
-		pl = plugin_resources;
-		while(pl) {
-			kiavc_plugin_resource *pr = (kiavc_plugin_resource *)pl->data;
-			if(pr && pr->rendering == KIAVC_PLUGIN_RENDERING_LAST && pr->plugin && pr->plugin->render) {
-				pr->plugin->render(pr, renderer, kiavc_screen_width * kiavc_screen_scale,
-					kiavc_screen_height * kiavc_screen_scale);
-			}
-			pl = pl->next;
+	}
+	/* Check if we're debugging the frame profiler */
+	if(kiavc_debug_profiler)
+		kiavc_engine_render_profiler();
+	/* If the console's active, draw that now */
+	if(console_active && console_rendered) {
+		rect.x = 0;
+		rect.y = (kiavc_screen_height * kiavc_screen_scale) - console_rendered->h;
+		rect.w = console_rendered->w;
+		rect.h = console_rendered->h;
+		kiavc_engine_render_copy(console_rendered->texture, NULL, &rect);
+	}
+	/* If the scanlines filter is active, display that too */
+	if(kiavc_screen_scanlines_texture)
+		kiavc_engine_render_copy(kiavc_screen_scanlines_texture, NULL, NULL);
+	/* Check if there's any plugins that want to render stuff as the last thing */
+	pl = plugin_resources;
+	while(pl) {
+		kiavc_plugin_resource *pr = (kiavc_plugin_resource *)pl->data;
+		if(pr && pr->rendering == KIAVC_PLUGIN_RENDERING_LAST && pr->plugin && pr->plugin->render) {
+			kiavc_capture_plugin(pr->plugin->get_name ? pr->plugin->get_name() : NULL);
+			Uint64 pstart = kiavc_profiler_now();
+			pr->plugin->render(pr, renderer, kiavc_screen_width * kiavc_screen_scale,
+				kiavc_screen_height * kiavc_screen_scale);
+			kiavc_profiler_plugins_render += (kiavc_profiler_now() - pstart);
+			render_stats.plugin_renders++;
+			/* The plugin may have changed the renderer state on its own */
+			kiavc_render_state_invalidate(render_state);
 		}
-		/* Done, render to the screen */
-		SDL_RenderPresent(renderer);
+		pl = pl->next;
 	}
-	SDL_Delay(10);
+	if(plugin_resources) {
+		kiavc_profiler_add_sample(KIAVC_PROFILER_PLUGINS_RENDER,
+			(double)kiavc_profiler_plugins_render * 1000.0 / (double)kiavc_clock_frequency);
+	}
+	kiavc_profiler_add(KIAVC_PROFILER_RENDER, start);
+	kiavc_engine_update_render_stats();
+	/* All draw calls are queued in the renderer now, so if we can, we start
+	 * updating the world for the next frame while this one is presented */
+	start = kiavc_profiler_now();
+	bool pipelined = kiavc_engine_can_pipeline() &&
+		kiavc_pipeline_start(kiavc_engine_pipeline_job, NULL) == 0;
+	/* Done, render to the screen */
+	kiavc_capture_frame();
+	SDL_RenderPresent(renderer);
+	Uint64 presented = kiavc_profiler_now();
+	/* Wait for the next frame, unless vsync is doing that for us already */
+	if(!kiavc_screen_vsync && !kiavc_headless && !replay)
+		kiavc_engine_wait_frame();
+	/* If the worker is updating the world, wait for it to be done: we only
+	 * add profiler samples after that, since the worker adds its own too */
+	if(pipelined) {
+		Uint64 waiting = kiavc_profiler_now();
+		kiavc_pipeline_result = kiavc_pipeline_wait();
+		kiavc_pipeline_ahead = true;
+		/* Keep track of how much of the update happened while presenting */
+		Uint64 overlap = SDL_min(kiavc_pipeline_done, waiting) - start;
+		kiavc_profiler_add_sample(KIAVC_PROFILER_OVERLAP,
+			(double)overlap * 1000.0 / (double)kiavc_clock_frequency);
+	}
+	kiavc_profiler_add_sample(KIAVC_PROFILER_PRESENT,
+		(double)(presented - start) * 1000.0 / (double)kiavc_clock_frequency);
 	/* Done */
 	return 0;
 }
 
 /* Destroy the engine */
 void kiavc_engine_destroy(void) {
+	/* Stop the update pipeline, if we were using it */
+	kiavc_pipeline_destroy();
+	kiavc_jobs_destroy();
+	/* If we're still tracing, save the trace now */
+	if(kiavc_trace_is_enabled())
+		kiavc_trace_stop();
+	/* Same thing for render captures */
+	if(kiavc_capture_is_enabled())
+		kiavc_capture_stop();
+	SDL_free(kiavc_capture_filename);
+	kiavc_capture_filename = NULL;
+	/* If we were running headless, print some statistics */
+	if(kiavc_headless && kiavc_headless_start > 0) {
+		double wall_ms = (double)(SDL_GetPerformanceCounter() - kiavc_headless_start) * 1000.0 / (double)kiavc_clock_frequency;
+		SDL_Log("Headless run: %"SCNu32" steps, %"SCNu32" simulated ms, %.2f real ms (%.2f steps/s)\n",
+			kiavc_clock_steps, (uint32_t)kiavc_clock_ms, wall_ms,
+			wall_ms > 0 ? ((double)kiavc_clock_steps * 1000.0 / wall_ms) : 0.0);
+	}
+	/* Close the recording, if any, and print replay statistics if needed */
+	if(recording) {
+		SDL_Log("Recorded %"SCNu32" events over %"SCNu32" steps\n", recording->events, kiavc_clock_steps);
+		kiavc_recording_destroy(recording);
+		recording = NULL;
+	}
+	if(replay) {
+		double wall_ms = (double)(SDL_GetPerformanceCounter() - replay_start) * 1000.0 / (double)kiavc_clock_frequency;
+		SDL_Log("Replayed %"SCNu32" events over %"SCNu32" steps in %.2f ms (%.2fx)\n",
+			replay->events, kiavc_clock_steps, wall_ms, wall_ms > 0 ? (kiavc_clock_ms / wall_ms) : 0.0);
+		if(replay->checksums) {
+			if(replay_mismatches > 0)
+				SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "  -- %"SCNu32" checksum mismatches\n", replay_mismatches);
+			else
+				SDL_Log("  -- No checksum mismatches\n");
+		}
+		kiavc_recording_destroy(replay);
+		replay = NULL;
+	}
 	/* Destroy all resources */
 	kiavc_scripts_unload();
+	kiavc_render_queue_destroy(engine.render_queue);
+	engine.render_queue = NULL;
+	kiavc_tweens_destroy(engine.tweens);
+	engine.tweens = NULL;
+	kiavc_schedule_destroy(engine.schedule);
+	engine.schedule = NULL;
+	SDL_free(engine.moved);
+	engine.moved = NULL;
+	SDL_free(engine.moved_walkboxes);
+	engine.moved_walkboxes = NULL;
+	engine.moved_count = 0;
+	engine.moved_size = 0;
 	kiavc_map_destroy(cursors);
 	kiavc_map_destroy(rooms);
 	kiavc_map_destroy(actors);
@@ -1724,6 +3118,22 @@ void kiavc_engine_destroy(void) {
 	kiavc_map_destroy(animations);
 	kiavc_map_destroy(plugins);
 	kiavc_list_destroy(plugins_list);
+	kiavc_layer_cache_destroy(layer_cache);
+	kiavc_batch_destroy(batch);
+	kiavc_render_state_destroy(render_state);
+	render_state = NULL;
+	kiavc_dirty_rects_destroy(dirty_rects);
+	dirty_rects = NULL;
+	kiavc_atlas_destroy(atlas);
+	kiavc_map_destroy(opaque_regions);
+	kiavc_compositor_destroy(compositor);
+	compositor = NULL;
+	kiavc_overdraw_destroy(overdraw);
+	overdraw = NULL;
+	SDL_free(occluders);
+	occluders = NULL;
+	occluders_count = 0;
+	occluders_size = 0;
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 	SDL_DestroyTexture(canvas);
@@ -1837,6 +3247,49 @@ static bool kiavc_engine_set_scanlines(int alpha) {
 static int kiavc_engine_get_scanlines(void) {
 	return kiavc_screen_scanlines;
 }
+static bool kiavc_engine_set_dirty_rects(bool enabled) {
+	if(kiavc_screen_dirty_rects == enabled)
+		return true;
+	kiavc_screen_dirty_rects = enabled;
+	kiavc_dirty_rects_invalidate(dirty_rects);
+	SDL_Log("%s dirty rectangles\n", kiavc_screen_dirty_rects ? "Enabling" : "Disabling");
+	return true;
+}
+static bool kiavc_engine_get_dirty_rects(void) {
+	return kiavc_screen_dirty_rects;
+}
+static bool kiavc_engine_set_compositor(const char *name) {
+	if(!name || (SDL_strcasecmp(name, "gpu") && SDL_strcasecmp(name, "cpu"))) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Invalid compositor '%s'\n", name);
+		return false;
+	}
+	bool cpu = !SDL_strcasecmp(name, "cpu");
+	if(renderer) {
+		/* The CPU compositor needs the pixels of all textures as they're
+		 * created, so it can only be picked before we create any */
+		if(cpu == (compositor != NULL))
+			return true;
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't switch to the %s compositor, it can only be set before the window is created\n",
+			cpu ? "CPU" : "GPU");
+		return false;
+	}
+	kiavc_screen_cpu_compositor = cpu;
+	SDL_Log("Sprites will be composited on the %s\n", kiavc_screen_cpu_compositor ? "CPU" : "GPU");
+	return true;
+}
+static const char *kiavc_engine_get_compositor(void) {
+	return compositor ? "cpu" : "gpu";
+}
+static bool kiavc_engine_set_pipelining(bool enabled) {
+	if(kiavc_screen_pipelining == enabled)
+		return true;
+	kiavc_screen_pipelining = enabled;
+	SDL_Log("%s the update pipeline\n", kiavc_screen_pipelining ? "Enabling" : "Disabling");
+	return true;
+}
+static bool kiavc_engine_get_pipelining(void) {
+	return kiavc_screen_pipelining;
+}
 static bool kiavc_engine_debug_objects(bool debug) {
 	if(kiavc_debug_objects == debug) {
 		/* Nothing to do */
@@ -1861,6 +3314,58 @@ static bool kiavc_engine_debug_walkboxes(bool debug) {
 static bool kiavc_engine_is_debugging_walkboxes(void) {
 	return kiavc_debug_walkboxes;
 }
+static bool kiavc_engine_debug_overdraw(bool debug) {
+	if(kiavc_debug_overdraw == debug) {
+		/* Nothing to do */
+		return true;
+	}
+	kiavc_debug_overdraw = debug;
+	if(!kiavc_debug_overdraw) {
+		kiavc_overdraw_destroy(overdraw);
+		overdraw = NULL;
+	}
+	SDL_Log("%s overdraw debugging\n", kiavc_debug_overdraw ? "Enabling" : "Disabling");
+	return true;
+}
+static bool kiavc_engine_is_debugging_overdraw(void) {
+	return kiavc_debug_overdraw;
+}
+static bool kiavc_engine_debug_profiler(bool debug) {
+	if(kiavc_debug_profiler == debug) {
+		/* Nothing to do */
+		return true;
+	}
+	kiavc_debug_profiler = debug;
+	SDL_Log("%s profiler debugging\n", kiavc_debug_profiler ? "Enabling" : "Disabling");
+	return true;
+}
+static bool kiavc_engine_is_debugging_profiler(void) {
+	return kiavc_debug_profiler;
+}
+static bool kiavc_engine_get_frame_stats(int phase, kiavc_profiler_stats *stats) {
+	return kiavc_profiler_get_stats(phase, stats) == 0;
+}
+static bool kiavc_engine_get_render_stats(kiavc_render_stats *stats) {
+	if(!stats)
+		return false;
+	*stats = render_stats_last;
+	return true;
+}
+static bool kiavc_engine_log_render_stats(int seconds) {
+	if(seconds < 0) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Invalid render stats interval %d\n", seconds);
+		return false;
+	}
+	render_stats_interval = seconds * 1000;
+	render_stats_logged = 0;
+	render_stats_frames = 0;
+	SDL_zero(render_stats_total);
+	if(seconds > 0)
+		SDL_Log("Logging render stats every %d seconds\n", seconds);
+	else
+		SDL_Log("Not logging render stats\n");
+	return true;
+}
 static bool kiavc_engine_save_screenshot(const char *filename) {
 	if(!filename)
 		return false;
@@ -1884,6 +3389,41 @@ static bool kiavc_engine_save_screenshot(const char *filename) {
 	SDL_FreeSurface(screenshot);
 	return true;
 }
+static bool kiavc_engine_start_trace(const char *filename) {
+	if(!filename)
+		return false;
+	char fullpath[1024];
+	g_snprintf(fullpath, sizeof(fullpath)-1, "%s%s", app_path, filename);
+	return kiavc_trace_start(fullpath) == 0;
+}
+static bool kiavc_engine_stop_trace(void) {
+	return kiavc_trace_stop() == 0;
+}
+static bool kiavc_engine_start_capture(const char *filename, int frames) {
+	if(!filename || kiavc_capture_is_enabled())
+		return false;
+	/* We'll start capturing at the beginning of the next frame */
+	kiavc_engine_set_capture(filename, frames);
+	return true;
+}
+static bool kiavc_engine_stop_capture(void) {
+	if(kiavc_capture_filename) {
+		SDL_free(kiavc_capture_filename);
+		kiavc_capture_filename = NULL;
+		return true;
+	}
+	return kiavc_capture_stop() == 0;
+}
+static bool kiavc_engine_trace_begin(const char *name, const char *detail) {
+	if(!name)
+		return false;
+	kiavc_trace_begin(name, detail);
+	return true;
+}
+static bool kiavc_engine_trace_end(void) {
+	kiavc_trace_end();
+	return true;
+}
 static bool kiavc_engine_enable_console(const char *font) {
 	if(!font)
 		return false;
@@ -2100,7 +3640,7 @@ static bool kiavc_engine_add_dialog_line(const char *id, const char *name, const
 		return false;
 	}
 	bool selected = (line == dialog->selected);
-	engine.render_list = kiavc_list_append(engine.render_list, selected ? line->selected : line->text);
+	kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)(selected ? line->selected : line->text));
 	kiavc_engine_check_hovering();
 	/* Done */
 	SDL_Log("Added dialog line to '%s' (%s)\n", id, name);
@@ -2123,9 +3663,9 @@ static bool kiavc_engine_stop_dialog(const char *id) {
 	while(temp) {
 		line = (kiavc_dialog_line *)temp->data;
 		if(line->text)
-			engine.render_list = kiavc_list_remove(engine.render_list, line->text);
+			kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)line->text);
 		if(line->selected)
-			engine.render_list = kiavc_list_remove(engine.render_list, line->selected);
+			kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)line->selected);
 		temp = temp->next;
 	}
 	kiavc_dialog_clear(dialog);
@@ -2275,21 +3815,21 @@ static bool kiavc_engine_show_cursor_text(const char *fid, const char *text, SDL
 	}
 	/* Create a line of text */
 	if(engine.cursor_text) {
-		engine.render_list = kiavc_list_remove(engine.render_list, engine.cursor_text);
+		kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)engine.cursor_text);
 		kiavc_font_text_destroy(engine.cursor_text);
 	}
 	engine.cursor_text = kiavc_font_render_text(font, renderer, text, color, outline, kiavc_screen_width);
 	if(engine.cursor_text == NULL)
 		return false;
 	engine.cursor_text->owner_type = KIAVC_CURSOR;
-	engine.render_list = kiavc_list_insert_sorted(engine.render_list, engine.cursor_text, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+	kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)engine.cursor_text);
 	/* Done */
 	SDL_Log("Added cursor text\n");
 	return true;
 }
 static bool kiavc_engine_hide_cursor_text(void) {
 	if(engine.cursor_text) {
-		engine.render_list = kiavc_list_remove(engine.render_list, engine.cursor_text);
+		kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)engine.cursor_text);
 		kiavc_font_text_destroy(engine.cursor_text);
 	}
 	engine.cursor_text = NULL;
@@ -2413,6 +3953,7 @@ static bool kiavc_engine_set_room_background(const char *id, const char *bg) {
 	room->background = img;
 	room->res.x = 0;
 	room->res.y = 0;
+	kiavc_layer_cache_invalidate(layer_cache);
 	SDL_Log("Set background of room '%s' to '%s'\n", room->id, img->id);
 	return true;
 }
@@ -2439,7 +3980,8 @@ static bool kiavc_engine_add_room_layer(const char *id, const char *name, const
 		return false;
 	}
 	layer->background = img;
-	engine.render_list = kiavc_list_insert_sorted(engine.render_list, layer, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+	kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)layer);
+	kiavc_layer_cache_invalidate(layer_cache);
 	/* Done */
 	SDL_Log("Added layer '%s' to room '%s'\n", name, room->id);
 	return true;
@@ -2457,13 +3999,15 @@ static bool kiavc_engine_remove_room_layer(const char *id, const char *name) {
 	kiavc_list *list = room->layers;
 	while(list) {
 		kiavc_room_layer *layer = (kiavc_room_layer *)list->data;
-		if(layer->id && !SDL_strcasecmp(layer->id, id)) {
+		if(layer->id && !SDL_strcasecmp(layer->id, name)) {
 			/* Found */
 			kiavc_animation_unload(layer->background, layer);
-			engine.render_list = kiavc_list_remove(engine.render_list, layer);
+			kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)layer);
 			break;
 		}
+		list = list->next;
 	}
+	kiavc_layer_cache_invalidate(layer_cache);
 	if(kiavc_room_remove_layer(room, name) < 0) {
 		/* Error adding layer */
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't remove room layer '%s' from room '%s'\n", name, id);
@@ -2559,9 +4103,11 @@ static bool kiavc_engine_show_room(const char *id) {
 	}
 	/* Cleanup previous room and render list */
 	kiavc_resource *resource = NULL;
-	kiavc_list *tmp = engine.render_list;
-	while(tmp) {
-		resource = (kiavc_resource *)tmp->data;
+	int qi = 0;
+	for(qi=0; qi<engine.render_queue->count; qi++) {
+		resource = engine.render_queue->items[qi].resource;
+		if(!resource)
+			continue;
 		if(resource->type == KIAVC_ACTOR) {
 			kiavc_actor *actor = (kiavc_actor *)resource;
 			kiavc_costume_unload_sets(actor->costume, actor);
@@ -2582,20 +4128,20 @@ static bool kiavc_engine_show_room(const char *id) {
 			kiavc_room *room = (kiavc_room *)resource;
 			kiavc_animation_unload(room->background, room);
 		}
-		tmp = tmp->next;
 	}
-	kiavc_list_destroy(engine.render_list);
-	engine.render_list = NULL;
+	kiavc_render_queue_clear(engine.render_queue);
+	kiavc_schedule_clear(engine.schedule);
+	kiavc_layer_cache_invalidate(layer_cache);
 	/* Setup new room */
 	engine.room = room;
-	engine.render_list = kiavc_list_insert_sorted(engine.render_list, room, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+	kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)room);
 	kiavc_actor *actor = NULL;
 	kiavc_list *item = room->actors;
 	while(item) {
 		actor = (kiavc_actor *)item->data;
 		if(actor->visible) {
 			actor->res.ticks = 0;
-			engine.render_list = kiavc_list_insert_sorted(engine.render_list, actor, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+			kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)actor);
 		}
 		item = item->next;
 	}
@@ -2605,26 +4151,22 @@ static bool kiavc_engine_show_room(const char *id) {
 		object = (kiavc_object *)item->data;
 		if(object->visible) {
 			object->res.ticks = 0;
-			engine.render_list = kiavc_list_insert_sorted(engine.render_list, object, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+			kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)object);
 		}
 		item = item->next;
 	}
-	kiavc_list *objs = kiavc_map_get_values(objects);
-	item = objs;
-	while(item) {
-		object = (kiavc_object *)item->data;
+	Uint32 handle = 0;
+	while((object = kiavc_object_next(&handle)) != NULL) {
 		if(object->ui && object->visible) {
 			object->res.ticks = 0;
-			engine.render_list = kiavc_list_insert_sorted(engine.render_list, object, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+			kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)object);
 		}
-		item = item->next;
 	}
-	kiavc_list_destroy(objs);
 	kiavc_room_layer *layer = NULL;
 	item = room->layers;
 	while(item) {
 		layer = (kiavc_room_layer *)item->data;
-		engine.render_list = kiavc_list_insert_sorted(engine.render_list, layer, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+		kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)layer);
 		item = item->next;
 	}
 	if(engine.following && engine.following->room == room) {
@@ -2673,6 +4215,7 @@ static bool kiavc_engine_set_actor_costume(const char *id, const char *cost) {
 	if(actor->costume)
 		kiavc_costume_unload_sets(actor->costume, actor);
 	actor->costume = costume;
+	kiavc_engine_update_actor_animation(actor);
 	SDL_Log("Set costume of actor '%s' to '%s'\n", actor->id, costume->id);
 	return true;
 }
@@ -2698,13 +4241,14 @@ static bool kiavc_engine_move_actor_to(const char *id, const char *rid, int x, i
 	if(!kiavc_list_find(room->actors, actor))
 		room->actors = kiavc_list_append(room->actors, actor);
 	kiavc_costume_unload_sets(actor->costume, actor);
-	engine.render_list = kiavc_list_remove(engine.render_list, actor);
+	kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)actor);
 	actor->room = room;
 	actor->state = KIAVC_ACTOR_STILL;
+	kiavc_engine_update_actor_animation(actor);
 	actor->res.x = x;
 	actor->res.y = y;
 	if(actor->visible && engine.room && engine.room == room)
-		engine.render_list = kiavc_list_insert_sorted(engine.render_list, actor, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+		kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)actor);
 	if(engine.room && engine.following == actor && engine.following->room == room) {
 		engine.room->res.x = (int)engine.following->res.x - kiavc_screen_width/2;
 		engine.room->res.y = (int)engine.following->res.y - kiavc_screen_height/2;
@@ -2714,6 +4258,7 @@ static bool kiavc_engine_move_actor_to(const char *id, const char *rid, int x, i
 	actor->step = NULL;
 	actor->res.target_x = -1;
 	actor->res.target_y = -1;
+	kiavc_tweens_stop(engine.tweens, &actor->res, KIAVC_TWEEN_MOTION);
 	/* Check which walkbox we're in */
 	if(actor->room && actor->room->pathfinding && actor->room->pathfinding->walkboxes) {
 		int x = (int)actor->res.x;
@@ -2750,9 +4295,10 @@ static bool kiavc_engine_show_actor(const char *id) {
 	actor->visible = true;
 	/* FIXME Should these be configurable? */
 	actor->state = KIAVC_ACTOR_STILL;
+	kiavc_engine_update_actor_animation(actor);
 	/* Done */
-	if(actor->room == engine.room && !kiavc_list_find(engine.render_list, actor))
-		engine.render_list = kiavc_list_insert_sorted(engine.render_list, actor, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+	if(actor->room == engine.room && !kiavc_render_queue_contains(engine.render_queue, (kiavc_resource *)actor))
+		kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)actor);
 	SDL_Log("Shown actor '%s'\n", actor->id);
 	return true;
 }
@@ -2783,7 +4329,7 @@ static bool kiavc_engine_hide_actor(const char *id) {
 	actor->visible = false;
 	actor->res.ticks = 0;
 	kiavc_costume_unload_sets(actor->costume, actor);
-	engine.render_list = kiavc_list_remove(engine.render_list, actor);
+	kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)actor);
 	/* Done */
 	SDL_Log("Hidden actor '%s'\n", actor->id);
 	return true;
@@ -2802,15 +4348,10 @@ static bool kiavc_engine_fade_actor_to(const char *id, int alpha, int ms) {
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't fade actor, no such actor '%s'\n", id);
 		return false;
 	}
-	if(actor->room == engine.room && !kiavc_list_find(engine.render_list, actor))
-		engine.render_list = kiavc_list_insert_sorted(engine.render_list, actor, (kiavc_list_item_compare)kiavc_engine_sort_resources);
-	actor->res.fade_ms = ms;
-	actor->res.fade_start = actor->res.fade_alpha;
-	actor->res.fade_target = alpha;
-	actor->res.fade_ticks = 0;
+	if(actor->room == engine.room && !kiavc_render_queue_contains(engine.render_queue, (kiavc_resource *)actor))
+		kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)actor);
+	kiavc_tweens_fade(engine.tweens, &actor->res, alpha, ms);
 	actor->visible = true;
-	if(!kiavc_list_find(engine.fading, actor))
-		engine.fading = kiavc_list_append(engine.fading, actor);
 	/* Done */
 	SDL_Log("Fading actor '%s' alpha to '%d'\n", actor->id, alpha);
 	return true;
@@ -2845,7 +4386,7 @@ static bool kiavc_engine_set_actor_plane(const char *id, int zplane) {
 		return false;
 	}
 	actor->res.zplane = zplane;
-	engine.render_list = kiavc_list_sort(engine.render_list, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+	kiavc_render_queue_invalidate(engine.render_queue);
 	/* Done */
 	SDL_Log("Set actor '%s' plane to '%d'\n", actor->id, zplane);
 	return true;
@@ -2870,7 +4411,7 @@ static bool kiavc_engine_set_actor_speed(const char *id, int speed) {
 	SDL_Log("Set actor '%s' speed to '%d'\n", actor->id, speed);
 	return true;
 }
-static bool kiavc_engine_scale_actor(const char *id, float scale) {
+static bool kiavc_engine_scale_actor(const char *id, float scale, int ms) {
 	if(!id)
 		return false;
 	/* Get the actor */
@@ -2880,6 +4421,13 @@ static bool kiavc_engine_scale_actor(const char *id, float scale) {
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't scale actor, no such actor '%s'\n", id);
 		return false;
 	}
+	if(ms > 0) {
+		/* Scale the actor gradually */
+		kiavc_tweens_scale(engine.tweens, &actor->res, &actor->scale, scale, ms);
+		SDL_Log("Scaling actor '%s' to '%f'\n", actor->id, scale);
+		return true;
+	}
+	kiavc_tweens_stop(engine.tweens, &actor->res, KIAVC_TWEEN_SCALE);
 	actor->scale = scale;
 	/* Done */
 	SDL_Log("Set actor '%s' scaling to '%f'\n", actor->id, scale);
@@ -2909,6 +4457,7 @@ static bool kiavc_engine_walk_actor_to(const char *id, int x, int y) {
 	actor->res.target_x = p->x;
 	actor->res.target_y = p->y;
 	actor->step = actor->path->next;
+	kiavc_tweens_move(engine.tweens, &actor->res, p->x, p->y, actor->res.speed);
 	/* Done */
 	SDL_Log("Walking actor '%s' to %dx%d\n", actor->id, to.x, to.y);
 	return true;
@@ -2931,7 +4480,9 @@ static bool kiavc_engine_say_actor(const char *id, const char *text, const char
 	}
 	/* Create a line of text */
 	if(actor->line) {
-		engine.render_list = kiavc_list_remove(engine.render_list, actor->line);
+		kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)actor->line);
+		kiavc_tweens_remove(engine.tweens, (kiavc_resource *)actor->line);
+		kiavc_schedule_remove(engine.schedule, (kiavc_resource *)actor->line);
 		kiavc_font_text_destroy(actor->line);
 	}
 	int max_width = (2 * kiavc_screen_width) / 3;
@@ -2942,8 +4493,10 @@ static bool kiavc_engine_say_actor(const char *id, const char *text, const char
 	actor->line->owner = actor;
 	actor->res.target_x = -1;
 	actor->res.target_y = -1;
+	kiavc_tweens_stop(engine.tweens, &actor->res, KIAVC_TWEEN_MOTION);
 	actor->state = KIAVC_ACTOR_TALKING;
-	engine.render_list = kiavc_list_insert_sorted(engine.render_list, actor->line, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+	kiavc_engine_update_actor_animation(actor);
+	kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)actor->line);
 	/* Done */
 	SDL_Log("Created text for actor '%s'\n", actor->id);
 	return true;
@@ -2965,6 +4518,7 @@ static bool kiavc_engine_set_actor_direction(const char *id, const char *directi
 		return false;
 	}
 	actor->direction = dir;
+	kiavc_engine_update_actor_animation(actor);
 	/* Done */
 	SDL_Log("Changed actor '%s' direction to '%s'\n", actor->id, direction);
 	return true;
@@ -2988,15 +4542,18 @@ static bool kiavc_engine_skip_actors_text(void) {
 	/* Iterate on all actor lines and set their duration to 1 */
 	kiavc_resource *resource = NULL;
 	kiavc_font_text *line = NULL;
-	kiavc_list *temp = engine.render_list;
-	while(temp) {
-		resource = (kiavc_resource *)temp->data;
+	int qi = 0;
+	for(qi=0; qi<engine.render_queue->count; qi++) {
+		resource = engine.render_queue->items[qi].resource;
+		if(!resource)
+			continue;
 		if(resource->type == KIAVC_FONT_TEXT) {
 			line = (kiavc_font_text *)resource;
-			if(line->owner_type == KIAVC_ACTOR)
+			if(line->owner_type == KIAVC_ACTOR) {
 				line->duration = 1;
+				kiavc_engine_schedule(resource);
+			}
 		}
-		temp = temp->next;
 	}
 	/* Done */
 	SDL_Log("Skipped actors text\n");
@@ -3012,7 +4569,10 @@ static bool kiavc_engine_set_actor_state(const char *id, const char *type) {
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't have actor use object, no such object '%s'\n", id);
 		return false;
 	}
-	actor->state = kiavc_actor_state(type);
+	/* Check if this is a custom state a costume defined an animation for */
+	int state = kiavc_costume_set_index(type, false);
+	actor->state = state >= 0 ? state : kiavc_actor_state(type);
+	kiavc_engine_update_actor_animation(actor);
 	/* Done */
 	SDL_Log("Set actor '%s' state to '%s'\n", id, type);
 	return true;
@@ -3038,10 +4598,10 @@ static bool kiavc_engine_register_costume(const char *id) {
 static bool kiavc_engine_set_costume_animation(const char *id, const char *type, const char *direction, const char *canim) {
 	if(!id || !type || !direction || !canim)
 		return false;
-	/* FIXME We only accept still, walking, talking and using for animations at the moment */
-	if(SDL_strcasecmp(type, "still") && SDL_strcasecmp(type, "walking") && SDL_strcasecmp(type, "talking") &&
-			SDL_strcasecmp(type, "usehigh") && SDL_strcasecmp(type, "usemid") && SDL_strcasecmp(type, "uselow")) {
-		/* Invalid direction */
+	/* Besides still, walking, talking and using, custom types are accepted too */
+	int index = kiavc_costume_set_index(type, true);
+	if(index < 0) {
+		/* Invalid type */
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't set costume animation, invalid type '%s'\n", type);
 		return false;
 	}
@@ -3065,13 +4625,21 @@ static bool kiavc_engine_set_costume_animation(const char *id, const char *type,
 		return false;
 	}
 	/* FIXME Done */
-	kiavc_costume_set *set = kiavc_costume_get_set(costume, type);
+	kiavc_costume_set *set = kiavc_costume_get_set(costume, index, true);
 	if(!set) {
 		/* Error accessing set */
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't set costume animation for costume '%s', error adding/retrieving set '%s'\n", id, type);
 		return false;
 	}
 	set->animations[dir] = anim;
+	/* Actors using this costume may need a new animation and bounding box */
+	kiavc_actor *actor = NULL;
+	Uint32 handle = 0;
+	while((actor = kiavc_actor_next(&handle)) != NULL) {
+		if(actor->costume == costume)
+			kiavc_engine_update_actor_animation(actor);
+	}
+	kiavc_bounds_generation++;
 	SDL_Log("Set %s %s animation of costume '%s' to '%s'\n", direction, type, costume->id, anim->id);
 	return true;
 }
@@ -3119,6 +4687,7 @@ static bool kiavc_engine_set_object_animation(const char *id, const char *state,
 	}
 	/* Done */
 	obj_state->animation = anim;
+	kiavc_engine_schedule(&object->res);
 	SDL_Log("Set animation for state '%s' of object '%s' to '%s'\n", obj_state->id, object->id, anim->id);
 	return true;
 }
@@ -3153,6 +4722,7 @@ static bool kiavc_engine_set_object_ui(const char *id, bool ui) {
 	object->ui = ui;
 	object->res.x = -1;
 	object->res.y = -1;
+	kiavc_engine_schedule(&object->res);
 	SDL_Log("Marked object '%s' as %s of the UI\n", object->id, ui ? "part" : "NOT part");
 	return true;
 }
@@ -3171,9 +4741,10 @@ static bool kiavc_engine_set_object_ui_position(const char *id, int x, int y) {
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't set object UI position, object '%s' not part of the UI\n", id);
 		return false;
 	}
-	/* Done */
 	object->res.x = x;
 	object->res.y = y;
+	kiavc_render_queue_invalidate(engine.render_queue);
+	/* Done */
 	SDL_Log("Marked object '%s' position in the UI to [%d,%d]\n", object->id, x, y);
 	return true;
 }
@@ -3195,6 +4766,7 @@ static bool kiavc_engine_set_object_ui_animation(const char *id, const char *can
 	}
 	/* Done */
 	object->ui_animation = anim;
+	kiavc_engine_schedule(&object->res);
 	SDL_Log("Set UI animation of object '%s' to '%s'\n", object->id, anim->id);
 	return true;
 }
@@ -3265,13 +4837,13 @@ static bool kiavc_engine_move_object_to(const char *id, const char *rid, int x,
 		temp = temp->next;
 	}
 	kiavc_list_destroy(states);
-	engine.render_list = kiavc_list_remove(engine.render_list, object);
+	kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)object);
 	object->room = room;
 	object->ui = 0;
 	object->res.x = x;
 	object->res.y = y;
 	if(object->visible && engine.room && engine.room == room)
-		engine.render_list = kiavc_list_insert_sorted(engine.render_list, object, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+		kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)object);
 	SDL_Log("Moved object '%s' to room '%s' (%dx%d)\n", object->id, room->id, (int)object->res.x, (int)object->res.y);
 	return true;
 }
@@ -3293,7 +4865,7 @@ static bool kiavc_engine_float_object_to(const char *id, int x, int y, int speed
 	object->res.target_x = x;
 	object->res.target_y = y;
 	object->res.speed = speed;
-	object->res.move_ticks = 0;
+	kiavc_tweens_move(engine.tweens, &object->res, x, y, speed);
 	/* Done */
 	return true;
 }
@@ -3328,8 +4900,8 @@ static bool kiavc_engine_show_object(const char *id) {
 	}
 	object->visible = true;
 	/* Done */
-	if((object->ui || object->room == engine.room) && !kiavc_list_find(engine.render_list, object))
-		engine.render_list = kiavc_list_insert_sorted(engine.render_list, object, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+	if((object->ui || object->room == engine.room) && !kiavc_render_queue_contains(engine.render_queue, (kiavc_resource *)object))
+		kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)object);
 	SDL_Log("Shown object '%s'\n", object->id);
 	return true;
 }
@@ -3354,7 +4926,7 @@ static bool kiavc_engine_hide_object(const char *id) {
 	}
 	kiavc_list_destroy(states);
 	kiavc_animation_unload(object->ui_animation, object);
-	engine.render_list = kiavc_list_remove(engine.render_list, object);
+	kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)object);
 	/* Done */
 	SDL_Log("Hidden object '%s'\n", object->id);
 	return true;
@@ -3373,15 +4945,10 @@ static bool kiavc_engine_fade_object_to(const char *id, int alpha, int ms) {
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't fade object, no such object '%s'\n", id);
 		return false;
 	}
-	if((object->ui || object->room == engine.room) && !kiavc_list_find(engine.render_list, object))
-		engine.render_list = kiavc_list_insert_sorted(engine.render_list, object, (kiavc_list_item_compare)kiavc_engine_sort_resources);
-	object->res.fade_ms = ms;
-	object->res.fade_start = object->res.fade_alpha;
-	object->res.fade_target = alpha;
-	object->res.fade_ticks = 0;
+	if((object->ui || object->room == engine.room) && !kiavc_render_queue_contains(engine.render_queue, (kiavc_resource *)object))
+		kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)object);
+	kiavc_tweens_fade(engine.tweens, &object->res, alpha, ms);
 	object->visible = true;
-	if(!kiavc_list_find(engine.fading, object))
-		engine.fading = kiavc_list_append(engine.fading, object);
 	/* Done */
 	SDL_Log("Fading object '%s' alpha to '%d'\n", object->id, alpha);
 	return true;
@@ -3416,7 +4983,7 @@ static bool kiavc_engine_set_object_plane(const char *id, int zplane) {
 		return false;
 	}
 	object->res.zplane = zplane;
-	engine.render_list = kiavc_list_sort(engine.render_list, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+	kiavc_render_queue_invalidate(engine.render_queue);
 	/* Done */
 	SDL_Log("Set object '%s' plane to '%d'\n", object->id, zplane);
 	return true;
@@ -3441,11 +5008,12 @@ static bool kiavc_engine_set_object_state(const char *id, const char *state) {
 	if(object->state && object->state != obj_state)
 		kiavc_animation_unload(object->state->animation, object->state);
 	object->state = obj_state;
+	kiavc_engine_schedule(&object->res);
 	/* Done */
 	SDL_Log("Set object '%s' state to '%s'\n", object->id, state);
 	return true;
 }
-static bool kiavc_engine_scale_object(const char *id, float scale) {
+static bool kiavc_engine_scale_object(const char *id, float scale, int ms) {
 	if(!id)
 		return false;
 	/* Get the object */
@@ -3455,6 +5023,13 @@ static bool kiavc_engine_scale_object(const char *id, float scale) {
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't scale object, no such object '%s'\n", id);
 		return false;
 	}
+	if(ms > 0) {
+		/* Scale the object gradually */
+		kiavc_tweens_scale(engine.tweens, &object->res, &object->scale, scale, ms);
+		SDL_Log("Scaling object '%s' to '%f'\n", object->id, scale);
+		return true;
+	}
+	kiavc_tweens_stop(engine.tweens, &object->res, KIAVC_TWEEN_SCALE);
 	object->scale = scale;
 	/* Done */
 	SDL_Log("Set object '%s' scaling to '%f'\n", object->id, scale);
@@ -3553,7 +5128,7 @@ static bool kiavc_engine_show_text(const char *id, const char *text, const char
 		line->id = SDL_strdup(id);
 		kiavc_map_insert(texts, SDL_strdup(id), line);
 	}
-	engine.render_list = kiavc_list_insert_sorted(engine.render_list, line, (kiavc_list_item_compare)kiavc_engine_sort_resources);
+	kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)line);
 	/* Done */
 	return true;
 }
@@ -3575,7 +5150,7 @@ static bool kiavc_engine_float_text_to(const char *id, int x, int y, int speed)
 	line->res.target_x = x;
 	line->res.target_y = y;
 	line->res.speed = speed;
-	line->res.move_ticks = 0;
+	kiavc_tweens_move(engine.tweens, &line->res, x, y, speed);
 	/* Done */
 	SDL_Log("Floating text '%s' to %dx%d at speed %d\n", line->id, x, y, speed);
 	return true;
@@ -3594,12 +5169,7 @@ static bool kiavc_engine_fade_text_to(const char *id, int alpha, int ms) {
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't fade text, no such text '%s'\n", id);
 		return false;
 	}
-	line->res.fade_ms = ms;
-	line->res.fade_start = line->res.fade_alpha;
-	line->res.fade_target = alpha;
-	line->res.fade_ticks = 0;
-	if(!kiavc_list_find(engine.fading, line))
-		engine.fading = kiavc_list_append(engine.fading, line);
+	kiavc_tweens_fade(engine.tweens, &line->res, alpha, ms);
 	/* Done */
 	SDL_Log("Fading text '%s' alpha to '%d'\n", line->id, alpha);
 	return true;
@@ -3633,8 +5203,9 @@ static bool kiavc_engine_remove_text(const char *id) {
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't remove text, no such text '%s'\n", id);
 		return false;
 	}
-	engine.render_list = kiavc_list_remove(engine.render_list, line);
-	engine.fading = kiavc_list_remove(engine.fading, line);
+	kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)line);
+	kiavc_tweens_remove(engine.tweens, (kiavc_resource *)line);
+	kiavc_schedule_remove(engine.schedule, (kiavc_resource *)line);
 	kiavc_map_remove(texts, id);
 	/* Done */
 	SDL_Log("Removed text '%s'\n", id);
@@ -3690,8 +5261,7 @@ static void kiavc_plugins_add_resource(kiavc_plugin_resource *resource) {
 	plugin_resources = kiavc_list_insert_sorted(plugin_resources, resource,
 		(kiavc_list_item_compare)kiavc_engine_sort_resources);
 	if(resource->rendering == KIAVC_PLUGIN_RENDERING_REGULAR) {
-		engine.render_list = kiavc_list_insert_sorted(engine.render_list, resource,
-			(kiavc_list_item_compare)kiavc_engine_sort_resources);
+		kiavc_render_queue_add(engine.render_queue, (kiavc_resource *)resource);
 	}
 }
 static void kiavc_plugins_remove_resource(kiavc_plugin_resource *resource) {
@@ -3703,7 +5273,7 @@ static void kiavc_plugins_remove_resource(kiavc_plugin_resource *resource) {
 	if(!resource)
 		return;
 	plugin_resources = kiavc_list_remove(plugin_resources, resource);
-	engine.render_list = kiavc_list_remove(engine.render_list, resource);
+	kiavc_render_queue_remove(engine.render_queue, (kiavc_resource *)resource);
 }
 static void kiavc_plugins_run_command(const char *fmt, ...) {
 	if(SDL_ThreadID() != thread) {
@@ -3716,3 +5286,12 @@ static void kiavc_plugins_run_command(const char *fmt, ...) {
 	kiavc_scripts_run_command(fmt, args);
 	va_end(args);
 }
+static void kiavc_plugins_set_draw_color(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+	kiavc_render_state_set_draw_color(render_state, r, g, b, a);
+}
+static void kiavc_plugins_set_draw_blend_mode(SDL_BlendMode blend) {
+	kiavc_render_state_set_blend_mode(render_state, blend);
+}
+static void kiavc_plugins_set_viewport(const SDL_Rect *viewport) {
+	kiavc_render_state_set_viewport(render_state, viewport);
+}
@@ -16,11 +16,46 @@
 #include <SDL2/SDL.h>
 
 #include "bag.h"
+#include "atlas.h"
+#include "opaque.h"
 
+/* Headless modes */
+#define KIAVC_HEADLESS_NONE		0
+#define KIAVC_HEADLESS_NORENDER	1
+#define KIAVC_HEADLESS_SOFTWARE	2
+
+/* Enable the headless mode, optionally stopping after the provided
+ * amount of simulated time: must be called before initializing SDL */
+void kiavc_engine_set_headless(int mode, uint32_t run_ms);
+/* Start tracing as soon as the engine is initialized: the trace will
+ * be saved to the provided file in the app folder when stopped */
+void kiavc_engine_set_trace(const char *filename);
+/* Capture what's rendered as soon as the engine starts drawing, for the
+ * provided number of frames: the capture will be saved to the provided
+ * file in the app folder, and can be played back with kiavc-replay */
+void kiavc_engine_set_capture(const char *filename, int frames);
 /* Initialize the engine */
 int kiavc_engine_init(const char *app, kiavc_bag *bagfile);
+/* Start recording user input to a file, optionally with a checksum of
+ * the state of the world after each step: must be called after init */
+int kiavc_engine_record_input(const char *path, bool checksums);
+/* Replay user input from a file, at normal or maximum speed: must be
+ * called after init, and live input is ignored while replaying */
+int kiavc_engine_replay_input(const char *path, bool fast);
 /* Return a SDL_RWops instance for a path */
 SDL_RWops *kiavc_engine_open_file(const char *path);
+/* Return the texture atlas from the BAG archive, if any */
+kiavc_atlas *kiavc_engine_get_atlas(void);
+/* Return the opaque regions of images from the BAG archive, if any */
+kiavc_map *kiavc_engine_get_opaque_regions(void);
+/* Force the whole canvas to be redrawn in the next frame */
+void kiavc_engine_invalidate_canvas(void);
+/* Take note of a new texture that may be drawn on the canvas, and of
+ * the surface it was created from (used by the CPU compositor) */
+void kiavc_engine_texture_created(SDL_Texture *texture, SDL_Surface *surface);
+/* Take note of a texture that may be on the canvas and is about to be
+ * destroyed: must be called before actually destroying the texture */
+void kiavc_engine_texture_destroyed(SDL_Texture *texture);
 /* Handle input from the user */
 int kiavc_engine_handle_input(void);
 /* Update the "world" */
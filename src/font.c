@@ -15,6 +15,7 @@
 #include "font.h"
 #include "list.h"
 #include "utils.h"
+#include "trace.h"
 
 /* Font constructor */
 kiavc_font *kiavc_font_create(const char *id, const char *path, int size) {
@@ -110,7 +111,7 @@ static SDL_Surface *kiavc_font_render_helper(kiavc_font *font, SDL_Renderer *ren
 }
 
 /* Helper to render text using the specified font */
-kiavc_font_text *kiavc_font_render_text(kiavc_font *font, SDL_Renderer *renderer,
+static kiavc_font_text *kiavc_font_render_text_internal(kiavc_font *font, SDL_Renderer *renderer,
 		const char *text, SDL_Color *color, SDL_Color *bg_color, int max_width) {
 	if(!font || !renderer || !text || !color)
 		return NULL;
@@ -240,6 +241,8 @@ kiavc_font_text *kiavc_font_render_text(kiavc_font *font, SDL_Renderer *renderer
 	ft->res.fade_alpha = 255;
 	ft->res.zplane = 50;	/* By default text is written on top of most things */
 	ft->texture = SDL_CreateTextureFromSurface(renderer, s_text);
+	if(ft->texture)
+		kiavc_engine_texture_created(ft->texture, s_text);
 	ft->w = s_text->w;
 	ft->h = s_text->h;
 	/* FIXME Compute how long this should be displayed */
@@ -255,6 +258,15 @@ kiavc_font_text *kiavc_font_render_text(kiavc_font *font, SDL_Renderer *renderer
 	return ft;
 }
 
+/* Render text using the specified font, tracing how long it takes */
+kiavc_font_text *kiavc_font_render_text(kiavc_font *font, SDL_Renderer *renderer,
+		const char *text, SDL_Color *color, SDL_Color *bg_color, int max_width) {
+	kiavc_trace_begin("render_text", text);
+	kiavc_font_text *rendered = kiavc_font_render_text_internal(font, renderer, text, color, bg_color, max_width);
+	kiavc_trace_end();
+	return rendered;
+}
+
 /* Font destructor */
 void kiavc_font_destroy(kiavc_font *font) {
 	if(font) {
@@ -270,6 +282,7 @@ void kiavc_font_text_destroy(kiavc_font_text *text) {
 	if(text && text->id)
 		SDL_free(text->id);
 	if(text && text->texture) {
+		kiavc_engine_texture_destroyed(text->texture);
 		SDL_DestroyTexture(text->texture);
 		SDL_free(text);
 	}
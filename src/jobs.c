@@ -0,0 +1,169 @@
+/*
+ *
+ * KIAVC job system. Work on many independent items (e.g., moving lots
+ * of resources, or finding which walkbox each actor is in) can be split
+ * in chunks, that are run in parallel on a small set of worker threads
+ * and on the thread asking for the work. Each thread starts from its own
+ * share of the chunks and, when it's done with those, steals chunks from
+ * the other threads, so that uneven chunks don't leave cores idle. The
+ * function running on chunks must only write to its own items: anything
+ * that needs to be done in order (e.g., notifying scripts) should be done
+ * by the caller once all chunks are done, looking at the results.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "jobs.h"
+
+/* Maximum number of worker threads */
+#define KIAVC_JOBS_MAX_WORKERS	7
+
+/* Worker threads (-1 if we didn't create them yet), and the lock and
+ * condition we use to wake them up and to know when they're done */
+static SDL_Thread *workers[KIAVC_JOBS_MAX_WORKERS];
+static int workers_count = -1;
+static SDL_mutex *mutex = NULL;
+static SDL_cond *cond = NULL;
+static bool stopping = false;
+/* Current batch of chunks: each thread has its own share of the chunks,
+ * from the next one to take to where it ends, and steals from the others */
+static Uint32 generation = 0;
+static kiavc_jobs_func batch_func = NULL;
+static void *batch_data = NULL;
+static int batch_count = 0, batch_chunk = 0;
+static SDL_atomic_t batch_next[KIAVC_JOBS_MAX_WORKERS+1];
+static int batch_end[KIAVC_JOBS_MAX_WORKERS+1];
+static int batch_busy = 0;
+
+/* Helper to run chunks, starting from a thread's own share */
+static void kiavc_jobs_work(int index) {
+	int threads = workers_count + 1, i = 0, t = 0, c = 0;
+	for(i=0; i<threads; i++) {
+		t = (index + i) % threads;
+		while((c = SDL_AtomicAdd(&batch_next[t], 1)) < batch_end[t]) {
+			int from = c * batch_chunk;
+			int to = from + batch_chunk;
+			if(to > batch_count)
+				to = batch_count;
+			batch_func(from, to, batch_data);
+		}
+	}
+}
+
+/* Worker thread */
+static int kiavc_jobs_thread(void *data) {
+	int index = (int)(intptr_t)data;
+	Uint32 seen = 0;
+	SDL_LockMutex(mutex);
+	while(!stopping) {
+		if(seen == generation) {
+			SDL_CondWait(cond, mutex);
+			continue;
+		}
+		seen = generation;
+		SDL_UnlockMutex(mutex);
+		kiavc_jobs_work(index);
+		SDL_LockMutex(mutex);
+		batch_busy--;
+		SDL_CondBroadcast(cond);
+	}
+	SDL_UnlockMutex(mutex);
+	return 0;
+}
+
+/* Helper to create the worker threads, the first time we need them */
+static void kiavc_jobs_init(void) {
+	workers_count = 0;
+	int cpus = SDL_GetCPUCount();
+	if(cpus < 2)
+		return;
+	mutex = SDL_CreateMutex();
+	cond = SDL_CreateCond();
+	if(!mutex || !cond) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error creating jobs lock: %s\n", SDL_GetError());
+		kiavc_jobs_destroy();
+		workers_count = 0;
+		return;
+	}
+	stopping = false;
+	int i = 0;
+	for(i=0; i<cpus-1 && i<KIAVC_JOBS_MAX_WORKERS; i++) {
+		workers[i] = SDL_CreateThread(kiavc_jobs_thread, "kiavc-jobs", (void *)(intptr_t)(i+1));
+		if(!workers[i]) {
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error creating jobs thread: %s\n", SDL_GetError());
+			break;
+		}
+		workers_count++;
+	}
+	SDL_Log("Created %d job threads\n", workers_count);
+}
+
+/* Run a function on count items, split in chunks, in parallel */
+void kiavc_jobs_run(kiavc_jobs_func func, void *data, int count, int chunk) {
+	if(!func || count < 1)
+		return;
+	if(chunk < 1)
+		chunk = count;
+	int chunks = (count + chunk - 1) / chunk;
+	if(chunks > 1 && workers_count < 0)
+		kiavc_jobs_init();
+	if(chunks < 2 || workers_count < 1) {
+		/* Not worth it, or not possible: do it all here */
+		func(0, count, data);
+		return;
+	}
+	/* Give each thread its share of the chunks, and wake the workers up */
+	SDL_LockMutex(mutex);
+	batch_func = func;
+	batch_data = data;
+	batch_count = count;
+	batch_chunk = chunk;
+	int threads = workers_count + 1, i = 0, start = 0;
+	for(i=0; i<threads; i++) {
+		SDL_AtomicSet(&batch_next[i], start);
+		start += chunks / threads + (i < chunks % threads ? 1 : 0);
+		batch_end[i] = start;
+	}
+	batch_busy = workers_count;
+	generation++;
+	SDL_CondBroadcast(cond);
+	SDL_UnlockMutex(mutex);
+	/* Do our part, and then wait for the workers to be done too */
+	kiavc_jobs_work(0);
+	SDL_LockMutex(mutex);
+	while(batch_busy > 0)
+		SDL_CondWait(cond, mutex);
+	batch_func = NULL;
+	batch_data = NULL;
+	SDL_UnlockMutex(mutex);
+}
+
+/* Get the number of threads that can run chunks */
+int kiavc_jobs_threads(void) {
+	return (workers_count > 0 ? workers_count : 0) + 1;
+}
+
+/* Stop the worker threads */
+void kiavc_jobs_destroy(void) {
+	if(workers_count > 0) {
+		SDL_LockMutex(mutex);
+		stopping = true;
+		SDL_CondBroadcast(cond);
+		SDL_UnlockMutex(mutex);
+		int i = 0;
+		for(i=0; i<workers_count; i++)
+			SDL_WaitThread(workers[i], NULL);
+	}
+	workers_count = -1;
+	if(cond)
+		SDL_DestroyCond(cond);
+	cond = NULL;
+	if(mutex)
+		SDL_DestroyMutex(mutex);
+	mutex = NULL;
+}
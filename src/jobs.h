@@ -0,0 +1,32 @@
+/*
+ *
+ * KIAVC job system. Work on many independent items (e.g., moving lots
+ * of resources, or finding which walkbox each actor is in) can be split
+ * in chunks, that are run in parallel on a small set of worker threads
+ * and on the thread asking for the work. Each thread starts from its own
+ * share of the chunks and, when it's done with those, steals chunks from
+ * the other threads, so that uneven chunks don't leave cores idle. The
+ * function running on chunks must only write to its own items: anything
+ * that needs to be done in order (e.g., notifying scripts) should be done
+ * by the caller once all chunks are done, looking at the results.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_JOBS_H
+#define __KIAVC_JOBS_H
+
+/* Function to run on a chunk of items, from (included) to (excluded) */
+typedef void (*kiavc_jobs_func)(int from, int to, void *data);
+
+/* Run a function on count items, split in chunks of the specified size,
+ * in parallel: returns when all chunks are done. If there's a single
+ * chunk, or no worker threads, the function is run right away instead */
+void kiavc_jobs_run(kiavc_jobs_func func, void *data, int count, int chunk);
+/* Get the number of threads that can run chunks (workers plus the caller) */
+int kiavc_jobs_threads(void);
+/* Stop the worker threads */
+void kiavc_jobs_destroy(void);
+
+#endif
@@ -16,18 +16,71 @@
 
 #include "engine.h"
 #include "logger.h"
+#include "trace.h"
 #include "version.h"
 
 /* Main application */
 int main(int argc, char *argv[]) {
-	/* Check if we need to read assets from a BAG file or from disk */
+	/* Check the command line arguments: besides the optional BAG file,
+	 * we may be asked to run in headless mode (e.g., for benchmarks),
+	 * and/or to record or replay the user input */
 	kiavc_bag *bag = NULL;
 	const char *bagfile = "assets.bag";
-	if(argc > 1)
-		bagfile = argv[1];
+	bool custom_bag = false;
+	int headless = KIAVC_HEADLESS_NONE;
+	uint32_t run_ms = 0;
+	const char *record = NULL, *replay = NULL, *trace = NULL, *capture = NULL;
+	int capture_frames = 0;
+	bool checksums = false, replay_fast = false;
+	int i = 0;
+	for(i=1; i<argc; i++) {
+		if(!SDL_strcasecmp(argv[i], "--headless")) {
+			headless = KIAVC_HEADLESS_NORENDER;
+		} else if(!SDL_strcasecmp(argv[i], "--headless-software")) {
+			headless = KIAVC_HEADLESS_SOFTWARE;
+		} else if(!SDL_strncasecmp(argv[i], "--run-for=", strlen("--run-for="))) {
+			run_ms = SDL_atoi(argv[i] + strlen("--run-for="));
+		} else if(!SDL_strncasecmp(argv[i], "--record=", strlen("--record="))) {
+			record = argv[i] + strlen("--record=");
+		} else if(!SDL_strcasecmp(argv[i], "--checksums")) {
+			checksums = true;
+		} else if(!SDL_strncasecmp(argv[i], "--replay=", strlen("--replay="))) {
+			replay = argv[i] + strlen("--replay=");
+		} else if(!SDL_strcasecmp(argv[i], "--replay-speed=max")) {
+			replay_fast = true;
+		} else if(!SDL_strcasecmp(argv[i], "--replay-speed=1")) {
+			replay_fast = false;
+		} else if(!SDL_strncasecmp(argv[i], "--trace=", strlen("--trace="))) {
+			trace = argv[i] + strlen("--trace=");
+		} else if(!SDL_strncasecmp(argv[i], "--capture=", strlen("--capture="))) {
+			capture = argv[i] + strlen("--capture=");
+		} else if(!SDL_strncasecmp(argv[i], "--capture-frames=", strlen("--capture-frames="))) {
+			capture_frames = SDL_atoi(argv[i] + strlen("--capture-frames="));
+		} else if(argv[i][0] == '-') {
+			SDL_Log("Usage: %s [--headless|--headless-software] [--run-for=<ms>] [--record=<file> [--checksums]] "
+				"[--replay=<file> [--replay-speed=1|max]] [--trace=<file>] [--capture=<file> [--capture-frames=<n>]] "
+				"[assets.bag]\n", argv[0]);
+			return -1;
+		} else {
+			bagfile = argv[i];
+			custom_bag = true;
+		}
+	}
+	if(run_ms > 0 && headless == KIAVC_HEADLESS_NONE) {
+		SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "--run-for is only supported in headless mode\n");
+		return -1;
+	}
+	if(record && replay) {
+		SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Can't record and replay input at the same time\n");
+		return -1;
+	}
+	kiavc_engine_set_headless(headless, run_ms);
+	kiavc_engine_set_trace(trace);
+	if(capture)
+		kiavc_engine_set_capture(capture, capture_frames);
 	/* If we need to open a BAG file, let's import it now */
 	bag = kiavc_bag_import(bagfile);
-	if(!bag && argc > 1) {
+	if(!bag && custom_bag) {
 		SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Error importing BAG file\n");
 		return -1;
 	}
@@ -103,17 +156,38 @@ int main(int argc, char *argv[]) {
 		SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Error initializing game engine\n");
 		goto error;
 	}
+	/* Check if we need to record or replay the user input */
+	if(record && kiavc_engine_record_input(record, checksums) < 0) {
+		SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Error recording input\n");
+		goto error;
+	}
+	if(replay && kiavc_engine_replay_input(replay, replay_fast) < 0) {
+		SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Error replaying input\n");
+		goto error;
+	}
 
 	/* Game engine loop */
+	int res = 0;
 	while(true) {
+		kiavc_trace_begin("frame", NULL);
 		/* Handle the user input */
-		if(kiavc_engine_handle_input() < 0)
-			break;
+		kiavc_trace_begin("input", NULL);
+		res = kiavc_engine_handle_input();
+		kiavc_trace_end();
 		/* Update world */
-		if(kiavc_engine_update_world() < 0)
-			break;
+		if(res == 0) {
+			kiavc_trace_begin("update", NULL);
+			res = kiavc_engine_update_world();
+			kiavc_trace_end();
+		}
 		/* Render */
-		if(kiavc_engine_render() < 0)
+		if(res == 0) {
+			kiavc_trace_begin("render", NULL);
+			res = kiavc_engine_render();
+			kiavc_trace_end();
+		}
+		kiavc_trace_end();
+		if(res < 0)
 			break;
 	}
 
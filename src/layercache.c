@@ -0,0 +1,134 @@
+/*
+ *
+ * KIAVC static room layer cache. Most room layers never change, and
+ * scroll along with the room background: rather than drawing the room
+ * background and each of those layers separately every frame, they're
+ * flattened once in a single texture as large as the room, which is
+ * then drawn as if it were the room background. The cache remembers
+ * which images (and textures) it was built from, so that it's rebuilt
+ * automatically as soon as any of them changes.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include "engine.h"
+#include "layercache.h"
+#include "capture.h"
+
+/* Create a new layer cache */
+kiavc_layer_cache *kiavc_layer_cache_create(kiavc_render_state *rs) {
+	if(!rs)
+		return NULL;
+	kiavc_layer_cache *cache = SDL_calloc(1, sizeof(kiavc_layer_cache));
+	cache->renderer = rs->renderer;
+	cache->rs = rs;
+	cache->invalid = true;
+	return cache;
+}
+
+/* Helper to check if the cache contains exactly the provided images */
+static bool kiavc_layer_cache_matches(kiavc_layer_cache *cache, kiavc_animation **layers, int count) {
+	if(cache->invalid || !cache->texture || cache->count != count)
+		return false;
+	int i = 0;
+	for(i=0; i<count; i++) {
+		if(cache->layers[i] != layers[i] || cache->textures[i] != layers[i]->texture)
+			return false;
+	}
+	return true;
+}
+
+/* Get a texture with the provided images flattened, in order, rebuilding the cache if needed */
+SDL_Texture *kiavc_layer_cache_get(kiavc_layer_cache *cache, kiavc_animation **layers, int count, SDL_Texture *target) {
+	if(!cache || !layers || count < 1)
+		return NULL;
+	if(kiavc_layer_cache_matches(cache, layers, count))
+		return cache->texture;
+	/* Check if we can flatten these images at all */
+	int i = 0, w = layers[0]->w, h = layers[0]->h;
+	for(i=0; i<count; i++) {
+		if(!layers[i]->texture || layers[i]->frames != 1 || layers[i]->w != w || layers[i]->h != h)
+			return NULL;
+	}
+	if(w < 1 || h < 1)
+		return NULL;
+	/* Make sure we have enough room to remember what we flattened */
+	if(count > cache->size) {
+		kiavc_animation **cl = SDL_realloc(cache->layers, count * sizeof(kiavc_animation *));
+		if(!cl)
+			return NULL;
+		cache->layers = cl;
+		SDL_Texture **ct = SDL_realloc(cache->textures, count * sizeof(SDL_Texture *));
+		if(!ct)
+			return NULL;
+		cache->textures = ct;
+		cache->size = count;
+	}
+	/* Create a new texture, if the size changed */
+	if(cache->texture && (cache->w != w || cache->h != h)) {
+		kiavc_capture_forget(cache->texture);
+		SDL_DestroyTexture(cache->texture);
+		cache->texture = NULL;
+	}
+	if(!cache->texture) {
+		cache->texture = SDL_CreateTexture(cache->renderer, SDL_PIXELFORMAT_RGBA8888,
+			SDL_TEXTUREACCESS_TARGET, w, h);
+		if(!cache->texture) {
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error creating layer cache texture: %s\n", SDL_GetError());
+			cache->count = 0;
+			return NULL;
+		}
+		SDL_SetTextureBlendMode(cache->texture, SDL_BLENDMODE_BLEND);
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+		/* The texture may be scaled by the renderer when drawing to the window directly */
+		SDL_SetTextureScaleMode(cache->texture, SDL_ScaleModeNearest);
+#endif
+		cache->w = w;
+		cache->h = h;
+	}
+	/* Flatten all images in the texture */
+	kiavc_render_state_set_target(cache->rs, cache->texture);
+	kiavc_render_state_set_draw_color(cache->rs, 0, 0, 0, 0);
+	SDL_RenderClear(cache->renderer);
+	kiavc_capture_clear();
+	SDL_Rect clip = { 0 }, rect = { 0 };
+	for(i=0; i<count; i++) {
+		clip.x = 0;
+		clip.y = 0;
+		clip.w = w;
+		clip.h = h;
+		rect = clip;
+		if(kiavc_animation_clip(layers[i], &clip, &rect)) {
+			kiavc_render_state_set_alpha_mod(cache->rs, layers[i]->texture, SDL_ALPHA_OPAQUE);
+			SDL_RenderCopy(cache->renderer, layers[i]->texture, &clip, &rect);
+			kiavc_capture_copy(layers[i]->texture, &clip, &rect);
+		}
+		cache->layers[i] = layers[i];
+		cache->textures[i] = layers[i]->texture;
+	}
+	cache->count = count;
+	cache->invalid = false;
+	kiavc_render_state_set_target(cache->rs, target);
+	/* The texture may be the same, but its content changed */
+	kiavc_engine_invalidate_canvas();
+	SDL_Log("Flattened %d room layers (%dx%d)\n", count, w, h);
+	return cache->texture;
+}
+
+/* Force the cache to be rebuilt the next time it's needed */
+void kiavc_layer_cache_invalidate(kiavc_layer_cache *cache) {
+	if(cache)
+		cache->invalid = true;
+}
+
+/* Destroy a layer cache */
+void kiavc_layer_cache_destroy(kiavc_layer_cache *cache) {
+	if(!cache)
+		return;
+	if(cache->texture)
+		SDL_DestroyTexture(cache->texture);
+	SDL_free(cache->layers);
+	SDL_free(cache->textures);
+	SDL_free(cache);
+}
@@ -0,0 +1,57 @@
+/*
+ *
+ * KIAVC static room layer cache. Most room layers never change, and
+ * scroll along with the room background: rather than drawing the room
+ * background and each of those layers separately every frame, they're
+ * flattened once in a single texture as large as the room, which is
+ * then drawn as if it were the room background. The cache is rebuilt
+ * automatically whenever the set of layers it contains changes, or
+ * when it's explicitly invalidated (e.g., when layers are added or
+ * removed).
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_LAYERCACHE_H
+#define __KIAVC_LAYERCACHE_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "animation.h"
+#include "renderstate.h"
+
+/* Maximum number of images we can flatten */
+#define KIAVC_LAYER_CACHE_MAX	32
+
+/* Static room layer cache */
+typedef struct kiavc_layer_cache {
+	/* Renderer (and its state) to draw with */
+	SDL_Renderer *renderer;
+	kiavc_render_state *rs;
+	/* Texture with the flattened layers, and its size */
+	SDL_Texture *texture;
+	int w, h;
+	/* Images flattened in the texture, in order, and their textures */
+	kiavc_animation **layers;
+	SDL_Texture **textures;
+	int count, size;
+	/* Whether the cache needs to be rebuilt */
+	bool invalid;
+} kiavc_layer_cache;
+
+/* Create a new layer cache */
+kiavc_layer_cache *kiavc_layer_cache_create(kiavc_render_state *rs);
+/* Get a texture with the provided images flattened, in order, rebuilding
+ * the cache if needed: images must all be loaded, static and the same size.
+ * The render target is reset to the provided one when done. Returns NULL if
+ * the images can't be cached, in which case they must be drawn as usual */
+SDL_Texture *kiavc_layer_cache_get(kiavc_layer_cache *cache, kiavc_animation **layers, int count, SDL_Texture *target);
+/* Force the cache to be rebuilt the next time it's needed */
+void kiavc_layer_cache_invalidate(kiavc_layer_cache *cache);
+/* Destroy a layer cache */
+void kiavc_layer_cache_destroy(kiavc_layer_cache *cache);
+
+#endif
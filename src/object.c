@@ -15,6 +15,10 @@
  */
 
 #include "object.h"
+#include "pool.h"
+
+/* Pool all objects are allocated from */
+static kiavc_pool *objects_pool = NULL;
 
 /* Object state destructor */
 static void kiavc_object_state_destroy(kiavc_object_state *state) {
@@ -28,7 +32,13 @@ static void kiavc_object_state_destroy(kiavc_object_state *state) {
 kiavc_object *kiavc_object_create(const char *id) {
 	if(!id)
 		return NULL;
-	kiavc_object *object = SDL_calloc(1, sizeof(kiavc_object));
+	if(!objects_pool)
+		objects_pool = kiavc_pool_create(sizeof(kiavc_object));
+	Uint32 handle = 0;
+	kiavc_object *object = kiavc_pool_alloc(objects_pool, &handle);
+	if(!object)
+		return NULL;
+	object->handle = handle;
 	object->res.type = KIAVC_OBJECT;
 	object->res.fade_alpha = 255;
 	object->id = SDL_strdup(id);
@@ -43,11 +53,20 @@ kiavc_object *kiavc_object_create(const char *id) {
 	return object;
 }
 
+/* Iterate on all objects, in the order they're stored in memory */
+kiavc_object *kiavc_object_next(Uint32 *handle) {
+	return kiavc_pool_next(objects_pool, handle);
+}
+
 /* Object destructor */
 void kiavc_object_destroy(kiavc_object *object) {
 	if(object) {
 		SDL_free(object->id);
 		kiavc_map_destroy(object->states);
-		SDL_free(object);
+		kiavc_pool_release(objects_pool, object->handle);
+		if(objects_pool->items == 0) {
+			kiavc_pool_destroy(objects_pool);
+			objects_pool = NULL;
+		}
 	}
 }
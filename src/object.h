@@ -37,40 +37,47 @@ typedef struct kiavc_object_state {
 	kiavc_animation *animation;
 } kiavc_object_state;
 
-/* Abstraction of an object in the KIAVC engine */
+/* Abstraction of an object in the KIAVC engine: objects are allocated
+ * from a pool, and what the update and render passes need comes first,
+ * while what's only looked at once in a while is at the end */
 typedef struct kiavc_object {
 	/* Common resource info */
 	kiavc_resource res;
-	/* Unique ID of the object */
-	char *id;
-	/* Room this object is in */
-	kiavc_room *room;
-	/* If the object is in an inventory, the owner of the object */
-	kiavc_actor *owner;
-	/* FIXME Coordinates for detecting interaction */
-	kiavc_object_box hover;
 	/* Whether the object is visible or not */
 	bool visible;
+	/* Whether this object is part of the UI */
+	bool ui;
 	/* Whether the object can be interacted with or not */
 	bool interactable;
-	/* Scaling of the actor, if needed */
-	float scale;
 	/* Current frame in an object animation */
 	int frame;
-	/* States the object can be in */
-	kiavc_map *states;
+	/* Scaling of the actor, if needed */
+	float scale;
 	/* Current state of the object */
 	kiavc_object_state *state;
-	/* Whether this object is part of the UI */
-	bool ui;
 	/* UI image or animation, if any */
 	kiavc_animation *ui_animation;
 	/* Object parent, if any (for relative positioning) */
 	struct kiavc_object *parent;
+	/* Room this object is in */
+	kiavc_room *room;
+	/* FIXME Coordinates for detecting interaction */
+	kiavc_object_box hover;
+	/* Unique ID of the object */
+	char *id;
+	/* If the object is in an inventory, the owner of the object */
+	kiavc_actor *owner;
+	/* States the object can be in */
+	kiavc_map *states;
+	/* Handle of the object in the pool */
+	Uint32 handle;
 } kiavc_object;
 
 /* Object constructor */
 kiavc_object *kiavc_object_create(const char *id);
+/* Iterate on all objects, in the order they're stored in memory: start
+ * with a handle set to 0, and stop when NULL is returned */
+kiavc_object *kiavc_object_next(Uint32 *handle);
 /* Object destructor */
 void kiavc_object_destroy(kiavc_object *object);
 
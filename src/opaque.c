@@ -0,0 +1,111 @@
+/*
+ *
+ * KIAVC opaque regions. When creating a BAG archive, kiavc-bag looks
+ * for the largest rectangle in each image that has no transparent or
+ * semi-transparent pixels, and saves a table telling where it is: at
+ * runtime, the engine can use that to avoid drawing things that would
+ * be completely hidden by opaque layers or UI panels drawn later on.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include "opaque.h"
+
+/* Find the largest opaque rectangle in an image: we go through the image
+ * row by row, keeping track of how many opaque pixels there are above
+ * each column, and look for the largest rectangle in that histogram */
+bool kiavc_opaque_find(SDL_Surface *surface, SDL_Rect *rect) {
+	if(!surface || !rect)
+		return false;
+	SDL_zerop(rect);
+	SDL_Surface *rgba = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+	if(!rgba)
+		return false;
+	int w = rgba->w, h = rgba->h;
+	int *heights = SDL_calloc(w + 1, sizeof(int));
+	int *stack = SDL_calloc(w + 1, sizeof(int));
+	int x = 0, y = 0, top = 0, height = 0, left = 0, best = 0;
+	SDL_LockSurface(rgba);
+	for(y=0; y<h; y++) {
+		Uint8 *row = (Uint8 *)rgba->pixels + y * rgba->pitch;
+		for(x=0; x<w; x++)
+			heights[x] = (row[x*4 + 3] == SDL_ALPHA_OPAQUE) ? heights[x] + 1 : 0;
+		/* The last column is always zero, so that the stack is emptied */
+		top = 0;
+		for(x=0; x<=w; x++) {
+			while(top > 0 && heights[stack[top-1]] >= heights[x]) {
+				height = heights[stack[--top]];
+				left = top > 0 ? stack[top-1] + 1 : 0;
+				if(height * (x - left) > best) {
+					best = height * (x - left);
+					rect->x = left;
+					rect->y = y - height + 1;
+					rect->w = x - left;
+					rect->h = height;
+				}
+			}
+			stack[top++] = x;
+		}
+	}
+	SDL_UnlockSurface(rgba);
+	SDL_FreeSurface(rgba);
+	SDL_free(heights);
+	SDL_free(stack);
+	return best > 0;
+}
+
+/* Import an opaque regions table */
+kiavc_map *kiavc_opaque_import(SDL_RWops *rwops) {
+	if(!rwops)
+		return NULL;
+	Sint64 size = SDL_RWsize(rwops);
+	if(size <= 0) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Invalid opaque regions table\n");
+		SDL_RWclose(rwops);
+		return NULL;
+	}
+	char *table = SDL_malloc(size + 1);
+	if(SDL_RWread(rwops, table, 1, size) != (size_t)size) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error reading opaque regions table\n");
+		SDL_free(table);
+		SDL_RWclose(rwops);
+		return NULL;
+	}
+	SDL_RWclose(rwops);
+	table[size] = '\0';
+	kiavc_map *regions = kiavc_map_create((kiavc_map_value_destroy)&SDL_free);
+	/* Parse the table line by line */
+	char *line = table, *next = NULL;
+	int x = 0, y = 0, w = 0, h = 0, offset = 0, count = 0;
+	while(line && *line) {
+		next = SDL_strchr(line, '\n');
+		if(next)
+			*next++ = '\0';
+		offset = 0;
+		if(SDL_sscanf(line, "opaque %d %d %d %d %n", &x, &y, &w, &h, &offset) == 4 && offset > 0) {
+			if(x < 0 || y < 0 || w <= 0 || h <= 0) {
+				SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Invalid opaque region for '%s'\n", line + offset);
+			} else {
+				SDL_Rect *rect = SDL_calloc(1, sizeof(SDL_Rect));
+				rect->x = x;
+				rect->y = y;
+				rect->w = w;
+				rect->h = h;
+				kiavc_map_insert(regions, line + offset, rect);
+				count++;
+			}
+		}
+		line = next;
+	}
+	SDL_free(table);
+	SDL_Log("Imported opaque regions (%d images)\n", count);
+	return regions;
+}
+
+/* Find out if an image has an opaque region */
+SDL_Rect *kiavc_opaque_lookup(kiavc_map *regions, const char *path) {
+	if(!regions || !path)
+		return NULL;
+	return kiavc_map_lookup(regions, path);
+}
@@ -0,0 +1,40 @@
+/*
+ *
+ * KIAVC opaque regions. When creating a BAG archive, kiavc-bag looks
+ * for the largest rectangle in each image that has no transparent or
+ * semi-transparent pixels, and saves a table telling where it is: at
+ * runtime, the engine can use that to avoid drawing things that would
+ * be completely hidden by opaque layers or UI panels drawn later on.
+ * The table is a text file in the BAG, with lines like this:
+ *
+ *	opaque 0 120 640 240 ./assets/images/foreground.png
+ *
+ * where the numbers are the position and size of the opaque rectangle
+ * in the image, followed by the path of the image itself.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_OPAQUE_H
+#define __KIAVC_OPAQUE_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "map.h"
+
+/* Key of the opaque regions table in a BAG archive */
+#define KIAVC_OPAQUE_TABLE	"opaque/opaque.txt"
+/* Smallest opaque region worth saving, in pixels */
+#define KIAVC_OPAQUE_MIN_AREA	1024
+
+/* Find the largest opaque rectangle in an image */
+bool kiavc_opaque_find(SDL_Surface *surface, SDL_Rect *rect);
+/* Import an opaque regions table, as a map of rects indexed by image path */
+kiavc_map *kiavc_opaque_import(SDL_RWops *rwops);
+/* Find out if an image has an opaque region */
+SDL_Rect *kiavc_opaque_lookup(kiavc_map *regions, const char *path);
+
+#endif
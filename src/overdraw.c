@@ -0,0 +1,108 @@
+/*
+ *
+ * KIAVC overdraw heatmap. When debugging overdraw, the engine keeps
+ * track of how many times each pixel of the canvas was written to in
+ * a frame (sprites, fills, plugins), and then draws those counts as a
+ * false color heatmap on top of the scene: blue pixels were written
+ * once, and the color moves to green, yellow and finally red the more
+ * times a pixel was written to, showing where fill rate is wasted.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include "overdraw.h"
+#include "capture.h"
+
+/* Colors of the heatmap, indexed by write count (the last one is used for anything higher) */
+static const Uint32 kiavc_overdraw_colors[] = {
+	0x00000000,	/* Never written */
+	0xA00000FF,	/* Blue */
+	0xA000FFFF,	/* Cyan */
+	0xA000FF00,	/* Green */
+	0xA0FFFF00,	/* Yellow */
+	0xA0FF8000,	/* Orange */
+	0xA0FF0000	/* Red */
+};
+#define KIAVC_OVERDRAW_COLORS	(int)(sizeof(kiavc_overdraw_colors)/sizeof(Uint32))
+
+/* Create a new overdraw heatmap */
+kiavc_overdraw *kiavc_overdraw_create(SDL_Renderer *renderer, int w, int h) {
+	if(!renderer || w < 1 || h < 1)
+		return NULL;
+	kiavc_overdraw *od = SDL_calloc(1, sizeof(kiavc_overdraw));
+	od->renderer = renderer;
+	od->w = w;
+	od->h = h;
+	od->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING, w, h);
+	if(!od->texture) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error creating overdraw texture: %s\n", SDL_GetError());
+		kiavc_overdraw_destroy(od);
+		return NULL;
+	}
+	SDL_SetTextureBlendMode(od->texture, SDL_BLENDMODE_BLEND);
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+	/* The heatmap is scaled to the window like the canvas is */
+	SDL_SetTextureScaleMode(od->texture, SDL_ScaleModeNearest);
+#endif
+	od->counts = SDL_calloc(w * h, sizeof(Uint8));
+	od->pixels = SDL_calloc(w * h, sizeof(Uint32));
+	if(!od->counts || !od->pixels) {
+		kiavc_overdraw_destroy(od);
+		return NULL;
+	}
+	return od;
+}
+
+/* Reset the write counts */
+void kiavc_overdraw_reset(kiavc_overdraw *od) {
+	if(od)
+		SDL_memset(od->counts, 0, od->w * od->h);
+}
+
+/* Take note of an area of the canvas being written to */
+void kiavc_overdraw_add(kiavc_overdraw *od, const SDL_Rect *rect) {
+	if(!od)
+		return;
+	SDL_Rect canvas = { 0, 0, od->w, od->h }, area = { 0 };
+	if(rect && !SDL_IntersectRect(rect, &canvas, &area))
+		return;
+	if(!rect)
+		area = canvas;
+	int x = 0, y = 0;
+	Uint8 *row = NULL;
+	for(y=area.y; y<area.y+area.h; y++) {
+		row = od->counts + y * od->w;
+		for(x=area.x; x<area.x+area.w; x++) {
+			if(row[x] < 255)
+				row[x]++;
+		}
+	}
+}
+
+/* Draw the heatmap */
+void kiavc_overdraw_render(kiavc_overdraw *od) {
+	if(!od)
+		return;
+	int i = 0, count = od->w * od->h;
+	for(i=0; i<count; i++)
+		od->pixels[i] = kiavc_overdraw_colors[SDL_min(od->counts[i], KIAVC_OVERDRAW_COLORS - 1)];
+	SDL_UpdateTexture(od->texture, NULL, od->pixels, od->w * sizeof(Uint32));
+	SDL_RenderCopy(od->renderer, od->texture, NULL, NULL);
+	kiavc_capture_update(od->texture);
+	kiavc_capture_copy(od->texture, NULL, NULL);
+}
+
+/* Destroy an overdraw heatmap */
+void kiavc_overdraw_destroy(kiavc_overdraw *od) {
+	if(!od)
+		return;
+	if(od->texture) {
+		kiavc_capture_forget(od->texture);
+		SDL_DestroyTexture(od->texture);
+	}
+	SDL_free(od->counts);
+	SDL_free(od->pixels);
+	SDL_free(od);
+}
@@ -0,0 +1,45 @@
+/*
+ *
+ * KIAVC overdraw heatmap. When debugging overdraw, the engine keeps
+ * track of how many times each pixel of the canvas was written to in
+ * a frame (sprites, fills, plugins), and then draws those counts as a
+ * false color heatmap on top of the scene: blue pixels were written
+ * once, and the color moves to green, yellow and finally red the more
+ * times a pixel was written to, showing where fill rate is wasted.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_OVERDRAW_H
+#define __KIAVC_OVERDRAW_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+/* Overdraw heatmap */
+typedef struct kiavc_overdraw {
+	/* Renderer to draw the heatmap with */
+	SDL_Renderer *renderer;
+	/* Streaming texture the heatmap is drawn in */
+	SDL_Texture *texture;
+	/* Write counts for each pixel of the canvas, and its size */
+	Uint8 *counts;
+	int w, h;
+	/* Pixels of the heatmap */
+	Uint32 *pixels;
+} kiavc_overdraw;
+
+/* Create a new overdraw heatmap as large as the canvas */
+kiavc_overdraw *kiavc_overdraw_create(SDL_Renderer *renderer, int w, int h);
+/* Reset the write counts, before a new frame */
+void kiavc_overdraw_reset(kiavc_overdraw *od);
+/* Take note of an area of the canvas being written to (NULL means the whole canvas) */
+void kiavc_overdraw_add(kiavc_overdraw *od, const SDL_Rect *rect);
+/* Draw the heatmap on the current render target */
+void kiavc_overdraw_render(kiavc_overdraw *od);
+/* Destroy an overdraw heatmap */
+void kiavc_overdraw_destroy(kiavc_overdraw *od);
+
+#endif
@@ -9,6 +9,7 @@
 #include <SDL2/SDL.h>
 
 #include "pathfinding.h"
+#include "trace.h"
 
 #define KIAVC_MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define KIAVC_MIN(x, y) (((x) < (y)) ? (x) : (y))
@@ -242,7 +243,7 @@ kiavc_pathfinding_walkbox *kiavc_pathfinding_context_find_walkbox(kiavc_pathfind
 }
 
 /* Helper to find a path as a series of points to walk to */
-kiavc_list *kiavc_pathfinding_context_find_path(kiavc_pathfinding_context *pathfinding,
+static kiavc_list *kiavc_pathfinding_context_find_path_internal(kiavc_pathfinding_context *pathfinding,
 		kiavc_pathfinding_point *from, kiavc_pathfinding_point *to) {
 	if(!pathfinding || !pathfinding->nodes || !from || !to)
 		return NULL;
@@ -341,6 +342,15 @@ kiavc_list *kiavc_pathfinding_context_find_path(kiavc_pathfinding_context *pathf
 	return path;
 }
 
+/* Find a path as a series of points to walk to, tracing how long it takes */
+kiavc_list *kiavc_pathfinding_context_find_path(kiavc_pathfinding_context *pathfinding,
+		kiavc_pathfinding_point *from, kiavc_pathfinding_point *to) {
+	kiavc_trace_begin("find_path", NULL);
+	kiavc_list *path = kiavc_pathfinding_context_find_path_internal(pathfinding, from, to);
+	kiavc_trace_end();
+	return path;
+}
+
 /* Helper to destroy a pathfinding context instance */
 void kiavc_pathfinding_context_destroy(kiavc_pathfinding_context *pathfinding) {
 	if(pathfinding) {
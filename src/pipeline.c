@@ -0,0 +1,188 @@
+/*
+ *
+ * KIAVC update pipeline. When enabled, the world for the next frame is
+ * updated on a worker thread while the main thread presents the current
+ * one, which may block waiting for vsync: that way, frames that are heavy
+ * on scripts and stalls in the renderer overlap, rather than adding up.
+ * SDL must only be used from the main thread, so anything the worker
+ * needs to do that involves SDL (e.g., creating or destroying textures)
+ * is handed to the main thread, which takes care of it while it waits
+ * for the next frame, or as soon as it's done presenting, while the
+ * worker waits. Script calls that only change the state of the world
+ * don't need SDL, and run on the worker directly.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include <SDL2/SDL.h>
+
+#include "pipeline.h"
+
+/* Worker thread, and the lock and condition we use to talk to it */
+static SDL_Thread *worker = NULL;
+static SDL_threadID worker_id = 0;
+static SDL_mutex *mutex = NULL;
+static SDL_cond *cond = NULL;
+static bool stopping = false;
+/* Job the worker is running, and its result */
+static int (*job)(void *data) = NULL;
+static void *job_data = NULL;
+static bool job_running = false, job_done = false;
+static int job_result = 0;
+/* Call the worker is waiting for the main thread to execute, if any */
+static void (*call)(void *data) = NULL;
+static void *call_data = NULL;
+
+/* Worker thread */
+static int kiavc_pipeline_thread(void *data) {
+	SDL_LockMutex(mutex);
+	while(!stopping) {
+		if(!job) {
+			SDL_CondWait(cond, mutex);
+			continue;
+		}
+		int (*current)(void *data) = job;
+		void *current_data = job_data;
+		SDL_UnlockMutex(mutex);
+		int res = current(current_data);
+		SDL_LockMutex(mutex);
+		job = NULL;
+		job_result = res;
+		job_done = true;
+		SDL_CondBroadcast(cond);
+	}
+	SDL_UnlockMutex(mutex);
+	return 0;
+}
+
+/* Start running a job on the worker */
+int kiavc_pipeline_start(int (*func)(void *data), void *data) {
+	if(!func || job_running)
+		return -1;
+	if(!worker) {
+		/* First time we get here, create the worker */
+		mutex = SDL_CreateMutex();
+		cond = SDL_CreateCond();
+		if(!mutex || !cond) {
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error creating pipeline lock: %s\n", SDL_GetError());
+			kiavc_pipeline_destroy();
+			return -1;
+		}
+		stopping = false;
+		worker = SDL_CreateThread(kiavc_pipeline_thread, "kiavc-pipeline", NULL);
+		if(!worker) {
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error creating pipeline thread: %s\n", SDL_GetError());
+			kiavc_pipeline_destroy();
+			return -1;
+		}
+		worker_id = SDL_GetThreadID(worker);
+	}
+	SDL_LockMutex(mutex);
+	job = func;
+	job_data = data;
+	job_done = false;
+	job_running = true;
+	SDL_CondBroadcast(cond);
+	SDL_UnlockMutex(mutex);
+	return 0;
+}
+
+/* Helper to execute the call the worker is waiting for: the lock must be held */
+static void kiavc_pipeline_run_call(void) {
+	void (*func)(void *data) = call;
+	void *data = call_data;
+	SDL_UnlockMutex(mutex);
+	func(data);
+	SDL_LockMutex(mutex);
+	call = NULL;
+	call_data = NULL;
+	SDL_CondBroadcast(cond);
+}
+
+/* Wait for the job on the worker to complete */
+int kiavc_pipeline_wait(void) {
+	if(!job_running)
+		return 0;
+	SDL_LockMutex(mutex);
+	while(!job_done) {
+		if(call) {
+			/* The worker needs us to do something on its behalf */
+			kiavc_pipeline_run_call();
+			continue;
+		}
+		SDL_CondWait(cond, mutex);
+	}
+	job_running = false;
+	int res = job_result;
+	SDL_UnlockMutex(mutex);
+	return res;
+}
+
+/* Sleep on the main thread, taking care of the calls from the worker */
+void kiavc_pipeline_sleep(Uint32 ms) {
+	if(!job_running) {
+		SDL_Delay(ms);
+		return;
+	}
+	Uint32 start = SDL_GetTicks(), elapsed = 0;
+	SDL_LockMutex(mutex);
+	while(elapsed < ms) {
+		if(call) {
+			/* The worker needs us to do something on its behalf */
+			kiavc_pipeline_run_call();
+		} else if(job_done) {
+			/* Nothing else will come from the worker, just sleep */
+			SDL_UnlockMutex(mutex);
+			SDL_Delay(ms - elapsed);
+			return;
+		} else {
+			SDL_CondWaitTimeout(cond, mutex, ms - elapsed);
+		}
+		elapsed = SDL_GetTicks() - start;
+	}
+	SDL_UnlockMutex(mutex);
+}
+
+/* Check whether the current thread is the worker */
+bool kiavc_pipeline_is_worker(void) {
+	return worker && SDL_ThreadID() == worker_id;
+}
+
+/* Run a function on the main thread */
+void kiavc_pipeline_call(void (*func)(void *data), void *data) {
+	if(!func)
+		return;
+	if(!kiavc_pipeline_is_worker()) {
+		/* We're on the main thread already */
+		func(data);
+		return;
+	}
+	SDL_LockMutex(mutex);
+	call = func;
+	call_data = data;
+	SDL_CondBroadcast(cond);
+	while(call)
+		SDL_CondWait(cond, mutex);
+	SDL_UnlockMutex(mutex);
+}
+
+/* Stop the worker thread */
+void kiavc_pipeline_destroy(void) {
+	if(worker) {
+		kiavc_pipeline_wait();
+		SDL_LockMutex(mutex);
+		stopping = true;
+		SDL_CondBroadcast(cond);
+		SDL_UnlockMutex(mutex);
+		SDL_WaitThread(worker, NULL);
+		worker = NULL;
+		worker_id = 0;
+	}
+	if(cond)
+		SDL_DestroyCond(cond);
+	cond = NULL;
+	if(mutex)
+		SDL_DestroyMutex(mutex);
+	mutex = NULL;
+}
@@ -0,0 +1,41 @@
+/*
+ *
+ * KIAVC update pipeline. When enabled, the world for the next frame is
+ * updated on a worker thread while the main thread presents the current
+ * one, which may block waiting for vsync: that way, frames that are heavy
+ * on scripts and stalls in the renderer overlap, rather than adding up.
+ * SDL must only be used from the main thread, so anything the worker
+ * needs to do that involves SDL (e.g., creating or destroying textures)
+ * is handed to the main thread, which takes care of it while it waits
+ * for the next frame, or as soon as it's done presenting, while the
+ * worker waits. Script calls that only change the state of the world
+ * don't need SDL, and run on the worker directly.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_PIPELINE_H
+#define __KIAVC_PIPELINE_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+/* Start running a job on the worker (the thread is created the first time) */
+int kiavc_pipeline_start(int (*job)(void *data), void *data);
+/* Wait for the job on the worker to complete, taking care of the calls it
+ * hands to the main thread in the meanwhile: returns what the job returned */
+int kiavc_pipeline_wait(void);
+/* Sleep for up to the provided milliseconds on the main thread, taking care
+ * of the calls the worker hands to it in the meanwhile, if it's running a job */
+void kiavc_pipeline_sleep(Uint32 ms);
+/* Check whether the current thread is the worker running a job */
+bool kiavc_pipeline_is_worker(void);
+/* Run a function on the main thread: if we're on the worker, this blocks
+ * until the main thread executes it, otherwise it's executed right away */
+void kiavc_pipeline_call(void (*func)(void *data), void *data);
+/* Stop the worker thread */
+void kiavc_pipeline_destroy(void);
+
+#endif
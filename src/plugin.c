@@ -61,6 +61,13 @@ kiavc_plugin *kiavc_plugin_load(kiavc_plugin_callbacks *core, const char *name)
 		dlclose(p);
 		return NULL;
 	}
+	if(plugin->get_api_compatibility() > KIAVC_PLUGIN_API_VERSION) {
+		/* The plugin may use callbacks we don't have */
+		SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "The '%s' plugin was compiled against a newer version of the API (%d > %d)\n",
+			name, plugin->get_api_compatibility(), KIAVC_PLUGIN_API_VERSION);
+		dlclose(p);
+		return NULL;
+	}
 	if(plugin->init(core) < 0) {
 		SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Couldn't initialize '%s': error invoking 'init'\n", name);
 		dlclose(p);
@@ -14,8 +14,9 @@
 
 #include "resources.h"
 
-/* Plugin API version, to detect mismatches between engine and plugins */
-#define KIAVC_PLUGIN_API_VERSION	1
+/* Plugin API version, to detect mismatches between engine and plugins:
+ * version 2 added the trace and renderer state callbacks to the core */
+#define KIAVC_PLUGIN_API_VERSION	2
 
 #define KIAVC_PLUGIN_INIT(...) {		\
 		.init = NULL,					\
@@ -75,6 +76,15 @@ struct kiavc_plugin_callbacks {
 	void (* const add_resource)(kiavc_plugin_resource *resource);
 	/* Helper function to remove a previously added plugin resource */
 	void (* const remove_resource)(kiavc_plugin_resource *resource);
+	/* Helper function to open a zone in the trace, if tracing is active */
+	void (* const trace_begin)(const char *name, const char *detail);
+	/* Helper function to close the most recent zone in the trace */
+	void (* const trace_end)(void);
+	/* Helper functions to change the renderer state when rendering: using
+	 * these rather than SDL directly avoids redundant state changes */
+	void (* const set_draw_color)(Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+	void (* const set_draw_blend_mode)(SDL_BlendMode blend);
+	void (* const set_viewport)(const SDL_Rect *viewport);
 };
 
 /* This helps defining at what step of the rendering the resource should
@@ -0,0 +1,119 @@
+/*
+ *
+ * KIAVC pool of items of the same type. Rather than allocating each
+ * item on its own, which scatters them all over the heap, items are
+ * stored next to each other in large chunks, that are never moved once
+ * allocated: this means pointers to items are stable, and that looping
+ * on all items streams through contiguous memory. Each item is also
+ * addressed by a handle (its slot in the pool, plus one), and slots of
+ * items that are released are reused for new ones.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include "pool.h"
+
+/* Number of items in each chunk */
+#define KIAVC_POOL_CHUNK	128
+
+/* Helper to get the address of the item in a slot */
+static inline void *kiavc_pool_slot(kiavc_pool *pool, Uint32 slot) {
+	return pool->chunks[slot / KIAVC_POOL_CHUNK] + (slot % KIAVC_POOL_CHUNK) * pool->item_size;
+}
+
+/* Create a new pool of items of the specified size */
+kiavc_pool *kiavc_pool_create(size_t item_size) {
+	if(item_size == 0)
+		return NULL;
+	kiavc_pool *pool = SDL_calloc(1, sizeof(kiavc_pool));
+	pool->item_size = item_size;
+	return pool;
+}
+
+/* Allocate a new item, zeroed: returns a pointer to it, and its handle */
+void *kiavc_pool_alloc(kiavc_pool *pool, Uint32 *handle) {
+	if(!pool)
+		return NULL;
+	Uint32 slot = 0;
+	if(pool->free_count > 0) {
+		/* Reuse a slot that was released */
+		pool->free_count--;
+		slot = pool->free[pool->free_count] - 1;
+	} else {
+		if(pool->count == pool->chunks_count * KIAVC_POOL_CHUNK) {
+			/* Allocate a new chunk: existing ones are never moved */
+			Uint8 **chunks = SDL_realloc(pool->chunks, (pool->chunks_count + 1) * sizeof(Uint8 *));
+			if(!chunks)
+				return NULL;
+			pool->chunks = chunks;
+			Uint8 *used = SDL_realloc(pool->used, (pool->chunks_count + 1) * KIAVC_POOL_CHUNK);
+			if(!used)
+				return NULL;
+			pool->used = used;
+			Uint32 *free = SDL_realloc(pool->free, (pool->chunks_count + 1) * KIAVC_POOL_CHUNK * sizeof(Uint32));
+			if(!free)
+				return NULL;
+			pool->free = free;
+			pool->chunks[pool->chunks_count] = SDL_malloc(KIAVC_POOL_CHUNK * pool->item_size);
+			if(!pool->chunks[pool->chunks_count])
+				return NULL;
+			pool->chunks_count++;
+		}
+		slot = pool->count;
+		pool->count++;
+	}
+	void *item = kiavc_pool_slot(pool, slot);
+	SDL_memset(item, 0, pool->item_size);
+	pool->used[slot] = 1;
+	pool->items++;
+	if(handle)
+		*handle = slot + 1;
+	return item;
+}
+
+/* Get the item with the specified handle, if it's in use */
+void *kiavc_pool_get(kiavc_pool *pool, Uint32 handle) {
+	if(!pool || handle < 1 || handle > pool->count || !pool->used[handle-1])
+		return NULL;
+	return kiavc_pool_slot(pool, handle - 1);
+}
+
+/* Get the next item in use after the specified handle, updating the handle */
+void *kiavc_pool_next(kiavc_pool *pool, Uint32 *handle) {
+	if(!pool || !handle)
+		return NULL;
+	Uint32 slot = 0;
+	for(slot = *handle; slot < pool->count; slot++) {
+		if(pool->used[slot]) {
+			*handle = slot + 1;
+			return kiavc_pool_slot(pool, slot);
+		}
+	}
+	*handle = pool->count;
+	return NULL;
+}
+
+/* Release an item, so that its slot can be reused */
+void kiavc_pool_release(kiavc_pool *pool, Uint32 handle) {
+	if(!pool || handle < 1 || handle > pool->count || !pool->used[handle-1])
+		return;
+	pool->used[handle-1] = 0;
+	pool->items--;
+	/* The stack of free slots is always large enough for all of them */
+	pool->free[pool->free_count] = handle;
+	pool->free_count++;
+}
+
+/* Destroy a pool */
+void kiavc_pool_destroy(kiavc_pool *pool) {
+	if(!pool)
+		return;
+	int i = 0;
+	for(i=0; i<pool->chunks_count; i++)
+		SDL_free(pool->chunks[i]);
+	SDL_free(pool->chunks);
+	SDL_free(pool->used);
+	SDL_free(pool->free);
+	SDL_free(pool);
+}
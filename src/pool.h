@@ -0,0 +1,51 @@
+/*
+ *
+ * KIAVC pool of items of the same type. Rather than allocating each
+ * item on its own, which scatters them all over the heap, items are
+ * stored next to each other in large chunks, that are never moved once
+ * allocated: this means pointers to items are stable, and that looping
+ * on all items streams through contiguous memory. Each item is also
+ * addressed by a handle (its slot in the pool, plus one), and slots of
+ * items that are released are reused for new ones.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_POOL_H
+#define __KIAVC_POOL_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+/* Pool of items */
+typedef struct kiavc_pool {
+	/* Size of each item */
+	size_t item_size;
+	/* Chunks of items */
+	Uint8 **chunks;
+	int chunks_count;
+	/* Whether each slot is in use */
+	Uint8 *used;
+	/* Slots that were released and can be reused, as a stack of handles */
+	Uint32 *free;
+	int free_count;
+	/* Number of slots, and of slots in use */
+	Uint32 count, items;
+} kiavc_pool;
+
+/* Create a new pool of items of the specified size */
+kiavc_pool *kiavc_pool_create(size_t item_size);
+/* Allocate a new item, zeroed: returns a pointer to it, and its handle */
+void *kiavc_pool_alloc(kiavc_pool *pool, Uint32 *handle);
+/* Get the item with the specified handle, if it's in use */
+void *kiavc_pool_get(kiavc_pool *pool, Uint32 handle);
+/* Get the next item in use after the specified handle (0 to start from the beginning), updating the handle */
+void *kiavc_pool_next(kiavc_pool *pool, Uint32 *handle);
+/* Release an item, so that its slot can be reused */
+void kiavc_pool_release(kiavc_pool *pool, Uint32 handle);
+/* Destroy a pool */
+void kiavc_pool_destroy(kiavc_pool *pool);
+
+#endif
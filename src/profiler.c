@@ -0,0 +1,108 @@
+/*
+ *
+ * KIAVC frame profiler. It keeps track of how long each phase of a
+ * frame (input, world updates, scripts, plugins, rendering) takes,
+ * using the high resolution counter, and stores the last samples for
+ * each phase in a ring buffer, so that we can compute percentiles.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include "profiler.h"
+
+/* Ring buffer of samples for a phase */
+typedef struct kiavc_profiler_phase {
+	float samples[KIAVC_PROFILER_SAMPLES];
+	Uint32 next, count;
+} kiavc_profiler_phase;
+static kiavc_profiler_phase phases[KIAVC_PROFILER_PHASES];
+
+/* Counter frequency */
+static double frequency = 0;
+
+/* Phase names */
+static const char *phase_names[KIAVC_PROFILER_PHASES] = {
+	"frame",
+	"input",
+	"update",
+	"scripts",
+	"plugins_update",
+	"render",
+	"plugins_render",
+	"present",
+	"overlap"
+};
+
+/* Initialize the profiler */
+void kiavc_profiler_init(void) {
+	frequency = (double)SDL_GetPerformanceFrequency();
+	kiavc_profiler_reset();
+}
+
+/* Get the current value of the high resolution counter */
+Uint64 kiavc_profiler_now(void) {
+	return SDL_GetPerformanceCounter();
+}
+
+/* Add a sample for a phase, as the time elapsed since the provided counter */
+void kiavc_profiler_add(int phase, Uint64 start) {
+	if(frequency == 0 || start == 0)
+		return;
+	Uint64 now = SDL_GetPerformanceCounter();
+	kiavc_profiler_add_sample(phase, (double)(now - start) * 1000.0 / frequency);
+}
+
+/* Add a sample for a phase, in milliseconds */
+void kiavc_profiler_add_sample(int phase, double ms) {
+	if(phase < 0 || phase >= KIAVC_PROFILER_PHASES)
+		return;
+	kiavc_profiler_phase *p = &phases[phase];
+	p->samples[p->next] = (float)ms;
+	p->next = (p->next + 1) % KIAVC_PROFILER_SAMPLES;
+	if(p->count < KIAVC_PROFILER_SAMPLES)
+		p->count++;
+}
+
+/* Helper to sort samples */
+static int kiavc_profiler_sort(const void *a, const void *b) {
+	float s1 = *(const float *)a, s2 = *(const float *)b;
+	return (s1 < s2) ? -1 : (s1 > s2 ? 1 : 0);
+}
+
+/* Get the statistics for a phase */
+int kiavc_profiler_get_stats(int phase, kiavc_profiler_stats *stats) {
+	if(phase < 0 || phase >= KIAVC_PROFILER_PHASES || !stats)
+		return -1;
+	SDL_zerop(stats);
+	kiavc_profiler_phase *p = &phases[phase];
+	if(p->count == 0)
+		return 0;
+	/* Sort a copy of the samples, to compute the percentiles */
+	float sorted[KIAVC_PROFILER_SAMPLES];
+	SDL_memcpy(sorted, p->samples, p->count * sizeof(float));
+	SDL_qsort(sorted, p->count, sizeof(float), kiavc_profiler_sort);
+	double total = 0;
+	Uint32 i = 0;
+	for(i=0; i<p->count; i++)
+		total += sorted[i];
+	stats->samples = p->count;
+	stats->avg = total / p->count;
+	stats->p50 = sorted[(p->count - 1) * 50 / 100];
+	stats->p95 = sorted[(p->count - 1) * 95 / 100];
+	stats->p99 = sorted[(p->count - 1) * 99 / 100];
+	stats->max = sorted[p->count - 1];
+	return 0;
+}
+
+/* Get the name of a phase */
+const char *kiavc_profiler_phase_name(int phase) {
+	if(phase < 0 || phase >= KIAVC_PROFILER_PHASES)
+		return NULL;
+	return phase_names[phase];
+}
+
+/* Reset all samples */
+void kiavc_profiler_reset(void) {
+	SDL_memset(phases, 0, sizeof(phases));
+}
@@ -0,0 +1,78 @@
+/*
+ *
+ * KIAVC frame profiler. It keeps track of how long each phase of a
+ * frame (input, world updates, scripts, plugins, rendering) takes,
+ * using the high resolution counter, and stores the last samples for
+ * each phase in a ring buffer, so that we can compute percentiles.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_PROFILER_H
+#define __KIAVC_PROFILER_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+/* Phases we profile */
+#define KIAVC_PROFILER_FRAME			0
+#define KIAVC_PROFILER_INPUT			1
+#define KIAVC_PROFILER_UPDATE			2
+#define KIAVC_PROFILER_SCRIPTS			3
+#define KIAVC_PROFILER_PLUGINS_UPDATE	4
+#define KIAVC_PROFILER_RENDER			5
+#define KIAVC_PROFILER_PLUGINS_RENDER	6
+#define KIAVC_PROFILER_PRESENT			7
+#define KIAVC_PROFILER_OVERLAP			8
+#define KIAVC_PROFILER_PHASES			9
+
+/* How many samples we keep for each phase */
+#define KIAVC_PROFILER_SAMPLES	256
+
+/* Statistics on a phase, in milliseconds */
+typedef struct kiavc_profiler_stats {
+	/* How many samples these statistics are based on */
+	Uint32 samples;
+	/* Average, percentiles and max */
+	double avg, p50, p95, p99, max;
+} kiavc_profiler_stats;
+
+/* Statistics on what was rendered in a frame */
+typedef struct kiavc_render_stats {
+	/* Draw calls (sprite batches, copies, fills and lines) */
+	Uint32 draw_calls;
+	/* Sprites drawn, and how many times we had to switch texture */
+	Uint32 sprites, texture_switches;
+	/* Rectangles filled, including clears */
+	Uint32 fill_rects;
+	/* Plugin render callbacks invoked */
+	Uint32 plugin_renders;
+	/* Actors, objects and text lines drawn, and culled because off-screen */
+	Uint32 resources_drawn, resources_culled;
+	/* Layers, actors and objects not drawn because hidden by something opaque */
+	Uint32 resources_occluded;
+	/* Renderer state changes applied, and avoided because redundant */
+	Uint32 state_changes, state_changes_avoided;
+	/* Pixels covered by sprites, and how many times that is the canvas */
+	Uint64 pixels;
+	double overdraw;
+} kiavc_render_stats;
+
+/* Initialize the profiler */
+void kiavc_profiler_init(void);
+/* Get the current value of the high resolution counter */
+Uint64 kiavc_profiler_now(void);
+/* Add a sample for a phase, as the time elapsed since the provided counter */
+void kiavc_profiler_add(int phase, Uint64 start);
+/* Add a sample for a phase, in milliseconds */
+void kiavc_profiler_add_sample(int phase, double ms);
+/* Get the statistics for a phase */
+int kiavc_profiler_get_stats(int phase, kiavc_profiler_stats *stats);
+/* Get the name of a phase */
+const char *kiavc_profiler_phase_name(int phase);
+/* Reset all samples */
+void kiavc_profiler_reset(void);
+
+#endif
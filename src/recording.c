@@ -0,0 +1,245 @@
+/*
+ *
+ * KIAVC input recording implementation. The file format is very simple:
+ * a "KIAVCREC" header, a version and a flags byte, followed by a list
+ * of items, each made of the simulation step (32 bits), the item type
+ * (8 bits) and a type specific payload, all in network byte order:
+ *
+ * - mouse motion: x (16 bits), y (16 bits), modifiers (16 bits);
+ * - mouse button up: button (8 bits), x (16 bits), y (16 bits), modifiers (16 bits);
+ * - text input: modifiers (16 bits), length (8 bits), text;
+ * - key down: key (32 bits), modifiers (16 bits);
+ * - quit: no payload;
+ * - checksum: checksum (32 bits).
+ *
+ * Mouse coordinates are in canvas coordinates, rather than in window
+ * coordinates, so that a replay works no matter the size of the window,
+ * and modifiers are the state of the modifier keys when the event was
+ * handled, since handling an event may depend on them.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include "recording.h"
+
+/* Recording header and version */
+#define KIAVC_RECORDING_HEADER	"KIAVCREC"
+#define KIAVC_RECORDING_VERSION	2
+
+/* Recording flags */
+#define KIAVC_RECORDING_FLAG_CHECKSUMS	0x01
+
+/* Helpers to read from the file */
+static bool kiavc_recording_read_u8(SDL_RWops *file, Uint8 *value) {
+	return SDL_RWread(file, value, sizeof(Uint8), 1) == 1;
+}
+static bool kiavc_recording_read_u16(SDL_RWops *file, Uint16 *value) {
+	if(SDL_RWread(file, value, sizeof(Uint16), 1) != 1)
+		return false;
+	*value = SDL_SwapBE16(*value);
+	return true;
+}
+static bool kiavc_recording_read_u32(SDL_RWops *file, Uint32 *value) {
+	if(SDL_RWread(file, value, sizeof(Uint32), 1) != 1)
+		return false;
+	*value = SDL_SwapBE32(*value);
+	return true;
+}
+
+/* Helper to read the next item when replaying */
+static void kiavc_recording_read_item(kiavc_recording *rec) {
+	rec->has_next = false;
+	SDL_zero(rec->next);
+	kiavc_recording_item *item = &rec->next;
+	if(!kiavc_recording_read_u32(rec->file, &item->step) || !kiavc_recording_read_u8(rec->file, &item->type))
+		return;
+	bool ok = false;
+	Uint8 button = 0, len = 0;
+	Uint16 x = 0, y = 0, mod = 0;
+	Uint32 key = 0;
+	switch(item->type) {
+		case KIAVC_RECORDING_MOUSEMOTION:
+			ok = kiavc_recording_read_u16(rec->file, &x) && kiavc_recording_read_u16(rec->file, &y) &&
+				kiavc_recording_read_u16(rec->file, &item->mod);
+			item->event.type = SDL_MOUSEMOTION;
+			item->event.motion.x = (Sint16)x;
+			item->event.motion.y = (Sint16)y;
+			break;
+		case KIAVC_RECORDING_MOUSEBUTTONUP:
+			ok = kiavc_recording_read_u8(rec->file, &button) &&
+				kiavc_recording_read_u16(rec->file, &x) && kiavc_recording_read_u16(rec->file, &y) &&
+				kiavc_recording_read_u16(rec->file, &item->mod);
+			item->event.type = SDL_MOUSEBUTTONUP;
+			item->event.button.button = button;
+			item->event.button.x = (Sint16)x;
+			item->event.button.y = (Sint16)y;
+			break;
+		case KIAVC_RECORDING_TEXTINPUT:
+			ok = kiavc_recording_read_u16(rec->file, &item->mod) &&
+				kiavc_recording_read_u8(rec->file, &len) && len < sizeof(item->event.text.text) &&
+				(len == 0 || SDL_RWread(rec->file, item->event.text.text, sizeof(char), len) == len);
+			item->event.type = SDL_TEXTINPUT;
+			break;
+		case KIAVC_RECORDING_KEYDOWN:
+			ok = kiavc_recording_read_u32(rec->file, &key) && kiavc_recording_read_u16(rec->file, &mod);
+			item->event.type = SDL_KEYDOWN;
+			item->event.key.keysym.sym = (Sint32)key;
+			item->event.key.keysym.mod = mod;
+			item->mod = mod;
+			break;
+		case KIAVC_RECORDING_QUIT:
+			ok = true;
+			item->event.type = SDL_QUIT;
+			break;
+		case KIAVC_RECORDING_CHECKSUM:
+			ok = kiavc_recording_read_u32(rec->file, &item->checksum);
+			break;
+		default:
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown item type %"SCNu8" in recording\n", item->type);
+			break;
+	}
+	if(!ok) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Truncated or broken recording, stopping here\n");
+		return;
+	}
+	if(item->type != KIAVC_RECORDING_CHECKSUM)
+		rec->events++;
+	rec->has_next = true;
+}
+
+/* Create a new recording, optionally with checksums */
+kiavc_recording *kiavc_recording_create(const char *path, bool checksums) {
+	if(!path)
+		return NULL;
+	SDL_RWops *file = SDL_RWFromFile(path, "wb");
+	if(!file) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create recording '%s': %s\n", path, SDL_GetError());
+		return NULL;
+	}
+	/* Write the header */
+	SDL_RWwrite(file, KIAVC_RECORDING_HEADER, sizeof(char), SDL_strlen(KIAVC_RECORDING_HEADER));
+	SDL_WriteBE32(file, KIAVC_RECORDING_VERSION);
+	SDL_WriteU8(file, checksums ? KIAVC_RECORDING_FLAG_CHECKSUMS : 0);
+	kiavc_recording *rec = SDL_calloc(1, sizeof(kiavc_recording));
+	rec->file = file;
+	rec->writing = true;
+	rec->checksums = checksums;
+	SDL_Log("Recording input to '%s'%s\n", path, checksums ? " (with checksums)" : "");
+	return rec;
+}
+
+/* Open an existing recording for replaying it */
+kiavc_recording *kiavc_recording_open(const char *path) {
+	if(!path)
+		return NULL;
+	SDL_RWops *file = SDL_RWFromFile(path, "rb");
+	if(!file) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open recording '%s': %s\n", path, SDL_GetError());
+		return NULL;
+	}
+	/* Parse the header */
+	char header[10];
+	size_t hlen = SDL_strlen(KIAVC_RECORDING_HEADER);
+	Uint32 version = 0;
+	Uint8 flags = 0;
+	if(SDL_RWread(file, header, sizeof(char), hlen) != hlen || SDL_memcmp(header, KIAVC_RECORDING_HEADER, hlen) ||
+			!kiavc_recording_read_u32(file, &version) || !kiavc_recording_read_u8(file, &flags)) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Invalid recording '%s'\n", path);
+		SDL_RWclose(file);
+		return NULL;
+	}
+	if(version != KIAVC_RECORDING_VERSION) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unsupported recording version %"SCNu32"\n", version);
+		SDL_RWclose(file);
+		return NULL;
+	}
+	kiavc_recording *rec = SDL_calloc(1, sizeof(kiavc_recording));
+	rec->file = file;
+	rec->checksums = (flags & KIAVC_RECORDING_FLAG_CHECKSUMS);
+	kiavc_recording_read_item(rec);
+	SDL_Log("Replaying input from '%s'%s\n", path, rec->checksums ? " (with checksums)" : "");
+	return rec;
+}
+
+/* Check if an event is something we can record */
+bool kiavc_recording_is_supported(SDL_Event *event) {
+	if(!event)
+		return false;
+	return (event->type == SDL_MOUSEMOTION || event->type == SDL_MOUSEBUTTONUP ||
+		event->type == SDL_TEXTINPUT || event->type == SDL_KEYDOWN || event->type == SDL_QUIT);
+}
+
+/* Add an input event to a recording */
+int kiavc_recording_add_event(kiavc_recording *rec, Uint32 step, SDL_Event *event, Uint16 mod) {
+	if(!rec || !rec->writing || !event)
+		return -1;
+	if(event->type == SDL_MOUSEMOTION) {
+		SDL_WriteBE32(rec->file, step);
+		SDL_WriteU8(rec->file, KIAVC_RECORDING_MOUSEMOTION);
+		SDL_WriteBE16(rec->file, (Uint16)event->motion.x);
+		SDL_WriteBE16(rec->file, (Uint16)event->motion.y);
+		SDL_WriteBE16(rec->file, mod);
+	} else if(event->type == SDL_MOUSEBUTTONUP) {
+		SDL_WriteBE32(rec->file, step);
+		SDL_WriteU8(rec->file, KIAVC_RECORDING_MOUSEBUTTONUP);
+		SDL_WriteU8(rec->file, event->button.button);
+		SDL_WriteBE16(rec->file, (Uint16)event->button.x);
+		SDL_WriteBE16(rec->file, (Uint16)event->button.y);
+		SDL_WriteBE16(rec->file, mod);
+	} else if(event->type == SDL_TEXTINPUT) {
+		Uint8 len = (Uint8)SDL_strlen(event->text.text);
+		SDL_WriteBE32(rec->file, step);
+		SDL_WriteU8(rec->file, KIAVC_RECORDING_TEXTINPUT);
+		SDL_WriteBE16(rec->file, mod);
+		SDL_WriteU8(rec->file, len);
+		if(len > 0)
+			SDL_RWwrite(rec->file, event->text.text, sizeof(char), len);
+	} else if(event->type == SDL_KEYDOWN) {
+		SDL_WriteBE32(rec->file, step);
+		SDL_WriteU8(rec->file, KIAVC_RECORDING_KEYDOWN);
+		SDL_WriteBE32(rec->file, (Uint32)event->key.keysym.sym);
+		SDL_WriteBE16(rec->file, event->key.keysym.mod);
+	} else if(event->type == SDL_QUIT) {
+		SDL_WriteBE32(rec->file, step);
+		SDL_WriteU8(rec->file, KIAVC_RECORDING_QUIT);
+	} else {
+		/* Not an event we care about */
+		return -2;
+	}
+	rec->events++;
+	return 0;
+}
+
+/* Add a checksum to a recording */
+int kiavc_recording_add_checksum(kiavc_recording *rec, Uint32 step, Uint32 checksum) {
+	if(!rec || !rec->writing || !rec->checksums)
+		return -1;
+	SDL_WriteBE32(rec->file, step);
+	SDL_WriteU8(rec->file, KIAVC_RECORDING_CHECKSUM);
+	SDL_WriteBE32(rec->file, checksum);
+	return 0;
+}
+
+/* Peek at the next item in a recording we're replaying */
+kiavc_recording_item *kiavc_recording_peek(kiavc_recording *rec) {
+	if(!rec || rec->writing || !rec->has_next)
+		return NULL;
+	return &rec->next;
+}
+
+/* Move to the next item in a recording we're replaying */
+void kiavc_recording_next(kiavc_recording *rec) {
+	if(!rec || rec->writing || !rec->has_next)
+		return;
+	kiavc_recording_read_item(rec);
+}
+
+/* Close a recording */
+void kiavc_recording_destroy(kiavc_recording *rec) {
+	if(!rec)
+		return;
+	if(rec->file)
+		SDL_RWclose(rec->file);
+	SDL_free(rec);
+}
@@ -0,0 +1,75 @@
+/*
+ *
+ * KIAVC input recording. A recording is a compact binary file that
+ * contains the user input events the engine consumed, each tagged with
+ * the simulation step it was handled at, and optionally a checksum of
+ * the state of the world after each step: this allows us to replay a
+ * whole session later on (e.g., at a faster speed, for profiling), and
+ * to check whether the replay diverged from the original session.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_RECORDING_H
+#define __KIAVC_RECORDING_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+/* Recording items */
+#define KIAVC_RECORDING_MOUSEMOTION		1
+#define KIAVC_RECORDING_MOUSEBUTTONUP	2
+#define KIAVC_RECORDING_TEXTINPUT		3
+#define KIAVC_RECORDING_KEYDOWN			4
+#define KIAVC_RECORDING_QUIT			5
+#define KIAVC_RECORDING_CHECKSUM		6
+
+/* Recording item */
+typedef struct kiavc_recording_item {
+	/* Simulation step this item refers to */
+	Uint32 step;
+	/* Item type */
+	Uint8 type;
+	/* Event, if this is an input event, and the modifiers at the time */
+	SDL_Event event;
+	Uint16 mod;
+	/* Checksum, if this is a checksum */
+	Uint32 checksum;
+} kiavc_recording_item;
+
+/* Recording */
+typedef struct kiavc_recording {
+	/* File we're writing to or reading from */
+	SDL_RWops *file;
+	/* Whether we're writing (recording) or reading (replaying) */
+	bool writing;
+	/* Whether the recording contains checksums */
+	bool checksums;
+	/* When replaying, next item to process, if any */
+	kiavc_recording_item next;
+	bool has_next;
+	/* Number of input events we wrote or read */
+	Uint32 events;
+} kiavc_recording;
+
+/* Create a new recording, optionally with checksums */
+kiavc_recording *kiavc_recording_create(const char *path, bool checksums);
+/* Open an existing recording for replaying it */
+kiavc_recording *kiavc_recording_open(const char *path);
+/* Check if an event is something we can record */
+bool kiavc_recording_is_supported(SDL_Event *event);
+/* Add an input event to a recording: mouse coordinates must be in canvas
+ * coordinates already, and mod is the state of the modifier keys */
+int kiavc_recording_add_event(kiavc_recording *rec, Uint32 step, SDL_Event *event, Uint16 mod);
+/* Add a checksum to a recording */
+int kiavc_recording_add_checksum(kiavc_recording *rec, Uint32 step, Uint32 checksum);
+/* Peek at the next item in a recording we're replaying (NULL when done) */
+kiavc_recording_item *kiavc_recording_peek(kiavc_recording *rec);
+/* Move to the next item in a recording we're replaying */
+void kiavc_recording_next(kiavc_recording *rec);
+/* Close a recording */
+void kiavc_recording_destroy(kiavc_recording *rec);
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ *
+ * KIAVC render queue. It's a contiguous array of the resources to
+ * render, sorted by z-plane and y coordinate. Since the order is
+ * nearly the same from one frame to the next, sorting is done with an
+ * incremental insertion sort on precomputed keys, rather than a full
+ * sort of a linked list. Resources keep track of their position in the
+ * queue, which means checking if a resource is in the queue and
+ * removing it are O(1) operations: removed items leave a hole that is
+ * compacted the next time the queue is sorted, so it's safe to add or
+ * remove resources while iterating on the queue.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include <SDL2/SDL.h>
+
+#include "renderqueue.h"
+
+/* Initial size of the queue */
+#define KIAVC_RENDER_QUEUE_SIZE	64
+
+/* Create a new render queue */
+kiavc_render_queue *kiavc_render_queue_create(void) {
+	kiavc_render_queue *queue = SDL_calloc(1, sizeof(kiavc_render_queue));
+	queue->size = KIAVC_RENDER_QUEUE_SIZE;
+	queue->items = SDL_calloc(queue->size, sizeof(kiavc_render_queue_item));
+	return queue;
+}
+
+/* Add a resource to the queue, if it's not there already */
+int kiavc_render_queue_add(kiavc_render_queue *queue, kiavc_resource *resource) {
+	if(!queue || !resource)
+		return -1;
+	if(kiavc_render_queue_contains(queue, resource))
+		return 0;
+	if(queue->count == queue->size) {
+		/* Make room for more items */
+		int size = queue->size * 2;
+		kiavc_render_queue_item *items = SDL_realloc(queue->items, size * sizeof(kiavc_render_queue_item));
+		if(!items)
+			return -2;
+		queue->items = items;
+		queue->size = size;
+	}
+	/* We append at the end: sorting will move the resource where it belongs */
+	kiavc_render_queue_item *item = &queue->items[queue->count];
+	item->resource = resource;
+	item->zplane = resource->zplane;
+	item->y = resource->y;
+	queue->count++;
+	resource->queue_index = queue->count;
+	queue->dirty = true;
+	queue->added = true;
+	return 0;
+}
+
+/* Check if a resource is in the queue */
+bool kiavc_render_queue_contains(kiavc_render_queue *queue, kiavc_resource *resource) {
+	if(!queue || !resource || resource->queue_index < 1 || resource->queue_index > queue->count)
+		return false;
+	return queue->items[resource->queue_index-1].resource == resource;
+}
+
+/* Remove a resource from the queue */
+int kiavc_render_queue_remove(kiavc_render_queue *queue, kiavc_resource *resource) {
+	if(!kiavc_render_queue_contains(queue, resource))
+		return -1;
+	/* Leave a hole, we'll get rid of it when sorting */
+	queue->items[resource->queue_index-1].resource = NULL;
+	resource->queue_index = 0;
+	queue->dirty = true;
+	return 0;
+}
+
+/* Mark the queue as needing to be sorted (e.g., because a z-plane or position changed) */
+void kiavc_render_queue_invalidate(kiavc_render_queue *queue) {
+	if(queue)
+		queue->dirty = true;
+}
+
+/* Helper to compare two items */
+static inline bool kiavc_render_queue_greater(kiavc_render_queue_item *i1, kiavc_render_queue_item *i2) {
+	/* We check the z-plane first, and then which one has a higher y coordinate */
+	if(i1->zplane != i2->zplane)
+		return i1->zplane > i2->zplane;
+	return i1->y > i2->y;
+}
+
+/* Compact and sort the queue, if needed */
+void kiavc_render_queue_sort(kiavc_render_queue *queue) {
+	if(!queue || !queue->dirty)
+		return;
+	/* Get rid of the holes and refresh the keys first */
+	int i = 0, j = 0, count = 0;
+	for(i=0; i<queue->count; i++) {
+		kiavc_render_queue_item *item = &queue->items[i];
+		if(!item->resource)
+			continue;
+		item->zplane = item->resource->zplane;
+		item->y = item->resource->y;
+		if(count != i)
+			queue->items[count] = *item;
+		count++;
+	}
+	queue->count = count;
+	/* Now do an insertion sort, which is stable and very fast when
+	 * the array is already sorted, or nearly so, as it usually is */
+	kiavc_render_queue_item tmp;
+	for(i=1; i<queue->count; i++) {
+		if(!kiavc_render_queue_greater(&queue->items[i-1], &queue->items[i]))
+			continue;
+		tmp = queue->items[i];
+		j = i - 1;
+		while(j >= 0 && kiavc_render_queue_greater(&queue->items[j], &tmp)) {
+			queue->items[j+1] = queue->items[j];
+			j--;
+		}
+		queue->items[j+1] = tmp;
+	}
+	/* Update the indexes in the resources */
+	for(i=0; i<queue->count; i++)
+		queue->items[i].resource->queue_index = i+1;
+	queue->dirty = false;
+}
+
+/* Get the resource at the specified index (may be NULL for holes) */
+kiavc_resource *kiavc_render_queue_get(kiavc_render_queue *queue, int index) {
+	if(!queue || index < 0 || index >= queue->count)
+		return NULL;
+	return queue->items[index].resource;
+}
+
+/* Remove all resources from the queue */
+void kiavc_render_queue_clear(kiavc_render_queue *queue) {
+	if(!queue)
+		return;
+	int i = 0;
+	for(i=0; i<queue->count; i++) {
+		if(queue->items[i].resource)
+			queue->items[i].resource->queue_index = 0;
+	}
+	queue->count = 0;
+	queue->dirty = false;
+}
+
+/* Destroy a render queue */
+void kiavc_render_queue_destroy(kiavc_render_queue *queue) {
+	if(!queue)
+		return;
+	kiavc_render_queue_clear(queue);
+	SDL_free(queue->items);
+	SDL_free(queue);
+}
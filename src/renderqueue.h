@@ -0,0 +1,64 @@
+/*
+ *
+ * KIAVC render queue. It's a contiguous array of the resources to
+ * render, sorted by z-plane and y coordinate. Since the order is
+ * nearly the same from one frame to the next, sorting is done with an
+ * incremental insertion sort on precomputed keys, rather than a full
+ * sort of a linked list. Resources keep track of their position in the
+ * queue, which means checking if a resource is in the queue and
+ * removing it are O(1) operations: removed items leave a hole that is
+ * compacted the next time the queue is sorted, so it's safe to add or
+ * remove resources while iterating on the queue.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_RENDERQUEUE_H
+#define __KIAVC_RENDERQUEUE_H
+
+#include <stdbool.h>
+
+#include "resources.h"
+
+/* Render queue item, with the precomputed sort keys */
+typedef struct kiavc_render_queue_item {
+	/* Resource to render (NULL if it's been removed) */
+	kiavc_resource *resource;
+	/* Sort keys */
+	int zplane;
+	float y;
+} kiavc_render_queue_item;
+
+/* Render queue */
+typedef struct kiavc_render_queue {
+	/* Items in the queue, including holes */
+	kiavc_render_queue_item *items;
+	/* Number of items (including holes), and size of the array */
+	int count, size;
+	/* Whether the queue needs to be compacted and/or sorted */
+	bool dirty;
+	/* Whether resources were added since the last time the owner checked */
+	bool added;
+} kiavc_render_queue;
+
+/* Create a new render queue */
+kiavc_render_queue *kiavc_render_queue_create(void);
+/* Add a resource to the queue, if it's not there already */
+int kiavc_render_queue_add(kiavc_render_queue *queue, kiavc_resource *resource);
+/* Check if a resource is in the queue */
+bool kiavc_render_queue_contains(kiavc_render_queue *queue, kiavc_resource *resource);
+/* Remove a resource from the queue */
+int kiavc_render_queue_remove(kiavc_render_queue *queue, kiavc_resource *resource);
+/* Mark the queue as needing to be sorted (e.g., because a z-plane or position changed) */
+void kiavc_render_queue_invalidate(kiavc_render_queue *queue);
+/* Compact and sort the queue, if needed */
+void kiavc_render_queue_sort(kiavc_render_queue *queue);
+/* Get the resource at the specified index (may be NULL for holes) */
+kiavc_resource *kiavc_render_queue_get(kiavc_render_queue *queue, int index);
+/* Remove all resources from the queue */
+void kiavc_render_queue_clear(kiavc_render_queue *queue);
+/* Destroy a render queue */
+void kiavc_render_queue_destroy(kiavc_render_queue *queue);
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ *
+ * KIAVC renderer state tracking. Changing the state of the renderer
+ * (draw color, blend mode, viewport, render target, etc.) forces SDL to
+ * flush the draw calls it batched so far, even when the new state is
+ * the same as the old one. This thin layer sits between the engine and
+ * SDL, remembers the state it set last, and skips redundant changes,
+ * keeping track of how many were applied and how many were avoided.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include "renderstate.h"
+#include "capture.h"
+
+/* Helper to compare rects */
+static bool kiavc_render_state_same_rect(const SDL_Rect *r1, const SDL_Rect *r2) {
+	return r1->x == r2->x && r1->y == r2->y && r1->w == r2->w && r1->h == r2->h;
+}
+
+/* Create a new renderer state tracker */
+kiavc_render_state *kiavc_render_state_create(SDL_Renderer *renderer) {
+	if(!renderer)
+		return NULL;
+	kiavc_render_state *rs = SDL_calloc(1, sizeof(kiavc_render_state));
+	rs->renderer = renderer;
+	return rs;
+}
+
+/* Set the render target */
+void kiavc_render_state_set_target(kiavc_render_state *rs, SDL_Texture *target) {
+	if(!rs)
+		return;
+	if(rs->known_target && rs->target == target) {
+		rs->avoided++;
+		return;
+	}
+	SDL_SetRenderTarget(rs->renderer, target);
+	kiavc_capture_target(target);
+	rs->target = target;
+	rs->known_target = true;
+	/* Changing target changes viewport, clipping and scale too */
+	rs->known_viewport = false;
+	rs->known_clip = false;
+	rs->known_scale = false;
+	rs->applied++;
+}
+
+/* Set the draw color */
+void kiavc_render_state_set_draw_color(kiavc_render_state *rs, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+	if(!rs)
+		return;
+	if(rs->known_color && rs->color.r == r && rs->color.g == g && rs->color.b == b && rs->color.a == a) {
+		rs->avoided++;
+		return;
+	}
+	SDL_SetRenderDrawColor(rs->renderer, r, g, b, a);
+	kiavc_capture_draw_color(r, g, b, a);
+	rs->color.r = r;
+	rs->color.g = g;
+	rs->color.b = b;
+	rs->color.a = a;
+	rs->known_color = true;
+	rs->applied++;
+}
+
+/* Set the draw blend mode */
+void kiavc_render_state_set_blend_mode(kiavc_render_state *rs, SDL_BlendMode blend) {
+	if(!rs)
+		return;
+	if(rs->known_blend && rs->blend == blend) {
+		rs->avoided++;
+		return;
+	}
+	SDL_SetRenderDrawBlendMode(rs->renderer, blend);
+	kiavc_capture_blend_mode(blend);
+	rs->blend = blend;
+	rs->known_blend = true;
+	rs->applied++;
+}
+
+/* Set the viewport */
+void kiavc_render_state_set_viewport(kiavc_render_state *rs, const SDL_Rect *viewport) {
+	if(!rs)
+		return;
+	SDL_Rect none = { 0 };
+	if(rs->known_viewport && kiavc_render_state_same_rect(&rs->viewport, viewport ? viewport : &none)) {
+		rs->avoided++;
+		return;
+	}
+	SDL_RenderSetViewport(rs->renderer, viewport);
+	kiavc_capture_viewport(viewport);
+	rs->viewport = viewport ? *viewport : none;
+	rs->known_viewport = true;
+	rs->applied++;
+}
+
+/* Set the clip rect */
+void kiavc_render_state_set_clip(kiavc_render_state *rs, const SDL_Rect *clip) {
+	if(!rs)
+		return;
+	SDL_Rect none = { 0 };
+	if(rs->known_clip && kiavc_render_state_same_rect(&rs->clip, clip ? clip : &none)) {
+		rs->avoided++;
+		return;
+	}
+	SDL_RenderSetClipRect(rs->renderer, clip);
+	kiavc_capture_clip(clip);
+	rs->clip = clip ? *clip : none;
+	rs->known_clip = true;
+	rs->applied++;
+}
+
+/* Set the scale */
+void kiavc_render_state_set_scale(kiavc_render_state *rs, float scale) {
+	if(!rs)
+		return;
+	if(rs->known_scale && rs->scale == scale) {
+		rs->avoided++;
+		return;
+	}
+	SDL_RenderSetScale(rs->renderer, scale, scale);
+	kiavc_capture_scale(scale);
+	rs->scale = scale;
+	rs->known_scale = true;
+	rs->applied++;
+}
+
+/* Set the alpha modulation of a texture */
+void kiavc_render_state_set_alpha_mod(kiavc_render_state *rs, SDL_Texture *texture, Uint8 alpha) {
+	if(!rs || !texture)
+		return;
+	/* Textures keep their own state, so we just ask SDL */
+	Uint8 current = 0;
+	if(SDL_GetTextureAlphaMod(texture, &current) == 0 && current == alpha) {
+		rs->avoided++;
+		return;
+	}
+	SDL_SetTextureAlphaMod(texture, alpha);
+	kiavc_capture_alpha_mod(texture, alpha);
+	rs->applied++;
+}
+
+/* Forget what we know about the state */
+void kiavc_render_state_invalidate(kiavc_render_state *rs) {
+	if(!rs)
+		return;
+	rs->known_target = false;
+	rs->known_color = false;
+	rs->known_blend = false;
+	rs->known_viewport = false;
+	rs->known_clip = false;
+	rs->known_scale = false;
+}
+
+/* Start counting changes for a new frame */
+void kiavc_render_state_reset_stats(kiavc_render_state *rs) {
+	if(!rs)
+		return;
+	rs->total_applied += rs->applied;
+	rs->total_avoided += rs->avoided;
+	rs->applied = 0;
+	rs->avoided = 0;
+}
+
+/* Destroy a renderer state tracker */
+void kiavc_render_state_destroy(kiavc_render_state *rs) {
+	if(!rs)
+		return;
+	kiavc_render_state_reset_stats(rs);
+	SDL_Log("Renderer state changes: %"SCNu64" applied, %"SCNu64" avoided\n",
+		rs->total_applied, rs->total_avoided);
+	SDL_free(rs);
+}
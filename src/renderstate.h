@@ -0,0 +1,71 @@
+/*
+ *
+ * KIAVC renderer state tracking. Changing the state of the renderer
+ * (draw color, blend mode, viewport, render target, etc.) forces SDL to
+ * flush the draw calls it batched so far, even when the new state is
+ * the same as the old one. This thin layer sits between the engine and
+ * SDL, remembers the state it set last, and skips redundant changes,
+ * keeping track of how many were applied and how many were avoided.
+ * When something else may have changed the state behind our back (e.g.,
+ * a plugin drawing directly with SDL), the state must be invalidated.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_RENDERSTATE_H
+#define __KIAVC_RENDERSTATE_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+/* Renderer state */
+typedef struct kiavc_render_state {
+	/* Renderer we're tracking */
+	SDL_Renderer *renderer;
+	/* Current render target */
+	SDL_Texture *target;
+	bool known_target;
+	/* Current draw color */
+	SDL_Color color;
+	bool known_color;
+	/* Current draw blend mode */
+	SDL_BlendMode blend;
+	bool known_blend;
+	/* Current viewport and clip rect (zero size if disabled) */
+	SDL_Rect viewport, clip;
+	bool known_viewport, known_clip;
+	/* Current scale */
+	float scale;
+	bool known_scale;
+	/* How many changes were applied and avoided in the current frame */
+	Uint32 applied, avoided;
+	/* How many changes were applied and avoided overall */
+	Uint64 total_applied, total_avoided;
+} kiavc_render_state;
+
+/* Create a new renderer state tracker */
+kiavc_render_state *kiavc_render_state_create(SDL_Renderer *renderer);
+/* Set the render target (NULL for the default target): this resets viewport, clip rect and scale */
+void kiavc_render_state_set_target(kiavc_render_state *rs, SDL_Texture *target);
+/* Set the draw color */
+void kiavc_render_state_set_draw_color(kiavc_render_state *rs, Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+/* Set the draw blend mode */
+void kiavc_render_state_set_blend_mode(kiavc_render_state *rs, SDL_BlendMode blend);
+/* Set the viewport (NULL for the whole target) */
+void kiavc_render_state_set_viewport(kiavc_render_state *rs, const SDL_Rect *viewport);
+/* Set the clip rect (NULL to disable clipping) */
+void kiavc_render_state_set_clip(kiavc_render_state *rs, const SDL_Rect *clip);
+/* Set the scale (the same on both axes) */
+void kiavc_render_state_set_scale(kiavc_render_state *rs, float scale);
+/* Set the alpha modulation of a texture */
+void kiavc_render_state_set_alpha_mod(kiavc_render_state *rs, SDL_Texture *texture, Uint8 alpha);
+/* Forget what we know about the state, since it may have been changed elsewhere */
+void kiavc_render_state_invalidate(kiavc_render_state *rs);
+/* Start counting changes for a new frame */
+void kiavc_render_state_reset_stats(kiavc_render_state *rs);
+/* Destroy a renderer state tracker */
+void kiavc_render_state_destroy(kiavc_render_state *rs);
+
+#endif
@@ -9,6 +9,8 @@
 #ifndef __KIAVC_RESOURCES_H
 #define __KIAVC_RESOURCES_H
 
+#include <stdbool.h>
+
 #include <SDL2/SDL.h>
 
 #define KIAVC_ROOM			1
@@ -20,6 +22,24 @@
 #define KIAVC_DIALOG		7
 #define KIAVC_PLUGIN		8
 
+/* Cached world-space bounding box of a resource, and what it was computed
+ * from: the box only needs updating when the resource moves, is scaled,
+ * or starts drawing something else, which means we can cull resources
+ * that are off-screen without looking up what they would draw first */
+typedef struct kiavc_bounds {
+	/* Bounding box, in world coordinates */
+	SDL_Rect rect;
+	/* Position, scale and image the box was computed from */
+	int x, y;
+	float scale;
+	const void *image;
+	int variant;
+	/* Generation of the images the box was computed with */
+	Uint32 generation;
+	/* Whether the box is valid */
+	bool valid;
+} kiavc_bounds;
+
 /* Dynamic renderable resource (rooms and cursors are excluded since
  * there can only be a single instance of each displayed at any time) */
 typedef struct kiavc_resource {
@@ -31,18 +51,24 @@ typedef struct kiavc_resource {
 	int zplane;
 	/* Ticks timer */
 	uint32_t ticks;
-	/* Whether we're fading the object in or out, and how long that should be */
-	int fade_ms;
 	/* Fade alpha to apply */
-	Uint8 fade_alpha, fade_start, fade_target;
-	/* Fade in/out ticks */
-	uint32_t fade_ticks;
+	Uint8 fade_alpha;
 	/* Target coordinates of the resource, when it's moving */
 	int target_x, target_y;
 	/* Movement speed of the resource (pixels per second) */
 	int speed;
-	/* Movement ticks */
-	uint32_t move_ticks;
+	/* Position at the start and at the end of the last simulation step
+	 * the resource moved in, used to interpolate the position when rendering */
+	float prev_x, prev_y, last_x, last_y;
+	Uint32 moved;
+	/* Position in the render queue, plus one (0 if not in the queue) */
+	int queue_index;
+	/* Position in the motion and tween arrays, plus one (0 if none) */
+	int motion_index, alpha_index, scale_index;
+	/* Position in the schedule of timed updates, plus one (0 if not scheduled) */
+	int schedule_index;
+	/* Cached bounding box, for culling */
+	kiavc_bounds bounds;
 } kiavc_resource;
 
 #endif
@@ -70,6 +70,7 @@ int kiavc_room_remove_layer(kiavc_room *room, const char *id) {
 			kiavc_room_layer_destroy(layer);
 			return 0;
 		}
+		list = list->next;
 	}
 	/* If we got here, we couldn't find it */
 	return -2;
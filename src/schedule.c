@@ -0,0 +1,149 @@
+/*
+ *
+ * KIAVC schedule of timed updates. Resources that need to change at
+ * some point in the future (e.g., actors and objects whose animation
+ * will move to the next frame, or text lines that will need to be
+ * removed) are kept in a min-heap, sorted by when that will happen:
+ * this way, in each simulation step, we only need to look at the
+ * resources that are due, rather than checking all of them, and rooms
+ * full of static resources don't cost anything. Resources keep track
+ * of their position in the heap, which means rescheduling or removing
+ * a resource are O(log n) operations.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include <SDL2/SDL.h>
+
+#include "schedule.h"
+
+/* Initial size of the heap */
+#define KIAVC_SCHEDULE_SIZE	64
+
+/* Helper to put an item at a specific position, updating its resource */
+static inline void kiavc_schedule_place(kiavc_schedule *schedule, int index, kiavc_schedule_item *item) {
+	schedule->items[index] = *item;
+	item->resource->schedule_index = index + 1;
+}
+
+/* Helpers to move an item up or down in the heap, until it's where it belongs */
+static void kiavc_schedule_sift_up(kiavc_schedule *schedule, int index) {
+	kiavc_schedule_item item = schedule->items[index];
+	while(index > 0) {
+		int parent = (index - 1) / 2;
+		if(schedule->items[parent].deadline <= item.deadline)
+			break;
+		kiavc_schedule_place(schedule, index, &schedule->items[parent]);
+		index = parent;
+	}
+	kiavc_schedule_place(schedule, index, &item);
+}
+static void kiavc_schedule_sift_down(kiavc_schedule *schedule, int index) {
+	kiavc_schedule_item item = schedule->items[index];
+	while(true) {
+		int child = 2*index + 1;
+		if(child >= schedule->count)
+			break;
+		if(child + 1 < schedule->count && schedule->items[child+1].deadline < schedule->items[child].deadline)
+			child++;
+		if(item.deadline <= schedule->items[child].deadline)
+			break;
+		kiavc_schedule_place(schedule, index, &schedule->items[child]);
+		index = child;
+	}
+	kiavc_schedule_place(schedule, index, &item);
+}
+
+/* Create a new schedule */
+kiavc_schedule *kiavc_schedule_create(void) {
+	kiavc_schedule *schedule = SDL_calloc(1, sizeof(kiavc_schedule));
+	schedule->size = KIAVC_SCHEDULE_SIZE;
+	schedule->items = SDL_calloc(schedule->size, sizeof(kiavc_schedule_item));
+	return schedule;
+}
+
+/* Schedule an update for a resource, or change when it's due if it's scheduled already */
+int kiavc_schedule_set(kiavc_schedule *schedule, kiavc_resource *resource, Uint32 deadline) {
+	if(!schedule || !resource)
+		return -1;
+	if(kiavc_schedule_contains(schedule, resource)) {
+		/* Update the deadline, and move the item accordingly */
+		int index = resource->schedule_index - 1;
+		Uint32 previous = schedule->items[index].deadline;
+		schedule->items[index].deadline = deadline;
+		if(deadline < previous)
+			kiavc_schedule_sift_up(schedule, index);
+		else if(deadline > previous)
+			kiavc_schedule_sift_down(schedule, index);
+		return 0;
+	}
+	if(schedule->count == schedule->size) {
+		/* Make room for more items */
+		int size = schedule->size * 2;
+		kiavc_schedule_item *items = SDL_realloc(schedule->items, size * sizeof(kiavc_schedule_item));
+		if(!items)
+			return -2;
+		schedule->items = items;
+		schedule->size = size;
+	}
+	/* Add at the bottom, and move up where it belongs */
+	schedule->items[schedule->count].resource = resource;
+	schedule->items[schedule->count].deadline = deadline;
+	schedule->count++;
+	kiavc_schedule_sift_up(schedule, schedule->count - 1);
+	return 0;
+}
+
+/* Check if a resource is scheduled */
+bool kiavc_schedule_contains(kiavc_schedule *schedule, kiavc_resource *resource) {
+	if(!schedule || !resource || resource->schedule_index < 1 || resource->schedule_index > schedule->count)
+		return false;
+	return schedule->items[resource->schedule_index-1].resource == resource;
+}
+
+/* Remove a resource from the schedule */
+int kiavc_schedule_remove(kiavc_schedule *schedule, kiavc_resource *resource) {
+	if(!kiavc_schedule_contains(schedule, resource))
+		return -1;
+	int index = resource->schedule_index - 1;
+	resource->schedule_index = 0;
+	schedule->count--;
+	if(index == schedule->count)
+		return 0;
+	/* Fill the hole with the last item, and move it where it belongs */
+	Uint32 previous = schedule->items[index].deadline;
+	kiavc_schedule_place(schedule, index, &schedule->items[schedule->count]);
+	if(schedule->items[index].deadline < previous)
+		kiavc_schedule_sift_up(schedule, index);
+	else
+		kiavc_schedule_sift_down(schedule, index);
+	return 0;
+}
+
+/* Get the resource that's due first, and when, without removing it */
+kiavc_resource *kiavc_schedule_peek(kiavc_schedule *schedule, Uint32 *deadline) {
+	if(!schedule || schedule->count == 0)
+		return NULL;
+	if(deadline)
+		*deadline = schedule->items[0].deadline;
+	return schedule->items[0].resource;
+}
+
+/* Remove all resources from the schedule */
+void kiavc_schedule_clear(kiavc_schedule *schedule) {
+	if(!schedule)
+		return;
+	int i = 0;
+	for(i=0; i<schedule->count; i++)
+		schedule->items[i].resource->schedule_index = 0;
+	schedule->count = 0;
+}
+
+/* Destroy a schedule */
+void kiavc_schedule_destroy(kiavc_schedule *schedule) {
+	if(!schedule)
+		return;
+	SDL_free(schedule->items);
+	SDL_free(schedule);
+}
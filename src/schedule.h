@@ -0,0 +1,55 @@
+/*
+ *
+ * KIAVC schedule of timed updates. Resources that need to change at
+ * some point in the future (e.g., actors and objects whose animation
+ * will move to the next frame, or text lines that will need to be
+ * removed) are kept in a min-heap, sorted by when that will happen:
+ * this way, in each simulation step, we only need to look at the
+ * resources that are due, rather than checking all of them, and rooms
+ * full of static resources don't cost anything. Resources keep track
+ * of their position in the heap, which means rescheduling or removing
+ * a resource are O(log n) operations.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_SCHEDULE_H
+#define __KIAVC_SCHEDULE_H
+
+#include <stdbool.h>
+
+#include "resources.h"
+
+/* Scheduled update */
+typedef struct kiavc_schedule_item {
+	/* Resource to update */
+	kiavc_resource *resource;
+	/* When the resource needs to be updated (ticks) */
+	Uint32 deadline;
+} kiavc_schedule_item;
+
+/* Schedule */
+typedef struct kiavc_schedule {
+	/* Heap of scheduled updates */
+	kiavc_schedule_item *items;
+	/* Number of items, and size of the array */
+	int count, size;
+} kiavc_schedule;
+
+/* Create a new schedule */
+kiavc_schedule *kiavc_schedule_create(void);
+/* Schedule an update for a resource, or change when it's due if it's scheduled already */
+int kiavc_schedule_set(kiavc_schedule *schedule, kiavc_resource *resource, Uint32 deadline);
+/* Check if a resource is scheduled */
+bool kiavc_schedule_contains(kiavc_schedule *schedule, kiavc_resource *resource);
+/* Remove a resource from the schedule */
+int kiavc_schedule_remove(kiavc_schedule *schedule, kiavc_resource *resource);
+/* Get the resource that's due first, and when, without removing it */
+kiavc_resource *kiavc_schedule_peek(kiavc_schedule *schedule, Uint32 *deadline);
+/* Remove all resources from the schedule */
+void kiavc_schedule_clear(kiavc_schedule *schedule);
+/* Destroy a schedule */
+void kiavc_schedule_destroy(kiavc_schedule *schedule);
+
+#endif
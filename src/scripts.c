@@ -20,6 +20,8 @@
 #include "engine.h"
 #include "scripts.h"
 #include "version.h"
+#include "trace.h"
+#include "pipeline.h"
 
 /* Lua state */
 static lua_State *lua_state = NULL;
@@ -58,6 +60,18 @@ static int kiavc_lua_method_getfullscreen(lua_State *s);
 static int kiavc_lua_method_setscanlines(lua_State *s);
 /* Check the scanlines mode */
 static int kiavc_lua_method_getscanlines(lua_State *s);
+/* Set whether to only redraw what changed on screen */
+static int kiavc_lua_method_setdirtyrects(lua_State *s);
+/* Check whether we only redraw what changed on screen */
+static int kiavc_lua_method_getdirtyrects(lua_State *s);
+/* Set whether sprites should be composited on the GPU or the CPU */
+static int kiavc_lua_method_setcompositor(lua_State *s);
+/* Check whether sprites are composited on the GPU or the CPU */
+static int kiavc_lua_method_getcompositor(lua_State *s);
+/* Set whether to update the world while presenting the previous frame */
+static int kiavc_lua_method_setpipelining(lua_State *s);
+/* Check whether we update the world while presenting the previous frame */
+static int kiavc_lua_method_getpipelining(lua_State *s);
 /* Set whether to debug objects or not */
 static int kiavc_lua_method_debugobjects(lua_State *s);
 /* Check whether objects debugging is on or not */
@@ -66,8 +80,34 @@ static int kiavc_lua_method_isdebuggingobjects(lua_State *s);
 static int kiavc_lua_method_debugwalkboxes(lua_State *s);
 /* Check whether walkboxes debugging is on or not */
 static int kiavc_lua_method_isdebuggingwalkboxes(lua_State *s);
+/* Set whether to show the overdraw heatmap or not */
+static int kiavc_lua_method_debugoverdraw(lua_State *s);
+/* Check whether the overdraw heatmap is on or not */
+static int kiavc_lua_method_isdebuggingoverdraw(lua_State *s);
+/* Set whether to show the profiler overlay or not */
+static int kiavc_lua_method_debugprofiler(lua_State *s);
+/* Check whether the profiler overlay is on or not */
+static int kiavc_lua_method_isdebuggingprofiler(lua_State *s);
+/* Get the frame timing statistics */
+static int kiavc_lua_method_getframestats(lua_State *s);
+/* Get the statistics on the last rendered frame */
+static int kiavc_lua_method_getrenderstats(lua_State *s);
+/* Set how often the render statistics should be logged */
+static int kiavc_lua_method_logrenderstats(lua_State *s);
 /* Save a screenshot */
 static int kiavc_lua_method_savescreenshot(lua_State *s);
+/* Start tracing */
+static int kiavc_lua_method_starttrace(lua_State *s);
+/* Stop tracing and save the trace */
+static int kiavc_lua_method_stoptrace(lua_State *s);
+/* Start capturing what's rendered */
+static int kiavc_lua_method_startcapture(lua_State *s);
+/* Stop capturing what's rendered */
+static int kiavc_lua_method_stopcapture(lua_State *s);
+/* Open a trace zone */
+static int kiavc_lua_method_tracebegin(lua_State *s);
+/* Close the most recent trace zone */
+static int kiavc_lua_method_traceend(lua_State *s);
 /* Enable the console and specify which font to use */
 static int kiavc_lua_method_enableconsole(lua_State *s);
 /* Show the console */
@@ -172,7 +212,7 @@ static int kiavc_lua_method_setactoralpha(lua_State *s);
 static int kiavc_lua_method_setactorplane(lua_State *s);
 /* Set the movement speed for the actor */
 static int kiavc_lua_method_setactorspeed(lua_State *s);
-/* Scale an actor */
+/* Scale an actor, optionally over some time */
 static int kiavc_lua_method_scaleactor(lua_State *s);
 /* Walk an actor to some coordinates */
 static int kiavc_lua_method_walkactorto(lua_State *s);
@@ -228,7 +268,7 @@ static int kiavc_lua_method_setobjectalpha(lua_State *s);
 static int kiavc_lua_method_setobjectplane(lua_State *s);
 /* Set the state for the object */
 static int kiavc_lua_method_setobjectstate(lua_State *s);
-/* Scale an object */
+/* Scale an object, optionally over some time */
 static int kiavc_lua_method_scaleobject(lua_State *s);
 /* Add an object to an actor's inventory */
 static int kiavc_lua_method_addobjecttoinventory(lua_State *s);
@@ -306,6 +346,43 @@ static char *kiavc_scripts_open_file(const char *path) {
 	return script;
 }
 
+/* When the world is updated on the pipeline worker, Lua methods that
+ * may end up using SDL are executed on the main thread instead: since we
+ * can't have Lua errors jump across threads, they're called protected */
+typedef struct kiavc_scripts_call {
+	lua_State *s;
+	lua_CFunction function;
+	int status;
+} kiavc_scripts_call;
+static void kiavc_scripts_call_main(void *data) {
+	kiavc_scripts_call *call = (kiavc_scripts_call *)data;
+	lua_pushcfunction(call->s, call->function);
+	lua_insert(call->s, 1);
+	call->status = lua_pcall(call->s, lua_gettop(call->s) - 1, LUA_MULTRET, 0);
+}
+static int kiavc_scripts_dispatch(lua_State *s) {
+	lua_CFunction function = lua_tocfunction(s, lua_upvalueindex(1));
+	if(!kiavc_pipeline_is_worker())
+		return function(s);
+	kiavc_scripts_call call = { .s = s, .function = function, .status = LUA_OK };
+	kiavc_pipeline_call(kiavc_scripts_call_main, &call);
+	if(call.status != LUA_OK)
+		return lua_error(s);
+	return lua_gettop(s);
+}
+
+/* Helper to register a Lua method: unless it's safe to call from any
+ * thread, we make sure it's always executed on the main thread */
+static void kiavc_scripts_register(const char *name, lua_CFunction function, bool main_thread) {
+	if(!main_thread) {
+		lua_register(lua_state, name, function);
+		return;
+	}
+	lua_pushcfunction(lua_state, function);
+	lua_pushcclosure(lua_state, kiavc_scripts_dispatch, 1);
+	lua_setglobal(lua_state, name);
+}
+
 /* Initialize Lua and load the main script */
 int kiavc_scripts_load(const char *path, const kiavc_scripts_callbacks *callbacks) {
 	if(!path || !callbacks)
@@ -316,119 +393,138 @@ int kiavc_scripts_load(const char *path, const kiavc_scripts_callbacks *callback
 	lua_state = luaL_newstate();
 	luaL_openlibs(lua_state);
 	/* Register our functions */
-	lua_register(lua_state, "kiavcRequire", kiavc_lua_method_kiavcrequire);
-	lua_register(lua_state, "getVersion", kiavc_lua_method_getversion);
-	lua_register(lua_state, "getVersionString", kiavc_lua_method_getversionstring);
-	lua_register(lua_state, "kiavcLog", kiavc_lua_method_kiavclog);
-	lua_register(lua_state, "kiavcError", kiavc_lua_method_kiavcerror);
-	lua_register(lua_state, "kiavcWarn", kiavc_lua_method_kiavcwarn);
-	lua_register(lua_state, "setResolution", kiavc_lua_method_setresolution);
-	lua_register(lua_state, "setTitle", kiavc_lua_method_settitle);
-	lua_register(lua_state, "setIcon", kiavc_lua_method_seticon);
-	lua_register(lua_state, "grabMouse", kiavc_lua_method_grabmouse);
-	lua_register(lua_state, "isGrabbingMouse", kiavc_lua_method_isgrabbingmouse);
-	lua_register(lua_state, "setFullscreen", kiavc_lua_method_setfullscreen);
-	lua_register(lua_state, "getFullscreen", kiavc_lua_method_getfullscreen);
-	lua_register(lua_state, "setScanlines", kiavc_lua_method_setscanlines);
-	lua_register(lua_state, "getScanlines", kiavc_lua_method_getscanlines);
-	lua_register(lua_state, "debugObjects", kiavc_lua_method_debugobjects);
-	lua_register(lua_state, "isDebuggingObjects", kiavc_lua_method_isdebuggingobjects);
-	lua_register(lua_state, "debugWalkboxes", kiavc_lua_method_debugwalkboxes);
-	lua_register(lua_state, "isDebuggingWalkboxes", kiavc_lua_method_isdebuggingwalkboxes);
-	lua_register(lua_state, "saveScreenshot", kiavc_lua_method_savescreenshot);
-	lua_register(lua_state, "enableConsole", kiavc_lua_method_enableconsole);
-	lua_register(lua_state, "showConsole", kiavc_lua_method_showconsole);
-	lua_register(lua_state, "hideConsole", kiavc_lua_method_hideconsole);
-	lua_register(lua_state, "disableConsole", kiavc_lua_method_disableconsole);
-	lua_register(lua_state, "isConsoleEnabled", kiavc_lua_method_isconsoleenabled);
-	lua_register(lua_state, "isConsoleVisible", kiavc_lua_method_isconsolevisible);
-	lua_register(lua_state, "enableInput", kiavc_lua_method_enableinput);
-	lua_register(lua_state, "disableInput", kiavc_lua_method_disableinput);
-	lua_register(lua_state, "isInputEnabled", kiavc_lua_method_isinputenabled);
-	lua_register(lua_state, "startCutscene", kiavc_lua_method_startcutscene);
-	lua_register(lua_state, "stopCutscene", kiavc_lua_method_stopcutscene);
-	lua_register(lua_state, "fadeIn", kiavc_lua_method_fadein);
-	lua_register(lua_state, "fadeOut", kiavc_lua_method_fadeout);
-	lua_register(lua_state, "startDialog", kiavc_lua_method_startdialog);
-	lua_register(lua_state, "addDialogLine", kiavc_lua_method_adddialogline);
-	lua_register(lua_state, "stopDialog", kiavc_lua_method_stopdialog);
-	lua_register(lua_state, "registerAnimation", kiavc_lua_method_registeranimation);
-	lua_register(lua_state, "registerFont", kiavc_lua_method_registerfont);
-	lua_register(lua_state, "registerCursor", kiavc_lua_method_registercursor);
-	lua_register(lua_state, "setCursorAnimation", kiavc_lua_method_setcursoranimation);
-	lua_register(lua_state, "setMainCursor", kiavc_lua_method_setmaincursor);
-	lua_register(lua_state, "setHotspotCursor", kiavc_lua_method_sethotspotcursor);
-	lua_register(lua_state, "showCursor", kiavc_lua_method_showcursor);
-	lua_register(lua_state, "hideCursor", kiavc_lua_method_hidecursor);
-	lua_register(lua_state, "showCursorText", kiavc_lua_method_showcursortext);
-	lua_register(lua_state, "hideCursorText", kiavc_lua_method_hidecursortext);
-	lua_register(lua_state, "registerAudio", kiavc_lua_method_registeraudio);
-	lua_register(lua_state, "playAudio", kiavc_lua_method_playaudio);
-	lua_register(lua_state, "pauseAudio", kiavc_lua_method_pauseaudio);
-	lua_register(lua_state, "resumeAudio", kiavc_lua_method_resumeaudio);
-	lua_register(lua_state, "stopAudio", kiavc_lua_method_stopaudio);
-	lua_register(lua_state, "registerRoom", kiavc_lua_method_registerroom);
-	lua_register(lua_state, "setRoomBackground", kiavc_lua_method_setroombackground);
-	lua_register(lua_state, "addRoomLayer", kiavc_lua_method_addroomlayer);
-	lua_register(lua_state, "removeRoomLayer", kiavc_lua_method_removeroomlayer);
-	lua_register(lua_state, "addRoomWalkbox", kiavc_lua_method_addroomwalkbox);
-	lua_register(lua_state, "enableRoomWalkbox", kiavc_lua_method_enableroomwalkbox);
-	lua_register(lua_state, "disableRoomWalkbox", kiavc_lua_method_disableroomwalkbox);
-	lua_register(lua_state, "recalculateRoomWalkboxes", kiavc_lua_method_recalculateroomwalkboxes);
-	lua_register(lua_state, "showRoom", kiavc_lua_method_showroom);
-	lua_register(lua_state, "registerActor", kiavc_lua_method_registeractor);
-	lua_register(lua_state, "setActorCostume", kiavc_lua_method_setactorcostume);
-	lua_register(lua_state, "moveActorTo", kiavc_lua_method_moveactorto);
-	lua_register(lua_state, "showActor", kiavc_lua_method_showactor);
-	lua_register(lua_state, "followActor", kiavc_lua_method_followactor);
-	lua_register(lua_state, "hideActor", kiavc_lua_method_hideactor);
-	lua_register(lua_state, "fadeActorIn", kiavc_lua_method_fadeactorin);
-	lua_register(lua_state, "fadeActorOut", kiavc_lua_method_fadeactorout);
-	lua_register(lua_state, "fadeActorTo", kiavc_lua_method_fadeactorto);
-	lua_register(lua_state, "setActorAlpha", kiavc_lua_method_setactoralpha);
-	lua_register(lua_state, "setActorPlane", kiavc_lua_method_setactorplane);
-	lua_register(lua_state, "setActorSpeed", kiavc_lua_method_setactorspeed);
-	lua_register(lua_state, "scaleActor", kiavc_lua_method_scaleactor);
-	lua_register(lua_state, "walkActorTo", kiavc_lua_method_walkactorto);
-	lua_register(lua_state, "sayActor", kiavc_lua_method_sayactor);
-	lua_register(lua_state, "setActorDirection", kiavc_lua_method_setactordirection);
-	lua_register(lua_state, "controlledActor", kiavc_lua_method_controlledactor);
-	lua_register(lua_state, "skipActorsText", kiavc_lua_method_skipactorstext);
-	lua_register(lua_state, "setActorState", kiavc_lua_method_setactorstate);
-	lua_register(lua_state, "registerCostume", kiavc_lua_method_registercostume);
-	lua_register(lua_state, "setCostumeAnimation", kiavc_lua_method_setcostumeanimation);
-	lua_register(lua_state, "registerObject", kiavc_lua_method_registerobject);
-	lua_register(lua_state, "setObjectAnimation", kiavc_lua_method_setobjectanimation);
-	lua_register(lua_state, "setObjectInteractable", kiavc_lua_method_setobjectinteractable);
-	lua_register(lua_state, "setObjectUi", kiavc_lua_method_setobjectui);
-	lua_register(lua_state, "setObjectUiPosition", kiavc_lua_method_setobjectuiposition);
-	lua_register(lua_state, "setObjectUiAnimation", kiavc_lua_method_setobjectuianimation);
-	lua_register(lua_state, "setObjectParent", kiavc_lua_method_setobjectparent);
-	lua_register(lua_state, "removeObjectParent", kiavc_lua_method_removeobjectparent);
-	lua_register(lua_state, "moveObjectTo", kiavc_lua_method_moveobjectto);
-	lua_register(lua_state, "floatObjectTo", kiavc_lua_method_floatobjectto);
-	lua_register(lua_state, "setObjectHover", kiavc_lua_method_setobjecthover);
-	lua_register(lua_state, "showObject", kiavc_lua_method_showobject);
-	lua_register(lua_state, "hideObject", kiavc_lua_method_hideobject);
-	lua_register(lua_state, "fadeObjectIn", kiavc_lua_method_fadeobjectin);
-	lua_register(lua_state, "fadeObjectOut", kiavc_lua_method_fadeobjectout);
-	lua_register(lua_state, "fadeObjectTo", kiavc_lua_method_fadeobjectto);
-	lua_register(lua_state, "setObjectAlpha", kiavc_lua_method_setobjectalpha);
-	lua_register(lua_state, "setObjectPlane", kiavc_lua_method_setobjectplane);
-	lua_register(lua_state, "setObjectState", kiavc_lua_method_setobjectstate);
-	lua_register(lua_state, "scaleObject", kiavc_lua_method_scaleobject);
-	lua_register(lua_state, "addObjectToInventory", kiavc_lua_method_addobjecttoinventory);
-	lua_register(lua_state, "removeObjectFromInventory", kiavc_lua_method_removeobjectfrominventory);
-	lua_register(lua_state, "showText", kiavc_lua_method_showtext);
-	lua_register(lua_state, "floatTextTo", kiavc_lua_method_floattextto);
-	lua_register(lua_state, "fadeTextIn", kiavc_lua_method_fadetextin);
-	lua_register(lua_state, "fadeTextOut", kiavc_lua_method_fadetextout);
-	lua_register(lua_state, "fadeTextTo", kiavc_lua_method_fadetextto);
-	lua_register(lua_state, "setTextAlpha", kiavc_lua_method_settextalpha);
-	lua_register(lua_state, "removeText", kiavc_lua_method_removetext);
-	lua_register(lua_state, "loadPlugin", kiavc_lua_method_load_plugin);
-	lua_register(lua_state, "isPluginLoaded", kiavc_lua_method_is_plugin_loaded);
-	lua_register(lua_state, "quit", kiavc_lua_method_quit);
+	kiavc_scripts_register("kiavcRequire", kiavc_lua_method_kiavcrequire, true);
+	kiavc_scripts_register("getVersion", kiavc_lua_method_getversion, false);
+	kiavc_scripts_register("getVersionString", kiavc_lua_method_getversionstring, false);
+	kiavc_scripts_register("kiavcLog", kiavc_lua_method_kiavclog, false);
+	kiavc_scripts_register("kiavcError", kiavc_lua_method_kiavcerror, false);
+	kiavc_scripts_register("kiavcWarn", kiavc_lua_method_kiavcwarn, false);
+	kiavc_scripts_register("setResolution", kiavc_lua_method_setresolution, true);
+	kiavc_scripts_register("setTitle", kiavc_lua_method_settitle, true);
+	kiavc_scripts_register("setIcon", kiavc_lua_method_seticon, true);
+	kiavc_scripts_register("grabMouse", kiavc_lua_method_grabmouse, true);
+	kiavc_scripts_register("isGrabbingMouse", kiavc_lua_method_isgrabbingmouse, false);
+	kiavc_scripts_register("setFullscreen", kiavc_lua_method_setfullscreen, true);
+	kiavc_scripts_register("getFullscreen", kiavc_lua_method_getfullscreen, false);
+	kiavc_scripts_register("setScanlines", kiavc_lua_method_setscanlines, true);
+	kiavc_scripts_register("getScanlines", kiavc_lua_method_getscanlines, false);
+	kiavc_scripts_register("setDirtyRects", kiavc_lua_method_setdirtyrects, false);
+	kiavc_scripts_register("getDirtyRects", kiavc_lua_method_getdirtyrects, false);
+	kiavc_scripts_register("setCompositor", kiavc_lua_method_setcompositor, false);
+	kiavc_scripts_register("getCompositor", kiavc_lua_method_getcompositor, false);
+	kiavc_scripts_register("setPipelining", kiavc_lua_method_setpipelining, false);
+	kiavc_scripts_register("getPipelining", kiavc_lua_method_getpipelining, false);
+	kiavc_scripts_register("debugObjects", kiavc_lua_method_debugobjects, false);
+	kiavc_scripts_register("isDebuggingObjects", kiavc_lua_method_isdebuggingobjects, false);
+	kiavc_scripts_register("debugWalkboxes", kiavc_lua_method_debugwalkboxes, false);
+	kiavc_scripts_register("isDebuggingWalkboxes", kiavc_lua_method_isdebuggingwalkboxes, false);
+	kiavc_scripts_register("debugOverdraw", kiavc_lua_method_debugoverdraw, true);
+	kiavc_scripts_register("isDebuggingOverdraw", kiavc_lua_method_isdebuggingoverdraw, false);
+	kiavc_scripts_register("debugProfiler", kiavc_lua_method_debugprofiler, false);
+	kiavc_scripts_register("isDebuggingProfiler", kiavc_lua_method_isdebuggingprofiler, false);
+	kiavc_scripts_register("getFrameStats", kiavc_lua_method_getframestats, false);
+	kiavc_scripts_register("getRenderStats", kiavc_lua_method_getrenderstats, false);
+	kiavc_scripts_register("logRenderStats", kiavc_lua_method_logrenderstats, false);
+	kiavc_scripts_register("saveScreenshot", kiavc_lua_method_savescreenshot, true);
+	kiavc_scripts_register("startTrace", kiavc_lua_method_starttrace, true);
+	kiavc_scripts_register("startCapture", kiavc_lua_method_startcapture, true);
+	kiavc_scripts_register("stopCapture", kiavc_lua_method_stopcapture, true);
+	kiavc_scripts_register("stopTrace", kiavc_lua_method_stoptrace, true);
+	kiavc_scripts_register("traceBegin", kiavc_lua_method_tracebegin, false);
+	kiavc_scripts_register("traceEnd", kiavc_lua_method_traceend, false);
+	kiavc_scripts_register("enableConsole", kiavc_lua_method_enableconsole, false);
+	kiavc_scripts_register("showConsole", kiavc_lua_method_showconsole, true);
+	kiavc_scripts_register("hideConsole", kiavc_lua_method_hideconsole, true);
+	kiavc_scripts_register("disableConsole", kiavc_lua_method_disableconsole, true);
+	kiavc_scripts_register("isConsoleEnabled", kiavc_lua_method_isconsoleenabled, false);
+	kiavc_scripts_register("isConsoleVisible", kiavc_lua_method_isconsolevisible, false);
+	kiavc_scripts_register("enableInput", kiavc_lua_method_enableinput, false);
+	kiavc_scripts_register("disableInput", kiavc_lua_method_disableinput, true);
+	kiavc_scripts_register("isInputEnabled", kiavc_lua_method_isinputenabled, false);
+	kiavc_scripts_register("startCutscene", kiavc_lua_method_startcutscene, true);
+	kiavc_scripts_register("stopCutscene", kiavc_lua_method_stopcutscene, false);
+	kiavc_scripts_register("fadeIn", kiavc_lua_method_fadein, false);
+	kiavc_scripts_register("fadeOut", kiavc_lua_method_fadeout, false);
+	kiavc_scripts_register("startDialog", kiavc_lua_method_startdialog, false);
+	kiavc_scripts_register("addDialogLine", kiavc_lua_method_adddialogline, true);
+	kiavc_scripts_register("stopDialog", kiavc_lua_method_stopdialog, true);
+	kiavc_scripts_register("registerAnimation", kiavc_lua_method_registeranimation, false);
+	kiavc_scripts_register("registerFont", kiavc_lua_method_registerfont, true);
+	kiavc_scripts_register("registerCursor", kiavc_lua_method_registercursor, false);
+	kiavc_scripts_register("setCursorAnimation", kiavc_lua_method_setcursoranimation, false);
+	kiavc_scripts_register("setMainCursor", kiavc_lua_method_setmaincursor, false);
+	kiavc_scripts_register("setHotspotCursor", kiavc_lua_method_sethotspotcursor, false);
+	kiavc_scripts_register("showCursor", kiavc_lua_method_showcursor, false);
+	kiavc_scripts_register("hideCursor", kiavc_lua_method_hidecursor, false);
+	kiavc_scripts_register("showCursorText", kiavc_lua_method_showcursortext, true);
+	kiavc_scripts_register("hideCursorText", kiavc_lua_method_hidecursortext, true);
+	kiavc_scripts_register("registerAudio", kiavc_lua_method_registeraudio, true);
+	kiavc_scripts_register("playAudio", kiavc_lua_method_playaudio, true);
+	kiavc_scripts_register("pauseAudio", kiavc_lua_method_pauseaudio, true);
+	kiavc_scripts_register("resumeAudio", kiavc_lua_method_resumeaudio, true);
+	kiavc_scripts_register("stopAudio", kiavc_lua_method_stopaudio, true);
+	kiavc_scripts_register("registerRoom", kiavc_lua_method_registerroom, false);
+	kiavc_scripts_register("setRoomBackground", kiavc_lua_method_setroombackground, true);
+	kiavc_scripts_register("addRoomLayer", kiavc_lua_method_addroomlayer, false);
+	kiavc_scripts_register("removeRoomLayer", kiavc_lua_method_removeroomlayer, true);
+	kiavc_scripts_register("addRoomWalkbox", kiavc_lua_method_addroomwalkbox, false);
+	kiavc_scripts_register("enableRoomWalkbox", kiavc_lua_method_enableroomwalkbox, false);
+	kiavc_scripts_register("disableRoomWalkbox", kiavc_lua_method_disableroomwalkbox, false);
+	kiavc_scripts_register("recalculateRoomWalkboxes", kiavc_lua_method_recalculateroomwalkboxes, false);
+	kiavc_scripts_register("showRoom", kiavc_lua_method_showroom, true);
+	kiavc_scripts_register("registerActor", kiavc_lua_method_registeractor, false);
+	kiavc_scripts_register("setActorCostume", kiavc_lua_method_setactorcostume, true);
+	kiavc_scripts_register("moveActorTo", kiavc_lua_method_moveactorto, true);
+	kiavc_scripts_register("showActor", kiavc_lua_method_showactor, false);
+	kiavc_scripts_register("followActor", kiavc_lua_method_followactor, false);
+	kiavc_scripts_register("hideActor", kiavc_lua_method_hideactor, true);
+	kiavc_scripts_register("fadeActorIn", kiavc_lua_method_fadeactorin, false);
+	kiavc_scripts_register("fadeActorOut", kiavc_lua_method_fadeactorout, false);
+	kiavc_scripts_register("fadeActorTo", kiavc_lua_method_fadeactorto, false);
+	kiavc_scripts_register("setActorAlpha", kiavc_lua_method_setactoralpha, false);
+	kiavc_scripts_register("setActorPlane", kiavc_lua_method_setactorplane, false);
+	kiavc_scripts_register("setActorSpeed", kiavc_lua_method_setactorspeed, false);
+	kiavc_scripts_register("scaleActor", kiavc_lua_method_scaleactor, false);
+	kiavc_scripts_register("walkActorTo", kiavc_lua_method_walkactorto, false);
+	kiavc_scripts_register("sayActor", kiavc_lua_method_sayactor, true);
+	kiavc_scripts_register("setActorDirection", kiavc_lua_method_setactordirection, false);
+	kiavc_scripts_register("controlledActor", kiavc_lua_method_controlledactor, false);
+	kiavc_scripts_register("skipActorsText", kiavc_lua_method_skipactorstext, false);
+	kiavc_scripts_register("setActorState", kiavc_lua_method_setactorstate, false);
+	kiavc_scripts_register("registerCostume", kiavc_lua_method_registercostume, false);
+	kiavc_scripts_register("setCostumeAnimation", kiavc_lua_method_setcostumeanimation, false);
+	kiavc_scripts_register("registerObject", kiavc_lua_method_registerobject, false);
+	kiavc_scripts_register("setObjectAnimation", kiavc_lua_method_setobjectanimation, false);
+	kiavc_scripts_register("setObjectInteractable", kiavc_lua_method_setobjectinteractable, false);
+	kiavc_scripts_register("setObjectUi", kiavc_lua_method_setobjectui, false);
+	kiavc_scripts_register("setObjectUiPosition", kiavc_lua_method_setobjectuiposition, false);
+	kiavc_scripts_register("setObjectUiAnimation", kiavc_lua_method_setobjectuianimation, false);
+	kiavc_scripts_register("setObjectParent", kiavc_lua_method_setobjectparent, false);
+	kiavc_scripts_register("removeObjectParent", kiavc_lua_method_removeobjectparent, false);
+	kiavc_scripts_register("moveObjectTo", kiavc_lua_method_moveobjectto, true);
+	kiavc_scripts_register("floatObjectTo", kiavc_lua_method_floatobjectto, false);
+	kiavc_scripts_register("setObjectHover", kiavc_lua_method_setobjecthover, false);
+	kiavc_scripts_register("showObject", kiavc_lua_method_showobject, false);
+	kiavc_scripts_register("hideObject", kiavc_lua_method_hideobject, true);
+	kiavc_scripts_register("fadeObjectIn", kiavc_lua_method_fadeobjectin, false);
+	kiavc_scripts_register("fadeObjectOut", kiavc_lua_method_fadeobjectout, false);
+	kiavc_scripts_register("fadeObjectTo", kiavc_lua_method_fadeobjectto, false);
+	kiavc_scripts_register("setObjectAlpha", kiavc_lua_method_setobjectalpha, false);
+	kiavc_scripts_register("setObjectPlane", kiavc_lua_method_setobjectplane, false);
+	kiavc_scripts_register("setObjectState", kiavc_lua_method_setobjectstate, true);
+	kiavc_scripts_register("scaleObject", kiavc_lua_method_scaleobject, false);
+	kiavc_scripts_register("addObjectToInventory", kiavc_lua_method_addobjecttoinventory, false);
+	kiavc_scripts_register("removeObjectFromInventory", kiavc_lua_method_removeobjectfrominventory, false);
+	kiavc_scripts_register("showText", kiavc_lua_method_showtext, true);
+	kiavc_scripts_register("floatTextTo", kiavc_lua_method_floattextto, false);
+	kiavc_scripts_register("fadeTextIn", kiavc_lua_method_fadetextin, false);
+	kiavc_scripts_register("fadeTextOut", kiavc_lua_method_fadetextout, false);
+	kiavc_scripts_register("fadeTextTo", kiavc_lua_method_fadetextto, false);
+	kiavc_scripts_register("setTextAlpha", kiavc_lua_method_settextalpha, false);
+	kiavc_scripts_register("removeText", kiavc_lua_method_removetext, true);
+	kiavc_scripts_register("loadPlugin", kiavc_lua_method_load_plugin, true);
+	kiavc_scripts_register("isPluginLoaded", kiavc_lua_method_is_plugin_loaded, false);
+	kiavc_scripts_register("quit", kiavc_lua_method_quit, false);
 	/* Set the scripts folder */
 	lua_getglobal(lua_state, "package");
 	lua_getfield(lua_state, -1, "path");
@@ -477,24 +573,30 @@ void kiavc_scripts_run_command(const char *fmt, ...) {
 	va_start(args, fmt);
 	SDL_vsnprintf(command, sizeof(command)-1, fmt, args);
 	va_end(args);
+	kiavc_trace_begin("run_command", command);
 	lua_getglobal(lua_state, "runCommand");
 	lua_pushstring(lua_state, command);
 	if(lua_pcall(lua_state, 1, 0, 0) != 0) {
 		SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Error running function `runCommand': %s",
 			lua_tostring(lua_state, -1));
 	}
+	kiavc_trace_end();
 }
 
 /* Update the world in the script */
-int kiavc_scripts_update_world(Uint32 ticks) {
+int kiavc_scripts_update_world(Uint32 ticks, Uint32 *wakeup) {
 	/* We invoke the updateWorld() function in the Lua script */
 	lua_getglobal(lua_state, "updateWorld");
 	lua_pushnumber(lua_state, ticks);
-	if(lua_pcall(lua_state, 1, 0, 0) != 0) {
+	if(lua_pcall(lua_state, 1, 1, 0) != 0) {
 		SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Error running function `updateWorld': %s",
 			lua_tostring(lua_state, -1));
 		return -1;
 	}
+	/* The function may return when the next timer expires */
+	if(wakeup)
+		*wakeup = lua_isnumber(lua_state, -1) ? (Uint32)lua_tonumber(lua_state, -1) : 0;
+	lua_pop(lua_state, 1);
 	return 0;
 }
 
@@ -502,7 +604,7 @@ int kiavc_scripts_update_world(Uint32 ticks) {
 void kiavc_scripts_register_function(const char *name, int (* const function)(void *s)) {
 	if(!lua_state)
 		return;
-	lua_register(lua_state, name, (lua_CFunction)function);
+	kiavc_scripts_register(name, (lua_CFunction)function, true);
 }
 
 /* Close the script engine */
@@ -735,6 +837,70 @@ static int kiavc_lua_method_getscanlines(lua_State *s) {
 	return 1;
 }
 
+/* Set whether to only redraw what changed on screen */
+static int kiavc_lua_method_setdirtyrects(lua_State *s) {
+	/* This method allows the Lua script to enable or disable dirty rectangles */
+	int n = lua_gettop(s), exp = 1;
+	if(n < exp) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d)\n", n, exp);
+		return KIAVC_LUA_RESULT(s, false);
+	}
+	bool enabled = lua_toboolean(s, 1);
+	/* Invoke the application callback to enforce this */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->set_dirty_rects(enabled));
+}
+
+/* Check whether we only redraw what changed on screen */
+static int kiavc_lua_method_getdirtyrects(lua_State *s) {
+	/* This method allows the Lua script check if dirty rectangles are enabled */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->get_dirty_rects());
+}
+
+/* Set whether sprites should be composited on the GPU or the CPU */
+static int kiavc_lua_method_setcompositor(lua_State *s) {
+	/* This method allows the Lua script to pick the compositor at startup */
+	int n = lua_gettop(s), exp = 1;
+	if(n < exp) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d)\n", n, exp);
+		return KIAVC_LUA_RESULT(s, false);
+	}
+	const char *name = luaL_checkstring(s, 1);
+	if(name == NULL) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Missing compositor\n");
+		return KIAVC_LUA_RESULT(s, false);
+	}
+	/* Invoke the application callback to enforce this */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->set_compositor(name));
+}
+
+/* Check whether sprites are composited on the GPU or the CPU */
+static int kiavc_lua_method_getcompositor(lua_State *s) {
+	/* This method allows the Lua script check which compositor is in use */
+	const char *name = kiavc_cb->get_compositor();
+	/* Pass the response back to the stack */
+	lua_pushstring(s, name);
+	return 1;
+}
+
+/* Set whether to update the world while presenting the previous frame */
+static int kiavc_lua_method_setpipelining(lua_State *s) {
+	/* This method allows the Lua script to enable or disable the update pipeline */
+	int n = lua_gettop(s), exp = 1;
+	if(n < exp) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d)\n", n, exp);
+		return KIAVC_LUA_RESULT(s, false);
+	}
+	bool enabled = lua_toboolean(s, 1);
+	/* Invoke the application callback to enforce this */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->set_pipelining(enabled));
+}
+
+/* Check whether we update the world while presenting the previous frame */
+static int kiavc_lua_method_getpipelining(lua_State *s) {
+	/* This method allows the Lua script check if the update pipeline is enabled */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->get_pipelining());
+}
+
 /* Set whether to debug objects or not */
 static int kiavc_lua_method_debugobjects(lua_State *s) {
 	/* This method allows the Lua script to debug objects */
@@ -773,6 +939,122 @@ static int kiavc_lua_method_isdebuggingwalkboxes(lua_State *s) {
 	return KIAVC_LUA_RESULT(s, kiavc_cb->is_debugging_walkboxes());
 }
 
+/* Set whether to show the overdraw heatmap or not */
+static int kiavc_lua_method_debugoverdraw(lua_State *s) {
+	/* This method allows the Lua script to show the overdraw heatmap */
+	int n = lua_gettop(s), exp = 1;
+	if(n < exp) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d)\n", n, exp);
+		return KIAVC_LUA_RESULT(s, false);
+	}
+	bool debug = lua_toboolean(s, 1);
+	/* Invoke the application callback to enforce this */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->debug_overdraw(debug));
+}
+
+/* Check whether the overdraw heatmap is on or not */
+static int kiavc_lua_method_isdebuggingoverdraw(lua_State *s) {
+	/* This method allows the Lua script check if the overdraw heatmap is enabled */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->is_debugging_overdraw());
+}
+
+/* Set whether to show the profiler overlay or not */
+static int kiavc_lua_method_debugprofiler(lua_State *s) {
+	/* This method allows the Lua script to show the profiler overlay */
+	int n = lua_gettop(s), exp = 1;
+	if(n < exp) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d)\n", n, exp);
+		return KIAVC_LUA_RESULT(s, false);
+	}
+	bool debug = lua_toboolean(s, 1);
+	/* Invoke the application callback to enforce this */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->debug_profiler(debug));
+}
+
+/* Check whether the profiler overlay is on or not */
+static int kiavc_lua_method_isdebuggingprofiler(lua_State *s) {
+	/* This method allows the Lua script check if the profiler overlay is enabled */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->is_debugging_profiler());
+}
+
+/* Get the frame timing statistics */
+static int kiavc_lua_method_getframestats(lua_State *s) {
+	/* This method allows the Lua script to retrieve the frame timing
+	 * statistics, as a table indexed by phase name: each phase is a
+	 * table with the number of samples, and avg/p50/p95/p99/max in ms */
+	kiavc_profiler_stats stats = { 0 };
+	lua_newtable(s);
+	int phase = 0;
+	for(phase=0; phase<KIAVC_PROFILER_PHASES; phase++) {
+		if(!kiavc_cb->get_frame_stats(phase, &stats))
+			continue;
+		lua_newtable(s);
+		lua_pushinteger(s, stats.samples);
+		lua_setfield(s, -2, "samples");
+		lua_pushnumber(s, stats.avg);
+		lua_setfield(s, -2, "avg");
+		lua_pushnumber(s, stats.p50);
+		lua_setfield(s, -2, "p50");
+		lua_pushnumber(s, stats.p95);
+		lua_setfield(s, -2, "p95");
+		lua_pushnumber(s, stats.p99);
+		lua_setfield(s, -2, "p99");
+		lua_pushnumber(s, stats.max);
+		lua_setfield(s, -2, "max");
+		lua_setfield(s, -2, kiavc_profiler_phase_name(phase));
+	}
+	return 1;
+}
+
+/* Get the statistics on the last rendered frame */
+static int kiavc_lua_method_getrenderstats(lua_State *s) {
+	/* This method allows the Lua script to retrieve what was drawn in
+	 * the last frame (draw calls, sprites, culled resources, etc.) */
+	kiavc_render_stats stats = { 0 };
+	if(!kiavc_cb->get_render_stats(&stats))
+		return KIAVC_LUA_RESULT(s, false);
+	lua_newtable(s);
+	lua_pushinteger(s, stats.draw_calls);
+	lua_setfield(s, -2, "drawCalls");
+	lua_pushinteger(s, stats.sprites);
+	lua_setfield(s, -2, "sprites");
+	lua_pushinteger(s, stats.texture_switches);
+	lua_setfield(s, -2, "textureSwitches");
+	lua_pushinteger(s, stats.fill_rects);
+	lua_setfield(s, -2, "fillRects");
+	lua_pushinteger(s, stats.plugin_renders);
+	lua_setfield(s, -2, "pluginRenders");
+	lua_pushinteger(s, stats.resources_drawn);
+	lua_setfield(s, -2, "drawn");
+	lua_pushinteger(s, stats.resources_culled);
+	lua_setfield(s, -2, "culled");
+	lua_pushinteger(s, stats.resources_occluded);
+	lua_setfield(s, -2, "occluded");
+	lua_pushinteger(s, stats.state_changes);
+	lua_setfield(s, -2, "stateChanges");
+	lua_pushinteger(s, stats.state_changes_avoided);
+	lua_setfield(s, -2, "stateChangesAvoided");
+	lua_pushinteger(s, stats.pixels);
+	lua_setfield(s, -2, "pixels");
+	lua_pushnumber(s, stats.overdraw);
+	lua_setfield(s, -2, "overdraw");
+	return 1;
+}
+
+/* Set how often the render statistics should be logged */
+static int kiavc_lua_method_logrenderstats(lua_State *s) {
+	/* This method allows the Lua script to log the render statistics
+	 * every few seconds (0 disables logging) */
+	int n = lua_gettop(s), exp = 1;
+	if(n < exp) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d)\n", n, exp);
+		return KIAVC_LUA_RESULT(s, false);
+	}
+	int seconds = lua_tointeger(s, 1);
+	/* Invoke the application callback to enforce this */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->log_render_stats(seconds));
+}
+
 /* Save a screenshot */
 static int kiavc_lua_method_savescreenshot(lua_State *s) {
 	/* This method allows the Lua script to save a screenshot */
@@ -790,6 +1072,74 @@ static int kiavc_lua_method_savescreenshot(lua_State *s) {
 	return KIAVC_LUA_RESULT(s, kiavc_cb->save_screenshot(path));
 }
 
+/* Start tracing */
+static int kiavc_lua_method_starttrace(lua_State *s) {
+	/* This method allows the Lua script to start tracing */
+	int n = lua_gettop(s), exp = 1;
+	if(n < exp) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d)\n", n, exp);
+		return KIAVC_LUA_RESULT(s, false);
+	}
+	const char *path = luaL_checkstring(s, 1);
+	if(path == NULL) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Missing trace path\n");
+		return KIAVC_LUA_RESULT(s, false);
+	}
+	/* Invoke the application callback to enforce this */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->start_trace(path));
+}
+
+/* Stop tracing and save the trace */
+static int kiavc_lua_method_stoptrace(lua_State *s) {
+	/* This method allows the Lua script to stop tracing */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->stop_trace());
+}
+
+/* Start capturing what's rendered */
+static int kiavc_lua_method_startcapture(lua_State *s) {
+	/* This method allows the Lua script to capture what's rendered in
+	 * the next frames, optionally specifying how many frames */
+	int n = lua_gettop(s), exp = 1;
+	if(n < exp) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d)\n", n, exp);
+		return KIAVC_LUA_RESULT(s, false);
+	}
+	const char *path = luaL_checkstring(s, 1);
+	if(path == NULL) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Missing capture path\n");
+		return KIAVC_LUA_RESULT(s, false);
+	}
+	int frames = n > 1 ? luaL_checknumber(s, 2) : 0;
+	/* Invoke the application callback to enforce this */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->start_capture(path, frames));
+}
+
+/* Stop capturing what's rendered */
+static int kiavc_lua_method_stopcapture(lua_State *s) {
+	/* This method allows the Lua script to stop capturing before all frames are captured */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->stop_capture());
+}
+
+/* Open a trace zone */
+static int kiavc_lua_method_tracebegin(lua_State *s) {
+	/* This method allows the Lua script to open a trace zone */
+	int n = lua_gettop(s), exp = 1;
+	if(n < exp) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d)\n", n, exp);
+		return KIAVC_LUA_RESULT(s, false);
+	}
+	const char *name = luaL_checkstring(s, 1);
+	const char *detail = n > 1 ? luaL_checkstring(s, 2) : NULL;
+	/* Invoke the application callback to enforce this */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->trace_begin(name, detail));
+}
+
+/* Close the most recent trace zone */
+static int kiavc_lua_method_traceend(lua_State *s) {
+	/* This method allows the Lua script to close a trace zone */
+	return KIAVC_LUA_RESULT(s, kiavc_cb->trace_end());
+}
+
 /* Enable the console and specify which font to use */
 static int kiavc_lua_method_enableconsole(lua_State *s) {
 	/* This method allows the Lua script to enable the scripting console */
@@ -1692,21 +2042,22 @@ static int kiavc_lua_method_setactorspeed(lua_State *s) {
 	return KIAVC_LUA_RESULT(s, kiavc_cb->set_actor_speed(id, speed));
 }
 
-/* Scale an actor */
+/* Scale an actor, optionally over some time */
 static int kiavc_lua_method_scaleactor(lua_State *s) {
-	int n = lua_gettop(s), exp = 2;
-	if(n < exp) {
-		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d)\n", n, exp);
+	int n = lua_gettop(s), exp = 2, exp2 = 3;
+	if(n < exp && n < exp2) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d or %d)\n", n, exp, exp2);
 		return KIAVC_LUA_RESULT(s, false);
 	}
 	const char *id = luaL_checkstring(s, 1);
 	float scale = luaL_checknumber(s, 2);
-	if(id == NULL) {
-		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Missing actor ID\n");
+	int ms = (n == 3 && !lua_isnil(s, 3) ? luaL_checknumber(s, 3) : 0);
+	if(id == NULL || ms < 0) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Missing actor ID or invalid duration\n");
 		return KIAVC_LUA_RESULT(s, false);
 	}
 	/* Invoke the application callback to enforce this */
-	return KIAVC_LUA_RESULT(s, kiavc_cb->scale_actor(id, scale));
+	return KIAVC_LUA_RESULT(s, kiavc_cb->scale_actor(id, scale, ms));
 }
 
 /* Walk an actor to some coordinates */
@@ -2217,21 +2568,22 @@ static int kiavc_lua_method_setobjectstate(lua_State *s) {
 	return KIAVC_LUA_RESULT(s, kiavc_cb->set_object_state(id, state));
 }
 
-/* Scale an object */
+/* Scale an object, optionally over some time */
 static int kiavc_lua_method_scaleobject(lua_State *s) {
-	int n = lua_gettop(s), exp = 2;
-	if(n < exp) {
-		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d)\n", n, exp);
+	int n = lua_gettop(s), exp = 2, exp2 = 3;
+	if(n < exp && n < exp2) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Wrong number of arguments: %d (expected %d or %d)\n", n, exp, exp2);
 		return KIAVC_LUA_RESULT(s, false);
 	}
 	const char *id = luaL_checkstring(s, 1);
 	float scale = luaL_checknumber(s, 2);
-	if(id == NULL) {
-		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Missing object ID\n");
+	int ms = (n == 3 && !lua_isnil(s, 3) ? luaL_checknumber(s, 3) : 0);
+	if(id == NULL || ms < 0) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "[Lua] Missing object ID or invalid duration\n");
 		return KIAVC_LUA_RESULT(s, false);
 	}
 	/* Invoke the application callback to enforce this */
-	return KIAVC_LUA_RESULT(s, kiavc_cb->scale_object(id, scale));
+	return KIAVC_LUA_RESULT(s, kiavc_cb->scale_object(id, scale, ms));
 }
 
 /* Add an object to an actor's inventory */
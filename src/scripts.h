@@ -16,6 +16,8 @@
 
 #include <stdbool.h>
 
+#include "profiler.h"
+
 /* Callbacks to notify the main application about calls from Lua scripts */
 typedef struct kiavc_scripts_callbacks {
 	bool (* const set_resolution)(int width, int height, int fps, int scale);
@@ -27,11 +29,30 @@ typedef struct kiavc_scripts_callbacks {
 	bool (* const get_fullscreen)(void);
 	bool (* const set_scanlines)(int alpha);
 	int (* const get_scanlines)(void);
+	bool (* const set_dirty_rects)(bool enabled);
+	bool (* const get_dirty_rects)(void);
+	bool (* const set_compositor)(const char *name);
+	const char *(* const get_compositor)(void);
+	bool (* const set_pipelining)(bool enabled);
+	bool (* const get_pipelining)(void);
 	bool (* const debug_objects)(bool debug);
 	bool (* const is_debugging_objects)(void);
 	bool (* const debug_walkboxes)(bool debug);
 	bool (* const is_debugging_walkboxes)(void);
+	bool (* const debug_overdraw)(bool debug);
+	bool (* const is_debugging_overdraw)(void);
+	bool (* const debug_profiler)(bool debug);
+	bool (* const is_debugging_profiler)(void);
+	bool (* const get_frame_stats)(int phase, kiavc_profiler_stats *stats);
+	bool (* const get_render_stats)(kiavc_render_stats *stats);
+	bool (* const log_render_stats)(int seconds);
 	bool (* const save_screenshot)(const char *path);
+	bool (* const start_trace)(const char *path);
+	bool (* const stop_trace)(void);
+	bool (* const start_capture)(const char *path, int frames);
+	bool (* const stop_capture)(void);
+	bool (* const trace_begin)(const char *name, const char *detail);
+	bool (* const trace_end)(void);
 	bool (* const enable_console)(const char *font);
 	bool (* const show_console)(void);
 	bool (* const hide_console)(void);
@@ -84,7 +105,7 @@ typedef struct kiavc_scripts_callbacks {
 	bool (* const set_actor_alpha)(const char *id, int alpha);
 	bool (* const set_actor_plane)(const char *id, int zplane);
 	bool (* const set_actor_speed)(const char *id, int speed);
-	bool (* const scale_actor)(const char *id, float scale);
+	bool (* const scale_actor)(const char *id, float scale, int ms);
 	bool (* const walk_actor_to)(const char *id, int x, int y);
 	bool (* const say_actor)(const char *id, const char *text, const char *font, SDL_Color *color, SDL_Color *outline);
 	bool (* const set_actor_direction)(const char *id, const char *direction);
@@ -110,7 +131,7 @@ typedef struct kiavc_scripts_callbacks {
 	bool (* const set_object_alpha)(const char *id, int alpha);
 	bool (* const set_object_plane)(const char *id, int zplane);
 	bool (* const set_object_state)(const char *id, const char *state);
-	bool (* const scale_object)(const char *id, float scale);
+	bool (* const scale_object)(const char *id, float scale, int ms);
 	bool (* const add_object_to_inventory)(const char *id, const char *owner);
 	bool (* const remove_object_from_inventory)(const char *id, const char *owner);
 	bool (* const show_text)(const char *id, const char *text, const char *font, SDL_Color *color, SDL_Color *outline,
@@ -128,8 +149,8 @@ typedef struct kiavc_scripts_callbacks {
 int kiavc_scripts_load(const char *path, const kiavc_scripts_callbacks *callbacks);
 /* Run the provided script command */
 void kiavc_scripts_run_command(const char *fmt, ...);
-/* Update the world in the script */
-int kiavc_scripts_update_world(Uint32 ticks);
+/* Update the world in the script, and get when the next timer in the script expires (0 if none) */
+int kiavc_scripts_update_world(Uint32 ticks, Uint32 *wakeup);
 /* Register an external function */
 void kiavc_scripts_register_function(const char *name, int (* const function)(void *s));
 /* Close the script engine */
@@ -1,6 +1,13 @@
 /*
  *
- * KIAVC utility to create BAG archives.
+ * KIAVC utility to create BAG archives. Optionally, PNG images can be
+ * packed in a texture atlas as well, which the engine will then use
+ * to load and render images more efficiently: the original images are
+ * kept in the archive too, since color keyed animations can't use the
+ * atlas, and need to be loaded on their own: the tool finds them in the
+ * Lua scripts, and doesn't pack their images. The tool also looks for
+ * the opaque regions in PNG images, which the engine uses to avoid
+ * drawing things that are hidden by opaque layers or UI panels.
  *
  * Author: Lorenzo Miniero (lminiero@gmail.com)
  *
@@ -11,12 +18,21 @@
 #include <sys/stat.h>
 #include <errno.h>
 
+#include <SDL2/SDL_image.h>
+
 #include "../bag.h"
+#include "../atlas.h"
+#include "../opaque.h"
 #include "../version.h"
 
 /* BAG instance we'll write to */
 static kiavc_bag *bag = NULL;
 
+/* Size of the atlas pages, if we need to pack images */
+static int atlas_size = 0;
+/* Temporary files we created for the atlas and opaque regions */
+static kiavc_list *temp_files = NULL;
+
 static int add_asset(char *path) {
 	/* Check if it's a file or a folder */
 	struct stat s;
@@ -48,20 +64,382 @@ static int add_asset(char *path) {
 	return (kiavc_bag_add_asset(bag, path, path) ? 0 : -1);
 };
 
+/* Image to pack in the atlas */
+typedef struct atlas_image {
+	kiavc_bag_asset *asset;
+	SDL_Surface *surface;
+	int page, x, y;
+} atlas_image;
+
+/* Helper to sort images by height (and then width), which packs better */
+static int atlas_image_compare(const void *a, const void *b) {
+	const atlas_image *i1 = (const atlas_image *)a, *i2 = (const atlas_image *)b;
+	if(i1->surface->h != i2->surface->h)
+		return i2->surface->h - i1->surface->h;
+	return i2->surface->w - i1->surface->w;
+}
+
+/* Helper to read a whole file in memory, as a string */
+static char *read_file(const char *path) {
+	FILE *file = fopen(path, "rb");
+	if(!file)
+		return NULL;
+	fseek(file, 0L, SEEK_END);
+	long int size = ftell(file);
+	fseek(file, 0L, SEEK_SET);
+	char *content = size >= 0 ? SDL_malloc(size + 1) : NULL;
+	if(!content || fread(content, 1, size, file) != (size_t)size) {
+		SDL_free(content);
+		fclose(file);
+		return NULL;
+	}
+	content[size] = '\0';
+	fclose(file);
+	return content;
+}
+
+/* Color keyed images can't use the atlas, since transparency is applied
+ * when they're loaded: we look for the animations that need it in the
+ * Lua scripts, i.e., tables that have both a path and a transparency
+ * property (e.g., Animation:new({ path = '...', transparency = {...} })),
+ * and return a map of the images they refer to */
+static kiavc_map *find_color_keyed(void) {
+	kiavc_map *keyed = kiavc_map_create(NULL);
+	kiavc_list *list = bag->list;
+	kiavc_bag_asset *asset = NULL;
+	while(list) {
+		asset = (kiavc_bag_asset *)list->data;
+		list = list->next;
+		size_t len = SDL_strlen(asset->key);
+		if(len < 4 || SDL_strcasecmp(asset->key + len - 4, ".lua"))
+			continue;
+		char *script = read_file(asset->path);
+		if(!script)
+			continue;
+		char *property = script, *start = NULL, *end = NULL, *path = NULL, *value = NULL;
+		int depth = 0;
+		while((property = SDL_strstr(property, "transparency")) != NULL) {
+			/* Find the table this property belongs to */
+			depth = 0;
+			for(start = property; start > script; start--) {
+				if(*start == '}')
+					depth++;
+				else if(*start == '{' && depth-- == 0)
+					break;
+			}
+			depth = 0;
+			for(end = start; *end != '\0'; end++) {
+				if(*end == '{')
+					depth++;
+				else if(*end == '}' && --depth == 0)
+					break;
+			}
+			property += SDL_strlen("transparency");
+			if(*start != '{' || *end != '}')
+				continue;
+			/* Look for the path of the image in the same table */
+			for(path = start; (path = SDL_strstr(path, "path")) != NULL && path < end; path++) {
+				value = path + SDL_strlen("path");
+				while(*value == ' ' || *value == '\t')
+					value++;
+				if(*value++ != '=')
+					continue;
+				while(*value == ' ' || *value == '\t')
+					value++;
+				if(*value != '\'' && *value != '"')
+					continue;
+				char quote = *value++, *close = SDL_strchr(value, quote);
+				if(!close || close > end)
+					continue;
+				*close = '\0';
+				if(!kiavc_map_lookup(keyed, value)) {
+					SDL_Log("  -- Image '%s' is color keyed in '%s'\n", value, asset->key);
+					kiavc_map_insert(keyed, value, (void *)asset->key);
+				}
+				*close = quote;
+				break;
+			}
+		}
+		SDL_free(script);
+	}
+	return keyed;
+}
+
+/* Helper to repeat the edges of an image in the padding around it, so
+ * that sampling the image with linear filtering doesn't bleed in the
+ * transparent padding: since images share the padding between them,
+ * we only fill half of it, which is enough for linear filtering */
+static void extrude_image(SDL_Surface *page, const SDL_Rect *rect) {
+	int border = KIAVC_ATLAS_PADDING / 2, x = 0, y = 0, b = 0;
+	int pitch = page->pitch / sizeof(Uint32);
+	SDL_LockSurface(page);
+	Uint32 *pixels = (Uint32 *)page->pixels, *row = NULL;
+	/* Left and right edges first */
+	for(y=rect->y; y<rect->y + rect->h; y++) {
+		row = pixels + y * pitch;
+		for(b=1; b<=border; b++) {
+			row[rect->x - b] = row[rect->x];
+			row[rect->x + rect->w - 1 + b] = row[rect->x + rect->w - 1];
+		}
+	}
+	/* Then top and bottom edges, corners included */
+	x = rect->x - border;
+	for(b=1; b<=border; b++) {
+		SDL_memcpy(pixels + (rect->y - b) * pitch + x, pixels + rect->y * pitch + x,
+			(rect->w + 2*border) * sizeof(Uint32));
+		SDL_memcpy(pixels + (rect->y + rect->h - 1 + b) * pitch + x, pixels + (rect->y + rect->h - 1) * pitch + x,
+			(rect->w + 2*border) * sizeof(Uint32));
+	}
+	SDL_UnlockSurface(page);
+}
+
+/* Helper to remember the temporary files we create */
+static char *temp_file(const char *bagfile, const char *suffix) {
+	char path[1024];
+	SDL_snprintf(path, sizeof(path), "%s.%s", bagfile, suffix);
+	char *file = SDL_strdup(path);
+	temp_files = kiavc_list_append(temp_files, file);
+	return file;
+}
+
+/* Pack all PNG images in as few atlas pages as possible: we use a simple
+ * shelf packer, where images are placed in rows from the tallest one */
+static int pack_atlas(const char *bagfile) {
+	IMG_Init(IMG_INIT_PNG);
+	atlas_image *images = SDL_calloc(kiavc_list_size(bag->list), sizeof(atlas_image));
+	int count = 0, pages = 0, i = 0, res = -1;
+	int *pages_w = NULL, *pages_h = NULL, *resized = NULL;
+	kiavc_map *keyed = find_color_keyed();
+	kiavc_list *list = bag->list;
+	kiavc_bag_asset *asset = NULL;
+	while(list) {
+		asset = (kiavc_bag_asset *)list->data;
+		list = list->next;
+		size_t len = SDL_strlen(asset->key);
+		if(len < 4 || SDL_strcasecmp(asset->key + len - 4, ".png"))
+			continue;
+		if(kiavc_map_lookup(keyed, asset->key)) {
+			/* The engine will never use this image from the atlas */
+			SDL_Log("  -- Image '%s' is color keyed, not adding to atlas\n", asset->key);
+			continue;
+		}
+		SDL_Surface *loaded = IMG_Load(asset->path);
+		if(!loaded) {
+			SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "  -- Couldn't load image '%s', not adding to atlas: %s\n",
+				asset->key, IMG_GetError());
+			continue;
+		}
+		if(loaded->w + 2*KIAVC_ATLAS_PADDING > atlas_size || loaded->h + 2*KIAVC_ATLAS_PADDING > atlas_size) {
+			SDL_Log("  -- Image '%s' is too large for the atlas (%dx%d)\n", asset->key, loaded->w, loaded->h);
+			SDL_FreeSurface(loaded);
+			continue;
+		}
+		images[count].asset = asset;
+		images[count].surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+		SDL_FreeSurface(loaded);
+		if(!images[count].surface) {
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't convert image '%s': %s\n",
+				asset->key, SDL_GetError());
+			goto done;
+		}
+		count++;
+	}
+	if(count == 0) {
+		SDL_Log("  -- No images to pack in the atlas\n");
+		res = 0;
+		goto done;
+	}
+	SDL_qsort(images, count, sizeof(atlas_image), atlas_image_compare);
+	/* Find a place for all images */
+	int x = KIAVC_ATLAS_PADDING, y = KIAVC_ATLAS_PADDING, shelf = 0;
+	for(i=0; i<count; i++) {
+		SDL_Surface *surface = images[i].surface;
+		if(x + surface->w + KIAVC_ATLAS_PADDING > atlas_size) {
+			/* Start a new row */
+			x = KIAVC_ATLAS_PADDING;
+			y += shelf + KIAVC_ATLAS_PADDING;
+			shelf = 0;
+		}
+		if(pages == 0 || y + surface->h + KIAVC_ATLAS_PADDING > atlas_size) {
+			/* Start a new page */
+			resized = SDL_realloc(pages_w, (pages+1) * sizeof(int));
+			if(!resized) {
+				SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't allocate atlas pages\n");
+				goto done;
+			}
+			pages_w = resized;
+			resized = SDL_realloc(pages_h, (pages+1) * sizeof(int));
+			if(!resized) {
+				SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't allocate atlas pages\n");
+				goto done;
+			}
+			pages_h = resized;
+			pages++;
+			pages_w[pages-1] = 0;
+			pages_h[pages-1] = 0;
+			x = KIAVC_ATLAS_PADDING;
+			y = KIAVC_ATLAS_PADDING;
+			shelf = 0;
+		}
+		images[i].page = pages-1;
+		images[i].x = x;
+		images[i].y = y;
+		x += surface->w + KIAVC_ATLAS_PADDING;
+		shelf = SDL_max(shelf, surface->h);
+		pages_w[pages-1] = SDL_max(pages_w[pages-1], x);
+		pages_h[pages-1] = SDL_max(pages_h[pages-1], y + surface->h + KIAVC_ATLAS_PADDING);
+	}
+	/* Create the table */
+	char *tablefile = temp_file(bagfile, "atlas.txt");
+	FILE *table = fopen(tablefile, "wt");
+	if(!table) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create file '%s': %s\n",
+			tablefile, strerror(errno));
+		goto done;
+	}
+	/* Draw and save the pages */
+	char key[64], suffix[32];
+	int page = 0;
+	for(page=0; page<pages; page++) {
+		SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0,
+			pages_w[page], pages_h[page], 32, SDL_PIXELFORMAT_RGBA32);
+		if(!surface) {
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create atlas page: %s\n", SDL_GetError());
+			fclose(table);
+			goto done;
+		}
+		SDL_snprintf(key, sizeof(key), "%s%d.png", KIAVC_ATLAS_PAGE, page);
+		fprintf(table, "page %d %s\n", page, key);
+		for(i=0; i<count; i++) {
+			if(images[i].page != page)
+				continue;
+			SDL_Rect rect = { .x = images[i].x, .y = images[i].y,
+				.w = images[i].surface->w, .h = images[i].surface->h };
+			/* Copy the pixels as they are, alpha included */
+			SDL_SetSurfaceBlendMode(images[i].surface, SDL_BLENDMODE_NONE);
+			SDL_BlitSurface(images[i].surface, NULL, surface, &rect);
+			extrude_image(surface, &rect);
+			fprintf(table, "image %d %d %d %d %d %s\n", page,
+				rect.x, rect.y, rect.w, rect.h, images[i].asset->key);
+		}
+		SDL_snprintf(suffix, sizeof(suffix), "page%d.png", page);
+		char *pagefile = temp_file(bagfile, suffix);
+		if(IMG_SavePNG(surface, pagefile) < 0) {
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't save atlas page: %s\n", IMG_GetError());
+			SDL_FreeSurface(surface);
+			fclose(table);
+			goto done;
+		}
+		SDL_FreeSurface(surface);
+		SDL_Log("  -- Adding atlas page: %s (%dx%d)\n", key, pages_w[page], pages_h[page]);
+		if(!kiavc_bag_add_asset(bag, key, pagefile)) {
+			fclose(table);
+			goto done;
+		}
+	}
+	fclose(table);
+	if(!kiavc_bag_add_asset(bag, KIAVC_ATLAS_TABLE, tablefile))
+		goto done;
+	SDL_Log("  -- Packed %d images in %d atlas pages\n", count, pages);
+	res = 0;
+
+done:
+	for(i=0; i<count; i++)
+		SDL_FreeSurface(images[i].surface);
+	SDL_free(images);
+	SDL_free(pages_w);
+	SDL_free(pages_h);
+	kiavc_map_destroy(keyed);
+	IMG_Quit();
+	return res;
+}
+
+/* Find the opaque regions in all PNG images, and save them in a table */
+static int find_opaque(const char *bagfile) {
+	IMG_Init(IMG_INIT_PNG);
+	char *tablefile = temp_file(bagfile, "opaque.txt");
+	FILE *table = fopen(tablefile, "wt");
+	if(!table) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create file '%s': %s\n",
+			tablefile, strerror(errno));
+		IMG_Quit();
+		return -1;
+	}
+	int count = 0;
+	SDL_Rect rect = { 0 };
+	kiavc_list *list = bag->list;
+	kiavc_bag_asset *asset = NULL;
+	while(list) {
+		asset = (kiavc_bag_asset *)list->data;
+		list = list->next;
+		size_t len = SDL_strlen(asset->key);
+		if(len < 4 || SDL_strcasecmp(asset->key + len - 4, ".png"))
+			continue;
+		/* Atlas pages are only used through the images they contain */
+		if(!SDL_strncmp(asset->key, KIAVC_ATLAS_PAGE, SDL_strlen(KIAVC_ATLAS_PAGE)))
+			continue;
+		SDL_Surface *loaded = IMG_Load(asset->path);
+		if(!loaded)
+			continue;
+		if(kiavc_opaque_find(loaded, &rect) && rect.w * rect.h >= KIAVC_OPAQUE_MIN_AREA) {
+			fprintf(table, "opaque %d %d %d %d %s\n", rect.x, rect.y, rect.w, rect.h, asset->key);
+			count++;
+		}
+		SDL_FreeSurface(loaded);
+	}
+	fclose(table);
+	IMG_Quit();
+	if(count == 0) {
+		SDL_Log("  -- No images with opaque regions\n");
+		return 0;
+	}
+	if(!kiavc_bag_add_asset(bag, KIAVC_OPAQUE_TABLE, tablefile))
+		return -1;
+	SDL_Log("  -- Found opaque regions in %d images\n", count);
+	return 0;
+}
+
+/* Helper to get rid of the temporary files */
+static void cleanup_temp_files(void) {
+	kiavc_list *list = temp_files;
+	while(list) {
+		remove((char *)list->data);
+		SDL_free(list->data);
+		list = list->next;
+	}
+	kiavc_list_destroy(temp_files);
+	temp_files = NULL;
+}
+
 /* Main application */
 int main(int argc, char *argv[]) {
 	SDL_Log("KIAVC BAG creator v%s\n", KIAVC_VERSION_STRING);
 
-	if(argc < 3) {
-		SDL_Log("Usage: %s target.bag file1 [file2 [file3 ... ]]\n", argv[0]);
+	/* Check if we've been asked to pack images in an atlas */
+	int first = 1;
+	if(argc > 1 && !SDL_strncmp(argv[1], "--atlas", SDL_strlen("--atlas"))) {
+		atlas_size = KIAVC_ATLAS_PAGE_SIZE;
+		if(argv[1][SDL_strlen("--atlas")] == '=')
+			atlas_size = SDL_atoi(argv[1] + SDL_strlen("--atlas="));
+		else if(argv[1][SDL_strlen("--atlas")] != '\0')
+			atlas_size = 0;
+		if(atlas_size < 64 || atlas_size > KIAVC_ATLAS_PAGE_SIZE_MAX) {
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Invalid atlas page size (should be between 64 and %d)\n",
+				KIAVC_ATLAS_PAGE_SIZE_MAX);
+			exit(1);
+		}
+		first++;
+	}
+	if(argc < first + 2) {
+		SDL_Log("Usage: %s [--atlas[=size]] target.bag file1 [file2 [file3 ... ]]\n", argv[0]);
 		exit(0);
 	}
-	char *bagfile = argv[1], *assetfile = NULL;
-	int i = 0, assets = argc - 2;
+	char *bagfile = argv[first], *assetfile = NULL;
+	int i = 0, assets = argc - first - 1;
 
 	bag = kiavc_bag_create();
 	for(i=0; i<assets; i++) {
-		assetfile = argv[2+i];
+		assetfile = argv[first+1+i];
 		if(add_asset(assetfile) < 0) {
 			/* Give up */
 			kiavc_bag_destroy(bag);
@@ -69,11 +447,33 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	/* Pack the images in an atlas, if needed */
+	if(atlas_size > 0) {
+		SDL_Log("\n");
+		SDL_Log("Packing images in %dx%d atlas pages\n", atlas_size, atlas_size);
+		if(pack_atlas(bagfile) < 0) {
+			cleanup_temp_files();
+			kiavc_bag_destroy(bag);
+			exit(1);
+		}
+	}
+
+	/* Look for opaque regions in images */
+	SDL_Log("\n");
+	SDL_Log("Looking for opaque regions in images\n");
+	if(find_opaque(bagfile) < 0) {
+		cleanup_temp_files();
+		kiavc_bag_destroy(bag);
+		exit(1);
+	}
+
 	/* Save to file */
 	if(kiavc_bag_export(bag, bagfile) < 0) {
+		cleanup_temp_files();
 		kiavc_bag_destroy(bag);
 		exit(1);
 	}
+	cleanup_temp_files();
 	SDL_Log("\n");
 	kiavc_bag_list(bag);
 	kiavc_bag_destroy(bag);
@@ -0,0 +1,278 @@
+/*
+ *
+ * KIAVC utility to replay render captures. The commands saved by the
+ * engine when capturing (see capture.h) are played back in a loop on
+ * the SDL render driver of choice, with no game logic or Lua script
+ * involved, and timing statistics are printed at the end: this makes
+ * it easy to compare render drivers, and drawing sprites in batches or
+ * one by one, on exactly the same workload. Since captures don't
+ * contain the actual images, textures are filled with a pattern that
+ * mixes opaque and semi-transparent pixels. Plugins draw on their own,
+ * so what they render isn't part of the capture.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>
+
+#include "../capture.h"
+#include "../batch.h"
+#include "../version.h"
+
+/* Helper to sort frame times */
+static int compare_times(const void *a, const void *b) {
+	Uint64 t1 = *(const Uint64 *)a, t2 = *(const Uint64 *)b;
+	return (t1 > t2) - (t1 < t2);
+}
+
+/* Helper to convert a time to milliseconds */
+static double to_ms(Uint64 t) {
+	return (double)t * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+/* Main application */
+int main(int argc, char *argv[]) {
+	SDL_Log("KIAVC render capture replayer v%s\n", KIAVC_VERSION_STRING);
+
+	/* Check the command line arguments */
+	const char *driver = NULL, *path = NULL;
+	int loops = 10, i = 0;
+	bool batching = true, vsync = false, list = false, invalid = false;
+	for(i=1; i<argc; i++) {
+		if(!SDL_strncasecmp(argv[i], "--driver=", strlen("--driver="))) {
+			driver = argv[i] + strlen("--driver=");
+		} else if(!SDL_strncasecmp(argv[i], "--loops=", strlen("--loops="))) {
+			loops = SDL_atoi(argv[i] + strlen("--loops="));
+		} else if(!SDL_strcasecmp(argv[i], "--no-batch")) {
+			batching = false;
+		} else if(!SDL_strcasecmp(argv[i], "--vsync")) {
+			vsync = true;
+		} else if(!SDL_strcasecmp(argv[i], "--list-drivers")) {
+			list = true;
+		} else if(argv[i][0] != '-' && !path) {
+			path = argv[i];
+		} else {
+			invalid = true;
+			break;
+		}
+	}
+	if(!invalid && list) {
+		SDL_RendererInfo info;
+		for(i=0; i<SDL_GetNumRenderDrivers(); i++) {
+			if(SDL_GetRenderDriverInfo(i, &info) == 0)
+				SDL_Log("  -- %s\n", info.name);
+		}
+		exit(0);
+	}
+	if(invalid || !path || loops < 1) {
+		SDL_Log("Usage: %s [--driver=<name>] [--loops=<n>] [--no-batch] [--vsync] capture.kcap\n", argv[0]);
+		SDL_Log("       %s --list-drivers\n", argv[0]);
+		exit(1);
+	}
+
+	/* Read the capture */
+	kiavc_capture_file *capture = kiavc_capture_load(path);
+	if(!capture)
+		exit(1);
+	if(capture->frames == 0) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "No frames in capture file\n");
+		kiavc_capture_file_destroy(capture);
+		exit(1);
+	}
+	SDL_Log("Loaded %d frames (%d commands, %"SCNu32" textures, %dx%d)\n",
+		capture->frames, capture->count, capture->max_id, capture->w, capture->h);
+
+	/* Create the window and the renderer */
+	if(driver)
+		SDL_SetHint(SDL_HINT_RENDER_DRIVER, driver);
+	if(SDL_Init(SDL_INIT_VIDEO) < 0) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error initializing SDL: %s\n", SDL_GetError());
+		kiavc_capture_file_destroy(capture);
+		exit(1);
+	}
+	SDL_Window *window = SDL_CreateWindow("KIAVC replay", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+		capture->w, capture->h, 0);
+	SDL_Renderer *renderer = window ? SDL_CreateRenderer(window, -1,
+		SDL_RENDERER_TARGETTEXTURE | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0)) : NULL;
+	if(!renderer) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error creating window/renderer: %s\n", SDL_GetError());
+		if(window)
+			SDL_DestroyWindow(window);
+		SDL_Quit();
+		kiavc_capture_file_destroy(capture);
+		exit(1);
+	}
+	SDL_RendererInfo info = { 0 };
+	SDL_GetRendererInfo(renderer, &info);
+	SDL_Log("Using render driver '%s' (%s)\n", info.name, batching ? "batching sprites" : "one draw per sprite");
+	kiavc_batch *batch = batching ? kiavc_batch_create(renderer) : NULL;
+
+	/* Create all the textures in advance, so that it doesn't affect timing */
+	SDL_Texture **textures = SDL_calloc(capture->max_id + 1, sizeof(SDL_Texture *));
+	Uint32 *pattern = NULL;
+	int pattern_size = 0;
+	kiavc_capture_command *cmd = NULL;
+	for(i=0; i<capture->count; i++) {
+		cmd = &capture->commands[i];
+		if(cmd->type != KIAVC_CAPTURE_TEXTURE || cmd->w < 1 || cmd->h < 1 || textures[cmd->id])
+			continue;
+		if(cmd->w * cmd->h > pattern_size) {
+			pattern_size = cmd->w * cmd->h;
+			pattern = SDL_realloc(pattern, pattern_size * sizeof(Uint32));
+		}
+		int x = 0, y = 0;
+		for(y=0; y<cmd->h; y++) {
+			for(x=0; x<cmd->w; x++)
+				pattern[y*cmd->w + x] = (((x >> 3) + (y >> 3)) & 1) ? 0xFFC08040 : 0x80204080;
+		}
+		if(cmd->access == SDL_TEXTUREACCESS_TARGET) {
+			textures[cmd->id] = SDL_CreateTexture(renderer, cmd->format, SDL_TEXTUREACCESS_TARGET, cmd->w, cmd->h);
+		} else {
+			textures[cmd->id] = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, cmd->access, cmd->w, cmd->h);
+			if(textures[cmd->id])
+				SDL_UpdateTexture(textures[cmd->id], NULL, pattern, cmd->w * sizeof(Uint32));
+		}
+		if(!textures[cmd->id]) {
+			SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create texture %"SCNu32" (%dx%d): %s\n",
+				cmd->id, cmd->w, cmd->h, SDL_GetError());
+			continue;
+		}
+		SDL_SetTextureBlendMode(textures[cmd->id], cmd->blend);
+		SDL_SetTextureAlphaMod(textures[cmd->id], cmd->alpha);
+	}
+
+	/* Play the capture in a loop */
+	int total = capture->frames * loops, frames = 0;
+	Uint64 *times = SDL_calloc(total, sizeof(Uint64));
+	Uint64 start = 0, loop_start = SDL_GetPerformanceCounter();
+	Uint32 sprites = 0, draws = 0;
+	SDL_Texture *texture = NULL;
+	SDL_Event event;
+	bool quit = false;
+	int loop = 0;
+	for(loop=0; loop<loops && !quit; loop++) {
+		/* Start from the default state */
+		SDL_SetRenderTarget(renderer, NULL);
+		SDL_RenderSetScale(renderer, 1.0, 1.0);
+		SDL_RenderSetViewport(renderer, NULL);
+		SDL_RenderSetClipRect(renderer, NULL);
+		start = SDL_GetPerformanceCounter();
+		for(i=0; i<capture->count && !quit; i++) {
+			cmd = &capture->commands[i];
+			texture = cmd->id <= capture->max_id ? textures[cmd->id] : NULL;
+			/* Sprites may be batched, anything else needs what we batched to be drawn first */
+			if(cmd->type == KIAVC_CAPTURE_SPRITE) {
+				if(!texture)
+					continue;
+				sprites++;
+				if(batch) {
+					kiavc_batch_add(batch, texture, cmd->has_src ? &cmd->src : NULL, &cmd->dst, cmd->alpha);
+				} else {
+					SDL_SetTextureAlphaMod(texture, cmd->alpha);
+					SDL_RenderCopy(renderer, texture, cmd->has_src ? &cmd->src : NULL, &cmd->dst);
+					draws++;
+				}
+				continue;
+			}
+			kiavc_batch_flush(batch);
+			switch(cmd->type) {
+				case KIAVC_CAPTURE_TARGET:
+					SDL_SetRenderTarget(renderer, texture);
+					break;
+				case KIAVC_CAPTURE_DRAW_COLOR:
+					SDL_SetRenderDrawColor(renderer, cmd->color.r, cmd->color.g, cmd->color.b, cmd->color.a);
+					break;
+				case KIAVC_CAPTURE_BLEND_MODE:
+					SDL_SetRenderDrawBlendMode(renderer, cmd->blend);
+					break;
+				case KIAVC_CAPTURE_VIEWPORT:
+					SDL_RenderSetViewport(renderer, cmd->has_dst ? &cmd->dst : NULL);
+					break;
+				case KIAVC_CAPTURE_CLIP:
+					SDL_RenderSetClipRect(renderer, cmd->has_dst ? &cmd->dst : NULL);
+					break;
+				case KIAVC_CAPTURE_SCALE:
+					SDL_RenderSetScale(renderer, cmd->scale, cmd->scale);
+					break;
+				case KIAVC_CAPTURE_ALPHA_MOD:
+					if(texture)
+						SDL_SetTextureAlphaMod(texture, cmd->alpha);
+					break;
+				case KIAVC_CAPTURE_COPY:
+					if(texture) {
+						SDL_RenderCopy(renderer, texture, cmd->has_src ? &cmd->src : NULL, cmd->has_dst ? &cmd->dst : NULL);
+						draws++;
+					}
+					break;
+				case KIAVC_CAPTURE_FILL:
+					SDL_RenderFillRect(renderer, cmd->has_dst ? &cmd->dst : NULL);
+					draws++;
+					break;
+				case KIAVC_CAPTURE_LINE:
+					SDL_RenderDrawLine(renderer, cmd->dst.x, cmd->dst.y, cmd->dst.w, cmd->dst.h);
+					draws++;
+					break;
+				case KIAVC_CAPTURE_CLEAR:
+					SDL_RenderClear(renderer);
+					draws++;
+					break;
+				case KIAVC_CAPTURE_UPDATE:
+					if(texture && pattern) {
+						int w = 0;
+						SDL_QueryTexture(texture, NULL, NULL, &w, NULL);
+						SDL_UpdateTexture(texture, NULL, pattern, w * sizeof(Uint32));
+					}
+					break;
+				case KIAVC_CAPTURE_FRAME:
+					SDL_RenderPresent(renderer);
+					times[frames++] = SDL_GetPerformanceCounter() - start;
+					start = SDL_GetPerformanceCounter();
+					while(SDL_PollEvent(&event)) {
+						if(event.type == SDL_QUIT)
+							quit = true;
+					}
+					break;
+				default:
+					/* Textures were created already, and we
+					 * don't know what plugins drew on their own */
+					break;
+			}
+		}
+	}
+	Uint64 elapsed = SDL_GetPerformanceCounter() - loop_start;
+	if(batch)
+		draws += batch->draws;
+
+	/* Print the statistics */
+	if(frames > 0) {
+		SDL_qsort(times, frames, sizeof(Uint64), compare_times);
+		Uint64 sum = 0;
+		for(i=0; i<frames; i++)
+			sum += times[i];
+		SDL_Log("\n");
+		SDL_Log("Replayed %d frames in %.2fms (%.1f fps)\n", frames, to_ms(elapsed), frames * 1000.0 / to_ms(elapsed));
+		SDL_Log("  -- Frame time: avg %.3fms, p50 %.3fms, p95 %.3fms, p99 %.3fms, max %.3fms\n",
+			to_ms(sum) / frames, to_ms(times[frames/2]), to_ms(times[(frames*95)/100]),
+			to_ms(times[(frames*99)/100]), to_ms(times[frames-1]));
+		SDL_Log("  -- Per frame: %.1f sprites, %.1f draw calls\n",
+			(double)sprites / frames, (double)draws / frames);
+	}
+
+	/* Done */
+	SDL_free(times);
+	for(i=0; i<(int)capture->max_id + 1; i++) {
+		if(textures[i])
+			SDL_DestroyTexture(textures[i]);
+	}
+	SDL_free(textures);
+	SDL_free(pattern);
+	kiavc_batch_destroy(batch);
+	SDL_DestroyRenderer(renderer);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+	kiavc_capture_file_destroy(capture);
+	exit(0);
+}
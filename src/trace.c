@@ -0,0 +1,233 @@
+/*
+ *
+ * KIAVC tracing. When enabled, zones opened and closed by the engine,
+ * by Lua scripts and by plugins are stored as timestamped begin/end
+ * events in per-thread buffers, which are then saved to a JSON file
+ * in the Chrome trace event format when tracing is stopped: the file
+ * can then be opened in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Each thread only ever writes to its own buffer, so adding events
+ * needs no locking: a spinlock is only used the first time a thread
+ * traces something, to add its buffer to the list of buffers to save.
+ * Room for the end of each open zone is always reserved, so when a
+ * buffer fills up, zones are dropped as a whole and the saved trace
+ * is never unbalanced.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include <stdio.h>
+#include <errno.h>
+
+#include <SDL2/SDL.h>
+
+#include "trace.h"
+
+/* How many events we can store per thread, and how many threads */
+#define KIAVC_TRACE_EVENTS		32768
+#define KIAVC_TRACE_THREADS		16
+
+/* Trace event */
+typedef struct kiavc_trace_event {
+	/* Timestamp, as a value of the high resolution counter */
+	Uint64 ts;
+	/* Whether this is a begin or end event */
+	bool begin;
+	/* Name and details of the zone */
+	char name[48];
+	char detail[80];
+} kiavc_trace_event;
+
+/* Per-thread buffer of events */
+typedef struct kiavc_trace_buffer {
+	/* Thread this buffer belongs to */
+	SDL_threadID thread;
+	/* Events, and how many we have */
+	kiavc_trace_event *events;
+	SDL_atomic_t count;
+	/* How many zones are open, and how many of those we dropped */
+	int depth, skipped;
+	/* How many events we had to drop because the buffer was full */
+	Uint32 dropped;
+} kiavc_trace_buffer;
+
+/* Tracing state */
+static SDL_atomic_t enabled = { 0 };
+static char *trace_path = NULL;
+static Uint64 trace_start = 0, trace_frequency = 0;
+static SDL_TLSID trace_tls = 0;
+static SDL_SpinLock buffers_lock = 0;
+static kiavc_trace_buffer *buffers[KIAVC_TRACE_THREADS];
+static int buffers_count = 0;
+
+/* Helper to get the buffer of the current thread, creating it if needed */
+static kiavc_trace_buffer *kiavc_trace_get_buffer(void) {
+	kiavc_trace_buffer *buffer = (kiavc_trace_buffer *)SDL_TLSGet(trace_tls);
+	if(buffer)
+		return buffer;
+	SDL_AtomicLock(&buffers_lock);
+	if(buffers_count == KIAVC_TRACE_THREADS) {
+		SDL_AtomicUnlock(&buffers_lock);
+		return NULL;
+	}
+	buffer = SDL_calloc(1, sizeof(kiavc_trace_buffer));
+	buffer->thread = SDL_ThreadID();
+	buffer->events = SDL_calloc(KIAVC_TRACE_EVENTS, sizeof(kiavc_trace_event));
+	buffers[buffers_count] = buffer;
+	buffers_count++;
+	SDL_AtomicUnlock(&buffers_lock);
+	SDL_TLSSet(trace_tls, buffer, NULL);
+	return buffer;
+}
+
+/* Helper to add an event to the buffer of the current thread */
+static void kiavc_trace_add(bool begin, const char *name, const char *detail) {
+	kiavc_trace_buffer *buffer = kiavc_trace_get_buffer();
+	if(!buffer)
+		return;
+	int count = SDL_AtomicGet(&buffer->count);
+	if(begin) {
+		/* We need room for this event, its end, and the ends of the zones
+		 * already open: since that never shrinks, once a zone is dropped
+		 * all the ones nested in it are dropped as well */
+		if(buffer->skipped > 0 || count + buffer->depth + 2 > KIAVC_TRACE_EVENTS) {
+			buffer->skipped++;
+			buffer->dropped++;
+			return;
+		}
+		buffer->depth++;
+	} else {
+		if(buffer->skipped > 0) {
+			/* This closes a zone we dropped */
+			buffer->skipped--;
+			buffer->dropped++;
+			return;
+		}
+		if(buffer->depth == 0) {
+			/* This closes a zone opened before tracing started */
+			return;
+		}
+		buffer->depth--;
+	}
+	kiavc_trace_event *event = &buffer->events[count];
+	event->ts = SDL_GetPerformanceCounter();
+	event->begin = begin;
+	SDL_strlcpy(event->name, name ? name : "", sizeof(event->name));
+	SDL_strlcpy(event->detail, detail ? detail : "", sizeof(event->detail));
+	SDL_AtomicSet(&buffer->count, count + 1);
+}
+
+/* Helper to write a JSON string */
+static void kiavc_trace_write_string(FILE *file, const char *str) {
+	fputc('"', file);
+	while(str && *str) {
+		if(*str == '"' || *str == '\\')
+			fprintf(file, "\\%c", *str);
+		else if((unsigned char)*str < 0x20)
+			fprintf(file, "\\u%04x", (unsigned char)*str);
+		else
+			fputc(*str, file);
+		str++;
+	}
+	fputc('"', file);
+}
+
+/* Start tracing: events will be saved to the provided path when stopped */
+int kiavc_trace_start(const char *path) {
+	if(!path)
+		return -1;
+	if(SDL_AtomicGet(&enabled)) {
+		SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Tracing already active\n");
+		return -1;
+	}
+	if(trace_tls == 0)
+		trace_tls = SDL_TLSCreate();
+	SDL_free(trace_path);
+	trace_path = SDL_strdup(path);
+	trace_frequency = SDL_GetPerformanceFrequency();
+	trace_start = SDL_GetPerformanceCounter();
+	/* Get rid of the events of previous traces, if any */
+	SDL_AtomicLock(&buffers_lock);
+	int i = 0;
+	for(i=0; i<buffers_count; i++) {
+		SDL_AtomicSet(&buffers[i]->count, 0);
+		buffers[i]->depth = 0;
+		buffers[i]->skipped = 0;
+		buffers[i]->dropped = 0;
+	}
+	SDL_AtomicUnlock(&buffers_lock);
+	SDL_AtomicSet(&enabled, 1);
+	SDL_Log("Started tracing to '%s'\n", trace_path);
+	return 0;
+}
+
+/* Check whether tracing is active */
+bool kiavc_trace_is_enabled(void) {
+	return SDL_AtomicGet(&enabled) != 0;
+}
+
+/* Open a new zone in the current thread, optionally with some details */
+void kiavc_trace_begin(const char *name, const char *detail) {
+	if(!SDL_AtomicGet(&enabled) || !name)
+		return;
+	kiavc_trace_add(true, name, detail);
+}
+
+/* Close the most recent zone in the current thread */
+void kiavc_trace_end(void) {
+	if(!SDL_AtomicGet(&enabled))
+		return;
+	kiavc_trace_add(false, NULL, NULL);
+}
+
+/* Stop tracing and save the events to file */
+int kiavc_trace_stop(void) {
+	if(!SDL_AtomicGet(&enabled))
+		return -1;
+	SDL_AtomicSet(&enabled, 0);
+	FILE *file = fopen(trace_path, "wt");
+	if(!file) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error opening '%s': %s\n", trace_path, strerror(errno));
+		return -1;
+	}
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	Uint32 total = 0, dropped = 0;
+	bool first = true;
+	SDL_AtomicLock(&buffers_lock);
+	int i = 0, j = 0;
+	for(i=0; i<buffers_count; i++) {
+		kiavc_trace_buffer *buffer = buffers[i];
+		int count = SDL_AtomicGet(&buffer->count);
+		for(j=0; j<count; j++) {
+			kiavc_trace_event *event = &buffer->events[j];
+			double ts = (double)(event->ts - trace_start) * 1000000.0 / (double)trace_frequency;
+			fprintf(file, "%s{\"ph\":\"%c\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f",
+				first ? "" : ",\n", event->begin ? 'B' : 'E', (unsigned long)buffer->thread, ts);
+			if(event->begin) {
+				fprintf(file, ",\"name\":");
+				kiavc_trace_write_string(file, event->name);
+				if(event->detail[0] != '\0') {
+					fprintf(file, ",\"args\":{\"detail\":");
+					kiavc_trace_write_string(file, event->detail);
+					fprintf(file, "}");
+				}
+			}
+			fprintf(file, "}");
+			first = false;
+		}
+		total += count;
+		dropped += buffer->dropped;
+		SDL_AtomicSet(&buffer->count, 0);
+		buffer->depth = 0;
+		buffer->skipped = 0;
+		buffer->dropped = 0;
+	}
+	SDL_AtomicUnlock(&buffers_lock);
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	SDL_Log("Saved %"SCNu32" trace events to '%s'\n", total, trace_path);
+	if(dropped > 0)
+		SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "  -- %"SCNu32" events were dropped (buffers full)\n", dropped);
+	return 0;
+}
@@ -0,0 +1,29 @@
+/*
+ *
+ * KIAVC tracing. When enabled, zones opened and closed by the engine,
+ * by Lua scripts and by plugins are stored as timestamped begin/end
+ * events in per-thread buffers, which are then saved to a JSON file
+ * in the Chrome trace event format when tracing is stopped: the file
+ * can then be opened in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_TRACE_H
+#define __KIAVC_TRACE_H
+
+#include <stdbool.h>
+
+/* Start tracing: events will be saved to the provided path when stopped */
+int kiavc_trace_start(const char *path);
+/* Check whether tracing is active */
+bool kiavc_trace_is_enabled(void);
+/* Open a new zone in the current thread, optionally with some details */
+void kiavc_trace_begin(const char *name, const char *detail);
+/* Close the most recent zone in the current thread */
+void kiavc_trace_end(void);
+/* Stop tracing and save the events to file */
+int kiavc_trace_stop(void);
+
+#endif
@@ -0,0 +1,408 @@
+/*
+ *
+ * KIAVC motion and tween system. Resources that are moving towards a
+ * target, or whose alpha or scale are changing over time, are kept in
+ * contiguous arrays (one per property, rather than one per resource),
+ * which means all of them can be updated in a single tight loop once
+ * per simulation step, rather than checking each resource on its own.
+ * Resources keep track of where they are in the arrays, so starting,
+ * replacing or stopping a tween are O(1) operations. Tweens that are
+ * completed are removed at the end of an update, and returned as a
+ * batch of events the engine can then notify the scripts about.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#include <math.h>
+
+#include <SDL2/SDL.h>
+
+#include "tween.h"
+#include "jobs.h"
+
+/* Initial size of the arrays */
+#define KIAVC_TWEENS_SIZE	16
+/* How many motions to move in each parallel job */
+#define KIAVC_TWEENS_CHUNK	512
+
+/* Helper to resize an array */
+static bool kiavc_tweens_resize(void **array, size_t item, int size) {
+	void *resized = SDL_realloc(*array, size * item);
+	if(!resized)
+		return false;
+	*array = resized;
+	return true;
+}
+
+/* Helper to make sure there's room for one more motion */
+static bool kiavc_tweens_motions_grow(kiavc_tween_motions *m) {
+	if(m->count < m->size)
+		return true;
+	int size = m->size ? m->size * 2 : KIAVC_TWEENS_SIZE;
+	if(!kiavc_tweens_resize((void **)&m->resources, sizeof(kiavc_resource *), size) ||
+			!kiavc_tweens_resize((void **)&m->x, sizeof(float), size) ||
+			!kiavc_tweens_resize((void **)&m->y, sizeof(float), size) ||
+			!kiavc_tweens_resize((void **)&m->target_x, sizeof(float), size) ||
+			!kiavc_tweens_resize((void **)&m->target_y, sizeof(float), size) ||
+			!kiavc_tweens_resize((void **)&m->speed, sizeof(float), size) ||
+			!kiavc_tweens_resize((void **)&m->active, sizeof(Uint8), size) ||
+			!kiavc_tweens_resize((void **)&m->arrived, sizeof(Uint8), size)) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error resizing motions\n");
+		return false;
+	}
+	m->size = size;
+	return true;
+}
+
+/* Helper to make sure there's room for one more tween */
+static bool kiavc_tweens_values_grow(kiavc_tween_values *v) {
+	if(v->count < v->size)
+		return true;
+	int size = v->size ? v->size * 2 : KIAVC_TWEENS_SIZE;
+	if(!kiavc_tweens_resize((void **)&v->resources, sizeof(kiavc_resource *), size) ||
+			!kiavc_tweens_resize((void **)&v->types, sizeof(Uint8), size) ||
+			!kiavc_tweens_resize((void **)&v->targets, sizeof(float *), size) ||
+			!kiavc_tweens_resize((void **)&v->start, sizeof(float), size) ||
+			!kiavc_tweens_resize((void **)&v->delta, sizeof(float), size) ||
+			!kiavc_tweens_resize((void **)&v->current, sizeof(float), size) ||
+			!kiavc_tweens_resize((void **)&v->begin, sizeof(Uint32), size) ||
+			!kiavc_tweens_resize((void **)&v->duration, sizeof(Uint32), size) ||
+			!kiavc_tweens_resize((void **)&v->done, sizeof(Uint8), size)) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error resizing tweens\n");
+		return false;
+	}
+	v->size = size;
+	return true;
+}
+
+/* Helper to add a completion event */
+static void kiavc_tweens_add_event(kiavc_tweens *tweens, kiavc_resource *resource, int type) {
+	if(tweens->events_count == tweens->events_size) {
+		int size = tweens->events_size ? tweens->events_size * 2 : KIAVC_TWEENS_SIZE;
+		if(!kiavc_tweens_resize((void **)&tweens->events, sizeof(kiavc_tween_event), size)) {
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error resizing tween events\n");
+			return;
+		}
+		tweens->events_size = size;
+	}
+	tweens->events[tweens->events_count].resource = resource;
+	tweens->events[tweens->events_count].type = type;
+	tweens->events_count++;
+}
+
+/* Helper to access the index of a tween of a specific type in a resource */
+static int *kiavc_tweens_index(kiavc_resource *resource, int type) {
+	if(type == KIAVC_TWEEN_MOTION)
+		return &resource->motion_index;
+	else if(type == KIAVC_TWEEN_ALPHA)
+		return &resource->alpha_index;
+	else if(type == KIAVC_TWEEN_SCALE)
+		return &resource->scale_index;
+	return NULL;
+}
+
+/* Helpers to remove a motion or a tween, by moving the last one in its place */
+static void kiavc_tweens_motions_remove(kiavc_tween_motions *m, int i) {
+	m->resources[i]->motion_index = 0;
+	int last = m->count - 1;
+	if(i != last) {
+		m->resources[i] = m->resources[last];
+		m->x[i] = m->x[last];
+		m->y[i] = m->y[last];
+		m->target_x[i] = m->target_x[last];
+		m->target_y[i] = m->target_y[last];
+		m->speed[i] = m->speed[last];
+		m->active[i] = m->active[last];
+		m->arrived[i] = m->arrived[last];
+		m->resources[i]->motion_index = i + 1;
+	}
+	m->count--;
+}
+static void kiavc_tweens_values_remove(kiavc_tween_values *v, int i) {
+	*kiavc_tweens_index(v->resources[i], v->types[i]) = 0;
+	int last = v->count - 1;
+	if(i != last) {
+		v->resources[i] = v->resources[last];
+		v->types[i] = v->types[last];
+		v->targets[i] = v->targets[last];
+		v->start[i] = v->start[last];
+		v->delta[i] = v->delta[last];
+		v->current[i] = v->current[last];
+		v->begin[i] = v->begin[last];
+		v->duration[i] = v->duration[last];
+		v->done[i] = v->done[last];
+		*kiavc_tweens_index(v->resources[i], v->types[i]) = i + 1;
+	}
+	v->count--;
+}
+
+/* Create a new tweens container */
+kiavc_tweens *kiavc_tweens_create(void) {
+	return SDL_calloc(1, sizeof(kiavc_tweens));
+}
+
+/* Start moving a resource towards a target, or change the target if it's moving already */
+int kiavc_tweens_move(kiavc_tweens *tweens, kiavc_resource *resource, int x, int y, float speed) {
+	if(!tweens || !resource)
+		return -1;
+	kiavc_tween_motions *m = &tweens->motions;
+	int i = resource->motion_index - 1;
+	if(i < 0) {
+		/* Add a new motion */
+		if(!kiavc_tweens_motions_grow(m))
+			return -2;
+		i = m->count;
+		m->resources[i] = resource;
+		m->count++;
+		resource->motion_index = m->count;
+	}
+	m->x[i] = resource->x;
+	m->y[i] = resource->y;
+	m->target_x[i] = x;
+	m->target_y[i] = y;
+	m->speed[i] = speed;
+	m->active[i] = 0;
+	m->arrived[i] = 0;
+	return 0;
+}
+
+/* Change the speed of a resource that's moving */
+int kiavc_tweens_set_speed(kiavc_tweens *tweens, kiavc_resource *resource, float speed) {
+	if(!kiavc_tweens_is_moving(tweens, resource))
+		return -1;
+	tweens->motions.speed[resource->motion_index-1] = speed;
+	return 0;
+}
+
+/* Check if a resource is moving */
+bool kiavc_tweens_is_moving(kiavc_tweens *tweens, kiavc_resource *resource) {
+	return tweens && resource && resource->motion_index > 0 && resource->motion_index <= tweens->motions.count &&
+		tweens->motions.resources[resource->motion_index-1] == resource;
+}
+
+/* Check if any resource in the render queue is moving */
+bool kiavc_tweens_motions_active(kiavc_tweens *tweens) {
+	if(!tweens)
+		return false;
+	int i = 0;
+	for(i=0; i<tweens->motions.count; i++) {
+		if(tweens->motions.resources[i]->queue_index > 0)
+			return true;
+	}
+	return false;
+}
+
+/* Helper to start a tween on a value */
+static int kiavc_tweens_start(kiavc_tweens *tweens, kiavc_resource *resource, int type,
+		float *target, float start, float end, int ms) {
+	if(!tweens || !resource)
+		return -1;
+	kiavc_tween_values *v = &tweens->values;
+	int *index = kiavc_tweens_index(resource, type);
+	int i = *index - 1;
+	if(i < 0) {
+		/* Add a new tween */
+		if(!kiavc_tweens_values_grow(v))
+			return -2;
+		i = v->count;
+		v->resources[i] = resource;
+		v->types[i] = type;
+		v->count++;
+		*index = v->count;
+	}
+	v->targets[i] = target;
+	v->start[i] = start;
+	v->delta[i] = end - start;
+	v->current[i] = start;
+	/* We'll take note of when we started in the next update */
+	v->begin[i] = 0;
+	v->duration[i] = ms > 0 ? ms : 0;
+	v->done[i] = 0;
+	return 0;
+}
+
+/* Start fading a resource to a specific alpha, in the specified amount of milliseconds */
+int kiavc_tweens_fade(kiavc_tweens *tweens, kiavc_resource *resource, Uint8 alpha, int ms) {
+	if(!resource)
+		return -1;
+	return kiavc_tweens_start(tweens, resource, KIAVC_TWEEN_ALPHA, NULL, resource->fade_alpha, alpha, ms);
+}
+
+/* Start scaling a resource to a specific value, in the specified amount of milliseconds */
+int kiavc_tweens_scale(kiavc_tweens *tweens, kiavc_resource *resource, float *scale, float target, int ms) {
+	if(!scale)
+		return -1;
+	return kiavc_tweens_start(tweens, resource, KIAVC_TWEEN_SCALE, scale, *scale, target, ms);
+}
+
+/* Check if there's any alpha or scale tween in progress */
+bool kiavc_tweens_values_active(kiavc_tweens *tweens) {
+	return tweens && tweens->values.count > 0;
+}
+
+/* Stop a tween of the specified type for a resource, if any */
+void kiavc_tweens_stop(kiavc_tweens *tweens, kiavc_resource *resource, int type) {
+	if(!tweens || !resource)
+		return;
+	int *index = kiavc_tweens_index(resource, type);
+	if(!index || *index < 1)
+		return;
+	if(type == KIAVC_TWEEN_MOTION) {
+		if(*index <= tweens->motions.count && tweens->motions.resources[*index-1] == resource)
+			kiavc_tweens_motions_remove(&tweens->motions, *index-1);
+	} else {
+		if(*index <= tweens->values.count && tweens->values.resources[*index-1] == resource)
+			kiavc_tweens_values_remove(&tweens->values, *index-1);
+	}
+	*index = 0;
+}
+
+/* Stop all tweens for a resource (e.g., because it's being destroyed) */
+void kiavc_tweens_remove(kiavc_tweens *tweens, kiavc_resource *resource) {
+	kiavc_tweens_stop(tweens, resource, KIAVC_TWEEN_MOTION);
+	kiavc_tweens_stop(tweens, resource, KIAVC_TWEEN_ALPHA);
+	kiavc_tweens_stop(tweens, resource, KIAVC_TWEEN_SCALE);
+	/* Don't notify events for a resource that's going away */
+	int i = 0;
+	for(i=0; tweens && i<tweens->events_count; i++) {
+		if(tweens->events[i].resource == resource)
+			tweens->events[i].resource = NULL;
+	}
+}
+
+/* Motions to move in a simulation step */
+typedef struct kiavc_tweens_motions_job {
+	kiavc_tween_motions *motions;
+	int fps;
+	/* Whether any resource moved vertically */
+	SDL_atomic_t sorted;
+} kiavc_tweens_motions_job;
+
+/* Helper to move a chunk of resources: this may run in parallel on
+ * different chunks, since each resource is moved on its own */
+static void kiavc_tweens_motions_move(int from, int to, void *data) {
+	kiavc_tweens_motions_job *job = (kiavc_tweens_motions_job *)data;
+	kiavc_tween_motions *m = job->motions;
+	float *x = m->x, *y = m->y, *tx = m->target_x, *ty = m->target_y, *speed = m->speed;
+	Uint8 *active = m->active, *arrived = m->arrived;
+	int fps = job->fps, sorted = 0, i = 0;
+	for(i=from; i<to; i++) {
+		float cx = x[i], cy = y[i];
+		float dx = tx[i] - cx, dy = ty[i] - cy;
+		float movement = speed[i]/fps;
+		float d = sqrtf(dx*dx + dy*dy);
+		float p = d/movement;
+		float mx = cx + dx/p;
+		float my = cy + dy/p;
+		if((cx > tx[i] && mx < tx[i]) || (cx < tx[i] && mx > tx[i]))
+			mx = tx[i];
+		if((cy > ty[i] && my < ty[i]) || (cy < ty[i] && my > ty[i]))
+			my = ty[i];
+		int moving = active[i] && ((int)cx != (int)tx[i] || (int)cy != (int)ty[i]);
+		x[i] = moving ? mx : cx;
+		y[i] = moving ? my : cy;
+		sorted |= ((int)y[i] != (int)cy);
+		arrived[i] = active[i] && (int)x[i] == (int)tx[i] && (int)y[i] == (int)ty[i];
+	}
+	if(sorted)
+		SDL_AtomicSet(&job->sorted, 1);
+}
+
+/* Update all motions and tweens */
+bool kiavc_tweens_update(kiavc_tweens *tweens, Uint32 ticks, int fps) {
+	if(!tweens)
+		return false;
+	tweens->events_count = 0;
+	bool sort = false;
+	int i = 0;
+	kiavc_tween_motions *m = &tweens->motions;
+	if(m->count > 0 && fps > 0) {
+		/* Take note of where resources are, since scripts may have moved
+		 * them, and only move those that we're actually displaying */
+		for(i=0; i<m->count; i++) {
+			m->x[i] = m->resources[i]->x;
+			m->y[i] = m->resources[i]->y;
+			m->active[i] = (m->resources[i]->queue_index > 0);
+		}
+		/* Move all resources in a single pass, split in parallel jobs
+		 * if there are many of them (e.g., crowds of actors walking) */
+		kiavc_tweens_motions_job job = { .motions = m, .fps = fps };
+		SDL_AtomicSet(&job.sorted, 0);
+		kiavc_jobs_run(kiavc_tweens_motions_move, &job, m->count, KIAVC_TWEENS_CHUNK);
+		sort = (SDL_AtomicGet(&job.sorted) != 0);
+		/* Update the resources */
+		for(i=0; i<m->count; i++) {
+			if(!m->active[i])
+				continue;
+			m->resources[i]->x = m->x[i];
+			m->resources[i]->y = m->y[i];
+			if(m->arrived[i])
+				kiavc_tweens_add_event(tweens, m->resources[i], KIAVC_TWEEN_MOTION);
+		}
+	}
+	kiavc_tween_values *v = &tweens->values;
+	if(v->count > 0) {
+		/* Take note of when tweens that were just added started */
+		for(i=0; i<v->count; i++) {
+			if(v->begin[i] == 0)
+				v->begin[i] = ticks;
+		}
+		/* Interpolate all values in a single pass */
+		float *start = v->start, *delta = v->delta, *current = v->current;
+		Uint32 *begin = v->begin, *duration = v->duration;
+		Uint8 *done = v->done;
+		for(i=0; i<v->count; i++) {
+			float t = duration[i] > 0 ? (float)(ticks - begin[i])/(float)duration[i] : 1.0;
+			if(t > 1.0 || delta[i] == 0)
+				t = 1.0;
+			current[i] = start[i] + delta[i]*t;
+			done[i] = (t >= 1.0);
+		}
+		/* Update the resources */
+		for(i=0; i<v->count; i++) {
+			if(v->types[i] == KIAVC_TWEEN_ALPHA)
+				v->resources[i]->fade_alpha = (Uint8)v->current[i];
+			else if(v->targets[i])
+				*(v->targets[i]) = v->current[i];
+			if(v->done[i])
+				kiavc_tweens_add_event(tweens, v->resources[i], v->types[i]);
+		}
+	}
+	/* Get rid of what's completed: we go backwards, since we fill the
+	 * holes with the last items in the arrays */
+	for(i=m->count-1; i>=0; i--) {
+		if(m->arrived[i])
+			kiavc_tweens_motions_remove(m, i);
+	}
+	for(i=v->count-1; i>=0; i--) {
+		if(v->done[i])
+			kiavc_tweens_values_remove(v, i);
+	}
+	return sort;
+}
+
+/* Destroy a tweens container */
+void kiavc_tweens_destroy(kiavc_tweens *tweens) {
+	if(!tweens)
+		return;
+	SDL_free(tweens->motions.resources);
+	SDL_free(tweens->motions.x);
+	SDL_free(tweens->motions.y);
+	SDL_free(tweens->motions.target_x);
+	SDL_free(tweens->motions.target_y);
+	SDL_free(tweens->motions.speed);
+	SDL_free(tweens->motions.active);
+	SDL_free(tweens->motions.arrived);
+	SDL_free(tweens->values.resources);
+	SDL_free(tweens->values.types);
+	SDL_free(tweens->values.targets);
+	SDL_free(tweens->values.start);
+	SDL_free(tweens->values.delta);
+	SDL_free(tweens->values.current);
+	SDL_free(tweens->values.begin);
+	SDL_free(tweens->values.duration);
+	SDL_free(tweens->values.done);
+	SDL_free(tweens->events);
+	SDL_free(tweens);
+}
@@ -0,0 +1,107 @@
+/*
+ *
+ * KIAVC motion and tween system. Resources that are moving towards a
+ * target, or whose alpha or scale are changing over time, are kept in
+ * contiguous arrays (one per property, rather than one per resource),
+ * which means all of them can be updated in a single tight loop once
+ * per simulation step, rather than checking each resource on its own.
+ * Resources keep track of where they are in the arrays, so starting,
+ * replacing or stopping a tween are O(1) operations. Tweens that are
+ * completed are removed at the end of an update, and returned as a
+ * batch of events the engine can then notify the scripts about.
+ *
+ * Author: Lorenzo Miniero (lminiero@gmail.com)
+ *
+ */
+
+#ifndef __KIAVC_TWEEN_H
+#define __KIAVC_TWEEN_H
+
+#include <stdbool.h>
+
+#include "resources.h"
+
+/* Tween types */
+#define KIAVC_TWEEN_MOTION	1
+#define KIAVC_TWEEN_ALPHA	2
+#define KIAVC_TWEEN_SCALE	3
+
+/* Resources moving towards a target, at a specific speed */
+typedef struct kiavc_tween_motions {
+	/* Resources being moved */
+	kiavc_resource **resources;
+	/* Current and target positions */
+	float *x, *y, *target_x, *target_y;
+	/* Speed (pixels per second) */
+	float *speed;
+	/* Whether the resource was moved in the last update, and whether it arrived */
+	Uint8 *active, *arrived;
+	/* Number of motions, and size of the arrays */
+	int count, size;
+} kiavc_tween_motions;
+
+/* Values changing linearly from a start to a target over time */
+typedef struct kiavc_tween_values {
+	/* Resources the values belong to, and the tween types */
+	kiavc_resource **resources;
+	Uint8 *types;
+	/* Where to store the value, for scale tweens (alpha is in the resource) */
+	float **targets;
+	/* Start value and how much it needs to change, plus current value */
+	float *start, *delta, *current;
+	/* When the tween started (0 if it didn't yet), and how long it lasts */
+	Uint32 *begin, *duration;
+	/* Whether the tween is completed */
+	Uint8 *done;
+	/* Number of tweens, and size of the arrays */
+	int count, size;
+} kiavc_tween_values;
+
+/* Tween that has been completed in the last update */
+typedef struct kiavc_tween_event {
+	/* Resource the tween was for */
+	kiavc_resource *resource;
+	/* Tween type */
+	int type;
+} kiavc_tween_event;
+
+/* Motions and tweens */
+typedef struct kiavc_tweens {
+	/* Resources moving around */
+	kiavc_tween_motions motions;
+	/* Alpha and scale tweens */
+	kiavc_tween_values values;
+	/* Tweens that were completed in the last update */
+	kiavc_tween_event *events;
+	int events_count, events_size;
+} kiavc_tweens;
+
+/* Create a new tweens container */
+kiavc_tweens *kiavc_tweens_create(void);
+/* Start moving a resource towards a target, or change the target if it's moving already */
+int kiavc_tweens_move(kiavc_tweens *tweens, kiavc_resource *resource, int x, int y, float speed);
+/* Change the speed of a resource that's moving */
+int kiavc_tweens_set_speed(kiavc_tweens *tweens, kiavc_resource *resource, float speed);
+/* Check if a resource is moving */
+bool kiavc_tweens_is_moving(kiavc_tweens *tweens, kiavc_resource *resource);
+/* Check if any resource in the render queue is moving */
+bool kiavc_tweens_motions_active(kiavc_tweens *tweens);
+/* Start fading a resource to a specific alpha, in the specified amount of milliseconds */
+int kiavc_tweens_fade(kiavc_tweens *tweens, kiavc_resource *resource, Uint8 alpha, int ms);
+/* Start scaling a resource to a specific value, in the specified amount of milliseconds */
+int kiavc_tweens_scale(kiavc_tweens *tweens, kiavc_resource *resource, float *scale, float target, int ms);
+/* Check if there's any alpha or scale tween in progress */
+bool kiavc_tweens_values_active(kiavc_tweens *tweens);
+/* Stop a tween of the specified type for a resource, if any */
+void kiavc_tweens_stop(kiavc_tweens *tweens, kiavc_resource *resource, int type);
+/* Stop all tweens for a resource (e.g., because it's being destroyed) */
+void kiavc_tweens_remove(kiavc_tweens *tweens, kiavc_resource *resource);
+/* Update all motions and tweens: only resources in the render queue are
+ * moved. Completed tweens are removed, and can be found in the events
+ * array until the next update. Returns true if any resource moved
+ * vertically, which means the render queue will need sorting */
+bool kiavc_tweens_update(kiavc_tweens *tweens, Uint32 ticks, int fps);
+/* Destroy a tweens container */
+void kiavc_tweens_destroy(kiavc_tweens *tweens);
+
+#endif
@@ -29,3 +29,27 @@ SDL_Surface *kiavc_create_surface(int w, int h) {
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error creating %dx%d surface: %s\n", w, h, SDL_GetError());
 	return surface;
 }
+
+/* Helper to make sure a clip rect doesn't go beyond an image of the provided size */
+bool kiavc_clip_rect(int w, int h, SDL_Rect *clip, SDL_Rect *rect) {
+	if(!clip || clip->w <= 0 || clip->h <= 0)
+		return false;
+	int x1 = SDL_max(clip->x, 0), y1 = SDL_max(clip->y, 0);
+	int x2 = SDL_min(clip->x + clip->w, w);
+	int y2 = SDL_min(clip->y + clip->h, h);
+	if(x2 <= x1 || y2 <= y1)
+		return false;
+	if(rect && (x1 != clip->x || y1 != clip->y || x2 - x1 != clip->w || y2 - y1 != clip->h)) {
+		float sx = (float)rect->w / (float)clip->w;
+		float sy = (float)rect->h / (float)clip->h;
+		rect->x += (int)((x1 - clip->x) * sx);
+		rect->y += (int)((y1 - clip->y) * sy);
+		rect->w = (int)((x2 - x1) * sx);
+		rect->h = (int)((y2 - y1) * sy);
+	}
+	clip->x = x1;
+	clip->y = y1;
+	clip->w = x2 - x1;
+	clip->h = y2 - y1;
+	return true;
+}
@@ -9,9 +9,15 @@
 #ifndef __KIAVC_UTILS_H
 #define __KIAVC_UTILS_H
 
+#include <stdbool.h>
+
 #include <SDL2/SDL.h>
 
 /* Helper to create a surface to use in the engine */
 SDL_Surface *kiavc_create_surface(int w, int h);
+/* Helper to make sure a clip rect doesn't go beyond an image of the
+ * provided size: as SDL_RenderCopy does with textures, the target rect
+ * is scaled accordingly; returns false if there's nothing left to draw */
+bool kiavc_clip_rect(int w, int h, SDL_Rect *clip, SDL_Rect *rect);
 
 #endif